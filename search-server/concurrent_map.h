@@ -1,21 +1,32 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <mutex>
-
-using namespace std::string_literals;
-
-template <typename Key, typename Value>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// размер строки кэша: мьютексы соседних корзин не делят строку, и захват одного
+// не заставляет другие ядра перечитывать строку с чужим мьютексом
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+// потокобезопасная хеш-таблица: ключи распределяются по корзинам, у каждой корзины свой мьютекс
+// ключ - любой тип, для которого есть хешер Hash и сравнение KeyEqual
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
 class ConcurrentMap {
 
-struct t_item {
-    std::mutex mutex; // мутекс
-    std::map<Key, Value> map; // мапа
+struct alignas(CACHE_LINE_SIZE) Bucket {
+    mutable std::mutex mutex;
+    std::unordered_map<Key, Value, Hash, KeyEqual> map;
 };
 
 public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
-
+    // доступ к значению под блокировкой корзины, пока жив объект
     struct Access {
         std::lock_guard<std::mutex> guard; // защита от одновременного доступа
 
@@ -28,44 +39,126 @@ public:
         }
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : m_vct_items(bucket_count) {
+    // число корзин округляется вверх до степени двойки
+    explicit ConcurrentMap(size_t bucket_count, const Hash& hash = Hash(), const KeyEqual& key_equal = KeyEqual())
+        : m_buckets(RoundUpToPowerOfTwo(bucket_count))
+        , m_mask(m_buckets.size() - 1)
+        , m_hash(hash) {
+        for(Bucket& bucket : m_buckets) {
+            bucket.map = std::unordered_map<Key, Value, Hash, KeyEqual>(0, hash, key_equal);
+        }
     }
 
-    // ! используем простое число для количества элементов
-    explicit ConcurrentMap() : ConcurrentMap(31) {
+    // корзин в несколько раз больше, чем аппаратных потоков: два потока редко попадают в одну корзину
+    ConcurrentMap() : ConcurrentMap(BUCKETS_PER_THREAD * std::max(1u, std::thread::hardware_concurrency())) {
     }
 
+    // значение создается, если ключа не было
     Access operator[](const Key& key) {
-        // остаток от деления ключа на размер дает индекс
-        uint64_t index = static_cast<uint64_t>(key) % m_vct_items.size();
-        auto& item = m_vct_items[index];
-        return {std::lock_guard<std::mutex>(item.mutex), item.map[key]};
+        Bucket& bucket = GetBucket(key);
+        return {std::lock_guard<std::mutex>(bucket.mutex), bucket.map[key]};
+    }
+
+    // updater(Value&) под блокировкой корзины; значение создается, если ключа не было
+    template <typename Updater>
+    void Update(const Key& key, Updater updater) {
+        Bucket& bucket = GetBucket(key);
+        std::lock_guard<std::mutex> guard(bucket.mutex);
+        updater(bucket.map[key]);
+    }
+
+    // visitor(const Value&) под блокировкой корзины, если ключ есть; возвращает, нашелся ли ключ
+    template <typename Visitor>
+    bool Visit(const Key& key, Visitor visitor) const {
+        const Bucket& bucket = GetBucket(key);
+        std::lock_guard<std::mutex> guard(bucket.mutex);
+        const auto it = bucket.map.find(key);
+        if(it == bucket.map.end()) {
+            return false;
+        }
+        visitor(it->second);
+        return true;
     }
 
     // удаляем значение по ключу
     void erase(const Key& key) {
-        uint64_t index = static_cast<uint64_t>(key) % m_vct_items.size();
-        auto& item = m_vct_items[index];
-        std::lock_guard<std::mutex> guard(item.mutex);
-        item.map.erase(key);
+        Bucket& bucket = GetBucket(key);
+        std::lock_guard<std::mutex> guard(bucket.mutex);
+        bucket.map.erase(key);
+    }
+
+    size_t GetBucketCount() const {
+        return m_buckets.size();
     }
 
-    // строим общую мапу
-    std::map<Key, Value> BuildOrdinaryMap() {
+    // копия всех пар по возрастанию ключа
+    // корзины блокируются по одной: при одновременной записи это не мгновенный снимок
+    std::map<Key, Value> BuildOrdinaryMap() const {
         std::map<Key, Value> result;
+        for(const Bucket& bucket : m_buckets) {
+            std::lock_guard<std::mutex> guard(bucket.mutex);
+            result.insert(bucket.map.begin(), bucket.map.end());
+        }
+        return result;
+    }
 
-        // проход по всем кускам мапы
-        for(auto& item : m_vct_items) {
-            // сначала блокируем
-            std::lock_guard<std::mutex> guard(item.mutex);
-            // потом вставляем
-            result.insert(item.map.begin(), item.map.end());
+    // обход пар без блокировок, в порядке корзин
+    // вызывать, когда писателей нет: например, после завершения параллельного алгоритма -
+    // его завершение упорядочивает все записи потоков перед обходом
+    template <typename Callback>
+    void ForEach(Callback callback) const {
+        for(const Bucket& bucket : m_buckets) {
+            for(const auto& [key, value] : bucket.map) {
+                callback(key, value);
+            }
         }
+    }
 
+    // переносит все пары в вектор без копирования значений и очищает таблицу; без блокировок, как ForEach
+    std::vector<std::pair<Key, Value>> Extract() {
+        size_t size = 0;
+        for(const Bucket& bucket : m_buckets) {
+            size += bucket.map.size();
+        }
+        std::vector<std::pair<Key, Value>> result;
+        result.reserve(size);
+        for(Bucket& bucket : m_buckets) {
+            for(auto& [key, value] : bucket.map) {
+                result.emplace_back(key, std::move(value));
+            }
+            bucket.map.clear();
+        }
         return result;
     }
 
 private:
-    // вектор элементов
-    std::vector<t_item> m_vct_items;
+    inline static constexpr size_t BUCKETS_PER_THREAD = 8;
+
+    static size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while(result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // хеш перемешивается умножением Фибоначчи: std::hash целых - тождественная функция,
+    // и без перемешивания соседние ключи по маске попадали бы в соседние корзины только по младшим битам
+    size_t GetBucketIndex(const Key& key) const {
+        const uint64_t mixed = static_cast<uint64_t>(m_hash(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(mixed >> 32) & m_mask;
+    }
+
+    Bucket& GetBucket(const Key& key) {
+        return m_buckets[GetBucketIndex(key)];
+    }
+
+    const Bucket& GetBucket(const Key& key) const {
+        return m_buckets[GetBucketIndex(key)];
+    }
+
+    // вектор корзин
+    std::vector<Bucket> m_buckets;
+    size_t m_mask;
+    Hash m_hash;
 };
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "corpus_loader.h"
+
+using namespace std;
+
+namespace {
+
+// желаемый размер куска: достаточно крупный, чтобы накладные расходы на задачу были незаметны
+const size_t TARGET_CHUNK_SIZE = 4u << 20;
+
+struct ParsedChunk {
+    vector<CorpusRecord> records;
+    vector<CorpusError> errors;
+    size_t line_count = 0;
+};
+
+bool ParseInt(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(string_view text, DocumentStatus& status) {
+    if(text == "ACTUAL"sv) {
+        status = DocumentStatus::ACTUAL;
+    } else if(text == "IRRELEVANT"sv) {
+        status = DocumentStatus::IRRELEVANT;
+    } else if(text == "BANNED"sv) {
+        status = DocumentStatus::BANNED;
+    } else if(text == "REMOVED"sv) {
+        status = DocumentStatus::REMOVED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// отрезает от line поле до табуляции; false, если табуляции нет
+bool TakeField(string_view& line, string_view& field) {
+    const size_t tab = line.find('\t');
+    if(tab == string_view::npos) {
+        return false;
+    }
+    field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return true;
+}
+
+// разбирает одну непустую строку; текст ошибки - в error
+bool ParseRecord(string_view line, CorpusRecord& record, string& error) {
+    string_view field;
+    if(!TakeField(line, field) || !ParseInt(field, record.id)) {
+        error = "invalid document id"s;
+        return false;
+    }
+    if(!TakeField(line, field) || !ParseStatus(field, record.status)) {
+        error = "invalid document status"s;
+        return false;
+    }
+    if(!TakeField(line, field)) {
+        error = "missing ratings field"s;
+        return false;
+    }
+    record.ratings.clear();
+    while(!field.empty()) {
+        const size_t space = field.find(' ');
+        const string_view token = field.substr(0, space);
+        if(!token.empty()) {
+            int rating = 0;
+            if(!ParseInt(token, rating)) {
+                error = "invalid rating \""s + string(token) + "\""s;
+                return false;
+            }
+            record.ratings.push_back(rating);
+        }
+        field.remove_prefix(space == string_view::npos ? field.size() : space + 1);
+    }
+    record.text = line;
+    return true;
+}
+
+} // namespace
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& path) {
+    ifstream input(path, ios::binary);
+    if(!input) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    m_buffer.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+MappedFile::~MappedFile() = default;
+
+#else
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw runtime_error("Cannot open "s + path + ": "s + strerror(errno));
+    }
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) < 0) {
+        const int error = errno;
+        close(fd);
+        throw runtime_error("Cannot stat "s + path + ": "s + strerror(error));
+    }
+    m_size = static_cast<size_t>(file_stat.st_size);
+    // пустой файл отобразить нельзя - он остается пустым видом
+    if(m_size > 0) {
+        void* const data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            const int error = errno;
+            close(fd);
+            throw runtime_error("Cannot map "s + path + ": "s + strerror(error));
+        }
+        // файл читается один раз от начала к концу
+        madvise(data, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(data);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if(m_data != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+#endif
+
+string_view MappedFile::GetData() const {
+    return {m_data, m_size};
+}
+
+size_t ParseCorpus(string_view text, size_t base_offset, vector<CorpusRecord>& records, vector<CorpusError>& errors) {
+    size_t line_number = 0;
+    size_t position = 0;
+    string error;
+    while(position < text.size()) {
+        const size_t line_end = min(text.find('\n', position), text.size());
+        string_view line = text.substr(position, line_end - position);
+        const size_t line_offset = base_offset + position;
+        position = line_end + 1;
+        ++line_number;
+
+        if(!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if(line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        CorpusRecord record{line_offset, line_number, 0, DocumentStatus::ACTUAL, {}, {}};
+        if(ParseRecord(line, record, error)) {
+            records.push_back(move(record));
+        } else {
+            errors.push_back({line_offset, line_number, move(error)});
+        }
+    }
+    return line_number;
+}
+
+vector<size_t> SplitCorpusIntoChunks(string_view text, size_t chunk_count) {
+    chunk_count = max<size_t>(chunk_count, 1);
+    vector<size_t> boundaries = {0};
+    for(size_t i = 1; i < chunk_count; ++i) {
+        // граница сдвигается к началу следующей строки
+        const size_t target = max(text.size() / chunk_count * i, boundaries.back());
+        const size_t line_end = text.find('\n', target);
+        if(line_end == string_view::npos) {
+            break;
+        }
+        if(line_end + 1 > boundaries.back()) {
+            boundaries.push_back(line_end + 1);
+        }
+    }
+    if(boundaries.back() != text.size()) {
+        boundaries.push_back(text.size());
+    }
+    return boundaries;
+}
+
+namespace {
+
+// разбирает файл кусками параллельно и передает куски add_chunk строго по порядку
+// add_chunk(chunk, lines_before, result) добавляет записи куска и дописывает ошибки добавления
+template <typename AddChunk>
+CorpusLoadResult LoadCorpusChunks(const string& path, size_t chunk_count, AddChunk add_chunk) {
+    const MappedFile file(path);
+    const string_view data = file.GetData();
+    const size_t thread_count = max(1u, thread::hardware_concurrency());
+    if(chunk_count == 0) {
+        chunk_count = max(data.size() / TARGET_CHUNK_SIZE, thread_count);
+    }
+    const vector<size_t> boundaries = SplitCorpusIntoChunks(data, chunk_count);
+
+    CorpusLoadResult result;
+    result.bytes = data.size();
+
+    // разбор опережает добавление не больше чем на window кусков, чтобы разобранные записи не копились
+    const size_t window = thread_count + 1;
+    deque<future<ParsedChunk>> parsing;
+    size_t next_chunk = 0;
+    size_t lines_before = 0;
+    while(next_chunk + 1 < boundaries.size() || !parsing.empty()) {
+        while(next_chunk + 1 < boundaries.size() && parsing.size() < window) {
+            const size_t begin = boundaries[next_chunk];
+            const size_t end = boundaries[next_chunk + 1];
+            parsing.push_back(async(launch::async, [data, begin, end]() {
+                ParsedChunk chunk;
+                chunk.line_count = ParseCorpus(data.substr(begin, end - begin), begin, chunk.records, chunk.errors);
+                return chunk;
+            }));
+            ++next_chunk;
+        }
+        ParsedChunk chunk = parsing.front().get();
+        parsing.pop_front();
+
+        for(CorpusError& error : chunk.errors) {
+            error.line += lines_before;
+            result.errors.push_back(move(error));
+        }
+        add_chunk(chunk, lines_before, result);
+        lines_before += chunk.line_count;
+    }
+
+    stable_sort(result.errors.begin(), result.errors.end(),
+        [](const CorpusError& lhs, const CorpusError& rhs) { return lhs.offset < rhs.offset; });
+    return result;
+}
+
+string GetExceptionMessage(const exception_ptr& error) {
+    try {
+        rethrow_exception(error);
+    } catch(const exception& e) {
+        return e.what();
+    } catch(...) {
+        return "unknown error"s;
+    }
+}
+
+} // namespace
+
+CorpusLoadResult LoadCorpus(SearchServer& search_server, const string& path, size_t chunk_count) {
+    return LoadCorpusChunks(path, chunk_count,
+        [&search_server](ParsedChunk& chunk, size_t lines_before, CorpusLoadResult& result) {
+            for(const CorpusRecord& record : chunk.records) {
+                try {
+                    search_server.AddDocument(record.id, record.text, record.status, record.ratings);
+                    ++result.documents_added;
+                } catch(const exception& e) {
+                    result.errors.push_back({record.offset, lines_before + record.line, e.what()});
+                }
+            }
+        });
+}
+
+CorpusLoadResult LoadCorpus(ShardedSearchServer& search_server, const string& path, size_t chunk_count) {
+    return LoadCorpusChunks(path, chunk_count,
+        [&search_server](ParsedChunk& chunk, size_t lines_before, CorpusLoadResult& result) {
+            vector<DocumentInput> batch;
+            batch.reserve(chunk.records.size());
+            for(CorpusRecord& record : chunk.records) {
+                batch.push_back({record.id, record.text, record.status, move(record.ratings)});
+            }
+            const auto errors = search_server.TryAddDocuments(batch);
+            result.documents_added += batch.size() - errors.size();
+            for(const auto& [index, error] : errors) {
+                const CorpusRecord& record = chunk.records[index];
+                result.errors.push_back({record.offset, lines_before + record.line, GetExceptionMessage(error)});
+            }
+        });
+}
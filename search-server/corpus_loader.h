@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "sharded_search_server.h"
+
+// загрузка корпуса документов из файла
+//
+// формат: одна запись на строку, поля разделены табуляцией
+//   id<TAB>статус<TAB>рейтинги<TAB>текст
+// статус - ACTUAL, IRRELEVANT, BANNED или REMOVED; рейтинги - целые числа через пробел (может быть пусто);
+// текст - остаток строки. Пустые строки и строки, начинающиеся с '#', пропускаются; допускается конец строки \r\n.
+//
+// файл отображается в память, делится на куски по границам строк, куски разбираются параллельно;
+// записи ссылаются на отображенный файл, тексты не копируются до добавления в индекс
+
+// файл, отображенный в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view GetData() const;
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    std::string m_buffer; // без mmap (Windows) файл читается сюда целиком
+};
+
+struct CorpusRecord {
+    size_t offset;     // смещение начала строки в файле
+    size_t line;       // номер строки, с 1 от начала разобранного текста
+    int id;
+    DocumentStatus status;
+    std::vector<int> ratings;
+    std::string_view text;
+};
+
+struct CorpusError {
+    size_t offset;     // смещение начала строки в файле
+    size_t line;       // номер строки, с 1
+    std::string message;
+};
+
+struct CorpusLoadResult {
+    size_t bytes = 0;             // размер файла
+    size_t documents_added = 0;
+    std::vector<CorpusError> errors; // ошибки разбора и отказы AddDocument, по возрастанию смещения
+};
+
+// разбирает текст корпуса; base_offset - смещение text в файле, номера строк отсчитываются от начала text
+// возвращает число строк в text
+size_t ParseCorpus(std::string_view text, size_t base_offset, std::vector<CorpusRecord>& records, std::vector<CorpusError>& errors);
+
+// границы кусков text по началам строк: первое смещение 0, последнее text.size(), между ними не больше
+// chunk_count - 1 границ (меньше, если строки длиннее куска)
+std::vector<size_t> SplitCorpusIntoChunks(std::string_view text, size_t chunk_count);
+
+// разбирает файл кусками параллельно и добавляет документы в сервер в порядке файла
+// разбор следующих кусков идет одновременно с добавлением предыдущих
+// chunk_count == 0 - по размеру файла и числу аппаратных потоков
+// не открывшийся файл - исключение, ошибки в записях - в результате
+CorpusLoadResult LoadCorpus(SearchServer& search_server, const std::string& path, size_t chunk_count = 0);
+
+// то же для шардированного сервера: записи куска добавляются пакетом, шарды заполняются параллельно
+CorpusLoadResult LoadCorpus(ShardedSearchServer& search_server, const std::string& path, size_t chunk_count = 0);
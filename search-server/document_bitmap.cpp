@@ -0,0 +1,60 @@
+#include "document_bitmap.h"
+
+DocumentBitmap::DocumentBitmap(std::pmr::memory_resource* resource) : m_blocks(resource) {
+}
+
+void DocumentBitmap::Set(int document_id) {
+    const size_t block = static_cast<size_t>(document_id) >> BLOCK_BITS;
+    if(block >= m_blocks.size()) {
+        m_blocks.resize(block + 1);
+    }
+    auto& words = m_blocks[block];
+    if(words.empty()) {
+        words.resize(WORDS_PER_BLOCK);
+    }
+
+    const size_t offset = static_cast<size_t>(document_id) & ((size_t(1) << BLOCK_BITS) - 1);
+    const uint64_t mask = uint64_t(1) << (offset % 64);
+    if(!(words[offset / 64] & mask)) {
+        words[offset / 64] |= mask;
+        ++m_count;
+    }
+}
+
+void DocumentBitmap::Reset(int document_id) {
+    const size_t block = static_cast<size_t>(document_id) >> BLOCK_BITS;
+    if(block >= m_blocks.size() || m_blocks[block].empty()) {
+        return;
+    }
+    auto& words = m_blocks[block];
+
+    const size_t offset = static_cast<size_t>(document_id) & ((size_t(1) << BLOCK_BITS) - 1);
+    const uint64_t mask = uint64_t(1) << (offset % 64);
+    if(words[offset / 64] & mask) {
+        words[offset / 64] &= ~mask;
+        --m_count;
+    }
+}
+
+bool DocumentBitmap::Test(int document_id) const {
+    const size_t block = static_cast<size_t>(document_id) >> BLOCK_BITS;
+    if(block >= m_blocks.size() || m_blocks[block].empty()) {
+        return false;
+    }
+
+    const size_t offset = static_cast<size_t>(document_id) & ((size_t(1) << BLOCK_BITS) - 1);
+    return (m_blocks[block][offset / 64] >> (offset % 64)) & 1;
+}
+
+size_t DocumentBitmap::Count() const {
+    return m_count;
+}
+
+bool DocumentBitmap::Empty() const {
+    return m_count == 0;
+}
+
+void DocumentBitmap::Clear() {
+    m_blocks.clear();
+    m_count = 0;
+}
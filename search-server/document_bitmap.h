@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// разреженное битовое множество id документов
+// id делятся на блоки по 65536 штук, память (8 КБ) выделяется только под блоки, где есть хотя бы один id
+// проверка принадлежности - O(1): индекс блока и слово внутри блока
+class DocumentBitmap {
+public:
+    explicit DocumentBitmap(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    void Set(int document_id);
+    void Reset(int document_id);
+    bool Test(int document_id) const;
+
+    // число id в множестве
+    size_t Count() const;
+    bool Empty() const;
+
+    void Clear();
+
+    // обход id по возрастанию
+    template <typename Callback>
+    void ForEach(Callback callback) const;
+
+private:
+    static constexpr int BLOCK_BITS = 16;
+    static constexpr size_t WORDS_PER_BLOCK = (size_t(1) << BLOCK_BITS) / 64;
+
+    // пустой вектор - блок не выделен
+    std::pmr::vector<std::pmr::vector<uint64_t>> m_blocks;
+    size_t m_count = 0;
+};
+
+template <typename Callback>
+void DocumentBitmap::ForEach(Callback callback) const {
+    for(size_t block = 0; block < m_blocks.size(); ++block) {
+        const auto& words = m_blocks[block];
+        for(size_t word = 0; word < words.size(); ++word) {
+            uint64_t bits = words[word];
+            while(bits != 0) {
+                const int bit = __builtin_ctzll(bits);
+                callback(static_cast<int>((block << BLOCK_BITS) + word * 64 + bit));
+                bits &= bits - 1;
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// 128-битный отпечаток множества термов документа
+// совпадение отпечатков не гарантирует совпадение множеств - коллизии проверяются сравнением термов
+struct DocumentFingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const DocumentFingerprint& other) const {
+        return low == other.low && high == other.high;
+    }
+
+    bool operator!=(const DocumentFingerprint& other) const {
+        return !(*this == other);
+    }
+};
+
+struct DocumentFingerprintHasher {
+    size_t operator()(const DocumentFingerprint& fingerprint) const {
+        // половины отпечатка уже хорошо перемешаны
+        return static_cast<size_t>(fingerprint.low ^ (fingerprint.high >> 1));
+    }
+};
+
+// финализатор splitmix64
+inline uint64_t MixFingerprintBits(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// отпечаток строится по отсортированному массиву уникальных id термов
+// две половины считаются независимыми цепочками с разными константами
+inline DocumentFingerprint ComputeDocumentFingerprint(const std::pmr::vector<int>& sorted_term_ids) {
+    DocumentFingerprint fingerprint{0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL ^ sorted_term_ids.size()};
+    for(const int term_id : sorted_term_ids) {
+        const uint64_t value = static_cast<uint32_t>(term_id);
+        fingerprint.low = MixFingerprintBits(fingerprint.low ^ value);
+        fingerprint.high = MixFingerprintBits(fingerprint.high + value * 0xFF51AFD7ED558CCDULL);
+    }
+    return fingerprint;
+}
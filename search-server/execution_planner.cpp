@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+#include "execution_planner.h"
+
+using namespace std;
+
+namespace {
+
+// время = intercept + slope * объем работы
+struct LinearModel {
+    double intercept = 0.0;
+    double slope = 0.0;
+};
+
+// метод наименьших квадратов по замерам
+LinearModel FitLinearModel(const vector<PlannerCalibrationSample>& samples, double PlannerCalibrationSample::*time, size_t& used) {
+    double sum_x = 0.0;
+    double sum_y = 0.0;
+    double sum_xx = 0.0;
+    double sum_xy = 0.0;
+    used = 0;
+    for(const PlannerCalibrationSample& sample : samples) {
+        const double x = static_cast<double>(sample.postings);
+        const double y = sample.*time;
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        ++used;
+    }
+    LinearModel model;
+    const double denominator = used * sum_xx - sum_x * sum_x;
+    if(used < 2 || denominator <= 0.0) {
+        return model;
+    }
+    model.slope = (used * sum_xy - sum_x * sum_y) / denominator;
+    model.intercept = (sum_y - model.slope * sum_x) / used;
+    return model;
+}
+
+// наименьший объем работы, с которого other дешевле base
+size_t FindCrossover(const LinearModel& base, const LinearModel& other) {
+    if(other.slope >= base.slope) {
+        return other.intercept < base.intercept ? 0 : PlannerThresholds::NEVER;
+    }
+    const double crossover = (other.intercept - base.intercept) / (base.slope - other.slope);
+    if(crossover <= 0.0) {
+        return 0;
+    }
+    if(crossover >= static_cast<double>(PlannerThresholds::NEVER)) {
+        return PlannerThresholds::NEVER;
+    }
+    return static_cast<size_t>(ceil(crossover));
+}
+
+} // namespace
+
+QueryPlan PlanQuery(const QueryWorkEstimate& estimate, const PlannerThresholds& thresholds, size_t parallelism) {
+    if(parallelism < 2 || estimate.postings < thresholds.parallel_min_postings) {
+        return {};
+    }
+    const size_t tasks = min(parallelism, estimate.postings / max<size_t>(thresholds.range_min_postings, 1));
+    if(tasks < 2) {
+        return {};
+    }
+    if(estimate.postings >= thresholds.exhaustive_parallel_min_postings) {
+        return {ExecutionStrategy::EXHAUSTIVE_RANGE_PARALLEL, tasks};
+    }
+    return {ExecutionStrategy::DOC_RANGE_PARALLEL, tasks};
+}
+
+PlannerThresholds FitPlannerThresholds(const vector<PlannerCalibrationSample>& samples, size_t parallelism) {
+    PlannerThresholds thresholds;
+    if(parallelism < 2) {
+        return thresholds;
+    }
+
+    size_t used = 0;
+    const LinearModel sequential = FitLinearModel(samples, &PlannerCalibrationSample::sequential_ns, used);
+    const LinearModel range_parallel = FitLinearModel(samples, &PlannerCalibrationSample::range_parallel_ns, used);
+    if(used < 2) {
+        return thresholds;
+    }
+    thresholds.parallel_min_postings = FindCrossover(sequential, range_parallel);
+
+    // полный перебор по диапазонам выбирается, когда он дешевле и отсечения, и одного потока
+    const LinearModel exhaustive_parallel = FitLinearModel(samples, &PlannerCalibrationSample::exhaustive_parallel_ns, used);
+    thresholds.exhaustive_parallel_min_postings = max(FindCrossover(range_parallel, exhaustive_parallel), FindCrossover(sequential, exhaustive_parallel));
+    return thresholds;
+}
+
+string FormatPlannerThresholds(const PlannerThresholds& thresholds) {
+    const auto format_value = [](size_t value) {
+        return value == PlannerThresholds::NEVER ? "never"s : to_string(value);
+    };
+    return "parallel_min_postings="s + format_value(thresholds.parallel_min_postings)
+        + " exhaustive_parallel_min_postings="s + format_value(thresholds.exhaustive_parallel_min_postings)
+        + " range_min_postings="s + format_value(thresholds.range_min_postings)
+        + " parallelism="s + format_value(thresholds.parallelism);
+}
+
+PlannerThresholds ParsePlannerThresholds(string_view text) {
+    PlannerThresholds thresholds;
+    while(!text.empty()) {
+        const size_t field_end = min(text.find_first_of(" \t\r\n"sv), text.size());
+        const string_view field = text.substr(0, field_end);
+        text.remove_prefix(field_end == text.size() ? field_end : field_end + 1);
+        if(field.empty()) {
+            continue;
+        }
+
+        const size_t separator = field.find('=');
+        if(separator == string_view::npos) {
+            throw invalid_argument("Malformed planner thresholds field "s + string(field));
+        }
+        const string_view name = field.substr(0, separator);
+        const string_view value_text = field.substr(separator + 1);
+        size_t value = PlannerThresholds::NEVER;
+        if(value_text != "never"sv) {
+            const auto [end, error] = from_chars(value_text.data(), value_text.data() + value_text.size(), value);
+            if(error != errc() || end != value_text.data() + value_text.size()) {
+                throw invalid_argument("Malformed planner thresholds field "s + string(field));
+            }
+        }
+
+        if(name == "parallel_min_postings"sv) {
+            thresholds.parallel_min_postings = value;
+        } else if(name == "exhaustive_parallel_min_postings"sv) {
+            thresholds.exhaustive_parallel_min_postings = value;
+        } else if(name == "range_min_postings"sv) {
+            thresholds.range_min_postings = value;
+        } else if(name == "parallelism"sv) {
+            thresholds.parallelism = value;
+        } else {
+            throw invalid_argument("Unknown planner thresholds field "s + string(name));
+        }
+    }
+    return thresholds;
+}
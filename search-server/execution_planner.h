@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "query_stats.h"
+
+// политика выполнения: способ выполнения выбирает планировщик по оценке объема работы запроса
+struct AutoExecutionPolicy {};
+inline constexpr AutoExecutionPolicy auto_execution{};
+
+// оценка объема работы запроса по длинам списков постингов - известна сразу после разбора запроса
+struct QueryWorkEstimate {
+    size_t postings = 0; // суммарная длина списков плюс- и минус-слов в разделах нужных статусов
+};
+
+// пороги планировщика
+// по умолчанию параллельные способы не выбираются никогда; откалиброванные пороги - SearchServer::CalibratePlannerThresholds,
+// их можно сохранить FormatPlannerThresholds и загрузить ParsePlannerThresholds при следующем запуске
+struct PlannerThresholds {
+    inline static constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+
+    // с такой оценки объема работы запрос выполняется параллельно
+    size_t parallel_min_postings = NEVER;
+    // с такой оценки диапазоны id перебираются полностью, а не с отсечением MaxScore:
+    // на больших запросах отсечение мало что отбрасывает, а его учет стоит дороже перебора
+    size_t exhaustive_parallel_min_postings = NEVER;
+    // минимальный объем работы на один диапазон id: меньше - накладные расходы на задачу не окупаются
+    size_t range_min_postings = 4096;
+    // число потоков для планирования; 0 - std::thread::hardware_concurrency()
+    size_t parallelism = 0;
+};
+
+struct QueryPlan {
+    ExecutionStrategy strategy = ExecutionStrategy::SEQUENTIAL;
+    size_t tasks = 1; // число параллельных задач (диапазонов id)
+};
+
+// parallelism - число аппаратных потоков
+QueryPlan PlanQuery(const QueryWorkEstimate& estimate, const PlannerThresholds& thresholds, size_t parallelism);
+
+// время выполнения одного запроса калибровки каждым способом
+struct PlannerCalibrationSample {
+    size_t postings = 0;
+    double sequential_ns = 0.0;
+    double exhaustive_parallel_ns = 0.0;
+    double range_parallel_ns = 0.0;
+};
+
+// пороги по замерам: время каждого способа приближается линейной функцией от объема работы,
+// порог - точка, где параллельный способ становится дешевле; без выигрыша - PlannerThresholds::NEVER
+PlannerThresholds FitPlannerThresholds(const std::vector<PlannerCalibrationSample>& samples, size_t parallelism);
+
+// текстовая форма порогов: поля "имя=значение" через пробел, NEVER - "never"
+std::string FormatPlannerThresholds(const PlannerThresholds& thresholds);
+// поля можно опускать (остаются по умолчанию); неизвестное поле или значение - исключение invalid_argument
+PlannerThresholds ParsePlannerThresholds(std::string_view text);
@@ -0,0 +1,68 @@
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <utility>
+
+#include "index_memory.h"
+#include "memory_stats.h"
+
+using namespace std;
+
+namespace {
+
+// размер первого блока арены; следующие блоки растут геометрически
+const size_t ARENA_INITIAL_SIZE = 1 << 20;
+
+atomic<uint64_t> next_arena_resource_id{0};
+
+// последняя арена, из которой выделял поток: номер ресурса и арена этого потока в нем
+// кэшируется одна запись, поэтому разрушенные ресурсы не копятся в потоке
+struct ThreadArenaCache {
+    uint64_t id = numeric_limits<uint64_t>::max();
+    pmr::memory_resource* arena = nullptr;
+};
+thread_local ThreadArenaCache thread_arena;
+
+} // namespace
+
+ThreadArenaMemoryResource::ThreadArenaMemoryResource(size_t initial_size)
+    : m_id(next_arena_resource_id.fetch_add(1, memory_order_relaxed))
+    , m_initial_size(initial_size) {
+}
+
+void* ThreadArenaMemoryResource::do_allocate(size_t bytes, size_t alignment) {
+    if(thread_arena.id != m_id) {
+        thread_arena = {m_id, FindThreadArena()};
+    }
+    return thread_arena.arena->allocate(bytes, alignment);
+}
+
+void ThreadArenaMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    // память может освобождать не тот поток, что выделял; монотонная арена все равно ничего не освобождает
+    (void)pointer; (void)bytes; (void)alignment;
+}
+
+bool ThreadArenaMemoryResource::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+pmr::memory_resource* ThreadArenaMemoryResource::FindThreadArena() {
+    lock_guard guard(m_arenas_mutex);
+    auto& arena = m_arenas[this_thread::get_id()];
+    if(!arena) {
+        arena = make_unique<pmr::monotonic_buffer_resource>(m_initial_size);
+    }
+    return arena.get();
+}
+
+unique_ptr<pmr::memory_resource> MakeIndexMemoryResource(IndexMemory memory) {
+    switch(memory) {
+        case IndexMemory::POOL:
+            return make_unique<pmr::synchronized_pool_resource>();
+        case IndexMemory::ARENA:
+            return make_unique<ThreadArenaMemoryResource>(ARENA_INITIAL_SIZE);
+        case IndexMemory::HEAP:
+        default:
+            return make_unique<CountingMemoryResource>(pmr::new_delete_resource());
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// способ выделения памяти под индекс поискового сервера
+enum class IndexMemory {
+    HEAP,  // глобальный аллокатор
+    POOL,  // пулы блоков одного размера: для изменяемых индексов, память узлов переиспользуется
+    ARENA, // монотонная арена: освобождение узлов ничего не стоит, память возвращается целиком
+           // при разрушении арены - для индексов, которые строятся один раз и дальше только читаются
+};
+
+// монотонные арены по одной на поток
+// параллельные алгоритмы сервера выделяют память индекса из нескольких потоков, а
+// std::pmr::monotonic_buffer_resource не потокобезопасен: каждый поток выделяет из своей арены без блокировок,
+// арена берется из кэша последнего ресурса потока; мьютекс берется, только когда поток переходит к другому ресурсу. Освобождение - пустая операция, как у монотонной арены;
+// вся память возвращается при разрушении ресурса
+class ThreadArenaMemoryResource : public std::pmr::memory_resource {
+public:
+    // initial_size - размер первого блока арены каждого потока
+    explicit ThreadArenaMemoryResource(size_t initial_size);
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    // арена текущего потока, создается при первом обращении
+    std::pmr::memory_resource* FindThreadArena();
+
+    // номер ресурса в кэше арены потока; номера не переиспользуются, поэтому запись разрушенного ресурса не совпадет
+    const uint64_t m_id;
+    const size_t m_initial_size;
+    std::mutex m_arenas_mutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<std::pmr::monotonic_buffer_resource>> m_arenas;
+};
+
+// потокобезопасный ресурс памяти для индекса; должен пережить все серверы, которые им пользуются
+// HEAP - CountingMemoryResource над std::pmr::new_delete_resource() (счетчики атомарные, без блокировок);
+// вместо него можно передать серверу nullptr
+std::unique_ptr<std::pmr::memory_resource> MakeIndexMemoryResource(IndexMemory memory);
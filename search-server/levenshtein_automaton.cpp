@@ -0,0 +1,138 @@
+#include <algorithm>
+
+#include "levenshtein_automaton.h"
+
+using namespace std;
+
+LevenshteinAutomaton::LevenshteinAutomaton(string_view word, int max_distance)
+    : m_word(word)
+    , m_max_distance(max_distance)
+    , m_width(word.size() + 1)
+    , m_rows(m_width)
+    , m_scratch(m_width) {
+    // пустой префикс: расстояние до префикса слова длины j - j вставок
+    for(size_t j = 0; j < m_width; ++j) {
+        m_rows[j] = min(static_cast<int>(j), m_max_distance + 1);
+    }
+
+    for(const char c : word) {
+        m_is_word_byte[static_cast<unsigned char>(c)] = true;
+    }
+    for(int byte = 0; byte < 256; ++byte) {
+        if(m_is_word_byte[byte]) {
+            m_word_bytes.push_back(static_cast<char>(byte));
+        } else if(!m_has_other_byte) {
+            m_has_other_byte = true;
+            m_other_byte = static_cast<char>(byte);
+        }
+    }
+}
+
+int LevenshteinAutomaton::Step(const int* previous, char c, int* current, size_t row) const {
+    const int cap = m_max_distance + 1;
+    const size_t band = static_cast<size_t>(m_max_distance);
+    // клетки дальше band от диагонали не меньше cap; соседние с полосой клетки пишутся как cap,
+    // чтобы следующая строка читала из предыдущей только посчитанное
+    size_t first = row > band ? row - band : 0;
+    const size_t last = min(m_width - 1, row + band);
+    if(first > last) {
+        return cap;
+    }
+    int row_min = cap;
+    if(first == 0) {
+        current[0] = min(static_cast<int>(row), cap);
+        row_min = current[0];
+        first = 1;
+    } else {
+        current[first - 1] = cap;
+    }
+    for(size_t j = first; j <= last; ++j) {
+        current[j] = min({previous[j] + 1, current[j - 1] + 1, previous[j - 1] + (m_word[j - 1] != c ? 1 : 0), cap});
+        row_min = min(row_min, current[j]);
+    }
+    if(last + 1 < m_width) {
+        current[last + 1] = cap;
+    }
+    return row_min;
+}
+
+int LevenshteinAutomaton::Advance(size_t depth, char c) {
+    if(m_rows.size() < (depth + 2) * m_width) {
+        m_rows.resize((depth + 2) * m_width);
+    }
+    return Step(m_rows.data() + depth * m_width, c, m_rows.data() + (depth + 1) * m_width, depth + 1);
+}
+
+int LevenshteinAutomaton::GetDistance(size_t depth) const {
+    // разность длин - нижняя оценка расстояния: вне полосы клетка не посчитана
+    const size_t length_difference = depth > m_width - 1 ? depth - (m_width - 1) : (m_width - 1) - depth;
+    if(length_difference > static_cast<size_t>(m_max_distance)) {
+        return m_max_distance + 1;
+    }
+    return m_rows[depth * m_width + m_width - 1];
+}
+
+bool LevenshteinAutomaton::IsOtherByteLive(size_t depth) const {
+    return m_has_other_byte && Step(m_rows.data() + depth * m_width, m_other_byte, m_scratch.data(), depth + 1) <= m_max_distance;
+}
+
+bool LevenshteinAutomaton::IsWordByte(char c) const {
+    return m_is_word_byte[static_cast<unsigned char>(c)];
+}
+
+size_t LevenshteinAutomaton::Feed(string_view term) {
+    size_t depth = 0;
+    const size_t common_limit = min(term.size(), m_prefix.size());
+    while(depth < common_limit && term[depth] == m_prefix[depth]) {
+        ++depth;
+    }
+    m_prefix.resize(depth);
+
+    for(; depth < term.size(); ++depth) {
+        const char c = term[depth];
+        m_prefix.push_back(c);
+        // расстояние не убывает при дописывании символов: минимум строки - нижняя оценка для продолжений
+        if(Advance(depth, c) > m_max_distance) {
+            return depth + 1;
+        }
+    }
+    return NO_DEAD_PREFIX;
+}
+
+int LevenshteinAutomaton::GetDistance() const {
+    return GetDistance(m_prefix.size());
+}
+
+bool LevenshteinAutomaton::FindNextLiveString(size_t dead_prefix, string& result) const {
+    // перебираем позиции от конца тупикового префикса к началу: на позиции level ищем наименьший байт
+    // больше m_prefix[level], после которого строка живая; префикс до level живой
+    for(size_t level = dead_prefix; level-- > 0;) {
+        const int* const state = m_rows.data() + level * m_width;
+        const unsigned char current = static_cast<unsigned char>(m_prefix[level]);
+        if(current == 0xFF) {
+            continue;
+        }
+        // переход по байту не из слова - худший из возможных: если он живой, живые все байты
+        bool found = false;
+        unsigned char next = 0;
+        if(IsOtherByteLive(level)) {
+            found = true;
+            next = current + 1;
+        } else {
+            for(const char c : m_word_bytes) {
+                const unsigned char byte = static_cast<unsigned char>(c);
+                if(byte > current && Step(state, c, m_scratch.data(), level + 1) <= m_max_distance) {
+                    found = true;
+                    next = byte;
+                    break;
+                }
+            }
+        }
+        if(found) {
+            result.assign(m_prefix, 0, level);
+            result.push_back(static_cast<char>(next));
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// автомат Левенштейна: принимает строки на расстоянии редактирования не больше max_distance от слова
+// (вставка, удаление и замена байта)
+// состояние после префикса - строка таблицы расстояний от префикса до всех префиксов слова;
+// строки хранятся стеком по длине префикса, поэтому общий префикс соседних в словаре термов
+// не пересчитывается
+// считается только полоса строки шириной max_distance по обе стороны диагонали: остальные клетки
+// больше max_distance, поэтому расстояние больше max_distance сообщается как max_distance + 1
+class LevenshteinAutomaton {
+public:
+    inline static constexpr size_t NO_DEAD_PREFIX = std::numeric_limits<size_t>::max();
+
+    LevenshteinAutomaton(std::string_view word, int max_distance);
+
+    // переводит автомат в состояние после term, пересчитывая строки только после общего
+    // с предыдущим term префикса
+    // возвращает длину тупикового префикса term - его не продолжает ни одна принимаемая строка -
+    // или NO_DEAD_PREFIX, если term прочитан целиком
+    size_t Feed(std::string_view term);
+    // расстояние от последнего прочитанного целиком term до слова
+    int GetDistance() const;
+
+    // обход бора: строки для префикса длины depth уже посчитаны, префикс продолжается байтом c;
+    // возвращает минимум новой строки - у префикса есть принимаемые продолжения, только если он не больше max_distance
+    // Feed и обход бора на одном автомате не смешиваются
+    int Advance(size_t depth, char c);
+    // расстояние от префикса длины depth, прочитанного Advance, до слова
+    int GetDistance(size_t depth) const;
+    // есть ли принимаемые продолжения у префикса длины depth, продолженного байтом не из слова
+    bool IsOtherByteLive(size_t depth) const;
+    bool IsWordByte(char c) const;
+
+    // после Feed, вернувшего тупиковый префикс длины dead_prefix: наименьшая строка, которая больше
+    // всех строк с этим префиксом и все префиксы которой живые; false - такой строки нет
+    // байты, которых нет в слове, переводят автомат одинаково, поэтому проверяются только байты слова
+    // и один любой другой байт, а не все 256 продолжений
+    bool FindNextLiveString(size_t dead_prefix, std::string& result) const;
+
+private:
+    // строка таблицы row после байта c из строки previous (row - 1); возвращает минимум строки
+    int Step(const int* previous, char c, int* current, size_t row) const;
+
+    std::string m_word;
+    int m_max_distance;
+    // длина строки таблицы: m_word.size() + 1
+    size_t m_width;
+    // строки таблицы подряд: строка i - для префикса m_prefix длины i
+    std::vector<int> m_rows;
+    std::string m_prefix;
+    // различные байты слова по возрастанию (как unsigned char) и байт, которого в слове нет
+    std::string m_word_bytes;
+    std::array<bool, 256> m_is_word_byte{};
+    bool m_has_other_byte = false;
+    char m_other_byte = 0;
+    // рабочая строка для FindNextLiveString
+    mutable std::vector<int> m_scratch;
+};
+
+// ключ элемента упорядоченного контейнера: у мапы - first, у множества - сам элемент
+template <typename Key, typename Value>
+std::string_view GetFuzzyKey(const std::pair<const Key, Value>& element) {
+    return element.first;
+}
+
+template <typename Key>
+std::string_view GetFuzzyKey(const Key& element) {
+    return element;
+}
+
+// пересечение автомата с мапой или множеством, упорядоченными по строковому ключу:
+// callback(итератор, расстояние) для каждого ключа на расстоянии не больше max_distance, по возрастанию ключа
+// с тупикового префикса поиск lower_bound переходит сразу к следующей строке с живыми префиксами,
+// поэтому обходятся только ключи с живыми префиксами, а не весь словарь - как при обходе бора с автоматом
+template <typename SortedMap, typename Callback>
+void ForEachFuzzyMatch(const SortedMap& map, std::string_view word, int max_distance, Callback callback) {
+    LevenshteinAutomaton automaton(word, max_distance);
+    std::string next_live;
+    auto it = map.begin();
+    while(it != map.end()) {
+        const std::string_view key = GetFuzzyKey(*it);
+        const size_t dead_prefix = automaton.Feed(key);
+        if(dead_prefix == LevenshteinAutomaton::NO_DEAD_PREFIX) {
+            const int distance = automaton.GetDistance();
+            if(distance <= max_distance) {
+                callback(it, distance);
+            }
+            ++it;
+            continue;
+        }
+        if(!automaton.FindNextLiveString(dead_prefix, next_live)) {
+            break;
+        }
+        it = map.lower_bound(next_live);
+    }
+}
@@ -0,0 +1,46 @@
+#include "memory_stats.h"
+
+using namespace std;
+
+size_t MemoryStats::TotalBytes() const {
+    return document_text.bytes + inverted_index.bytes + forward_index.bytes + document_metadata.bytes
+         + dictionary.bytes + stop_words.bytes + auxiliary.bytes;
+}
+
+void AddToLengthHistogram(vector<size_t>& histogram, size_t length) {
+    const size_t bucket = length < 2 ? 0 : static_cast<size_t>(63 - __builtin_clzll(length));
+    if(bucket >= histogram.size()) {
+        histogram.resize(bucket + 1, 0);
+    }
+    ++histogram[bucket];
+}
+
+CountingMemoryResource::CountingMemoryResource(pmr::memory_resource* upstream)
+    : m_upstream(upstream) {
+}
+
+MemoryUsage CountingMemoryResource::GetUsage() const {
+    return {m_bytes.load(memory_order_relaxed), m_peak_bytes.load(memory_order_relaxed), m_allocations.load(memory_order_relaxed)};
+}
+
+void* CountingMemoryResource::do_allocate(size_t bytes, size_t alignment) {
+    void* const pointer = m_upstream->allocate(bytes, alignment);
+
+    const size_t current = m_bytes.fetch_add(bytes, memory_order_relaxed) + bytes;
+    size_t peak = m_peak_bytes.load(memory_order_relaxed);
+    while(current > peak && !m_peak_bytes.compare_exchange_weak(peak, current, memory_order_relaxed)) {
+    }
+    m_allocations.fetch_add(1, memory_order_relaxed);
+
+    return pointer;
+}
+
+void CountingMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    m_upstream->deallocate(pointer, bytes, alignment);
+    m_bytes.fetch_sub(bytes, memory_order_relaxed);
+    m_allocations.fetch_sub(1, memory_order_relaxed);
+}
+
+bool CountingMemoryResource::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
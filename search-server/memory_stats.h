@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// потребление памяти одной категорией структур
+// считаются байты, запрошенные у аллокатора (без служебных данных malloc)
+struct MemoryUsage {
+    size_t bytes = 0;       // занято сейчас
+    size_t peak_bytes = 0;  // максимум за время жизни сервера
+    size_t allocations = 0; // живых выделений
+};
+
+// потребление памяти поисковым сервером по структурам
+struct MemoryStats {
+    MemoryUsage document_text;     // тексты документов
+    MemoryUsage inverted_index;    // постинги: слово -> документы (word_to_document_freqs_)
+    MemoryUsage forward_index;     // документ -> слова (document_to_word_freqs_, массивы id термов)
+    MemoryUsage document_metadata; // рейтинг, статус, отпечаток, множество id
+    MemoryUsage dictionary;        // словарь термов
+    MemoryUsage stop_words;        // стоп-слова
+    MemoryUsage auxiliary;         // индекс вкладов, индекс отпечатков, битовые множества статусов, словарь опечаток
+
+    // гистограммы: индекс 0 - длины 0 и 1, индекс i > 0 - длины [2^i, 2^(i+1))
+    std::vector<size_t> posting_lengths;  // число документов в списке постингов терма
+    std::vector<size_t> document_lengths; // число различных термов документа
+
+    size_t TotalBytes() const;
+};
+
+// добавляет длину в гистограмму по степеням двойки
+void AddToLengthHistogram(std::vector<size_t>& histogram, size_t length);
+
+// ресурс памяти, считающий выделения; сама память берется у вышестоящего ресурса
+// счетчики атомарные: параллельные алгоритмы сервера выделяют и освобождают память из нескольких потоков
+class CountingMemoryResource : public std::pmr::memory_resource {
+public:
+    explicit CountingMemoryResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    CountingMemoryResource(const CountingMemoryResource&) = delete;
+    CountingMemoryResource& operator=(const CountingMemoryResource&) = delete;
+
+    MemoryUsage GetUsage() const;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::pmr::memory_resource* m_upstream;
+    std::atomic<size_t> m_bytes{0};
+    std::atomic<size_t> m_peak_bytes{0};
+    std::atomic<size_t> m_allocations{0};
+};
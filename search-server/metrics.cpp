@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "metrics.h"
+
+using namespace std;
+
+size_t GetMetricsShard() {
+    static atomic<size_t> next_shard{0};
+    thread_local const size_t shard = next_shard.fetch_add(1, memory_order_relaxed) % METRICS_SHARD_COUNT;
+    return shard;
+}
+
+uint64_t MetricsCounter::Value() const {
+    uint64_t value = 0;
+    for(const Shard& shard : m_shards) {
+        value += shard.value.load(memory_order_relaxed);
+    }
+    return value;
+}
+
+uint64_t HistogramSnapshot::Quantile(double quantile) const {
+    if(count == 0) {
+        return 0;
+    }
+    // ранг по методу ближайшего ранга
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(clamp(quantile, 0.0, 1.0) * count)));
+    uint64_t cumulative = 0;
+    for(size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+        cumulative += buckets[bucket];
+        if(cumulative >= rank) {
+            return LatencyHistogram::GetBucketUpperBound(bucket);
+        }
+    }
+    return LatencyHistogram::GetBucketUpperBound(buckets.size() - 1);
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+    constexpr uint64_t SUB_BUCKET_COUNT = uint64_t(1) << SUB_BUCKET_BITS;
+    if(bucket < SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    // верхняя граница последней корзины (2^64) не помещается в uint64_t
+    if(bucket + 1 >= BUCKET_COUNT) {
+        return numeric_limits<uint64_t>::max();
+    }
+    // корзина group*4 + sub_bucket покрывает [(4 + sub_bucket) << (group - 1), (5 + sub_bucket) << (group - 1))
+    const size_t group = bucket >> SUB_BUCKET_BITS;
+    const uint64_t sub_bucket = bucket & (SUB_BUCKET_COUNT - 1);
+    return ((SUB_BUCKET_COUNT + sub_bucket + 1) << (group - 1)) - 1;
+}
+
+HistogramSnapshot LatencyHistogram::Collect() const {
+    HistogramSnapshot snapshot;
+    snapshot.buckets.assign(BUCKET_COUNT, 0);
+    for(size_t i = 0; i < METRICS_SHARD_COUNT; ++i) {
+        const Shard& shard = m_shards[i];
+        for(size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+            const uint64_t value = shard.buckets[bucket].load(memory_order_relaxed);
+            snapshot.buckets[bucket] += value;
+            snapshot.count += value;
+        }
+        snapshot.sum_ns += shard.sum_ns.load(memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+MetricsCounter& MetricsRegistry::Counter(const string& name, const string& help) {
+    lock_guard guard(m_mutex);
+    auto& entry = m_counters[name];
+    if(!entry.metric) {
+        entry = {help, make_unique<MetricsCounter>()};
+    }
+    return *entry.metric;
+}
+
+LatencyHistogram& MetricsRegistry::Histogram(const string& name, const string& help) {
+    lock_guard guard(m_mutex);
+    auto& entry = m_histograms[name];
+    if(!entry.metric) {
+        entry = {help, make_unique<LatencyHistogram>()};
+    }
+    return *entry.metric;
+}
+
+void MetricsRegistry::WriteText(ostream& output) const {
+#ifdef SEARCH_SERVER_NO_METRICS
+    output << "# metrics disabled (SEARCH_SERVER_NO_METRICS)\n";
+#endif
+
+    lock_guard guard(m_mutex);
+    for(const auto& [name, entry] : m_counters) {
+        output << "# HELP " << name << ' ' << entry.help << '\n'
+               << "# TYPE " << name << " counter\n"
+               << name << ' ' << entry.metric->Value() << '\n';
+    }
+
+    for(const auto& [name, entry] : m_histograms) {
+        const HistogramSnapshot snapshot = entry.metric->Collect();
+        output << "# HELP " << name << ' ' << entry.help << '\n'
+               << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for(size_t bucket = 0; bucket < snapshot.buckets.size(); ++bucket) {
+            if(snapshot.buckets[bucket] == 0) {
+                continue;
+            }
+            cumulative += snapshot.buckets[bucket];
+            output << name << "_bucket{le=\"" << LatencyHistogram::GetBucketUpperBound(bucket) << "\"} " << cumulative << '\n';
+        }
+        output << name << "_bucket{le=\"+Inf\"} " << snapshot.count << '\n'
+               << name << "_sum " << snapshot.sum_ns << '\n'
+               << name << "_count " << snapshot.count << '\n';
+    }
+}
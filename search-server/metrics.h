@@ -0,0 +1,203 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "log_duration.h"
+
+// метрики поискового сервера: именованные счетчики и гистограммы задержек
+//
+// запись не берет блокировок: у каждой метрики METRICS_SHARD_COUNT копий (шардов), выровненных
+// по линии кэша, поток пишет в свой шард атомарными операциями с memory_order_relaxed,
+// шарды складываются только при чтении (WriteText, Collect)
+//
+// сборка с -DSEARCH_SERVER_NO_METRICS (make NO_METRICS=1) убирает запись полностью:
+// методы записи и StageTimer становятся пустыми и не обращаются к часам
+
+// Defines the number of per-thread copies of each metric
+inline constexpr size_t METRICS_SHARD_COUNT = 8;
+
+// номер шарда текущего потока: потоки получают номера по кругу при первой записи
+size_t GetMetricsShard();
+
+// монотонный счетчик
+class MetricsCounter {
+public:
+    void Add(uint64_t value = 1);
+
+    // сумма по всем шардам
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, METRICS_SHARD_COUNT> m_shards;
+};
+
+// содержимое гистограммы на момент чтения
+struct HistogramSnapshot {
+    std::vector<uint64_t> buckets; // число значений в каждой корзине
+    uint64_t count = 0;            // всего значений
+    uint64_t sum_ns = 0;           // сумма значений, нс
+
+    // оценка квантили (0 <= quantile <= 1) по верхней границе корзины, нс
+    uint64_t Quantile(double quantile) const;
+};
+
+// гистограмма задержек с лог-линейными корзинами:
+// значения до 4 нс - по корзине на наносекунду, дальше каждый интервал [2^e, 2^(e+1))
+// делится на 4 равные корзины, то есть относительная ошибка не больше 25%
+class LatencyHistogram {
+public:
+    // Defines the number of sub-buckets in each power-of-two interval, log2
+    inline static constexpr int SUB_BUCKET_BITS = 2;
+    // Defines the total number of buckets, enough for any uint64_t value
+    inline static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    void Record(LogDuration::Clock::duration duration);
+    void RecordNanoseconds(uint64_t value_ns);
+
+    // сложение шардов
+    HistogramSnapshot Collect() const;
+
+    static size_t GetBucketIndex(uint64_t value_ns);
+    // наибольшее значение, попадающее в корзину, нс
+    static uint64_t GetBucketUpperBound(size_t bucket);
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+
+    // шарды в куче: гистограмма занимает десятки килобайт
+    std::unique_ptr<Shard[]> m_shards = std::make_unique<Shard[]>(METRICS_SHARD_COUNT);
+};
+
+// реестр метрик: регистрация по имени (под мьютексом, обычно при создании сервера),
+// запись - через возвращенные ссылки, которые остаются верными все время жизни реестра
+class MetricsRegistry {
+public:
+    MetricsCounter& Counter(const std::string& name, const std::string& help);
+    LatencyHistogram& Histogram(const std::string& name, const std::string& help);
+
+    // текстовый формат экспозиции Prometheus: счетчики как есть, гистограммы - накопленные
+    // корзины с верхней границей le в наносекундах (выводятся только непустые), _sum и _count
+    void WriteText(std::ostream& output) const;
+
+private:
+    template <typename Metric>
+    struct Entry {
+        std::string help;
+        std::unique_ptr<Metric> metric;
+    };
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Entry<MetricsCounter>> m_counters;
+    std::map<std::string, Entry<LatencyHistogram>> m_histograms;
+};
+
+// RAII-замер этапа: время от создания (или последнего Switch) до разрушения пишется в гистограмму
+class StageTimer {
+public:
+    explicit StageTimer(LatencyHistogram& histogram);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    // завершает текущий этап и начинает следующий
+    void Switch(LatencyHistogram& histogram);
+    // завершает текущий этап досрочно
+    void Stop();
+
+private:
+#ifndef SEARCH_SERVER_NO_METRICS
+    LatencyHistogram* m_histogram;
+    LogDuration::Clock::time_point m_start;
+#endif
+};
+
+inline void MetricsCounter::Add([[maybe_unused]] uint64_t value) {
+#ifndef SEARCH_SERVER_NO_METRICS
+    m_shards[GetMetricsShard()].value.fetch_add(value, std::memory_order_relaxed);
+#endif
+}
+
+inline size_t LatencyHistogram::GetBucketIndex(uint64_t value_ns) {
+    constexpr uint64_t SUB_BUCKET_COUNT = uint64_t(1) << SUB_BUCKET_BITS;
+    if(value_ns < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value_ns);
+    }
+    const int exponent = 63 - __builtin_clzll(value_ns);
+    const uint64_t sub_bucket = (value_ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+    return static_cast<size_t>(((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub_bucket);
+}
+
+inline void LatencyHistogram::RecordNanoseconds([[maybe_unused]] uint64_t value_ns) {
+#ifndef SEARCH_SERVER_NO_METRICS
+    Shard& shard = m_shards[GetMetricsShard()];
+    shard.buckets[GetBucketIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum_ns.fetch_add(value_ns, std::memory_order_relaxed);
+#endif
+}
+
+inline void LatencyHistogram::Record([[maybe_unused]] LogDuration::Clock::duration duration) {
+#ifndef SEARCH_SERVER_NO_METRICS
+    const auto value_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    RecordNanoseconds(value_ns > 0 ? static_cast<uint64_t>(value_ns) : 0);
+#endif
+}
+
+#ifndef SEARCH_SERVER_NO_METRICS
+
+inline StageTimer::StageTimer(LatencyHistogram& histogram)
+    : m_histogram(&histogram), m_start(LogDuration::Clock::now()) {
+}
+
+inline StageTimer::~StageTimer() {
+    Stop();
+}
+
+inline void StageTimer::Switch(LatencyHistogram& histogram) {
+    const auto now = LogDuration::Clock::now();
+    if(m_histogram) {
+        m_histogram->Record(now - m_start);
+    }
+    m_histogram = &histogram;
+    m_start = now;
+}
+
+inline void StageTimer::Stop() {
+    if(m_histogram) {
+        m_histogram->Record(LogDuration::Clock::now() - m_start);
+        m_histogram = nullptr;
+    }
+}
+
+#else
+
+inline StageTimer::StageTimer(LatencyHistogram&) {
+}
+
+inline StageTimer::~StageTimer() {
+}
+
+inline void StageTimer::Switch(LatencyHistogram&) {
+}
+
+inline void StageTimer::Stop() {
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include "near_duplicates.h"
+#include "sorted_intersection.h"
+
+NearDuplicateDetector::NearDuplicateDetector(const SearchServer& search_server, NearDuplicateOptions options) :
+    m_search_server(search_server), m_options(options) {
+    if(m_options.hash_count <= 0 || m_options.band_count <= 0 || m_options.hash_count % m_options.band_count != 0)
+        throw std::invalid_argument("hash_count must be a positive multiple of band_count");
+    if(m_options.bucket_window <= 0)
+        throw std::invalid_argument("bucket_window must be positive");
+
+    m_rows_per_band = m_options.hash_count / m_options.band_count;
+
+    // хеш-функции вида Mix(term * a + b) с нечетным множителем a
+    m_hash_seeds.resize(2 * m_options.hash_count);
+    uint64_t state = 0x243F6A8885A308D3ULL;
+    for(uint64_t& seed : m_hash_seeds) {
+        state += 0x9E3779B97F4A7C15ULL;
+        seed = MixFingerprintBits(state);
+    }
+    for(int i = 0; i < m_options.hash_count; ++i) {
+        m_hash_seeds[2 * i] |= 1;
+    }
+
+    Rebuild();
+}
+
+void NearDuplicateDetector::Rebuild() {
+    m_document_ids.assign(m_search_server.begin(), m_search_server.end());
+
+    const size_t document_count = m_document_ids.size();
+    if(document_count > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("Too many documents for NearDuplicateDetector");
+
+    m_bands.assign(m_options.band_count, std::vector<BandEntry>(document_count));
+
+    std::vector<uint32_t> indexes(document_count);
+    std::iota(indexes.begin(), indexes.end(), 0);
+
+    // сигнатуры считаются параллельно, каждый документ пишет только в свою ячейку каждой полосы
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+        [this](const uint32_t index) {
+            const auto band_keys = ComputeBandKeys(m_search_server.GetDocumentTermIds(m_document_ids[index]));
+            for(size_t band = 0; band < band_keys.size(); ++band) {
+                m_bands[band][index] = {band_keys[band], index};
+            }
+        });
+
+    // полосы независимы - сортируем их параллельно
+    std::for_each(std::execution::par, m_bands.begin(), m_bands.end(),
+        [](std::vector<BandEntry>& band) {
+            std::sort(band.begin(), band.end());
+        });
+}
+
+std::vector<std::pair<int, double>> NearDuplicateDetector::FindNearDuplicates(int document_id) const {
+    const auto band_keys = ComputeBandKeys(m_search_server.GetDocumentTermIds(document_id));
+
+    // кандидаты - документы, совпавшие с данным хотя бы в одной полосе
+    std::vector<uint32_t> candidates;
+    for(size_t band = 0; band < band_keys.size(); ++band) {
+        const auto& entries = m_bands[band];
+        auto it = std::lower_bound(entries.begin(), entries.end(), BandEntry{band_keys[band], 0});
+        for(; it != entries.end() && it->key == band_keys[band]; ++it) {
+            if(m_document_ids[it->index] != document_id) {
+                candidates.push_back(it->index);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // кандидатов проверяем точной мерой Жаккара
+    std::vector<std::pair<int, double>> result;
+    for(const uint32_t index : candidates) {
+        const double similarity = ComputeJaccard(document_id, m_document_ids[index]);
+        if(similarity >= m_options.jaccard_threshold) {
+            result.emplace_back(m_document_ids[index], similarity);
+        }
+    }
+
+    std::sort(result.begin(), result.end(),
+        [](const auto& lhs, const auto& rhs) {
+            return lhs.second > rhs.second || (lhs.second == rhs.second && lhs.first < rhs.first);
+        });
+
+    return result;
+}
+
+std::vector<std::vector<int>> NearDuplicateDetector::ClusterNearDuplicates() const {
+    // система непересекающихся множеств по порядковым номерам документов
+    std::vector<uint32_t> parents(m_document_ids.size());
+    std::iota(parents.begin(), parents.end(), 0);
+    const auto find_root = [&parents](uint32_t index) {
+        while(parents[index] != index) {
+            parents[index] = parents[parents[index]];
+            index = parents[index];
+        }
+        return index;
+    };
+    const auto is_similar_pair = [this](const std::pair<uint32_t, uint32_t>& candidate_pair) {
+        return static_cast<char>(ComputeJaccardByIndex(candidate_pair.first, candidate_pair.second) >= m_options.jaccard_threshold);
+    };
+
+    // корзины проверяются и объединяются по одной: каждый документ корзины сравнивается с bucket_window
+    // предыдущими документами корзины, поэтому в памяти не больше bucket_window пар на документ одной корзины,
+    // а не всех полос сразу. Пары, уже попавшие в одно множество, не проверяются
+    const size_t window = static_cast<size_t>(m_options.bucket_window);
+    std::vector<std::pair<uint32_t, uint32_t>> bucket_pairs;
+    std::vector<char> is_similar;
+    for(const auto& entries : m_bands) {
+        for(size_t begin = 0; begin < entries.size();) {
+            size_t end = begin + 1;
+            while(end < entries.size() && entries[end].key == entries[begin].key) {
+                ++end;
+            }
+            bucket_pairs.clear();
+            for(size_t current = begin + 1; current < end; ++current) {
+                for(size_t previous = current - std::min(window, current - begin); previous < current; ++previous) {
+                    if(find_root(entries[previous].index) != find_root(entries[current].index)) {
+                        bucket_pairs.emplace_back(entries[previous].index, entries[current].index);
+                    }
+                }
+            }
+            begin = end;
+
+            // проверка - самая дорогая часть: пары большой корзины проверяются параллельно
+            is_similar.resize(bucket_pairs.size());
+            if(bucket_pairs.size() >= MIN_PARALLEL_PAIRS) {
+                std::transform(std::execution::par, bucket_pairs.begin(), bucket_pairs.end(), is_similar.begin(), is_similar_pair);
+            } else {
+                std::transform(bucket_pairs.begin(), bucket_pairs.end(), is_similar.begin(), is_similar_pair);
+            }
+
+            for(size_t i = 0; i < bucket_pairs.size(); ++i) {
+                if(!is_similar[i]) {
+                    continue;
+                }
+                const uint32_t lhs = find_root(bucket_pairs[i].first);
+                const uint32_t rhs = find_root(bucket_pairs[i].second);
+                if(lhs != rhs) {
+                    // корнем остается документ с меньшим id
+                    parents[std::max(lhs, rhs)] = std::min(lhs, rhs);
+                }
+            }
+        }
+    }
+
+    // собираем кластеры: корень - наименьший порядковый номер, поэтому кластеры идут по возрастанию первого id
+    std::vector<std::vector<int>> clusters;
+    std::vector<int> root_to_cluster(m_document_ids.size(), -1);
+    std::vector<uint32_t> cluster_sizes(m_document_ids.size(), 0);
+    for(uint32_t index = 0; index < m_document_ids.size(); ++index) {
+        ++cluster_sizes[find_root(index)];
+    }
+    for(uint32_t index = 0; index < m_document_ids.size(); ++index) {
+        const uint32_t root = find_root(index);
+        if(cluster_sizes[root] < 2) {
+            continue;
+        }
+        if(root_to_cluster[root] < 0) {
+            root_to_cluster[root] = static_cast<int>(clusters.size());
+            clusters.emplace_back();
+        }
+        clusters[root_to_cluster[root]].push_back(m_document_ids[index]);
+    }
+
+    return clusters;
+}
+
+double NearDuplicateDetector::ComputeJaccard(int lhs_document_id, int rhs_document_id) const {
+    const auto& lhs = m_search_server.GetDocumentTermIds(lhs_document_id);
+    const auto& rhs = m_search_server.GetDocumentTermIds(rhs_document_id);
+
+    size_t common = 0;
+    ForEachCommon(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [&common](int) { ++common; });
+
+    const size_t united = lhs.size() + rhs.size() - common;
+    return united == 0 ? 1.0 : static_cast<double>(common) / united;
+}
+
+std::vector<uint64_t> NearDuplicateDetector::ComputeBandKeys(const SearchServer::TermIdList& term_ids) const {
+    std::vector<uint32_t> signature(m_options.hash_count, std::numeric_limits<uint32_t>::max());
+    for(const int term_id : term_ids) {
+        const uint64_t term = static_cast<uint32_t>(term_id);
+        for(int i = 0; i < m_options.hash_count; ++i) {
+            const auto hash = static_cast<uint32_t>(MixFingerprintBits(term * m_hash_seeds[2 * i] + m_hash_seeds[2 * i + 1]) >> 32);
+            signature[i] = std::min(signature[i], hash);
+        }
+    }
+
+    // ключ корзины - хеш строк сигнатуры, попавших в полосу
+    std::vector<uint64_t> band_keys(m_options.band_count);
+    for(int band = 0; band < m_options.band_count; ++band) {
+        uint64_t key = static_cast<uint64_t>(band) + 1;
+        for(int row = 0; row < m_rows_per_band; ++row) {
+            key = MixFingerprintBits(key ^ signature[band * m_rows_per_band + row]);
+        }
+        band_keys[band] = key;
+    }
+
+    return band_keys;
+}
+
+double NearDuplicateDetector::ComputeJaccardByIndex(uint32_t lhs, uint32_t rhs) const {
+    return ComputeJaccard(m_document_ids[lhs], m_document_ids[rhs]);
+}
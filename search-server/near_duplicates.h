@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "search_server.h"
+
+// параметры поиска почти-дубликатов
+struct NearDuplicateOptions {
+    int hash_count = 64;            // длина MinHash-сигнатуры
+    int band_count = 16;            // число LSH-полос, в полосе hash_count / band_count строк
+    double jaccard_threshold = 0.8; // минимальная мера Жаккара для почти-дубликатов
+    int bucket_window = 64;         // с каким числом предыдущих документов корзины сравнивается документ при кластеризации
+};
+
+// поиск почти-дубликатов по MinHash-сигнатурам множеств термов документов
+// детектор строится по снимку сервера: после изменения сервера нужно вызвать Rebuild()
+class NearDuplicateDetector {
+public:
+    explicit NearDuplicateDetector(const SearchServer& search_server, NearDuplicateOptions options = {});
+
+    // пересчитывает сигнатуры и LSH-корзины (параллельно)
+    void Rebuild();
+
+    // почти-дубликаты документа: пары (id, мера Жаккара) по убыванию похожести
+    std::vector<std::pair<int, double>> FindNearDuplicates(int document_id) const;
+
+    // разбиение на кластеры почти-дубликатов за один проход по корзинам
+    // возвращаются только кластеры из двух и более документов, id внутри кластера по возрастанию
+    std::vector<std::vector<int>> ClusterNearDuplicates() const;
+
+    // точная мера Жаккара множеств термов двух документов
+    double ComputeJaccard(int lhs_document_id, int rhs_document_id) const;
+
+private:
+    // с какого числа пар кандидатов корзина проверяется параллельно
+    inline static constexpr size_t MIN_PARALLEL_PAIRS = 256;
+
+    // элемент LSH-полосы: ключ корзины и порядковый номер документа
+    struct BandEntry {
+        uint64_t key;
+        uint32_t index;
+
+        bool operator<(const BandEntry& other) const {
+            return key < other.key || (key == other.key && index < other.index);
+        }
+    };
+
+    const SearchServer& m_search_server; // ссылка на сервер
+    NearDuplicateOptions m_options;      // параметры
+    int m_rows_per_band;                 // строк сигнатуры в одной полосе
+
+    std::vector<uint64_t> m_hash_seeds;  // по паре множитель/сдвиг на каждую хеш-функцию
+    std::vector<int> m_document_ids;     // отсортированные id документов, индекс - порядковый номер
+    // отсортированные по ключу записи для каждой полосы; корзина - отрезок с одинаковым ключом
+    std::vector<std::vector<BandEntry>> m_bands;
+
+    std::vector<uint64_t> ComputeBandKeys(const SearchServer::TermIdList& term_ids) const;
+    double ComputeJaccardByIndex(uint32_t lhs, uint32_t rhs) const;
+};
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <cassert>
-#include <vector>
+#include <algorithm>
+#include <cstddef>
 #include <iterator>
+#include <ostream>
 
 template <typename Iterator>
 class IteratorRange {
@@ -34,49 +36,92 @@ private:
 template <typename Iterator>
 class Paginator {
 public:
-    explicit Paginator() = default;
+    // итератор по страницам: границы очередной страницы вычисляются при переходе к ней,
+    // поэтому массив страниц заранее не строится
+    class PageIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        explicit PageIterator() = default;
+
+        explicit PageIterator(Iterator begin, Iterator end, int page_size) : m_it_end(end), m_page_size(page_size) {
+            SetPage(begin);
+        }
 
-    explicit Paginator(Iterator begin, Iterator end, int size) : m_it_begin(begin), m_it_end(end), m_page_size(size) {
-        // тут формируем массив m_vctRange на основе m_it_begin, m_it_end и размера страницы m_page_size
+        reference operator*() const {
+            return m_page;
+        }
 
-        // проверка, что начало "раньше" конца
-        assert(end >= begin);
-        // проверка, что размер страницы не ноль
-        assert(size != 0);
+        pointer operator->() const {
+            return &m_page;
+        }
 
-        // итератор на начало изначально указывает на начало
-        Iterator it_begin = m_it_begin;
+        PageIterator& operator++() {
+            SetPage(m_page.end());
+            return *this;
+        }
+
+        PageIterator operator++(int) {
+            PageIterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const PageIterator& other) const {
+            return m_page.begin() == other.m_page.begin();
+        }
+
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
 
-        // пока итераторы не встретятся
-        while(it_begin != m_it_end)
-        {
-            // новый итератор на конец - это старый итератор на начало
-            Iterator it_end = it_begin; 
+    private:
+        // конец всего диапазона
+        Iterator m_it_end;
+
+        // размер станицы
+        int m_page_size = 0;
+
+        // текущая страница
+        IteratorRange<Iterator> m_page;
+
+        void SetPage(Iterator it_begin) {
+            // новый итератор на конец - это итератор на начало
+            Iterator it_end = it_begin;
 
             // двигаем конечный итератор на то, что меньше: расстояние между самим итератором и концом диапазона
             // или размер страницы
             advance(it_end, std::min(static_cast<int>(distance(it_end, m_it_end)), m_page_size));
 
-            // формируем IteratorRange<Iterator> и кладем в вектор
-            IteratorRange<Iterator> it_range(it_begin, it_end);
-            m_vctRange.push_back(it_range);
-
-            // двигаем начальный итератор на то, что меньше: расстояние между самим итератором и концом диапазона
-            // или размер страницы
-            advance(it_begin, std::min(static_cast<int>(distance(it_begin, m_it_end)), m_page_size));
+            m_page = IteratorRange<Iterator>(it_begin, it_end);
         }
+    };
+
+    explicit Paginator() = default;
+
+    explicit Paginator(Iterator begin, Iterator end, int size) : m_it_begin(begin), m_it_end(end), m_page_size(size) {
+        // проверка, что начало "раньше" конца
+        assert(distance(begin, end) >= 0);
+        // проверка, что размер страницы не ноль
+        assert(size != 0);
     }
 
-    auto begin() const {
-        return m_vctRange.begin();
+    PageIterator begin() const {
+        return PageIterator(m_it_begin, m_it_end, m_page_size);
     }
 
-    auto end() const {
-        return m_vctRange.end();
+    PageIterator end() const {
+        return PageIterator(m_it_end, m_it_end, m_page_size);
     }
 
-    auto size() const {
-        return m_vctRange.size();
+    size_t size() const {
+        // число страниц с округлением вверх
+        const auto count = static_cast<size_t>(distance(m_it_begin, m_it_end));
+        return (count + m_page_size - 1) / m_page_size;
     }
 
 private:
@@ -87,10 +132,7 @@ private:
     Iterator m_it_end;
 
     // размер станицы
-    int m_page_size;
-
-    // вектор с классами итераторов
-    std::vector<IteratorRange<Iterator>> m_vctRange;
+    int m_page_size = 1;
 };
 
 // вывод IteratorRange
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "query_log.h"
+
+using namespace std;
+
+namespace {
+
+const char QUERY_LOG_MAGIC[] = {'S', 'Q', 'L', 'G'};
+const uint8_t QUERY_LOG_VERSION = 1;
+
+void WriteVarint(string& output, uint64_t value) {
+    while(value >= 0x80) {
+        output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+// zigzag: маленькие по модулю отрицательные числа кодируются так же коротко, как положительные
+void WriteSignedVarint(string& output, int64_t value) {
+    WriteVarint(output, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+class QueryLogReader {
+public:
+    explicit QueryLogReader(string_view data) : m_data(data) {
+    }
+
+    bool AtEnd() const {
+        return m_position == m_data.size();
+    }
+
+    uint8_t ReadByte() {
+        if(AtEnd()) {
+            throw runtime_error("Corrupted query log: unexpected end"s);
+        }
+        return static_cast<uint8_t>(m_data[m_position++]);
+    }
+
+    uint64_t ReadVarint() {
+        uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = ReadByte();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw runtime_error("Corrupted query log: varint too long"s);
+    }
+
+    int64_t ReadSignedVarint() {
+        const uint64_t value = ReadVarint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    string_view Take(size_t size) {
+        if(size > m_data.size() - m_position) {
+            throw runtime_error("Corrupted query log: query out of range"s);
+        }
+        const string_view result = m_data.substr(m_position, size);
+        m_position += size;
+        return result;
+    }
+
+private:
+    string_view m_data;
+    size_t m_position = 0;
+};
+
+} // namespace
+
+QueryLogWriter::QueryLogWriter(const string& path)
+    : m_path(path)
+    , m_created(Clock::now())
+    , m_file(path, ios::binary | ios::trunc) {
+    if(!m_file) {
+        throw runtime_error("Cannot open query log "s + path);
+    }
+    m_buffer.reserve(FLUSH_SIZE + 1024);
+    m_buffer.append(QUERY_LOG_MAGIC, sizeof(QUERY_LOG_MAGIC));
+    m_buffer.push_back(static_cast<char>(QUERY_LOG_VERSION));
+}
+
+QueryLogWriter::~QueryLogWriter() {
+    try {
+        Flush();
+    } catch(...) {
+        // деструктор не бросает: недописанный хвост журнала теряется
+    }
+}
+
+void QueryLogWriter::Append(string_view raw_query, QueryLogFilter filter, DocumentStatus status, Clock::time_point start, Clock::duration latency) {
+    const int64_t start_us = chrono::duration_cast<chrono::microseconds>(start - m_created).count();
+    const uint64_t latency_ns = static_cast<uint64_t>(max<int64_t>(chrono::duration_cast<chrono::nanoseconds>(latency).count(), 0));
+
+    unique_lock<mutex> buffer_guard(m_buffer_mutex);
+    WriteSignedVarint(m_buffer, start_us - m_last_start_us);
+    m_last_start_us = start_us;
+    WriteVarint(m_buffer, latency_ns);
+    m_buffer.push_back(static_cast<char>((static_cast<uint8_t>(filter) << 4) | static_cast<uint8_t>(status)));
+    WriteVarint(m_buffer, raw_query.size());
+    m_buffer.append(raw_query);
+    ++m_record_count;
+    if(m_buffer.size() < FLUSH_SIZE) {
+        return;
+    }
+
+    string chunk;
+    chunk.reserve(FLUSH_SIZE + 1024);
+    chunk.swap(m_buffer);
+    lock_guard<mutex> file_guard(m_file_mutex);
+    buffer_guard.unlock();
+    WriteChunk(chunk);
+}
+
+void QueryLogWriter::Flush() {
+    unique_lock<mutex> buffer_guard(m_buffer_mutex);
+    string chunk;
+    chunk.swap(m_buffer);
+    lock_guard<mutex> file_guard(m_file_mutex);
+    buffer_guard.unlock();
+    WriteChunk(chunk);
+    m_file.flush();
+}
+
+size_t QueryLogWriter::GetRecordCount() const {
+    lock_guard<mutex> guard(m_buffer_mutex);
+    return m_record_count;
+}
+
+void QueryLogWriter::WriteChunk(const string& chunk) {
+    m_file.write(chunk.data(), static_cast<streamsize>(chunk.size()));
+    if(!m_file) {
+        throw runtime_error("Cannot write query log "s + m_path);
+    }
+}
+
+vector<QueryLogRecord> ReadQueryLog(const string& path) {
+    ifstream input(path, ios::binary);
+    if(!input) {
+        throw runtime_error("Cannot open query log "s + path);
+    }
+    const string data((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+
+    QueryLogReader reader(data);
+    if(reader.Take(min(sizeof(QUERY_LOG_MAGIC), data.size())) != string_view(QUERY_LOG_MAGIC, sizeof(QUERY_LOG_MAGIC))) {
+        throw runtime_error("Not a query log: "s + path);
+    }
+    if(reader.ReadByte() != QUERY_LOG_VERSION) {
+        throw runtime_error("Unsupported query log version: "s + path);
+    }
+
+    vector<QueryLogRecord> records;
+    int64_t start_us = 0;
+    while(!reader.AtEnd()) {
+        QueryLogRecord record;
+        start_us += reader.ReadSignedVarint();
+        record.start_us = start_us;
+        record.latency_ns = reader.ReadVarint();
+        const uint8_t filter = reader.ReadByte();
+        if((filter >> 4) > static_cast<uint8_t>(QueryLogFilter::PREDICATE) || (filter & 0x0F) > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+            throw runtime_error("Corrupted query log: invalid filter"s);
+        }
+        record.filter = static_cast<QueryLogFilter>(filter >> 4);
+        record.status = static_cast<DocumentStatus>(filter & 0x0F);
+        record.raw_query = string(reader.Take(reader.ReadVarint()));
+        records.push_back(move(record));
+    }
+    return records;
+}
+
+QueryLogScope::QueryLogScope(QueryLogWriter* log, string_view raw_query, QueryLogFilter filter, DocumentStatus status)
+    : m_log(log)
+    , m_raw_query(raw_query)
+    , m_filter(filter)
+    , m_status(status) {
+    if(m_log) {
+        m_start = QueryLogWriter::Clock::now();
+    }
+}
+
+QueryLogScope::~QueryLogScope() {
+    if(!m_log) {
+        return;
+    }
+    try {
+        m_log->Append(m_raw_query, m_filter, m_status, m_start, QueryLogWriter::Clock::now() - m_start);
+    } catch(...) {
+        // ошибка журнала не должна ломать запрос
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+
+// двоичный журнал поисковых запросов для воспроизведения нагрузки (утилита query_replay)
+//
+// формат: заголовок "SQLG" и байт версии, затем записи подряд
+//   смещение времени начала запроса от предыдущей записи, мкс - varint со знаком (zigzag):
+//     записи пишутся по завершении запроса, поэтому время начала может идти не по возрастанию
+//   длительность запроса, нс - varint
+//   байт фильтра: вид фильтра в старших 4 битах, статус - в младших
+//   длина текста запроса - varint, затем сам текст
+// время первой записи отсчитывается от создания журнала
+
+// чем отбирались документы запроса
+enum class QueryLogFilter : uint8_t {
+    STATUS,    // по статусу
+    PREDICATE, // произвольным предикатом - сам предикат в журнал не попадает
+};
+
+struct QueryLogRecord {
+    int64_t start_us = 0;     // начало запроса от создания журнала
+    uint64_t latency_ns = 0;
+    QueryLogFilter filter = QueryLogFilter::STATUS;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::string raw_query;
+};
+
+// дописывает записи в файл; Append потокобезопасен
+// записи копятся в буфере и уходят в файл пакетами по FLUSH_SIZE байт: запросы ждут друг друга только
+// на время кодирования записи, запись в файл идет вне блокировки буфера
+class QueryLogWriter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    inline static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+    // файл path создается заново; не открылся - исключение runtime_error
+    explicit QueryLogWriter(const std::string& path);
+    // дописывает буфер
+    ~QueryLogWriter();
+
+    QueryLogWriter(const QueryLogWriter&) = delete;
+    QueryLogWriter& operator=(const QueryLogWriter&) = delete;
+
+    void Append(std::string_view raw_query, QueryLogFilter filter, DocumentStatus status, Clock::time_point start, Clock::duration latency);
+    // дописывает буфер в файл; ошибка записи - исключение runtime_error
+    void Flush();
+
+    size_t GetRecordCount() const;
+
+private:
+    // пишет chunk в файл; вызывается под m_file_mutex
+    void WriteChunk(const std::string& chunk);
+
+    std::string m_path;
+    Clock::time_point m_created;
+
+    mutable std::mutex m_buffer_mutex;
+    std::string m_buffer;
+    int64_t m_last_start_us = 0;
+    size_t m_record_count = 0;
+
+    // порядок пакетов в файле - порядок их отбора из буфера: блокировка файла берется до
+    // освобождения блокировки буфера, иначе смещения времени разошлись бы с порядком записей
+    std::mutex m_file_mutex;
+    std::ofstream m_file;
+};
+
+// записи журнала в порядке файла; испорченный файл - исключение runtime_error
+std::vector<QueryLogRecord> ReadQueryLog(const std::string& path);
+
+// замер запроса для журнала: запись при выходе из области видимости, в том числе по исключению
+// log == nullptr - журнал выключен, часы не читаются
+class QueryLogScope {
+public:
+    QueryLogScope(QueryLogWriter* log, std::string_view raw_query, DocumentStatus status)
+        : QueryLogScope(log, raw_query, QueryLogFilter::STATUS, status) {
+    }
+
+    template <typename DocumentPredicate>
+    QueryLogScope(QueryLogWriter* log, std::string_view raw_query, const DocumentPredicate&)
+        : QueryLogScope(log, raw_query, QueryLogFilter::PREDICATE, DocumentStatus::ACTUAL) {
+    }
+
+    ~QueryLogScope();
+
+    QueryLogScope(const QueryLogScope&) = delete;
+    QueryLogScope& operator=(const QueryLogScope&) = delete;
+
+private:
+    QueryLogScope(QueryLogWriter* log, std::string_view raw_query, QueryLogFilter filter, DocumentStatus status);
+
+    QueryLogWriter* m_log;
+    std::string_view m_raw_query;
+    QueryLogFilter m_filter;
+    DocumentStatus m_status;
+    QueryLogWriter::Clock::time_point m_start;
+};
@@ -0,0 +1,340 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "query_protocol.h"
+
+using namespace std;
+
+namespace protocol {
+
+namespace {
+
+// запись полей кадра в little-endian независимо от платформы
+class FrameWriter {
+public:
+    // резервирует место под длину кадра
+    explicit FrameWriter(string& buffer) : m_buffer(buffer), m_frame_start(buffer.size()) {
+        m_buffer.append(FRAME_HEADER_SIZE, '\0');
+    }
+
+    // дописывает длину нагрузки в заголовок
+    ~FrameWriter() {
+        const uint32_t payload_size = static_cast<uint32_t>(m_buffer.size() - m_frame_start - FRAME_HEADER_SIZE);
+        for(size_t i = 0; i < FRAME_HEADER_SIZE; ++i) {
+            m_buffer[m_frame_start + i] = static_cast<char>((payload_size >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void WriteUint8(uint8_t value) {
+        m_buffer.push_back(static_cast<char>(value));
+    }
+
+    void WriteUint32(uint32_t value) {
+        for(int i = 0; i < 4; ++i) {
+            m_buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    void WriteInt32(int value) {
+        WriteUint32(static_cast<uint32_t>(value));
+    }
+
+    void WriteDouble(double value) {
+        uint64_t bits = 0;
+        static_assert(sizeof(bits) == sizeof(value));
+        memcpy(&bits, &value, sizeof(bits));
+        WriteUint32(static_cast<uint32_t>(bits));
+        WriteUint32(static_cast<uint32_t>(bits >> 32));
+    }
+
+    void WriteString(string_view text) {
+        WriteUint32(static_cast<uint32_t>(text.size()));
+        m_buffer.append(text);
+    }
+
+private:
+    string& m_buffer;
+    size_t m_frame_start;
+};
+
+// чтение полей нагрузки кадра с проверкой границ
+class FrameReader {
+public:
+    explicit FrameReader(string_view payload) : m_payload(payload) {
+    }
+
+    uint8_t ReadUint8() {
+        return static_cast<uint8_t>(Take(1)[0]);
+    }
+
+    uint32_t ReadUint32() {
+        const string_view bytes = Take(4);
+        uint32_t value = 0;
+        for(int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    int ReadInt32() {
+        return static_cast<int>(ReadUint32());
+    }
+
+    double ReadDouble() {
+        const uint64_t low = ReadUint32();
+        const uint64_t bits = low | (static_cast<uint64_t>(ReadUint32()) << 32);
+        double value = 0.0;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    string_view ReadString() {
+        return Take(ReadUint32());
+    }
+
+    // число элементов списка; каждый элемент занимает не меньше element_size байт,
+    // поэтому испорченный счетчик не приводит к огромному резервированию
+    uint32_t ReadCount(size_t element_size) {
+        const uint32_t count = ReadUint32();
+        if(count > m_payload.size() / element_size) {
+            throw invalid_argument("Malformed frame: count exceeds frame size"s);
+        }
+        return count;
+    }
+
+    void ExpectEnd() const {
+        if(!m_payload.empty()) {
+            throw invalid_argument("Malformed frame: trailing bytes"s);
+        }
+    }
+
+private:
+    string_view Take(size_t size) {
+        if(size > m_payload.size()) {
+            throw invalid_argument("Malformed frame: unexpected end of frame"s);
+        }
+        const string_view bytes = m_payload.substr(0, size);
+        m_payload.remove_prefix(size);
+        return bytes;
+    }
+
+    string_view m_payload;
+};
+
+DocumentStatus ReadStatus(FrameReader& reader) {
+    const uint8_t status = reader.ReadUint8();
+    if(status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+        throw invalid_argument("Malformed frame: unknown document status"s);
+    }
+    return static_cast<DocumentStatus>(status);
+}
+
+// нагрузка кадра в начале буфера; пустая, если кадр пришел не целиком
+string_view FramePayload(string_view buffer) {
+    if(buffer.size() < FRAME_HEADER_SIZE) {
+        return {};
+    }
+    uint32_t payload_size = 0;
+    for(size_t i = 0; i < FRAME_HEADER_SIZE; ++i) {
+        payload_size |= static_cast<uint32_t>(static_cast<uint8_t>(buffer[i])) << (8 * i);
+    }
+    if(payload_size == 0 || payload_size > MAX_FRAME_SIZE) {
+        throw invalid_argument("Malformed frame: invalid frame size "s + to_string(payload_size));
+    }
+    if(buffer.size() < FRAME_HEADER_SIZE + payload_size) {
+        return {};
+    }
+    return buffer.substr(FRAME_HEADER_SIZE, payload_size);
+}
+
+} // namespace
+
+void AppendRequest(string& buffer, const Request& request) {
+    FrameWriter writer(buffer);
+    writer.WriteUint8(static_cast<uint8_t>(request.type));
+    writer.WriteUint32(request.request_id);
+    switch(request.type) {
+        case RequestType::SEARCH:
+            writer.WriteUint8(static_cast<uint8_t>(request.status));
+            writer.WriteString(request.text);
+            break;
+        case RequestType::MATCH:
+            writer.WriteInt32(request.document_id);
+            writer.WriteString(request.text);
+            break;
+        case RequestType::ADD:
+            writer.WriteInt32(request.document_id);
+            writer.WriteUint8(static_cast<uint8_t>(request.status));
+            writer.WriteUint32(static_cast<uint32_t>(request.ratings.size()));
+            for(const int rating : request.ratings) {
+                writer.WriteInt32(rating);
+            }
+            writer.WriteString(request.text);
+            break;
+        case RequestType::REMOVE:
+            writer.WriteInt32(request.document_id);
+            break;
+    }
+}
+
+void AppendResponse(string& buffer, const Response& response) {
+    FrameWriter writer(buffer);
+    writer.WriteUint32(response.request_id);
+    writer.WriteUint8(static_cast<uint8_t>(response.code));
+    if(response.code == ResponseCode::ERROR) {
+        writer.WriteString(response.error);
+        return;
+    }
+    switch(response.type) {
+        case RequestType::SEARCH:
+            writer.WriteUint32(static_cast<uint32_t>(response.documents.size()));
+            for(const Document& document : response.documents) {
+                writer.WriteInt32(document.id);
+                writer.WriteDouble(document.relevance);
+                writer.WriteInt32(document.rating);
+            }
+            break;
+        case RequestType::MATCH:
+            writer.WriteUint8(static_cast<uint8_t>(response.status));
+            writer.WriteUint32(static_cast<uint32_t>(response.words.size()));
+            for(const string& word : response.words) {
+                writer.WriteString(word);
+            }
+            break;
+        case RequestType::ADD:
+        case RequestType::REMOVE:
+            break;
+    }
+}
+
+size_t ParseRequest(string_view buffer, Request& request) {
+    const string_view payload = FramePayload(buffer);
+    if(payload.empty()) {
+        return 0;
+    }
+
+    FrameReader reader(payload);
+    const uint8_t type = reader.ReadUint8();
+    if(type < static_cast<uint8_t>(RequestType::SEARCH) || type > static_cast<uint8_t>(RequestType::REMOVE)) {
+        throw invalid_argument("Malformed frame: unknown request type "s + to_string(type));
+    }
+    // поля, которых нет в кадре этого типа, получают значения по умолчанию
+    request = Request{};
+    request.type = static_cast<RequestType>(type);
+    request.request_id = reader.ReadUint32();
+    switch(request.type) {
+        case RequestType::SEARCH:
+            request.status = ReadStatus(reader);
+            request.text = reader.ReadString();
+            break;
+        case RequestType::MATCH:
+            request.document_id = reader.ReadInt32();
+            request.text = reader.ReadString();
+            break;
+        case RequestType::ADD: {
+            request.document_id = reader.ReadInt32();
+            request.status = ReadStatus(reader);
+            const uint32_t rating_count = reader.ReadCount(sizeof(int32_t));
+            request.ratings.reserve(rating_count);
+            for(uint32_t i = 0; i < rating_count; ++i) {
+                request.ratings.push_back(reader.ReadInt32());
+            }
+            request.text = reader.ReadString();
+            break;
+        }
+        case RequestType::REMOVE:
+            request.document_id = reader.ReadInt32();
+            break;
+    }
+    reader.ExpectEnd();
+
+    return FRAME_HEADER_SIZE + payload.size();
+}
+
+size_t ParseResponse(string_view buffer, Response& response) {
+    const string_view payload = FramePayload(buffer);
+    if(payload.empty()) {
+        return 0;
+    }
+
+    FrameReader reader(payload);
+    response.request_id = reader.ReadUint32();
+    const uint8_t code = reader.ReadUint8();
+    if(code > static_cast<uint8_t>(ResponseCode::ERROR)) {
+        throw invalid_argument("Malformed frame: unknown response code "s + to_string(code));
+    }
+    response.code = static_cast<ResponseCode>(code);
+    response.documents.clear();
+    response.status = DocumentStatus::ACTUAL;
+    response.words.clear();
+    response.error.clear();
+    if(response.code == ResponseCode::ERROR) {
+        response.error = reader.ReadString();
+    } else {
+        switch(response.type) {
+            case RequestType::SEARCH: {
+                const uint32_t document_count = reader.ReadCount(2 * sizeof(int32_t) + sizeof(double));
+                response.documents.reserve(document_count);
+                for(uint32_t i = 0; i < document_count; ++i) {
+                    const int id = reader.ReadInt32();
+                    const double relevance = reader.ReadDouble();
+                    response.documents.emplace_back(id, relevance, reader.ReadInt32());
+                }
+                break;
+            }
+            case RequestType::MATCH: {
+                response.status = ReadStatus(reader);
+                const uint32_t word_count = reader.ReadCount(sizeof(uint32_t));
+                response.words.reserve(word_count);
+                for(uint32_t i = 0; i < word_count; ++i) {
+                    response.words.emplace_back(reader.ReadString());
+                }
+                break;
+            }
+            case RequestType::ADD:
+            case RequestType::REMOVE:
+                break;
+        }
+    }
+    reader.ExpectEnd();
+
+    return FRAME_HEADER_SIZE + payload.size();
+}
+
+Response ExecuteRequest(SearchServer& search_server, const Request& request) {
+    Response response;
+    response.type = request.type;
+    response.request_id = request.request_id;
+    try {
+        switch(request.type) {
+            case RequestType::SEARCH:
+                // способ выполнения выбирает планировщик по порогам сервера (по умолчанию - последовательный)
+                response.documents = search_server.FindTopDocuments(auto_execution, request.text, request.status);
+                break;
+            case RequestType::MATCH: {
+                const auto [words, status] = search_server.MatchDocument(request.text, request.document_id);
+                response.words.assign(words.begin(), words.end());
+                response.status = status;
+                break;
+            }
+            case RequestType::ADD:
+                search_server.AddDocument(request.document_id, request.text, request.status, request.ratings);
+                break;
+            case RequestType::REMOVE:
+                search_server.RemoveDocument(request.document_id);
+                break;
+        }
+    } catch(const exception& e) {
+        response.code = ResponseCode::ERROR;
+        response.error = e.what();
+        response.documents.clear();
+        response.words.clear();
+    }
+    return response;
+}
+
+bool IsWriteRequest(RequestType type) {
+    return type == RequestType::ADD || type == RequestType::REMOVE;
+}
+
+} // namespace protocol
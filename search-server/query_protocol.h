@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// двоичный протокол сетевого поискового сервера
+//
+// кадр: длина полезной нагрузки (uint32, little-endian), затем нагрузка
+// запрос:  тип (uint8), id запроса (uint32), поля типа
+//   SEARCH: статус (uint8), запрос (строка)
+//   MATCH:  id документа (int32), запрос (строка)
+//   ADD:    id документа (int32), статус (uint8), число рейтингов (uint32), рейтинги (int32), текст (строка)
+//   REMOVE: id документа (int32)
+// ответ:   id запроса (uint32), код (uint8), тело кода
+//   OK для SEARCH: число документов (uint32), документы: id (int32), релевантность (float64), рейтинг (int32)
+//   OK для MATCH:  статус (uint8), число слов (uint32), слова (строки)
+//   OK для ADD и REMOVE: пусто
+//   ERROR: сообщение (строка)
+// строка - длина (uint32) и байты
+//
+// на одном соединении можно отправлять запросы, не дожидаясь ответов;
+// ответы приходят в порядке выполнения и сопоставляются с запросами по id запроса
+namespace protocol {
+
+// максимальная длина нагрузки кадра; кадр длиннее - ошибка протокола
+inline constexpr uint32_t MAX_FRAME_SIZE = 64u << 20;
+inline constexpr size_t FRAME_HEADER_SIZE = sizeof(uint32_t);
+
+enum class RequestType : uint8_t {
+    SEARCH = 1,
+    MATCH = 2,
+    ADD = 3,
+    REMOVE = 4,
+};
+
+enum class ResponseCode : uint8_t {
+    OK = 0,
+    ERROR = 1,
+};
+
+struct Request {
+    RequestType type = RequestType::SEARCH;
+    uint32_t request_id = 0;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string text; // запрос для SEARCH и MATCH, текст документа для ADD
+};
+
+struct Response {
+    RequestType type = RequestType::SEARCH; // в кадр не пишется: тело разбирается по типу запроса
+    uint32_t request_id = 0;
+    ResponseCode code = ResponseCode::OK;
+    std::vector<Document> documents;  // SEARCH
+    DocumentStatus status = DocumentStatus::ACTUAL; // MATCH
+    std::vector<std::string> words;   // MATCH
+    std::string error;                // ERROR
+};
+
+// дописывают кадр в конец буфера
+void AppendRequest(std::string& buffer, const Request& request);
+void AppendResponse(std::string& buffer, const Response& response);
+
+// разбирают кадр в начале буфера; возвращают число прочитанных байт или 0, если кадр пришел не целиком
+// некорректный кадр - исключение std::invalid_argument
+size_t ParseRequest(std::string_view buffer, Request& request);
+// тип запроса берется из response.type
+size_t ParseResponse(std::string_view buffer, Response& response);
+
+// выполняет запрос; исключения сервера превращаются в ответ ERROR
+// синхронизацию запросов, изменяющих сервер, обеспечивает вызывающий
+Response ExecuteRequest(SearchServer& search_server, const Request& request);
+
+// изменяет ли запрос сервер
+bool IsWriteRequest(RequestType type);
+
+} // namespace protocol
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+// способ вычисления выдачи
+enum class QueryEvaluator {
+    EXHAUSTIVE,     // полный перебор всех постингов
+    MAX_SCORE,      // динамическое отсечение MaxScore по оценкам терма и блока
+    IMPACT_ORDERED, // обход сегментов по убыванию вклада с ранней остановкой
+    CONJUNCTIVE,    // пересечение списков обязательных слов (+слово) от самого короткого
+};
+
+// способ выполнения запроса по потокам
+enum class ExecutionStrategy {
+    SEQUENTIAL,                // один поток
+    EXHAUSTIVE_RANGE_PARALLEL, // диапазоны id документов обрабатываются параллельно, полный перебор в каждом
+    DOC_RANGE_PARALLEL,        // диапазоны id документов обрабатываются параллельно, MaxScore в каждом
+};
+
+// статистика выполнения одного запроса
+struct QueryStats {
+    QueryEvaluator evaluator = QueryEvaluator::EXHAUSTIVE;
+    ExecutionStrategy strategy = ExecutionStrategy::SEQUENTIAL;
+    size_t parallel_tasks = 1;     // число выполненных параллельных задач (диапазонов id)
+    size_t estimated_postings = 0; // оценка объема работы планировщиком (auto_execution)
+    size_t postings_scanned = 0;   // просмотрено постингов
+    size_t documents_scored = 0;   // документов, для которых считалась релевантность
+    size_t segments_processed = 0; // обработано сегментов (IMPACT_ORDERED)
+    size_t segments_total = 0;     // всего сегментов в списках запроса (IMPACT_ORDERED)
+    bool early_terminated = false; // вычисление остановлено до конца списков
+    size_t words_skipped = 0;      // плюс-слов с IDF ниже порога, не участвовавших в отборе (приближенный поиск)
+};
@@ -1,22 +1,34 @@
 #include <iostream>
-#include <string>
+#include <unordered_map>
 #include <vector>
-#include <set>
 
 #include "remove_duplicates.h"
 
 void RemoveDuplicates(SearchServer& search_server) {
-    // сложность O(wN(logN+logW))
+    // сложность O(N) в среднем: один проход по документам с хеш-таблицей отпечатков
 
     std::vector<int> document_for_erase;
-    std::set<std::set<std::string>> set_of_set_words;
+    // мапа: ключ - отпечаток, значение - id документов с попарно различными множествами слов
+    // больше одного id бывает только при коллизии отпечатков
+    std::unordered_map<DocumentFingerprint, std::vector<int>, DocumentFingerprintHasher> fingerprint_to_documents;
+    fingerprint_to_documents.reserve(search_server.GetDocumentCount());
 
     for(const int document_id : search_server) {
-        // ссылка на множество слов документа document_id
-        const auto& set_words = search_server.document_to_set_words.at(document_id);
-        if(0 == set_of_set_words.count(set_words)) {
+        auto& originals = fingerprint_to_documents[search_server.GetDocumentFingerprint(document_id)];
+
+        // отпечаток совпал - сверяем сами множества термов
+        const auto& term_ids = search_server.GetDocumentTermIds(document_id);
+        bool is_duplicate = false;
+        for(const int original_id : originals) {
+            if(search_server.GetDocumentTermIds(original_id) == term_ids) {
+                is_duplicate = true;
+                break;
+            }
+        }
+
+        if(!is_duplicate) {
             // если множество слов не существует - запоминаем его
-            set_of_set_words.insert(set_words);
+            originals.push_back(document_id);
         } else {
             // если такое множество слов уже существует, то помечаем документ к удалению
             document_for_erase.push_back(document_id);
@@ -25,7 +37,7 @@ void RemoveDuplicates(SearchServer& search_server) {
         }
     }
 
-    // собственно даление документов
+    // собственно удаление документов
     for(const int document_id : document_for_erase) {
         search_server.RemoveDocument(document_id);
     }
@@ -6,10 +6,9 @@ RequestQueue::RequestQueue(const SearchServer& search_server) : m_search_server(
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query, 
-        [status]
-        (int document_id, DocumentStatus document_status, int rating) 
-        {(void)document_id; (void)rating; return document_status == status;});
+    // статус передается серверу как есть: он обходит только постинги с этим статусом
+    // и записывает статус в журнал запросов
+    return AddFindRequest<DocumentStatus>(raw_query, status);
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
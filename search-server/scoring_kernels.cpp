@@ -0,0 +1,266 @@
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "scoring_kernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCORING_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+bool IsNoScore(double score) {
+    return signbit(score);
+}
+
+void AccumulateScoresScalar(const uint32_t* offsets, const double* freqs, size_t count, double inverse_document_freq, double* scores) {
+    for(size_t i = 0; i < count; ++i) {
+        scores[offsets[i]] += freqs[i] * inverse_document_freq;
+    }
+}
+
+void ApplyScoreMaskScalar(const uint64_t* mask, size_t count, double* scores) {
+    for(size_t i = 0; i < count; ++i) {
+        if(((mask[i / 64] >> (i % 64)) & 1) == 0) {
+            scores[i] = NO_SCORE;
+        }
+    }
+}
+
+size_t CompactScoresScalar(const double* scores, size_t count, uint32_t* offsets, double* compacted_scores) {
+    size_t compacted = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(!IsNoScore(scores[i])) {
+            offsets[compacted] = static_cast<uint32_t>(i);
+            compacted_scores[compacted] = scores[i];
+            ++compacted;
+        }
+    }
+    return compacted;
+}
+
+#ifdef SCORING_KERNELS_X86
+
+// AVX2 без scatter: суммы собираются gather и векторным сложением, сохраняются по одной
+__attribute__((target("avx2")))
+void AccumulateScoresAvx2(const uint32_t* offsets, const double* freqs, size_t count, double inverse_document_freq, double* scores) {
+    const __m256d idf = _mm256_set1_pd(inverse_document_freq);
+    const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(offsets + i));
+        // вариант с маской: у варианта без маски GCC 12 предупреждает о неинициализированном источнике
+        const __m256d gathered = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), scores, index, all_lanes, 8);
+        const __m256d sums = _mm256_add_pd(gathered, _mm256_mul_pd(_mm256_loadu_pd(freqs + i), idf));
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, sums);
+        scores[offsets[i]] = lanes[0];
+        scores[offsets[i + 1]] = lanes[1];
+        scores[offsets[i + 2]] = lanes[2];
+        scores[offsets[i + 3]] = lanes[3];
+    }
+    AccumulateScoresScalar(offsets + i, freqs + i, count - i, inverse_document_freq, scores);
+}
+
+__attribute__((target("avx2")))
+void ApplyScoreMaskAvx2(const uint64_t* mask, size_t count, double* scores) {
+    const __m256d no_score = _mm256_set1_pd(NO_SCORE);
+    const __m256i lane_bits = _mm256_setr_epi64x(1, 2, 4, 8);
+    size_t i = 0;
+    for(; i + 64 <= count; i += 64) {
+        const uint64_t word = mask[i / 64];
+        // целые слова маски - частый случай: в слове нет исключенных документов
+        if(word == ~uint64_t(0)) {
+            continue;
+        }
+        for(size_t j = 0; j < 64; j += 4) {
+            const __m256i bits = _mm256_and_si256(_mm256_set1_epi64x(static_cast<int64_t>(word >> j)), lane_bits);
+            const __m256d rejected = _mm256_castsi256_pd(_mm256_cmpeq_epi64(bits, _mm256_setzero_si256()));
+            _mm256_storeu_pd(scores + i + j, _mm256_blendv_pd(_mm256_loadu_pd(scores + i + j), no_score, rejected));
+        }
+    }
+    for(; i < count; ++i) {
+        if(((mask[i / 64] >> (i % 64)) & 1) == 0) {
+            scores[i] = NO_SCORE;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+size_t CompactScoresAvx2(const double* scores, size_t count, uint32_t* offsets, double* compacted_scores) {
+    size_t compacted = 0;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        // знаковые биты четырех оценок; все четыре документа не найдены - блок пропускается целиком
+        unsigned found = ~static_cast<unsigned>(_mm256_movemask_pd(_mm256_loadu_pd(scores + i))) & 0xF;
+        while(found != 0) {
+            const unsigned lane = static_cast<unsigned>(__builtin_ctz(found));
+            offsets[compacted] = static_cast<uint32_t>(i + lane);
+            compacted_scores[compacted] = scores[i + lane];
+            ++compacted;
+            found &= found - 1;
+        }
+    }
+    for(; i < count; ++i) {
+        if(!IsNoScore(scores[i])) {
+            offsets[compacted] = static_cast<uint32_t>(i);
+            compacted_scores[compacted] = scores[i];
+            ++compacted;
+        }
+    }
+    return compacted;
+}
+
+__attribute__((target("avx512f")))
+void AccumulateScoresAvx512(const uint32_t* offsets, const double* freqs, size_t count, double inverse_document_freq, double* scores) {
+    const __m512d idf = _mm512_set1_pd(inverse_document_freq);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i));
+        const __m512d sums = _mm512_add_pd(_mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, index, scores, 8), _mm512_mul_pd(_mm512_loadu_pd(freqs + i), idf));
+        _mm512_i32scatter_pd(scores, index, sums, 8);
+    }
+    AccumulateScoresScalar(offsets + i, freqs + i, count - i, inverse_document_freq, scores);
+}
+
+__attribute__((target("avx512f")))
+void ApplyScoreMaskAvx512(const uint64_t* mask, size_t count, double* scores) {
+    const __m512d no_score = _mm512_set1_pd(NO_SCORE);
+    size_t i = 0;
+    for(; i + 64 <= count; i += 64) {
+        const uint64_t word = mask[i / 64];
+        if(word == ~uint64_t(0)) {
+            continue;
+        }
+        for(size_t j = 0; j < 64; j += 8) {
+            const __mmask8 accepted = static_cast<__mmask8>(word >> j);
+            _mm512_storeu_pd(scores + i + j, _mm512_mask_mov_pd(no_score, accepted, _mm512_loadu_pd(scores + i + j)));
+        }
+    }
+    for(; i < count; ++i) {
+        if(((mask[i / 64] >> (i % 64)) & 1) == 0) {
+            scores[i] = NO_SCORE;
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+size_t CompactScoresAvx512(const double* scores, size_t count, uint32_t* offsets, double* compacted_scores) {
+    const __m512i sign_bit = _mm512_set1_epi64(static_cast<int64_t>(0x8000000000000000ull));
+    const __m512i lane_offsets = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t compacted = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        const __m512d block = _mm512_loadu_pd(scores + i);
+        const __mmask8 found = static_cast<__mmask8>(~_mm512_test_epi64_mask(_mm512_castpd_si512(block), sign_bit));
+        if(found == 0) {
+            continue;
+        }
+        // смещения - младшие 8 из 16 полей epi32: сжимаются той же маской, что и оценки
+        _mm512_mask_compressstoreu_epi32(offsets + compacted, static_cast<__mmask16>(found),
+            _mm512_add_epi32(lane_offsets, _mm512_set1_epi32(static_cast<int>(i))));
+        _mm512_mask_compressstoreu_pd(compacted_scores + compacted, found, block);
+        compacted += static_cast<size_t>(__builtin_popcount(found));
+    }
+    for(; i < count; ++i) {
+        if(!IsNoScore(scores[i])) {
+            offsets[compacted] = static_cast<uint32_t>(i);
+            compacted_scores[compacted] = scores[i];
+            ++compacted;
+        }
+    }
+    return compacted;
+}
+
+#endif
+
+ScoringKernelIsa DetectScoringKernelIsa() {
+#ifdef SCORING_KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        return ScoringKernelIsa::AVX512;
+    }
+    if(__builtin_cpu_supports("avx2")) {
+        return ScoringKernelIsa::AVX2;
+    }
+#endif
+    return ScoringKernelIsa::SCALAR;
+}
+
+atomic<ScoringKernelIsa>& GetActiveIsa() {
+    static atomic<ScoringKernelIsa> isa(GetBestScoringKernelIsa());
+    return isa;
+}
+
+} // namespace
+
+ScoringKernelIsa GetBestScoringKernelIsa() {
+    static const ScoringKernelIsa isa = DetectScoringKernelIsa();
+    return isa;
+}
+
+void SetScoringKernelIsa(ScoringKernelIsa isa) {
+    if(static_cast<int>(isa) > static_cast<int>(GetBestScoringKernelIsa())) {
+        throw invalid_argument("Scoring kernels "s + GetScoringKernelIsaName(isa) + " are not supported by this CPU"s);
+    }
+    GetActiveIsa().store(isa, memory_order_relaxed);
+}
+
+ScoringKernelIsa GetScoringKernelIsa() {
+    return GetActiveIsa().load(memory_order_relaxed);
+}
+
+const char* GetScoringKernelIsaName(ScoringKernelIsa isa) {
+    switch(isa) {
+    case ScoringKernelIsa::AVX2:
+        return "avx2";
+    case ScoringKernelIsa::AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+void AccumulateScores(const uint32_t* offsets, const double* freqs, size_t count, double inverse_document_freq, double* scores) {
+    switch(GetScoringKernelIsa()) {
+#ifdef SCORING_KERNELS_X86
+    case ScoringKernelIsa::AVX512:
+        return AccumulateScoresAvx512(offsets, freqs, count, inverse_document_freq, scores);
+    case ScoringKernelIsa::AVX2:
+        return AccumulateScoresAvx2(offsets, freqs, count, inverse_document_freq, scores);
+#endif
+    default:
+        return AccumulateScoresScalar(offsets, freqs, count, inverse_document_freq, scores);
+    }
+}
+
+void ApplyScoreMask(const uint64_t* mask, size_t count, double* scores) {
+    switch(GetScoringKernelIsa()) {
+#ifdef SCORING_KERNELS_X86
+    case ScoringKernelIsa::AVX512:
+        return ApplyScoreMaskAvx512(mask, count, scores);
+    case ScoringKernelIsa::AVX2:
+        return ApplyScoreMaskAvx2(mask, count, scores);
+#endif
+    default:
+        return ApplyScoreMaskScalar(mask, count, scores);
+    }
+}
+
+size_t CompactScores(const double* scores, size_t count, uint32_t* offsets, double* compacted_scores) {
+    switch(GetScoringKernelIsa()) {
+#ifdef SCORING_KERNELS_X86
+    case ScoringKernelIsa::AVX512:
+        return CompactScoresAvx512(scores, count, offsets, compacted_scores);
+    case ScoringKernelIsa::AVX2:
+        return CompactScoresAvx2(scores, count, offsets, compacted_scores);
+#endif
+    default:
+        return CompactScoresScalar(scores, count, offsets, compacted_scores);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ядра полного перебора по плотному массиву оценок: элемент i - документ с id first + i
+//
+// ненайденный документ - отрицательный ноль: -0.0 + x == x для любого x, в том числе +0.0, поэтому
+// документ, найденный только по слову с нулевым IDF, отличается от ненайденного, а оценка суммируется
+// теми же операциями и в том же порядке, что и в мапе (векторные ядра не используют FMA)
+//
+// векторные версии (AVX2, AVX-512) собираются атрибутами target без флагов компилятора для всего проекта;
+// версия выбирается при первом вызове по __builtin_cpu_supports, на других процессорах и компиляторах - скалярная
+
+// оценка ненайденного документа
+inline constexpr double NO_SCORE = -0.0;
+
+enum class ScoringKernelIsa {
+    SCALAR,
+    AVX2,
+    AVX512,
+};
+
+// лучший набор инструкций, который поддерживает процессор
+ScoringKernelIsa GetBestScoringKernelIsa();
+// набор инструкций ядер (по умолчанию - лучший); неподдерживаемый - исключение invalid_argument
+// для замеров и тестов; менять нельзя одновременно с поиском
+void SetScoringKernelIsa(ScoringKernelIsa isa);
+ScoringKernelIsa GetScoringKernelIsa();
+const char* GetScoringKernelIsaName(ScoringKernelIsa isa);
+
+// scores[offsets[i]] += freqs[i] * inverse_document_freq; смещения одного вызова различны
+// (постинги одного списка), поэтому AVX-512 сохраняет суммы scatter без конфликтов
+void AccumulateScores(const uint32_t* offsets, const double* freqs, size_t count, double inverse_document_freq, double* scores);
+
+// scores[i] = NO_SCORE, если бит i маски сброшен; маска - слова по 64 бита, бит i - бит i % 64 слова i / 64
+void ApplyScoreMask(const uint64_t* mask, size_t count, double* scores);
+
+// выписывает смещения и оценки найденных документов (знаковый бит оценки сброшен) по возрастанию смещения
+// в offsets и compacted_scores (не меньше count элементов), возвращает их число;
+// compacted_scores может совпадать со scores - запись не обгоняет чтение
+size_t CompactScores(const double* scores, size_t count, uint32_t* offsets, double* compacted_scores);
@@ -0,0 +1,70 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "search_cursor.h"
+#include "search_server.h"
+
+using namespace std;
+
+SearchCursor::SearchCursor(const Document& last_document) : m_is_start(false), m_last_document(last_document) {
+}
+
+string SearchCursor::ToToken() const {
+    if(m_is_start) {
+        return ""s;
+    }
+
+    uint64_t relevance_bits = 0;
+    static_assert(sizeof(relevance_bits) == sizeof(m_last_document.relevance));
+    memcpy(&relevance_bits, &m_last_document.relevance, sizeof(relevance_bits));
+
+    // формат: 16 hex-цифр релевантности, 8 - рейтинга, 8 - id
+    char buffer[3 * 16 + 1];
+    snprintf(buffer, sizeof(buffer), "%016llx%08x%08x",
+             static_cast<unsigned long long>(relevance_bits),
+             static_cast<uint32_t>(m_last_document.rating),
+             static_cast<uint32_t>(m_last_document.id));
+    return buffer;
+}
+
+SearchCursor SearchCursor::FromToken(string_view token) {
+    if(token.empty()) {
+        return SearchCursor();
+    }
+
+    if(token.size() != 32)
+        throw invalid_argument("Malformed search cursor token"s);
+
+    const auto parse_hex = [](string_view digits) {
+        uint64_t value = 0;
+        for(const char c : digits) {
+            value <<= 4;
+            if(c >= '0' && c <= '9') {
+                value |= static_cast<uint64_t>(c - '0');
+            } else if(c >= 'a' && c <= 'f') {
+                value |= static_cast<uint64_t>(c - 'a' + 10);
+            } else {
+                throw invalid_argument("Malformed search cursor token"s);
+            }
+        }
+        return value;
+    };
+
+    const uint64_t relevance_bits = parse_hex(token.substr(0, 16));
+    Document last_document;
+    memcpy(&last_document.relevance, &relevance_bits, sizeof(relevance_bits));
+    last_document.rating = static_cast<int>(static_cast<uint32_t>(parse_hex(token.substr(16, 8))));
+    last_document.id = static_cast<int>(static_cast<uint32_t>(parse_hex(token.substr(24, 8))));
+
+    return SearchCursor(last_document);
+}
+
+bool SearchCursor::IsStart() const {
+    return m_is_start;
+}
+
+bool SearchCursor::IsBefore(const Document& document) const {
+    return m_is_start || SearchServer::IsRankedBefore(m_last_document, document);
+}
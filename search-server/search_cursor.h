@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+
+// позиция в выдаче для постраничного поиска (search-after)
+// хранит ключ сортировки последнего выданного документа: релевантность, рейтинг, id
+// для клиента курсор непрозрачен и передается как строка-токен
+class SearchCursor {
+public:
+    // курсор на начало выдачи
+    SearchCursor() = default;
+
+    // курсор сразу после документа
+    explicit SearchCursor(const Document& last_document);
+
+    // токен переносит релевантность побитово, поэтому порядок страниц не зависит от округления
+    std::string ToToken() const;
+    static SearchCursor FromToken(std::string_view token);
+
+    bool IsStart() const;
+
+    // лежит ли документ в выдаче строго после курсора
+    bool IsBefore(const Document& document) const;
+
+private:
+    bool m_is_start = true; // курсор на начало выдачи
+    Document m_last_document; // последний выданный документ
+};
+
+// страница выдачи и курсор для запроса следующей страницы
+struct SearchPage {
+    std::vector<Document> documents;
+    SearchCursor next_cursor;
+    bool has_more = false; // есть ли документы после этой страницы
+};
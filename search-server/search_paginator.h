@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// ленивое постраничное чтение выдачи через курсоры:
+// следующая страница запрашивается у сервера только при переходе к ней
+class SearchPaginator {
+public:
+    using DocumentPredicate = std::function<bool(int, DocumentStatus, int)>;
+
+    class PageIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::vector<Document>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        // итератор-конец
+        explicit PageIterator() = default;
+
+        explicit PageIterator(const SearchPaginator* paginator) : m_paginator(paginator) {
+            Fetch(SearchCursor());
+        }
+
+        reference operator*() const {
+            return m_page.documents;
+        }
+
+        pointer operator->() const {
+            return &m_page.documents;
+        }
+
+        PageIterator& operator++() {
+            if(m_page.has_more) {
+                Fetch(m_page.next_cursor);
+            } else {
+                m_paginator = nullptr;
+            }
+            return *this;
+        }
+
+        // курсор, с которого можно продолжить чтение позже
+        const SearchCursor& GetNextCursor() const {
+            return m_page.next_cursor;
+        }
+
+        bool operator==(const PageIterator& other) const {
+            return m_paginator == other.m_paginator;
+        }
+
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const SearchPaginator* m_paginator = nullptr; // nullptr - итератор-конец
+        SearchPage m_page;                            // текущая страница
+
+        void Fetch(const SearchCursor& cursor) {
+            m_page = m_paginator->m_document_predicate
+                ? m_paginator->m_search_server.FindTopDocumentsAfter(m_paginator->m_raw_query, cursor, m_paginator->m_page_size, m_paginator->m_document_predicate)
+                : m_paginator->m_search_server.FindTopDocumentsAfter(m_paginator->m_raw_query, cursor, m_paginator->m_page_size, m_paginator->m_status);
+            if(m_page.documents.empty()) {
+                m_paginator = nullptr;
+            }
+        }
+    };
+
+    explicit SearchPaginator(const SearchServer& search_server, std::string raw_query, int page_size, DocumentPredicate document_predicate) :
+        m_search_server(search_server), m_raw_query(std::move(raw_query)), m_page_size(page_size), m_document_predicate(std::move(document_predicate)) {
+    }
+
+    // фильтр по статусу передается серверу как есть, без обертки в предикат
+    explicit SearchPaginator(const SearchServer& search_server, std::string raw_query, int page_size, DocumentStatus status) :
+        m_search_server(search_server), m_raw_query(std::move(raw_query)), m_page_size(page_size), m_status(status) {
+    }
+
+    PageIterator begin() const {
+        return PageIterator(this);
+    }
+
+    PageIterator end() const {
+        return PageIterator();
+    }
+
+private:
+    const SearchServer& m_search_server; // ссылка на сервер
+    std::string m_raw_query;             // запрос
+    int m_page_size;                     // размер страницы
+    DocumentPredicate m_document_predicate; // пустой - фильтр по m_status
+    DocumentStatus m_status = DocumentStatus::ACTUAL;
+};
+
+inline SearchPaginator Paginate(const SearchServer& search_server, std::string raw_query, int page_size, DocumentStatus status = DocumentStatus::ACTUAL) {
+    return SearchPaginator(search_server, std::move(raw_query), page_size, status);
+}
+
+inline SearchPaginator Paginate(const SearchServer& search_server, std::string raw_query, int page_size, SearchPaginator::DocumentPredicate document_predicate) {
+    return SearchPaginator(search_server, std::move(raw_query), page_size, std::move(document_predicate));
+}
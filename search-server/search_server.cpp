@@ -1,51 +1,114 @@
 #include <iostream>
+#include <chrono>
 #include <cmath>
 #include <numeric>
+#include <random>
 
 #include "search_server.h"
+#include "sorted_intersection.h"
 
 using namespace std;
 
+SearchServer::SearchServer(pmr::memory_resource* upstream)
+    : upstream_memory_(upstream ? upstream : pmr::new_delete_resource()) {
+}
+
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
+    StageTimer add_timer(metrics_.add_duration);
+    StageTimer stage(metrics_.add_validate);
+
     // Наличие спецсимволов — то есть символов с кодами в диапазоне от 0 до 31 включительно
-    if(!IsValidWord(document))
+    if(!IsValidWord(document)) {
+        metrics_.documents_rejected.Add();
         throw invalid_argument("Forbidden symbol is detected"s);
+    }
 
     // Попытка добавить документ с отрицательным id
-    if(document_id < 0)
+    if(document_id < 0) {
+        metrics_.documents_rejected.Add();
         throw invalid_argument("Id is negative"s);
+    }
 
     // Попытка добавить документ с id, совпадающим с id документа, который добавился ранее
-    if(documents_.count(document_id))
+    if(documents_.count(document_id)) {
+        metrics_.documents_rejected.Add();
         throw invalid_argument("Document already exists"s);
+    }
+
+    // слова разбираем прямо из аргумента: индексы ссылаются на словарь, а не на текст
+    stage.Switch(metrics_.add_tokenize);
+    const vector<string_view> words = SplitIntoWordsNoStop(document);
+
+    // проверка на дубликат до любых изменений индекса (ищет по словарю, поэтому относится к вставке)
+    stage.Switch(metrics_.add_insert);
+    int original_id = INVALID_DOCUMENT_ID;
+    if(duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        original_id = FindDuplicateDocument(words);
+        if(original_id != INVALID_DOCUMENT_ID && duplicate_policy_ == DuplicatePolicy::REJECT) {
+            metrics_.documents_rejected.Add();
+            throw invalid_argument("Document duplicates document "s + to_string(original_id));
+        }
+    }
+
+    // текст документа уходит в хранилище текстов, в DocumentData - только номер записи;
+    // запись в файл может бросить исключение, поэтому она идет до любых изменений индекса
+    const size_t text_record = text_store_ ? text_store_->Append(document) : TextStore::NO_RECORD;
+
+    if(original_id != INVALID_DOCUMENT_ID) {
+        flagged_duplicates_[document_id] = original_id;
+    }
+
+    ClearImpactIndex();
 
     // добавляем в множество id документа
     documents_id_.insert(document_id);
+    status_documents_[GetStatusIndex(status)].Set(document_id);
 
-    // в DocumentData теперь кладем и сам текст документа, во всех других местах будут ссылки на него
     // emplace вернет пару: итератор, bool
-    const auto [it, is_inserted] = documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, static_cast<string>(document)});
+    const auto [it, is_inserted] = documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, text_record, TermIdList(&forward_index_memory_), {}});
 
-    const vector<string_view> words = SplitIntoWordsNoStop(it->second.text);
+    TermIdList& term_ids = it->second.term_ids;
+    term_ids.reserve(words.size());
 
     const double inv_word_count = 1.0 / words.size();
     for(const string_view& word : words) {
-        // формируем мапу по слову
-        word_to_document_freqs_[word][document_id] += inv_word_count;
+        // все индексы ссылаются на слово из словаря, а не на текст документа
+        const int term_id = AddTerm(word);
+        const string_view term = id_to_term_[term_id];
+
+        // формируем мапу по слову: постинг кладем в раздел статуса документа
+        TermPostings& postings = word_to_document_freqs_[term];
+        if(AddPosting(postings.by_status[GetStatusIndex(status)], document_id, inv_word_count)) {
+            ++postings.document_count;
+        }
 
         // формируем мапу по id
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+        document_to_word_freqs_[document_id][term] += inv_word_count;
 
-        // формируем мапу с множеством по id
-        // document_to_set_words[document_id].insert(static_cast<string>(word));
+        term_ids.push_back(term_id);
     }
+
+    // оставляем только уникальные id термов
+    sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    term_ids.shrink_to_fit();
+
+    // отпечаток считается один раз и дальше используется для поиска дубликатов
+    it->second.fingerprint = ComputeDocumentFingerprint(term_ids);
+    if(duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        IndexFingerprint(document_id, it->second.fingerprint);
+    }
+
+    metrics_.documents_added.Add();
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, 
-        [status]
-        (int document_id, DocumentStatus document_status, int rating) 
-        {(void)document_id; (void)rating; return document_status == status; });
+    // статус передается как фильтр: обходятся только постинги документов с этим статусом
+    return FindTopDocuments<DocumentStatus>(raw_query, status);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status, QueryStats& stats) const {
+    return FindTopDocuments<DocumentStatus>(raw_query, status, stats);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) const {
@@ -53,10 +116,7 @@ vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) con
 }
 
 vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_policy&, const string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(execution::seq, raw_query, 
-        [status]
-        (int document_id, DocumentStatus document_status, int rating) 
-        {(void)document_id; (void)rating; return document_status == status; });
+    return FindTopDocuments<DocumentStatus>(execution::seq, raw_query, status);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_policy&, const string_view raw_query) const {
@@ -64,56 +124,643 @@ vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_polic
 }
 
 vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy&, const string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(execution::par, raw_query, 
-        [status]
-        (int document_id, DocumentStatus document_status, int rating) 
-        {(void)document_id; (void)rating; return document_status == status; });
+    return FindTopDocuments<DocumentStatus>(execution::par, raw_query, status);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy&, const string_view raw_query) const {
     return FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(const AutoExecutionPolicy&, const string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments<DocumentStatus>(auto_execution, raw_query, status);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const AutoExecutionPolicy&, const string_view raw_query) const {
+    return FindTopDocuments(auto_execution, raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const AutoExecutionPolicy&, const string_view raw_query, DocumentStatus status, QueryStats& stats) const {
+    return FindTopDocuments<DocumentStatus>(auto_execution, raw_query, status, stats);
+}
+
+void SearchServer::SetPlannerThresholds(const PlannerThresholds& thresholds) {
+    planner_thresholds_ = thresholds;
+}
+
+PlannerThresholds SearchServer::GetPlannerThresholds() const {
+    return planner_thresholds_;
+}
+
+PlannerThresholds SearchServer::CalibratePlannerThresholds() {
+    const size_t parallelism = thread::hardware_concurrency();
+    if(parallelism < 2) {
+        return {};
+    }
+
+    // синтетический индекс: каждое слово словаря встречается примерно в трети документов,
+    // запросы из 1-16 слов дают объем работы от тысячи до десятков тысяч постингов
+    const int document_count = 4096;
+    const int vocabulary_size = 16;
+    const int words_per_document = 6;
+    mt19937 generator(20240601);
+    uniform_int_distribution<int> word_distribution(0, vocabulary_size - 1);
+    SearchServer search_server;
+    for(int id = 0; id < document_count; ++id) {
+        string text;
+        for(int i = 0; i < words_per_document; ++i) {
+            text += "term"s + to_string(word_distribution(generator)) + " "s;
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    }
+
+    const int repetitions = 5;
+    const auto measure = [&search_server](const Query& query, const vector<double>& inverse_document_freqs, const QueryPlan& plan) {
+        double best_ns = numeric_limits<double>::max();
+        for(int i = 0; i < repetitions; ++i) {
+            const auto start = chrono::steady_clock::now();
+            search_server.FindTopDocumentsPlanned(query, inverse_document_freqs, DocumentStatus::ACTUAL, plan, nullptr);
+            best_ns = min(best_ns, static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()));
+        }
+        return best_ns;
+    };
+
+    vector<PlannerCalibrationSample> samples;
+    for(int word_count = 1; word_count <= vocabulary_size; word_count *= 2) {
+        string raw_query;
+        for(int i = 0; i < word_count; ++i) {
+            raw_query += "term"s + to_string(i) + " "s;
+        }
+        const Query query = search_server.ParseQuery(raw_query);
+        const vector<double> inverse_document_freqs = search_server.ComputeInverseDocumentFreqs(query);
+        const QueryWorkEstimate estimate = search_server.EstimateQueryWork(query, DocumentStatus::ACTUAL);
+
+        PlannerCalibrationSample sample;
+        sample.postings = estimate.postings;
+        sample.sequential_ns = measure(query, inverse_document_freqs, {});
+        sample.exhaustive_parallel_ns = measure(query, inverse_document_freqs, {ExecutionStrategy::EXHAUSTIVE_RANGE_PARALLEL, parallelism});
+        sample.range_parallel_ns = measure(query, inverse_document_freqs, {ExecutionStrategy::DOC_RANGE_PARALLEL, parallelism});
+        samples.push_back(sample);
+    }
+    PlannerThresholds thresholds = FitPlannerThresholds(samples, parallelism);
+    thresholds.parallelism = parallelism;
+    return thresholds;
+}
+
+SearchPage SearchServer::FindTopDocumentsAfter(const string_view raw_query, const SearchCursor& cursor, int page_size, DocumentStatus status) const {
+    return FindTopDocumentsAfter<DocumentStatus>(raw_query, cursor, page_size, status);
+}
+
+SearchPage SearchServer::FindTopDocumentsAfter(const string_view raw_query, const SearchCursor& cursor, int page_size) const {
+    return FindTopDocumentsAfter(raw_query, cursor, page_size, DocumentStatus::ACTUAL);
+}
+
+void SearchServer::BuildImpactIndex() {
+    if(has_impact_index_) {
+        return;
+    }
+
+    // списки независимы - сортируем их параллельно
+    vector<pair<const TermPostings*, ImpactTermPostings*>> jobs;
+    jobs.reserve(word_to_document_freqs_.size());
+    for(const auto& [word, postings] : word_to_document_freqs_) {
+        if(IsLiveTerm(postings)) {
+            jobs.emplace_back(&postings, &impact_index_[word]);
+        }
+    }
+
+    for_each(execution::par, jobs.begin(), jobs.end(),
+        [](const auto& job) {
+            for(size_t status = 0; status < STATUS_COUNT; ++status) {
+                const auto& freqs = job.first->by_status[status].freqs;
+                ImpactPostings& impact_postings = job.second->by_status[status];
+                impact_postings.assign(freqs.begin(), freqs.end());
+                // по убыванию частоты, при равной частоте - по возрастанию id
+                stable_sort(impact_postings.begin(), impact_postings.end(),
+                    [](const auto& lhs, const auto& rhs) { return lhs.second > rhs.second; });
+            }
+        });
+
+    has_impact_index_ = true;
+}
+
+bool SearchServer::HasImpactIndex() const {
+    return has_impact_index_;
+}
+
+void SearchServer::ClearImpactIndex() {
+    if(has_impact_index_) {
+        impact_index_.clear();
+        has_impact_index_ = false;
+    }
+}
+
+namespace {
+
+// порядок индекса вкладов: по убыванию частоты, при равной частоте - по возрастанию id
+bool IsHigherImpact(const pair<int, double>& lhs, const pair<int, double>& rhs) {
+    return lhs.second > rhs.second || (lhs.second == rhs.second && lhs.first < rhs.first);
+}
+
+} // namespace
+
+void SearchServer::AddImpactPosting(const string_view term, size_t status_index, int document_id, double term_freq) {
+    if(!has_impact_index_) {
+        return;
+    }
+    ImpactPostings& postings = impact_index_[term].by_status[status_index];
+    const pair<int, double> posting{document_id, term_freq};
+    postings.insert(lower_bound(postings.begin(), postings.end(), posting, IsHigherImpact), posting);
+}
+
+void SearchServer::RemoveImpactPosting(const string_view term, size_t status_index, int document_id, double term_freq) {
+    if(!has_impact_index_) {
+        return;
+    }
+    ImpactPostings& postings = impact_index_.at(term).by_status[status_index];
+    const auto it = lower_bound(postings.begin(), postings.end(), pair<int, double>{document_id, term_freq}, IsHigherImpact);
+    if(it != postings.end() && it->first == document_id) {
+        postings.erase(it);
+    }
+}
+
+Document SearchServer::ScoreCandidate(const Query& query, const vector<double>& inverse_document_freqs, int document_id) const {
+    const auto& word_freqs = document_to_word_freqs_.at(document_id);
+    double relevance = 0.0;
+    for(size_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto it = word_freqs.find(query.plus_words[i]);
+        if(it != word_freqs.end()) {
+            relevance += it->second * inverse_document_freqs[i];
+        }
+    }
+    return {document_id, relevance, documents_.at(document_id).rating};
+}
+
+vector<Document> SearchServer::ScoreCandidates(const Query& query, const vector<double>& inverse_document_freqs, const vector<int>& candidates) const {
+    vector<Document> result;
+    result.reserve(candidates.size());
+    for(const int document_id : candidates) {
+        result.push_back(ScoreCandidate(query, inverse_document_freqs, document_id));
+    }
+    return result;
+}
+
+vector<Document> SearchServer::RankCandidates(const Query& query, const vector<double>& inverse_document_freqs, const vector<int>& candidates) const {
+    vector<Document> result = ScoreCandidates(query, inverse_document_freqs, candidates);
+
+    sort(result.begin(), result.end(), IsRankedBefore);
+    if(result.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        result.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+
+    return result;
+}
+
+bool SearchServer::IsRankedBefore(const Document& lhs, const Document& rhs) {
+    if(abs(lhs.relevance - rhs.relevance) >= EPSILON_DOUBLE) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if(lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    // id делает порядок полным - без него курсор не смог бы различить документы с равным ключом
+    return lhs.id < rhs.id;
+}
+
 int SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
 
-set<int>::const_iterator SearchServer::begin() const {
+pmr::set<int>::const_iterator SearchServer::begin() const {
     // константная сложность
     return documents_id_.begin();
 }
 
-set<int>::const_iterator SearchServer::end() const {
+pmr::set<int>::const_iterator SearchServer::end() const {
     // константная сложность
     return documents_id_.end();
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
+const SearchServer::WordFrequencies& SearchServer::GetWordFrequencies(int document_id) const {
     // сложность O(logN)
 
     if(0 == document_to_word_freqs_.count(document_id)) {
         // результат объявляем как статик иначе вернем ссылку на локальный объект
-        static const map<string_view, double> res;
+        static const WordFrequencies res;
         // возвращаем пустой результат
         return res;
     }
     return document_to_word_freqs_.at(document_id);
 }
 
+const SearchServer::TermIdList& SearchServer::GetDocumentTermIds(int document_id) const {
+    return documents_.at(document_id).term_ids;
+}
+
+DocumentFingerprint SearchServer::GetDocumentFingerprint(int document_id) const {
+    return documents_.at(document_id).fingerprint;
+}
+
+void SearchServer::SetDuplicatePolicy(DuplicatePolicy policy) {
+    if(policy == duplicate_policy_) {
+        return;
+    }
+
+    // индекс отпечатков строится при включении проверки и освобождается при выключении
+    fingerprint_to_documents_.clear();
+    if(policy != DuplicatePolicy::ALLOW) {
+        fingerprint_to_documents_.reserve(documents_.size());
+        for(const auto& [document_id, document_data] : documents_) {
+            IndexFingerprint(document_id, document_data.fingerprint);
+        }
+    }
+
+    duplicate_policy_ = policy;
+}
+
+DuplicatePolicy SearchServer::GetDuplicatePolicy() const {
+    return duplicate_policy_;
+}
+
+void SearchServer::SetTypoTolerance(int max_edit_distance) {
+    if(max_edit_distance < 0 || max_edit_distance > MAX_TYPO_EDIT_DISTANCE) {
+        throw invalid_argument("Typo tolerance must be between 0 and "s + to_string(MAX_TYPO_EDIT_DISTANCE));
+    }
+    if(max_edit_distance == 0) {
+        typo_lexicon_.Clear();
+    } else if(typo_tolerance_ == 0) {
+        typo_lexicon_.Assign(term_to_id_.begin(), term_to_id_.end());
+    }
+    typo_tolerance_ = max_edit_distance;
+}
+
+int SearchServer::GetTypoTolerance() const {
+    return typo_tolerance_;
+}
+
+void SearchServer::SetApproximateIdfThreshold(double threshold) {
+    if(!(threshold >= 0.0)) {
+        throw invalid_argument("Approximate IDF threshold must be non-negative"s);
+    }
+    approximate_idf_threshold_ = threshold;
+}
+
+double SearchServer::GetApproximateIdfThreshold() const {
+    return approximate_idf_threshold_;
+}
+
+string SearchServer::GetDocumentText(int document_id) const {
+    const DocumentData& document_data = documents_.at(document_id);
+    if(!text_store_) {
+        throw logic_error("Document texts are not stored"s);
+    }
+    return text_store_->Get(document_data.text_record);
+}
+
+void SearchServer::SetTextStorage(TextStorage storage, const string& path) {
+    if(!documents_.empty()) {
+        throw logic_error("Text storage can be changed only while the server is empty"s);
+    }
+    // старое хранилище разрушается до создания нового: файл может быть тем же
+    text_store_.reset();
+    switch(storage) {
+        case TextStorage::NONE:
+            break;
+        case TextStorage::MEMORY:
+            text_store_ = make_unique<TextStore>(&text_memory_);
+            break;
+        case TextStorage::FILE:
+            text_store_ = make_unique<TextStore>(path, &text_memory_);
+            break;
+    }
+    text_storage_ = storage;
+}
+
+TextStorage SearchServer::GetTextStorage() const {
+    return text_storage_;
+}
+
+TextStoreStats SearchServer::GetTextStoreStats() const {
+    return text_store_ ? text_store_->GetStats() : TextStoreStats{};
+}
+
+SearchServer::Metrics::Metrics()
+    : queries(registry.Counter("search_server_queries_total"s, "Search queries completed"s))
+    , documents_returned(registry.Counter("search_server_documents_returned_total"s, "Documents returned by search queries"s))
+    , query_words_skipped(registry.Counter("search_server_query_words_skipped_total"s, "Low-IDF plus words skipped by approximate search"s))
+    , query_duration(registry.Histogram("search_server_query_duration_ns"s, "Search query latency, ns"s))
+    , query_parse(registry.Histogram("search_server_query_parse_ns"s, "Query parsing stage, ns"s))
+    , query_score(registry.Histogram("search_server_query_score_ns"s, "Relevance scoring stage, ns"s))
+    , query_filter(registry.Histogram("search_server_query_filter_ns"s, "Minus-word filtering stage, ns"s))
+    , query_sort(registry.Histogram("search_server_query_sort_ns"s, "Ranking and truncation stage, ns"s))
+    , documents_added(registry.Counter("search_server_documents_added_total"s, "Documents added"s))
+    , documents_rejected(registry.Counter("search_server_documents_rejected_total"s, "Documents rejected by AddDocument"s))
+    , documents_removed(registry.Counter("search_server_documents_removed_total"s, "Documents removed"s))
+    , documents_updated(registry.Counter("search_server_documents_updated_total"s, "Documents updated in place"s))
+    , text_store_compaction_failures(registry.Counter("search_server_text_store_compaction_failures_total"s, "Failed document text store compactions"s))
+    , add_duration(registry.Histogram("search_server_add_document_duration_ns"s, "AddDocument latency, ns"s))
+    , add_validate(registry.Histogram("search_server_add_validate_ns"s, "Document validation stage, ns"s))
+    , add_tokenize(registry.Histogram("search_server_add_tokenize_ns"s, "Document tokenization stage, ns"s))
+    , add_insert(registry.Histogram("search_server_add_insert_ns"s, "Index insertion stage, ns"s))
+    , remove_duration(registry.Histogram("search_server_remove_document_duration_ns"s, "RemoveDocument latency, ns"s)) {
+}
+
+void SearchServer::WriteMetrics(ostream& output) const {
+    metrics_.registry.WriteText(output);
+}
+
+void SearchServer::SetQueryLog(QueryLogWriter* query_log) {
+    query_log_ = query_log;
+}
+
+const pmr::map<int, int>& SearchServer::GetFlaggedDuplicates() const {
+    return flagged_duplicates_;
+}
+
+MemoryStats SearchServer::GetMemoryStats() const {
+    MemoryStats stats;
+    stats.document_text = text_memory_.GetUsage();
+    stats.inverted_index = inverted_index_memory_.GetUsage();
+    stats.forward_index = forward_index_memory_.GetUsage();
+    stats.document_metadata = metadata_memory_.GetUsage();
+    stats.dictionary = dictionary_memory_.GetUsage();
+    stats.stop_words = stop_words_memory_.GetUsage();
+    stats.auxiliary = auxiliary_memory_.GetUsage();
+
+    for(const auto& [_, postings] : word_to_document_freqs_) {
+        (void)_;
+        if(IsLiveTerm(postings)) {
+            AddToLengthHistogram(stats.posting_lengths, postings.document_count);
+        }
+    }
+    for(const auto& [_, document_data] : documents_) {
+        (void)_;
+        AddToLengthHistogram(stats.document_lengths, document_data.term_ids.size());
+    }
+
+    return stats;
+}
+
+int SearchServer::FindDuplicateDocument(const vector<string_view>& words, int ignored_document_id) const {
+    TermIdList term_ids;
+    term_ids.reserve(words.size());
+    for(const string_view word : words) {
+        const int term_id = FindTermId(word);
+        // нового слова нет ни в одном документе - значит дубликата нет
+        if(term_id == INVALID_TERM_ID) {
+            return INVALID_DOCUMENT_ID;
+        }
+        term_ids.push_back(term_id);
+    }
+    sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+
+    const auto it = fingerprint_to_documents_.find(ComputeDocumentFingerprint(term_ids));
+    if(it == fingerprint_to_documents_.end()) {
+        return INVALID_DOCUMENT_ID;
+    }
+
+    // отпечаток совпал - проверяем, что это не коллизия
+    for(const int document_id : it->second) {
+        if(document_id != ignored_document_id && documents_.at(document_id).term_ids == term_ids) {
+            return document_id;
+        }
+    }
+    return INVALID_DOCUMENT_ID;
+}
+
+void SearchServer::RecheckDuplicatesOf(int document_id) {
+    const TermIdList& term_ids = documents_.at(document_id).term_ids;
+    // дубликаты обходятся по возрастанию id; еще не проверенный дубликат (все еще ссылается на document_id)
+    // оригиналом не выбирается - иначе два бывших дубликата могли бы указать друг на друга
+    for(auto it = flagged_duplicates_.begin(); it != flagged_duplicates_.end();) {
+        if(it->second != document_id) {
+            ++it;
+            continue;
+        }
+        const DocumentData& duplicate = documents_.at(it->first);
+        if(duplicate.term_ids == term_ids) {
+            ++it;
+            continue;
+        }
+
+        int original_id = INVALID_DOCUMENT_ID;
+        const auto bucket_it = duplicate_policy_ != DuplicatePolicy::ALLOW
+            ? fingerprint_to_documents_.find(duplicate.fingerprint) : fingerprint_to_documents_.end();
+        if(bucket_it != fingerprint_to_documents_.end()) {
+            for(const int candidate_id : bucket_it->second) {
+                const auto candidate_flag = flagged_duplicates_.find(candidate_id);
+                if(candidate_id != it->first && documents_.at(candidate_id).term_ids == duplicate.term_ids
+                    && (candidate_flag == flagged_duplicates_.end() || candidate_flag->second != document_id)) {
+                    original_id = candidate_id;
+                    break;
+                }
+            }
+        }
+        if(original_id == INVALID_DOCUMENT_ID) {
+            it = flagged_duplicates_.erase(it);
+        } else {
+            it->second = original_id;
+            ++it;
+        }
+    }
+}
+
+void SearchServer::CompactTextStore() {
+    if(!text_store_) {
+        return;
+    }
+    try {
+        text_store_->CompactIfSparse();
+    } catch(const exception&) {
+        // мертвые тексты остаются до следующей попытки уплотнения
+        metrics_.text_store_compaction_failures.Add();
+    }
+}
+
+void SearchServer::IndexFingerprint(int document_id, const DocumentFingerprint& fingerprint) {
+    fingerprint_to_documents_[fingerprint].push_back(document_id);
+}
+
+void SearchServer::UnindexFingerprint(int document_id) {
+    const auto it = fingerprint_to_documents_.find(documents_.at(document_id).fingerprint);
+    if(it == fingerprint_to_documents_.end()) {
+        return;
+    }
+    auto& ids = it->second;
+    ids.erase(remove(ids.begin(), ids.end(), document_id), ids.end());
+    if(ids.empty()) {
+        fingerprint_to_documents_.erase(it);
+    }
+}
+
 void SearchServer::RemoveDocument(int document_id) {
     // есть ли такой документ?
     if(!documents_id_.count(document_id)) {
         return;
     }
+    StageTimer remove_timer(metrics_.remove_duration);
 
-    for_each(word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
-        [this, document_id](auto& it) {
-            it.second.erase(document_id);
-        });
+    // сложность O(w*logW): обходим только слова самого документа
+    const size_t status_index = GetStatusIndex(documents_.at(document_id).status);
+    for(const auto& [word, _] : GetWordFrequencies(document_id)) {
+        (void)_;
+        TermPostings& postings = word_to_document_freqs_.at(word);
+        postings.document_count -= RemovePosting(postings.by_status[status_index], document_id);
+    }
+
+    ClearImpactIndex();
+    if(duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        UnindexFingerprint(document_id);
+    }
+    flagged_duplicates_.erase(document_id);
+    status_documents_[status_index].Reset(document_id);
 
+    if(text_store_) {
+        text_store_->Release(documents_.at(document_id).text_record);
+    }
     documents_.erase(document_id);
     documents_id_.erase(document_id);
     document_to_word_freqs_.erase(document_id);
+
+    metrics_.documents_removed.Add();
+
+    // уплотнение идет после того, как документ удален целиком
+    CompactTextStore();
+}
+
+void SearchServer::UpdateDocumentStatus(int document_id, DocumentStatus status) {
+    const auto document_it = documents_.find(document_id);
+    if(document_it == documents_.end()) {
+        throw out_of_range("Document does not exist"s);
+    }
+    const size_t old_status_index = GetStatusIndex(document_it->second.status);
+    const size_t new_status_index = GetStatusIndex(status);
+    if(old_status_index == new_status_index) {
+        return;
+    }
+
+    // число документов со словом не меняется: постинг переходит из раздела в раздел того же списка
+    for(const auto& [word, term_freq] : GetWordFrequencies(document_id)) {
+        TermPostings& postings = word_to_document_freqs_.at(word);
+        RemovePosting(postings.by_status[old_status_index], document_id);
+        AddPosting(postings.by_status[new_status_index], document_id, term_freq);
+        RemoveImpactPosting(word, old_status_index, document_id, term_freq);
+        AddImpactPosting(word, new_status_index, document_id, term_freq);
+    }
+    status_documents_[old_status_index].Reset(document_id);
+    status_documents_[new_status_index].Set(document_id);
+    document_it->second.status = status;
+
+    metrics_.documents_updated.Add();
+}
+
+void SearchServer::UpdateDocumentRating(int document_id, const vector<int>& ratings) {
+    const auto document_it = documents_.find(document_id);
+    if(document_it == documents_.end()) {
+        throw out_of_range("Document does not exist"s);
+    }
+    document_it->second.rating = ComputeAverageRating(ratings);
+
+    metrics_.documents_updated.Add();
+}
+
+void SearchServer::UpdateDocument(int document_id, const string_view document) {
+    const auto document_it = documents_.find(document_id);
+    if(document_it == documents_.end()) {
+        throw out_of_range("Document does not exist"s);
+    }
+    if(!IsValidWord(document)) {
+        throw invalid_argument("Forbidden symbol is detected"s);
+    }
+    const vector<string_view> words = SplitIntoWordsNoStop(document);
+
+    // проверка на дубликат до любых изменений индекса
+    int original_id = INVALID_DOCUMENT_ID;
+    if(duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        original_id = FindDuplicateDocument(words, document_id);
+        if(original_id != INVALID_DOCUMENT_ID && duplicate_policy_ == DuplicatePolicy::REJECT) {
+            throw invalid_argument("Document duplicates document "s + to_string(original_id));
+        }
+    }
+
+    // запись текста может бросить исключение, поэтому идет до любых изменений индекса
+    if(text_store_) {
+        text_store_->Replace(document_it->second.text_record, document);
+    }
+
+    // частоты нового текста накапливаются так же, как в AddDocument, поэтому частота
+    // не изменившегося терма совпадает со старой точно
+    map<string_view, double> new_word_freqs;
+    const double inv_word_count = 1.0 / words.size();
+    for(const string_view& word : words) {
+        new_word_freqs[word] += inv_word_count;
+    }
+
+    // слияние старых и новых термов: обе мапы упорядочены по слову
+    const size_t status_index = GetStatusIndex(document_it->second.status);
+    WordFrequencies& word_freqs = document_to_word_freqs_[document_id];
+    auto old_it = word_freqs.begin();
+    auto new_it = new_word_freqs.begin();
+    while(old_it != word_freqs.end() || new_it != new_word_freqs.end()) {
+        if(new_it == new_word_freqs.end() || (old_it != word_freqs.end() && old_it->first < new_it->first)) {
+            // терм выпал из документа
+            TermPostings& postings = word_to_document_freqs_.at(old_it->first);
+            postings.document_count -= RemovePosting(postings.by_status[status_index], document_id);
+            RemoveImpactPosting(old_it->first, status_index, document_id, old_it->second);
+            old_it = word_freqs.erase(old_it);
+        } else if(old_it == word_freqs.end() || new_it->first < old_it->first) {
+            // новый терм: как в AddDocument, индексы ссылаются на слово из словаря
+            const string_view term = id_to_term_[AddTerm(new_it->first)];
+            TermPostings& postings = word_to_document_freqs_[term];
+            if(AddPosting(postings.by_status[status_index], document_id, new_it->second)) {
+                ++postings.document_count;
+            }
+            AddImpactPosting(term, status_index, document_id, new_it->second);
+            word_freqs.emplace_hint(old_it, term, new_it->second);
+            ++new_it;
+        } else {
+            if(old_it->second != new_it->second) {
+                SetPostingFreq(word_to_document_freqs_.at(old_it->first).by_status[status_index], document_id, new_it->second);
+                RemoveImpactPosting(old_it->first, status_index, document_id, old_it->second);
+                AddImpactPosting(old_it->first, status_index, document_id, new_it->second);
+                old_it->second = new_it->second;
+            }
+            ++old_it;
+            ++new_it;
+        }
+    }
+    // как в AddDocument: у документа без слов нет записи в прямом индексе
+    if(word_freqs.empty()) {
+        document_to_word_freqs_.erase(document_id);
+    }
+
+    DocumentData& document_data = document_it->second;
+    TermIdList& term_ids = document_data.term_ids;
+    term_ids.clear();
+    for(const auto& [term, _] : word_freqs) {
+        (void)_;
+        term_ids.push_back(FindTermId(term));
+    }
+    sort(term_ids.begin(), term_ids.end());
+    term_ids.shrink_to_fit();
+
+    if(duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        UnindexFingerprint(document_id);
+    }
+    document_data.fingerprint = ComputeDocumentFingerprint(term_ids);
+    if(duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        IndexFingerprint(document_id, document_data.fingerprint);
+    }
+    flagged_duplicates_.erase(document_id);
+    if(original_id != INVALID_DOCUMENT_ID) {
+        flagged_duplicates_[document_id] = original_id;
+    }
+    RecheckDuplicatesOf(document_id);
+
+    metrics_.documents_updated.Add();
+
+    // уплотнение идет после того, как индекс обновлен целиком
+    CompactTextStore();
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
@@ -125,9 +772,10 @@ void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int do
     if(!documents_id_.count(document_id)) {
         return;
     }
+    StageTimer remove_timer(metrics_.remove_duration);
 
     // ссылка на мапу
-    const auto& map_word_freq = document_to_word_freqs_.at(document_id);
+    const auto& map_word_freq = GetWordFrequencies(document_id);
     
     // вспомогательный вектор слов
     std::vector<std::string_view> vct_words(map_word_freq.size());
@@ -139,78 +787,160 @@ void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int do
         });
 
     // удаляем документ с document_id из всех приватных структур
+    // у каждого слова свои постинги, поэтому потоки не пересекаются
+    const size_t status_index = GetStatusIndex(documents_.at(document_id).status);
     for_each(std::execution::par, vct_words.begin(), vct_words.end(),
-        [this, document_id](const std::string_view word) {
-            word_to_document_freqs_.at(word).erase(document_id);
+        [this, document_id, status_index](const std::string_view word) {
+            TermPostings& postings = word_to_document_freqs_.at(word);
+            postings.document_count -= RemovePosting(postings.by_status[status_index], document_id);
         });
 
+    ClearImpactIndex();
+    if(duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        UnindexFingerprint(document_id);
+    }
+    flagged_duplicates_.erase(document_id);
+    status_documents_[status_index].Reset(document_id);
+
+    if(text_store_) {
+        text_store_->Release(documents_.at(document_id).text_record);
+    }
     documents_.erase(document_id);
     documents_id_.erase(document_id);
     document_to_word_freqs_.erase(document_id);
+
+    metrics_.documents_removed.Add();
+
+    // уплотнение идет после того, как документ удален целиком
+    CompactTextStore();
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
     const Query query = ParseQuery(raw_query);
 
+    return MatchDocumentTerms(ParseQueryTerms(query), document_id);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const {
+    return MatchDocument(raw_query, document_id);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const {
+    // для одного документа распараллеливать нечего: слияние двух коротких массивов дешевле запуска потоков
+    const Query query = ParseQuery(std::execution::par, raw_query);
+
+    return MatchDocumentTerms(ParseQueryTerms(query), document_id);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const string_view raw_query, const vector<int>& document_ids) const {
+    const QueryTerms query_terms = ParseQueryTerms(ParseQuery(raw_query));
+
+    vector<tuple<vector<string_view>, DocumentStatus>> result;
+    result.reserve(document_ids.size());
+    for(const int document_id : document_ids) {
+        result.push_back(MatchDocumentTerms(query_terms, document_id));
+    }
+
+    return result;
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const execution::sequenced_policy&, const string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const execution::parallel_policy&, const string_view raw_query, const vector<int>& document_ids) const {
+    // запрос разбираем один раз, документы матчим параллельно
+    const QueryTerms query_terms = ParseQueryTerms(ParseQuery(execution::par, raw_query));
+
+    vector<tuple<vector<string_view>, DocumentStatus>> result(document_ids.size());
+    transform(execution::par, document_ids.begin(), document_ids.end(), result.begin(),
+        [this, &query_terms](const int document_id) {
+            return MatchDocumentTerms(query_terms, document_id);
+        });
+
+    return result;
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocumentTerms(const QueryTerms& query_terms, int document_id) const {
+    // сложность O(Q + W) слиянием или O(Q*logW) галопом, где Q - слов в запросе, W - термов в документе
+    const DocumentData& document_data = documents_.at(document_id);
+    const TermIdList& term_ids = document_data.term_ids;
+
     // проход по минус словам
-    for(const string_view& word : query.minus_words) {
-        if(word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if(word_to_document_freqs_.at(word).count(document_id)) {
-            return {vector<string_view>{}, documents_.at(document_id).status};
-        }
+    if(HasCommon(query_terms.minus_term_ids.begin(), query_terms.minus_term_ids.end(), term_ids.begin(), term_ids.end())) {
+        return {vector<string_view>{}, document_data.status};
     }
 
     vector<string_view> matched_words;
-    matched_words.reserve(query.plus_words.size());
+    matched_words.reserve(min(query_terms.plus_term_ids.size(), term_ids.size()));
 
-    // проход по плюс словам
-    for(const string_view& word : query.plus_words) {
-        if(word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if(word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+    // документ должен содержать все обязательные слова
+    if(!query_terms.required_term_ids.empty()) {
+        size_t required_found = 0;
+        ForEachCommon(query_terms.required_term_ids.begin(), query_terms.required_term_ids.end(), term_ids.begin(), term_ids.end(),
+            [&required_found](int) { ++required_found; });
+        if(required_found != query_terms.required_term_ids.size()) {
+            return {vector<string_view>{}, document_data.status};
         }
     }
 
-    return {matched_words, documents_.at(document_id).status};
+    // проход по плюс словам
+    ForEachCommon(query_terms.plus_term_ids.begin(), query_terms.plus_term_ids.end(), term_ids.begin(), term_ids.end(),
+        [this, &matched_words](const int term_id) {
+            matched_words.push_back(id_to_term_[term_id]);
+        });
+
+    // id термов выданы в порядке добавления - возвращаем слова в алфавитном порядке
+    sort(matched_words.begin(), matched_words.end());
+
+    return {matched_words, document_data.status};
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const {
-    return MatchDocument(raw_query, document_id);
+int SearchServer::AddTerm(const string_view word) {
+    auto it = term_to_id_.find(word);
+    if(it == term_to_id_.end()) {
+        const int term_id = static_cast<int>(id_to_term_.size());
+        it = term_to_id_.emplace(word, term_id).first;
+        id_to_term_.push_back(it->first);
+        if(typo_tolerance_ > 0) {
+            typo_lexicon_.Insert(it->first);
+        }
+    }
+    return it->second;
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const {
-    const Query query = ParseQuery(std::execution::par, raw_query);
+int SearchServer::FindTermId(const string_view word) const {
+    const auto it = term_to_id_.find(word);
+    return it == term_to_id_.end() ? INVALID_TERM_ID : it->second;
+}
 
-    // ссылка на мапу
-    const auto& map_word_freq = document_to_word_freqs_.at(document_id);
+SearchServer::QueryTerms SearchServer::ParseQueryTerms(const Query& query) const {
+    QueryTerms query_terms;
 
-    // проход по минус словам
-    if(any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-        [this, &map_word_freq](const std::string_view& word) {
-            return map_word_freq.count(word); })) {
-        return {std::vector<std::string_view>{}, documents_.at(document_id).status};
-    }
+    // слова, которых нет в словаре, ни с чем не совпадут - отбрасываем их сразу
+    const auto to_term_ids = [this](const vector<string_view>& words, vector<int>& term_ids) {
+        term_ids.reserve(words.size());
+        for(const string_view word : words) {
+            const int term_id = FindTermId(word);
+            if(term_id != INVALID_TERM_ID) {
+                term_ids.push_back(term_id);
+            }
+        }
+        sort(term_ids.begin(), term_ids.end());
+        term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    };
 
-    // вектор максимально возможного размера
-    std::vector<std::string_view> matched_words(query.plus_words.size());
+    to_term_ids(query.plus_words, query_terms.plus_term_ids);
+    to_term_ids(query.minus_words, query_terms.minus_term_ids);
 
-    // проход по плюс словам
-    copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(),
-        [this, &map_word_freq](const std::string_view& word) {
-            return map_word_freq.count(word);
-    });
- 
-    // слова лежат в векторе - сортируем
-    sort(std::execution::par, matched_words.begin(), matched_words.end());
- 
-    // оставляем только уникальные слова
-    auto iit = unique(std::execution::par, matched_words.begin(), matched_words.end());
+    query_terms.required_term_ids.reserve(query.required_words.size());
+    for(const string_view word : query.required_words) {
+        query_terms.required_term_ids.push_back(FindTermId(word));
+    }
+    sort(query_terms.required_term_ids.begin(), query_terms.required_term_ids.end());
+    query_terms.required_term_ids.erase(unique(query_terms.required_term_ids.begin(), query_terms.required_term_ids.end()), query_terms.required_term_ids.end());
 
-    return {{matched_words.begin(), next(iit, -1)}, documents_.at(document_id).status};
+    return query_terms;
 }
 
 bool SearchServer::IsStopWord(const string_view word) const {
@@ -236,6 +966,7 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     
 SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) const {
     bool is_minus = false;
+    bool is_required = false;
 
     string_view word = text;
 
@@ -251,24 +982,69 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) con
 
         is_minus = true;
         word = word.substr(1);
+    } else if(word[0] == '+') {
+        // после '+' нет букв
+        if(1 == word.length())
+            throw invalid_argument("Detected no letters after '+' symbol"s);
+
+        // '+' вместе с другим знаком
+        if('+' == word[1] || '-' == word[1])
+            throw invalid_argument("Detected several sign symbols in a row in \""s + static_cast<string>(text) + "\""s);
+
+        is_required = true;
+        word = word.substr(1);
+    }
+
+    // '*' в конце слова - префикс
+    bool is_prefix = false;
+    if(word.back() == '*') {
+        word.remove_suffix(1);
+        // перед '*' нет букв
+        if(word.empty())
+            throw invalid_argument("Detected no letters before '*' symbol in \""s + static_cast<string>(text) + "\""s);
+
+        // несколько подряд символов '*'
+        if('*' == word.back())
+            throw invalid_argument("Detected several '*' symbols in a row in \""s + static_cast<string>(text) + "\""s);
+
+        // обязательным может быть только слово: пересечение списков идет по конкретным термам
+        if(is_required)
+            throw invalid_argument("Prefix cannot be required in \""s + static_cast<string>(text) + "\""s);
+
+        is_prefix = true;
     }
 
     // проверка на наличие спецсимволов
     if(!IsValidWord(word))
         throw invalid_argument("Forbidden symbol is detected in \""s + static_cast<string>(text) + "\""s);
 
-    return {word, is_minus, IsStopWord(word)};
+    // префикс раскрывается только в термы индекса, а стоп-слов в индексе нет
+    return {word, is_minus, is_required, is_prefix, !is_prefix && IsStopWord(word)};
 }
     
 SearchServer::Query SearchServer::ParseQuery(const string_view text) const {
+    Query query = ParseQueryWords(text);
+    CorrectQueryTypos(query);
+    ExpandQueryPrefixes(query);
+    return query;
+}
+
+SearchServer::Query SearchServer::ParseQueryWords(const string_view text) const {
     Query query;
 
     for(const string_view& word : SplitIntoWords(text)) {
         const QueryWord query_word = ParseQueryWord(word);
-        if(!query_word.is_stop) {
+        if(query_word.is_prefix) {
+            query_word.is_minus ?
+            query.minus_prefixes.push_back(query_word.data) :
+            query.plus_prefixes.push_back(query_word.data);
+        } else if(!query_word.is_stop) {
             query_word.is_minus ? 
             query.minus_words.push_back(query_word.data) : 
             query.plus_words.push_back(query_word.data);
+            if(query_word.is_required) {
+                query.required_words.push_back(query_word.data);
+            }
         }
     }
 
@@ -286,6 +1062,10 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text) const {
     // лишнее отрезаем
     query.minus_words.resize(distance(query.minus_words.begin(), it));
 
+    sort(query.required_words.begin(), query.required_words.end());
+    it = unique(query.required_words.begin(), query.required_words.end());
+    query.required_words.resize(distance(query.required_words.begin(), it));
+
     return query;
 }
 
@@ -298,22 +1078,265 @@ SearchServer::Query SearchServer::ParseQuery(const std::execution::parallel_poli
 
     for(const std::string_view& word : SplitIntoWords(text)) {
         const QueryWord query_word = ParseQueryWord(word);
-        if(!query_word.is_stop) {
+        if(query_word.is_prefix) {
+            query_word.is_minus ?
+            query.minus_prefixes.push_back(query_word.data) :
+            query.plus_prefixes.push_back(query_word.data);
+        } else if(!query_word.is_stop) {
             query_word.is_minus ? 
             query.minus_words.push_back(query_word.data) : 
             query.plus_words.push_back(query_word.data);
+            if(query_word.is_required) {
+                query.required_words.push_back(query_word.data);
+            }
         }
     }
 
+    CorrectQueryTypos(query);
+    ExpandQueryPrefixes(query);
     return query;
 }
 
+vector<string_view> SearchServer::ExpandPrefix(const string_view prefix, size_t limit) const {
+    vector<string_view> terms;
+    for(auto it = word_to_document_freqs_.lower_bound(prefix);
+        it != word_to_document_freqs_.end() && terms.size() < limit && it->first.substr(0, prefix.size()) == prefix; ++it) {
+        if(IsLiveTerm(it->second)) {
+            terms.push_back(it->first);
+        }
+    }
+    return terms;
+}
+
+void SearchServer::ExpandQueryPrefixes(Query& query) const {
+    // раскрытия становятся обычными словами запроса: их релевантность - как у запроса из всех этих слов
+    for(const string_view prefix : query.plus_prefixes) {
+        AddQueryWords(query.plus_words, ExpandPrefix(prefix, MAX_PREFIX_EXPANSION_COUNT));
+    }
+    // минус-префикс раскрывается целиком: усеченное раскрытие пропустило бы документы, которые он исключает
+    for(const string_view prefix : query.minus_prefixes) {
+        AddQueryWords(query.minus_words, ExpandPrefix(prefix, numeric_limits<size_t>::max()));
+    }
+}
+
+int SearchServer::GetTypoDistanceLimit(size_t word_size, int tolerance) {
+    // в коротком слове одна-две правки дают почти любое короткое слово словаря
+    if(word_size <= 2) {
+        return 0;
+    }
+    return word_size <= 5 ? min(tolerance, 1) : tolerance;
+}
+
+vector<pair<string_view, int>> SearchServer::FindTypoCorrections(const string_view word, int max_distance) const {
+    vector<pair<string_view, int>> corrections;
+    if(max_distance <= 0) {
+        return corrections;
+    }
+    for(const auto& [term, distance] : typo_lexicon_.FindFuzzyMatches(word, max_distance)) {
+        // string_view словаря опечаток живет до его изменения - в исправления идет ключ индекса
+        const auto postings_it = word_to_document_freqs_.find(term);
+        if(postings_it != word_to_document_freqs_.end() && IsLiveTerm(postings_it->second)) {
+            corrections.emplace_back(postings_it->first, distance);
+        }
+    }
+    SelectTypoCorrections(corrections);
+    return corrections;
+}
+
+void SearchServer::SelectTypoCorrections(vector<pair<string_view, int>>& corrections) {
+    sort(corrections.begin(), corrections.end(),
+        [](const auto& lhs, const auto& rhs) {
+            return lhs.second != rhs.second ? lhs.second < rhs.second : lhs.first < rhs.first;
+        });
+    // у одного терма в разных словарях расстояние одно и то же
+    corrections.erase(unique(corrections.begin(), corrections.end()), corrections.end());
+    if(corrections.size() > MAX_TYPO_CORRECTION_COUNT) {
+        corrections.resize(MAX_TYPO_CORRECTION_COUNT);
+    }
+}
+
+void SearchServer::CorrectQueryTypos(Query& query) const {
+    if(typo_tolerance_ == 0) {
+        return;
+    }
+    vector<string_view> corrections;
+    auto word_it = query.plus_words.begin();
+    while(word_it != query.plus_words.end()) {
+        const string_view word = *word_it;
+        if(GetWordDocumentCount(word) > 0
+            || find(query.required_words.begin(), query.required_words.end(), word) != query.required_words.end()) {
+            ++word_it;
+            continue;
+        }
+        const auto word_corrections = FindTypoCorrections(word, GetTypoDistanceLimit(word.size(), typo_tolerance_));
+        if(word_corrections.empty()) {
+            ++word_it;
+            continue;
+        }
+        // слово без документов ничего не добавляет к релевантности - его место занимают исправления
+        for(const auto& [term, _] : word_corrections) {
+            (void)_;
+            corrections.push_back(term);
+        }
+        word_it = query.plus_words.erase(word_it);
+    }
+    AddQueryWords(query.plus_words, corrections);
+}
+
+void SearchServer::AddQueryWords(vector<string_view>& words, const vector<string_view>& new_words) {
+    if(new_words.empty()) {
+        return;
+    }
+    words.insert(words.end(), new_words.begin(), new_words.end());
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+}
+
 // Existence required
+// у слова, все документы которого удалены, IDF 0: оно не встречается ни в одном документе, как и неизвестное слово
 double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+    const TermPostings& postings = word_to_document_freqs_.at(word);
+    return IsLiveTerm(postings) ? log(GetDocumentCount() * 1.0 / postings.document_count) : 0.0;
+}
+
+vector<double> SearchServer::ComputeInverseDocumentFreqs(const Query& query) const {
+    // один поиск на слово: раскрытый префикс может дать десятки слов
+    vector<double> inverse_document_freqs(query.plus_words.size(), 0.0);
+    for(size_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto it = word_to_document_freqs_.find(query.plus_words[i]);
+        if(it != word_to_document_freqs_.end() && IsLiveTerm(it->second)) {
+            inverse_document_freqs[i] = log(GetDocumentCount() * 1.0 / it->second.document_count);
+        }
+    }
+    return inverse_document_freqs;
+}
+
+bool SearchServer::DropLowIdfWords(const Query& query, const vector<double>& inverse_document_freqs, Query& reduced_query, vector<double>& reduced_inverse_document_freqs) const {
+    if(approximate_idf_threshold_ <= 0.0) {
+        return false;
+    }
+    reduced_query.minus_words = query.minus_words;
+    reduced_query.required_words = query.required_words;
+    reduced_query.plus_words.reserve(query.plus_words.size());
+    reduced_inverse_document_freqs.reserve(query.plus_words.size());
+    bool has_significant_word = false;
+    for(size_t i = 0; i < query.plus_words.size(); ++i) {
+        const bool is_required = find(query.required_words.begin(), query.required_words.end(), query.plus_words[i]) != query.required_words.end();
+        const bool is_significant = inverse_document_freqs[i] >= approximate_idf_threshold_;
+        if(is_required || is_significant) {
+            // порядок слов сохраняется: plus_words отсортирован
+            reduced_query.plus_words.push_back(query.plus_words[i]);
+            reduced_inverse_document_freqs.push_back(inverse_document_freqs[i]);
+            has_significant_word = has_significant_word || is_significant;
+        }
+    }
+    // без значимых слов отбор шел бы только по обязательным словам или не шел бы вовсе
+    return has_significant_word && reduced_query.plus_words.size() < query.plus_words.size();
+}
+
+size_t SearchServer::GetWordDocumentCount(const string_view word) const {
+    const auto it = word_to_document_freqs_.find(word);
+    return it == word_to_document_freqs_.end() ? 0 : it->second.document_count;
+}
+
+int SearchServer::GetPostingBlock(int document_id) {
+    return document_id >> POSTING_BLOCK_BITS;
+}
+
+bool SearchServer::AddPosting(PostingList& postings, int document_id, double term_freq) {
+    const auto [it, is_new_posting] = postings.freqs.try_emplace(document_id, 0.0);
+    it->second += term_freq;
+
+    // частота только растет, поэтому оценки достаточно поднимать
+    postings.max_term_freq = max(postings.max_term_freq, it->second);
+    double& block_max_term_freq = postings.block_max_term_freqs[GetPostingBlock(document_id)];
+    block_max_term_freq = max(block_max_term_freq, it->second);
+
+    return is_new_posting;
+}
+
+bool SearchServer::RemovePosting(PostingList& postings, int document_id) {
+    const auto it = postings.freqs.find(document_id);
+    if(it == postings.freqs.end()) {
+        return false;
+    }
+    const double term_freq = it->second;
+    postings.freqs.erase(it);
+
+    // оценку блока пересчитываем по оставшимся постингам блока, только если удален постинг с максимальной частотой
+    const int block = GetPostingBlock(document_id);
+    if(term_freq >= GetBlockMaxTermFreq(postings, block)) {
+        UpdateBlockMaxTermFreq(postings, block);
+    }
+
+    // оценка терма остается верной, но может стать завышенной - сбрасываем ее только для пустого списка
+    if(postings.freqs.empty()) {
+        postings.max_term_freq = 0.0;
+    }
+
+    return true;
+}
+
+void SearchServer::SetPostingFreq(PostingList& postings, int document_id, double term_freq) {
+    double& stored_term_freq = postings.freqs.at(document_id);
+    const double old_term_freq = stored_term_freq;
+    stored_term_freq = term_freq;
+
+    // при росте достаточно поднять оценки; при снижении оценка блока пересчитывается, если постинг
+    // был в блоке максимальным, а оценка терма, как и при удалении, может остаться завышенной
+    postings.max_term_freq = max(postings.max_term_freq, term_freq);
+    const int block = GetPostingBlock(document_id);
+    double& block_max_term_freq = postings.block_max_term_freqs[block];
+    if(term_freq >= block_max_term_freq) {
+        block_max_term_freq = term_freq;
+    } else if(old_term_freq >= block_max_term_freq) {
+        UpdateBlockMaxTermFreq(postings, block);
+    }
+}
+
+void SearchServer::UpdateBlockMaxTermFreq(PostingList& postings, int block) {
+    const int block_begin = block << POSTING_BLOCK_BITS;
+    double block_max_term_freq = 0.0;
+    for(auto block_it = postings.freqs.lower_bound(block_begin);
+        block_it != postings.freqs.end() && GetPostingBlock(block_it->first) == block; ++block_it) {
+        block_max_term_freq = max(block_max_term_freq, block_it->second);
+    }
+    if(block_max_term_freq > 0.0) {
+        postings.block_max_term_freqs[block] = block_max_term_freq;
+    } else {
+        postings.block_max_term_freqs.erase(block);
+    }
+}
+
+double SearchServer::GetBlockMaxTermFreq(const PostingList& postings, int block) {
+    const auto it = postings.block_max_term_freqs.find(block);
+    return it == postings.block_max_term_freqs.end() ? 0.0 : it->second;
+}
+
+size_t SearchServer::GetStatusIndex(DocumentStatus status) {
+    return static_cast<size_t>(status);
+}
+
+pair<size_t, size_t> SearchServer::GetStatusRange(DocumentStatus status) {
+    const size_t status_index = GetStatusIndex(status);
+    return {status_index, status_index + 1};
+}
+
+bool SearchServer::IsAcceptedDocument(int document_id, DocumentStatus status) const {
+    // раздел постингов уже выбран по статусу - проверять нечего
+    (void)document_id; (void)status;
+    return true;
+}
+
+bool SearchServer::IsEmptyFilter(DocumentStatus status) const {
+    return status_documents_[GetStatusIndex(status)].Empty();
 }
 
 bool SearchServer::IsValidWord(const string_view word) {
     // A valid word must not contain special characters
     return none_of(word.begin(), word.end(), [](char c) {return c >= '\0' && c < ' ';});
 }
+
+bool SearchServer::IsLiveTerm(const TermPostings& postings) {
+    return postings.document_count > 0;
+}
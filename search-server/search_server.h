@@ -2,16 +2,57 @@
 
 #include <execution>
 #include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <ostream>
+#include <queue>
 #include <stdexcept>
+#include <array>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <set>
+#include <thread>
+#include <unordered_map>
 
 #include "document.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
-//#include "log_duration.h"
+#include "document_bitmap.h"
+#include "term_lexicon.h"
+#include "text_store.h"
+#include "document_fingerprint.h"
+#include "search_cursor.h"
+#include "query_stats.h"
+#include "execution_planner.h"
+#include "metrics.h"
+#include "memory_stats.h"
+#include "index_memory.h"
+#include "query_log.h"
+#include "scoring_kernels.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
+// сколько термов словаря (первых по алфавиту) подставляется вместо слова запроса с '*' на конце;
+// минус-слово с '*' исключает документы со всеми термами префикса
+const size_t MAX_PREFIX_EXPANSION_COUNT = 64;
+// наибольшее расстояние редактирования при исправлении опечаток в словах запроса
+const int MAX_TYPO_EDIT_DISTANCE = 2;
+// сколько ближайших термов словаря подставляется вместо слова с опечаткой
+const size_t MAX_TYPO_CORRECTION_COUNT = 8;
+// полный перебор считает релевантность в плотном массиве векторными ядрами, если промежуток id
+// найденных списков не больше стольких постингов на документ; иначе массив почти пуст и выгоднее мапа
+const size_t DENSE_SCORING_MAX_SPREAD = 16;
+// сколько постингов переписывается из дерева в буфер перед вызовом ядра
+const size_t DENSE_SCORING_CHUNK_SIZE = 1024;
+// постраничный поиск перебирает id окнами такой ширины: плотный массив оценок и мапа не растут с индексом
+const int STREAMED_SCORING_WINDOW = 1 << 16;
+
+// поведение AddDocument при добавлении документа с уже существующим набором слов
+enum class DuplicatePolicy {
+    ALLOW,  // добавлять без проверки
+    REJECT, // бросать исключение
+    FLAG,   // добавлять и запоминать как дубликат
+};
 
 class SearchServer {
 public:
@@ -20,14 +61,27 @@ public:
     // Defines an error for double values
     inline static constexpr double EPSILON_DOUBLE = 1e-6;
 
-    explicit SearchServer() = default;
+    // отсортированный массив id термов документа
+    using TermIdList = std::pmr::vector<int>;
+    // мапа: ключ - ссылка на слово, значение - частота
+    using WordFrequencies = std::pmr::map<std::string_view, double>;
+
+    // upstream - ресурс, из которого выделяется вся память индекса (см. MakeIndexMemoryResource),
+    // должен пережить сервер; nullptr - глобальный аллокатор
+    explicit SearchServer(std::pmr::memory_resource* upstream = nullptr);
+
+    // индексы ссылаются на собственный словарь и ресурсы памяти сервера, поэтому копировать его нельзя
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
 
-    explicit SearchServer(const std::string& text) : SearchServer(SplitIntoWords(text)) {};
+    explicit SearchServer(const std::string& text, std::pmr::memory_resource* upstream = nullptr)
+        : SearchServer(SplitIntoWords(text), upstream) {};
 
-    explicit SearchServer(const std::string_view text) : SearchServer(SplitIntoWords(text)) {};
+    explicit SearchServer(const std::string_view text, std::pmr::memory_resource* upstream = nullptr)
+        : SearchServer(SplitIntoWords(text), upstream) {};
 
     template <typename StringCollection>
-    explicit SearchServer(const StringCollection& stop_words);
+    explicit SearchServer(const StringCollection& stop_words, std::pmr::memory_resource* upstream = nullptr);
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
@@ -36,6 +90,11 @@ public:
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
 
+    // то же со статистикой выполнения запроса
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status, QueryStats& stats) const;
+
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query, DocumentPredicate document_predicate) const;
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query, DocumentStatus status) const;
@@ -46,43 +105,268 @@ public:
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query) const;
 
+    // способ выполнения выбирает планировщик по длинам списков постингов запроса:
+    // последовательно, параллельно по термам или параллельно по диапазонам id документов
+    // выбранный способ и оценка объема работы - в QueryStats
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const;
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentStatus status, QueryStats& stats) const;
+
+    // пороги планировщика auto_execution; по умолчанию PlannerThresholds{} - запросы выполняются последовательно
+    // сервер сам не калибруется: пороги задаются при запуске - откалиброванные или сохраненные ранее
+    // задавать пороги нельзя одновременно с поиском
+    void SetPlannerThresholds(const PlannerThresholds& thresholds);
+    PlannerThresholds GetPlannerThresholds() const;
+
+    // микробенчмарк способов выполнения на синтетическом индексе; занимает доли секунды
+    // результат не кэшируется: его передают в SetPlannerThresholds и могут сохранить FormatPlannerThresholds
+    static PlannerThresholds CalibratePlannerThresholds();
+
+    // постраничный поиск: документы строго после курсора, не больше page_size штук
+    // каждая страница стоит O(постингов + R*log(page_size)), без сортировки всей выдачи
+    template <typename DocumentPredicate>
+    SearchPage FindTopDocumentsAfter(const std::string_view raw_query, const SearchCursor& cursor, int page_size, DocumentPredicate document_predicate) const;
+    SearchPage FindTopDocumentsAfter(const std::string_view raw_query, const SearchCursor& cursor, int page_size, DocumentStatus status) const;
+    SearchPage FindTopDocumentsAfter(const std::string_view raw_query, const SearchCursor& cursor, int page_size) const;
+
+    // индекс с постингами, упорядоченными по убыванию частоты терма (вклада), для коротких запросов
+    // строится по запросу из основного индекса; AddDocument и RemoveDocument его сбрасывают,
+    // UpdateDocumentStatus и UpdateDocument правят на месте
+    void BuildImpactIndex();
+    bool HasImpactIndex() const;
+
+    // порядок выдачи: по убыванию релевантности (с точностью EPSILON_DOUBLE), затем рейтинга, затем по возрастанию id
+    static bool IsRankedBefore(const Document& lhs, const Document& rhs);
+
     int GetDocumentCount() const;
 
     // константные итераторы на начало и конец множества с id документов
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    std::pmr::set<int>::const_iterator begin() const;
+    std::pmr::set<int>::const_iterator end() const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    const WordFrequencies& GetWordFrequencies(int document_id) const;
 
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
 
+    // изменение документа без удаления и повторного добавления; нет документа - исключение out_of_range
+    // смена статуса переносит постинги документа в раздел нового статуса, сложность O(w*logW);
+    // IDF не меняется - число документов со словом от статуса не зависит
+    void UpdateDocumentStatus(int document_id, DocumentStatus status);
+    // сложность O(logN): рейтинг хранится только в данных документа
+    void UpdateDocumentRating(int document_id, const std::vector<int>& ratings);
+    // новый текст сравнивается со старым по термам: постинги выпавших термов удаляются, новых - добавляются,
+    // у общих термов меняется только частота, и только если она изменилась
+    // дубликат проверяется как в AddDocument, без учета самого документа
+    void UpdateDocument(int document_id, const std::string_view document);
+
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const;
 
-    // мапа: ключ - id документа, значение - множество слов
+    // матчинг одного запроса сразу по набору документов: запрос разбирается один раз
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    // отсортированный массив id термов документа и его отпечаток
     // need for RemoveDuplicates()
-    std::map<int, std::set<std::string>> document_to_set_words;
+    const TermIdList& GetDocumentTermIds(int document_id) const;
+    DocumentFingerprint GetDocumentFingerprint(int document_id) const;
+
+    // проверка дубликатов при добавлении документа
+    void SetDuplicatePolicy(DuplicatePolicy policy);
+    DuplicatePolicy GetDuplicatePolicy() const;
+    // мапа: ключ - id дубликата, значение - id документа, который он повторяет (для DuplicatePolicy::FLAG)
+    const std::pmr::map<int, int>& GetFlaggedDuplicates() const;
+
+    // исправление опечаток: плюс-слово запроса, которого нет в документах, заменяется ближайшими термами
+    // на расстоянии редактирования не больше max_edit_distance (0 - выключено, по умолчанию)
+    // слова до 2 байт не исправляются, до 5 байт - с расстоянием не больше 1; минус-слова и обязательные
+    // слова не исправляются
+    // включение строит словарь опечаток TermLexicon по словарю термов, выключение его освобождает
+    void SetTypoTolerance(int max_edit_distance);
+    int GetTypoTolerance() const;
+
+    // приближенный поиск: плюс-слова с IDF ниже threshold не участвуют в отборе верхних K документов,
+    // а только уточняют релевантность и порядок отобранных (0 - точный поиск, по умолчанию)
+    // у частых слов IDF около нуля: на порядок выдачи они почти не влияют, а списки постингов у них самые длинные
+    // обязательные слова не отбрасываются; если ниже порога все плюс-слова, запрос выполняется точно
+    // действует на FindTopDocuments; постраничный FindTopDocumentsAfter всегда точный
+    void SetApproximateIdfThreshold(double threshold);
+    double GetApproximateIdfThreshold() const;
+
+    // текст документа, распакованный из хранилища текстов; при TextStorage::NONE - исключение logic_error
+    std::string GetDocumentText(int document_id) const;
+
+    // способ хранения текстов документов (по умолчанию TextStorage::MEMORY); меняется только у пустого сервера
+    // для TextStorage::FILE сжатые блоки пишутся в файл path
+    void SetTextStorage(TextStorage storage, const std::string& path = {});
+    TextStorage GetTextStorage() const;
+    TextStoreStats GetTextStoreStats() const;
+
+    // метрики сервера в текстовом формате экспозиции Prometheus
+    void WriteMetrics(std::ostream& output) const;
+
+    // журнал запросов FindTopDocuments (текст, фильтр, время начала, длительность) для воспроизведения
+    // нагрузки утилитой query_replay; nullptr - журнал не пишется (по умолчанию)
+    // журнал должен пережить сервер; менять журнал нельзя одновременно с поиском
+    void SetQueryLog(QueryLogWriter* query_log);
+
+    // занятая структурами сервера память (по счетчикам аллокаторов) и гистограммы длин
+    // сложность O(W + N): обходятся словарь и документы
+    MemoryStats GetMemoryStats() const;
 
 private:
     struct DocumentData {
         int rating; // рейтинг
         DocumentStatus status; // статус
-        std::string text; // текст
+        size_t text_record; // номер записи текста в text_store_ или TextStore::NO_RECORD
+        TermIdList term_ids; // отсортированный массив id термов документа
+        DocumentFingerprint fingerprint; // отпечаток множества термов
     };
-    
+
+    // Defines an invalid term id
+    inline static constexpr int INVALID_TERM_ID = -1;
+    // Defines the number of document statuses
+    inline static constexpr size_t STATUS_COUNT = 4;
+
+    // Defines the size of a posting block: 2^POSTING_BLOCK_BITS consecutive document ids
+    inline static constexpr int POSTING_BLOCK_BITS = 7;
+
+    // список постингов с верхними оценками частоты терма для динамического отсечения
+    // оценки поддерживаются при добавлении и удалении документов; после удаления оценка терма
+    // может остаться завышенной (она остается верной), оценки блоков пересчитываются точно
+    // вложенные контейнеры индекса получают ресурс памяти внешнего контейнера (uses-allocator),
+    // поэтому структуры с ними объявляют allocator_type и конструкторы с аллокатором
+    using Allocator = std::pmr::polymorphic_allocator<std::byte>;
+
+    struct PostingList {
+        using allocator_type = Allocator;
+
+        explicit PostingList(const allocator_type& allocator = {})
+            : freqs(allocator), block_max_term_freqs(allocator) {}
+
+        // мапа: ключ - id документа, значение - частота
+        std::pmr::map<int, double> freqs;
+        // максимальная частота терма в списке
+        double max_term_freq = 0.0;
+        // мапа: ключ - номер блока id документов, значение - максимальная частота в блоке
+        std::pmr::map<int, double> block_max_term_freqs;
+    };
+
+    // постинги терма, разбитые по статусам документов:
+    // запрос по статусу обходит только свой раздел и не трогает постинги остальных документов
+    struct TermPostings {
+        using allocator_type = Allocator;
+
+        static_assert(STATUS_COUNT == 4);
+        explicit TermPostings(const allocator_type& allocator = {})
+            : by_status{PostingList(allocator), PostingList(allocator), PostingList(allocator), PostingList(allocator)} {}
+
+        // массив: индекс - статус, значение - постинги документов с этим статусом
+        std::array<PostingList, STATUS_COUNT> by_status;
+        // число документов с этим термом во всех разделах (для IDF)
+        size_t document_count = 0;
+    };
+
+    // ресурс, из которого берут память все категории
+    std::pmr::memory_resource* const upstream_memory_;
+
+    // ресурсы памяти по категориям MemoryStats
+    // объявлены раньше контейнеров: контейнеры создаются после ресурсов и разрушаются до них
+    CountingMemoryResource text_memory_{upstream_memory_};
+    CountingMemoryResource inverted_index_memory_{upstream_memory_};
+    CountingMemoryResource forward_index_memory_{upstream_memory_};
+    CountingMemoryResource metadata_memory_{upstream_memory_};
+    CountingMemoryResource dictionary_memory_{upstream_memory_};
+    CountingMemoryResource stop_words_memory_{upstream_memory_};
+    CountingMemoryResource auxiliary_memory_{upstream_memory_};
+
     // множество стоп-слов
-    std::set<std::string, std::less<>> stop_words_;
-    // мапа: ключ - ссылка на слово, значение - мапа: ключ - id документа, значение - частота
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
+    std::pmr::set<std::pmr::string, std::less<>> stop_words_{&stop_words_memory_};
+    // словарь термов: ключ - слово, значение - id терма
+    // словарь владеет строками, все string_view индексов ссылаются на его ключи
+    std::pmr::map<std::pmr::string, int, std::less<>> term_to_id_{&dictionary_memory_};
+    // вектор: индекс - id терма, значение - ссылка на слово в словаре
+    std::pmr::vector<std::string_view> id_to_term_{&dictionary_memory_};
+    // мапа: ключ - ссылка на слово, значение - постинги терма по статусам
+    std::pmr::map<std::string_view, TermPostings> word_to_document_freqs_{&inverted_index_memory_};
     // мапа: ключ - id документа, значение - данные документа
-    std::map<int, DocumentData> documents_;
+    // массив id термов документа выделяется из своего ресурса, остальное - метаданные
+    std::pmr::map<int, DocumentData> documents_{&metadata_memory_};
+    // тексты документов: индексы на них не ссылаются, поэтому тексты хранятся сжатыми
+    // nullptr - TextStorage::NONE
+    TextStorage text_storage_ = TextStorage::MEMORY;
+    std::unique_ptr<TextStore> text_store_ = std::make_unique<TextStore>(&text_memory_);
     // множество из id добавленных документов
-    std::set<int> documents_id_;
+    std::pmr::set<int> documents_id_{&metadata_memory_};
     // мапа: ключ - id документа, значение - мапа: ключ - ссылка на слово, значение - частота
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
+    std::pmr::map<int, WordFrequencies> document_to_word_freqs_{&forward_index_memory_};
+    // массив: индекс - статус, значение - битовое множество id документов с этим статусом
+    std::array<DocumentBitmap, STATUS_COUNT> status_documents_{
+        DocumentBitmap(&auxiliary_memory_), DocumentBitmap(&auxiliary_memory_),
+        DocumentBitmap(&auxiliary_memory_), DocumentBitmap(&auxiliary_memory_)};
+
+    DuplicatePolicy duplicate_policy_ = DuplicatePolicy::ALLOW;
+    int typo_tolerance_ = 0;
+    // словарь опечаток: все термы словаря, пока typo_tolerance_ > 0
+    TermLexicon typo_lexicon_{&auxiliary_memory_};
+    double approximate_idf_threshold_ = 0.0;
+    QueryLogWriter* query_log_ = nullptr;
+    // мапа: ключ - отпечаток, значение - id документов с таким отпечатком
+    // ведется только при политике, отличной от DuplicatePolicy::ALLOW
+    std::pmr::unordered_map<DocumentFingerprint, std::pmr::vector<int>, DocumentFingerprintHasher> fingerprint_to_documents_{&auxiliary_memory_};
+    // мапа: ключ - id дубликата, значение - id оригинала
+    std::pmr::map<int, int> flagged_duplicates_{&metadata_memory_};
+
+    // пороги планировщика, заданные SetPlannerThresholds
+    PlannerThresholds planner_thresholds_;
+
+    // счетчики и гистограммы этапов запроса и добавления документа
+    struct Metrics {
+        Metrics();
+
+        MetricsRegistry registry;
+
+        MetricsCounter& queries;
+        MetricsCounter& documents_returned;
+        MetricsCounter& query_words_skipped;
+        LatencyHistogram& query_duration;
+        LatencyHistogram& query_parse;
+        LatencyHistogram& query_score;
+        LatencyHistogram& query_filter;
+        LatencyHistogram& query_sort;
+
+        MetricsCounter& documents_added;
+        MetricsCounter& documents_rejected;
+        MetricsCounter& documents_removed;
+        MetricsCounter& documents_updated;
+        MetricsCounter& text_store_compaction_failures;
+        LatencyHistogram& add_duration;
+        LatencyHistogram& add_validate;
+        LatencyHistogram& add_tokenize;
+        LatencyHistogram& add_insert;
+        LatencyHistogram& remove_duration;
+    };
+    Metrics metrics_;
+
+    // ищет документ с тем же множеством слов (кроме ignored_document_id), возвращает его id или INVALID_DOCUMENT_ID
+    int FindDuplicateDocument(const std::vector<std::string_view>& words, int ignored_document_id = INVALID_DOCUMENT_ID) const;
+    void IndexFingerprint(int document_id, const DocumentFingerprint& fingerprint);
+    void UnindexFingerprint(int document_id);
+    // после изменения текста document_id: документы, отмеченные его дубликатами, но с другим набором слов,
+    // получают другой оригинал с их набором слов или снимаются с отметки
+    void RecheckDuplicatesOf(int document_id);
+    // уплотняет хранилище текстов после удаления или замены текста; ошибка уплотнения оставляет хранилище
+    // прежним и только учитывается в метриках - изменение документа к этому моменту уже выполнено
+    void CompactTextStore();
 
     bool IsStopWord(const std::string_view word) const;
     
@@ -93,6 +377,8 @@ private:
     struct QueryWord {
         std::string_view data;
         bool is_minus;
+        bool is_required;
+        bool is_prefix; // слово с '*' на конце, data - префикс без '*'
         bool is_stop;
     };
     
@@ -101,27 +387,246 @@ private:
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // слова с '+': документ должен содержать каждое; они же входят в plus_words и участвуют в релевантности
+        std::vector<std::string_view> required_words;
+        // префиксы слов с '*'; термы словаря с этими префиксами добавляются в plus_words (не больше
+        // MAX_PREFIX_EXPANSION_COUNT первых по алфавиту) и в minus_words (все)
+        std::vector<std::string_view> plus_prefixes;
+        std::vector<std::string_view> minus_prefixes;
     };
     
+    // разбор с раскрытием префиксов по словарю сервера
     Query ParseQuery(const std::string_view text) const;
     Query ParseQuery(const std::execution::sequenced_policy&, const std::string_view text) const;
     Query ParseQuery(const std::execution::parallel_policy&, const std::string_view text) const;
+    // разбор без раскрытия префиксов (ShardedSearchServer раскрывает их по словарям всех шардов)
+    Query ParseQueryWords(const std::string_view text) const;
+
+    // термы с префиксом prefix, которые встречаются в документах, по алфавиту, не больше limit
+    // инвертированный индекс упорядочен по слову, поэтому такие термы лежат подряд: один поиск начала
+    // диапазона и обход до первого терма без префикса, без поиска каждого терма в словаре
+    std::vector<std::string_view> ExpandPrefix(const std::string_view prefix, size_t limit) const;
+    void ExpandQueryPrefixes(Query& query) const;
+
+    // допустимое расстояние до слова длины word_size при допуске tolerance
+    static int GetTypoDistanceLimit(size_t word_size, int tolerance);
+    // термы, которые встречаются в документах, на расстоянии не больше max_distance от word:
+    // по возрастанию расстояния, при равном - по алфавиту, не больше MAX_TYPO_CORRECTION_COUNT
+    // автомат Левенштейна обходит словарь опечаток (ведется, только пока исправление включено)
+    std::vector<std::pair<std::string_view, int>> FindTypoCorrections(const std::string_view word, int max_distance) const;
+    void CorrectQueryTypos(Query& query) const;
+    // упорядочивает исправления и оставляет первые MAX_TYPO_CORRECTION_COUNT различных термов
+    static void SelectTypoCorrections(std::vector<std::pair<std::string_view, int>>& corrections);
+    // добавляет слова в отсортированный массив слов запроса без повторов
+    static void AddQueryWords(std::vector<std::string_view>& words, const std::vector<std::string_view>& new_words);
+
+    // запрос в виде отсортированных массивов id термов
+    struct QueryTerms {
+        std::vector<int> plus_term_ids;
+        std::vector<int> minus_term_ids;
+        // слово, которого нет в словаре, остается как INVALID_TERM_ID - с ним не совпадет ни один документ
+        std::vector<int> required_term_ids;
+    };
+
+    QueryTerms ParseQueryTerms(const Query& query) const;
+
+    // добавляет слово в словарь (если его там нет) и возвращает id терма
+    int AddTerm(const std::string_view word);
+    // возвращает id терма или INVALID_TERM_ID, если слова нет в словаре
+    int FindTermId(const std::string_view word) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocumentTerms(const QueryTerms& query_terms, int document_id) const;
 
     // Existence required
     double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    // IDF плюс-слов запроса по документам сервера; 0 - слова нет в индексе
+    // вычислители получают IDF готовым, поэтому его можно посчитать и по нескольким серверам (ShardedSearchServer)
+    std::vector<double> ComputeInverseDocumentFreqs(const Query& query) const;
+    // число документов со словом (для IDF)
+    size_t GetWordDocumentCount(const std::string_view word) const;
+
+    // запрос без плюс-слов с IDF ниже порога приближенного поиска (кроме обязательных) и IDF его слов
+    // false - отбрасывать нечего или ниже порога все плюс-слова: запрос выполняется точно
+    bool DropLowIdfWords(const Query& query, const std::vector<double>& inverse_document_freqs, Query& reduced_query, std::vector<double>& reduced_inverse_document_freqs) const;
+    // evaluate(запрос, IDF) - вычислитель верхних K документов
+    // в приближенном режиме он получает запрос без слов с IDF ниже порога, а отобранные документы
+    // ранжируются заново по полному запросу: отброшенные слова только уточняют порядок
+    template <typename Evaluator>
+    std::vector<Document> EvaluateApproximately(const Query& query, const std::vector<double>& inverse_document_freqs, QueryStats* stats, Evaluator evaluate) const;
 
+    friend class ShardedSearchServer;
+
+    static size_t GetStatusIndex(DocumentStatus status);
+
+    // фильтр документов - предикат или DocumentStatus
+    // для статуса обходится один раздел постингов и предикат не вычисляется,
+    // для произвольного предиката - все разделы с вызовом предиката на каждый постинг
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    static std::pair<size_t, size_t> GetStatusRange(const DocumentPredicate& document_predicate);
+    static std::pair<size_t, size_t> GetStatusRange(DocumentStatus status);
+
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const;
+    bool IsAcceptedDocument(int document_id, DocumentPredicate& document_predicate) const;
+    bool IsAcceptedDocument(int document_id, DocumentStatus status) const;
+
+    // заведомо пустая выдача: документов с нужным статусом нет
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const;
+    bool IsEmptyFilter(const DocumentPredicate& document_predicate) const;
+    bool IsEmptyFilter(DocumentStatus status) const;
+
+    // Defines the number of postings in one segment of the impact-ordered index
+    inline static constexpr size_t IMPACT_SEGMENT_SIZE = 64;
+    // Defines the longest query (in plus words) evaluated over the impact-ordered index
+    inline static constexpr size_t IMPACT_QUERY_WORD_LIMIT = 4;
+
+    // постинги терма по убыванию частоты; сегмент i - постинги [i*IMPACT_SEGMENT_SIZE, (i+1)*IMPACT_SEGMENT_SIZE)
+    using ImpactPostings = std::pmr::vector<std::pair<int, double>>;
+
+    struct ImpactTermPostings {
+        using allocator_type = Allocator;
+
+        static_assert(STATUS_COUNT == 4);
+        explicit ImpactTermPostings(const allocator_type& allocator = {})
+            : by_status{ImpactPostings(allocator), ImpactPostings(allocator), ImpactPostings(allocator), ImpactPostings(allocator)} {}
+
+        // массив: индекс - статус, значение - постинги документов с этим статусом
+        std::array<ImpactPostings, STATUS_COUNT> by_status;
+    };
+
+    // мапа: ключ - ссылка на слово, значение - упорядоченные по вкладу постинги по статусам
+    std::pmr::map<std::string_view, ImpactTermPostings> impact_index_{&auxiliary_memory_};
+    bool has_impact_index_ = false;
+
+    void ClearImpactIndex();
+    // правка построенного индекса вкладов на месте: постинг вставляется в свою позицию порядка по вкладу
+    void AddImpactPosting(std::string_view term, size_t status_index, int document_id, double term_freq);
+    void RemoveImpactPosting(std::string_view term, size_t status_index, int document_id, double term_freq);
+
+    static int GetPostingBlock(int document_id);
+    // добавляет частоту в постинг, возвращает true, если постинг новый
+    static bool AddPosting(PostingList& postings, int document_id, double term_freq);
+    // удаляет постинг, возвращает true, если он был
+    static bool RemovePosting(PostingList& postings, int document_id);
+    // меняет частоту существующего постинга
+    static void SetPostingFreq(PostingList& postings, int document_id, double term_freq);
+    // пересчитывает оценку блока по его постингам
+    static void UpdateBlockMaxTermFreq(PostingList& postings, int block);
+    static double GetBlockMaxTermFreq(const PostingList& postings, int block);
+
+    // диапазон id документов [first, last]
+    struct DocumentRange {
+        int first;
+        int last;
+    };
+    inline static constexpr DocumentRange ALL_DOCUMENTS{0, std::numeric_limits<int>::max()};
+
+    // кандидаты в верхний K документов диапазона, отобранные динамическим отсечением MaxScore по оценкам терма и блока
+    // верхний K среди кандидатов совпадает с верхним K полного перебора документов диапазона
+    template <typename DocumentFilter>
+    std::vector<int> FindPrunedCandidates(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, DocumentRange range, QueryStats* stats) const;
+
+    // верхний K документов с динамическим отсечением MaxScore
+    // результат совпадает с полным перебором FindAllDocuments + сортировка
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsPruned(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryStats* stats) const;
+
+    // полный перебор параллельно в range_count диапазонах id (FindAllDocuments par), сортировка и усечение до K
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsExhaustiveParallel(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, size_t range_count, QueryStats* stats) const;
+
+    // MaxScore параллельно в range_count диапазонах id документов; кандидаты всех диапазонов ранжируются вместе
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsRangeParallel(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, size_t range_count, QueryStats* stats) const;
+
+    // оценка объема работы запроса для планировщика: один поиск в словаре на слово, без обхода списков
+    template <typename DocumentFilter>
+    QueryWorkEstimate EstimateQueryWork(const Query& query, const DocumentFilter& document_filter) const;
+
+    // выполнение запроса выбранным способом
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsPlanned(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryPlan plan, QueryStats* stats) const;
+
+    // верхний K документов обходом сегментов индекса вкладов (score-at-a-time) с ранней остановкой
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsByImpact(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryStats* stats) const;
+
+    // выбор способа вычисления верхнего K документов для последовательного поиска
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsSeq(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryStats* stats) const;
+
+    // точная релевантность кандидата в порядке слов запроса (как при полном переборе)
+    Document ScoreCandidate(const Query& query, const std::vector<double>& inverse_document_freqs, int document_id) const;
+    // ScoreCandidate для всех кандидатов
+    std::vector<Document> ScoreCandidates(const Query& query, const std::vector<double>& inverse_document_freqs, const std::vector<int>& candidates) const;
+    // ScoreCandidates, сортировка и усечение до K
+    std::vector<Document> RankCandidates(const Query& query, const std::vector<double>& inverse_document_freqs, const std::vector<int>& candidates) const;
+
+    // документы со всеми обязательными словами, без минус-слов, прошедшие фильтр, по возрастанию id
+    // списки пересекаются от самого короткого: остальные списки не обходятся, а проверяются поиском
+    // по дереву с текущего id ведущего списка, и ведущий список перепрыгивает к следующему общему кандидату,
+    // так что работа пропорциональна длине самого редкого списка, а не сумме длин
+    template <typename DocumentFilter>
+    std::vector<int> FindRequiredCandidates(const Query& query, DocumentFilter document_filter, QueryStats* stats) const;
+
+    // список постингов плюс-слова в разделе одного статуса с IDF слова
+    struct ScoringTerm {
+        const PostingList* postings;
+        double inverse_document_freq;
+    };
+
+    // план полного перебора, общий для seq и par: строится до обхода постингов
+    struct ScoringPlan {
+        // непустые списки плюс-слов в порядке слов запроса - в этом порядке суммируется релевантность документа
+        std::vector<ScoringTerm> terms;
+        // индекс самого длинного списка в terms: он задает большую часть работы
+        size_t longest_term = 0;
+        // документы с минус-словами - исключаются до вычисления релевантности
+        DocumentBitmap excluded;
+        // промежуток id и число постингов списков terms - по ним выбирается плотный перебор
+        int first_document_id = std::numeric_limits<int>::max();
+        int last_document_id = std::numeric_limits<int>::min();
+        size_t postings_count = 0;
+    };
+
+    // пустой план (terms пуст), если плюс-слова не встречаются в документах нужных статусов;
+    // тогда списки минус-слов не обходятся
+    template <typename DocumentFilter>
+    ScoringPlan BuildScoringPlan(const Query& query, const std::vector<double>& inverse_document_freqs, const DocumentFilter& document_filter) const;
+
+    // полный перебор плана в диапазоне id range: найденные документы передаются в consume по возрастанию id;
+    // общий для постраничного поиска и задач par
+    // плотный план (промежуток id не больше DENSE_SCORING_MAX_SPREAD постингов на документ) считается в ScoreDense,
+    // остальные - в ScoreInMap
+    template <typename DocumentFilter, typename DocumentConsumer>
+    void ScoreRange(const ScoringPlan& plan, DocumentFilter document_filter, DocumentRange range, DocumentConsumer& consume) const;
+
+    // перебор в плотном массиве оценок окна window (внутри [first_document_id, last_document_id]) ядрами scoring_kernels:
+    // постинги переписываются кусками в буферы смещений и частот, минус-слова накладываются маской,
+    // найденные документы выбираются сжатием; релевантность совпадает с перебором в мапе до бита
+    template <typename DocumentFilter, typename DocumentConsumer>
+    void ScoreDense(const ScoringPlan& plan, DocumentFilter document_filter, DocumentRange window, DocumentConsumer& consume) const;
+
+    // перебор с суммированием релевантности в мапе
+    template <typename DocumentFilter, typename DocumentConsumer>
+    void ScoreInMap(const ScoringPlan& plan, DocumentFilter document_filter, DocumentRange range, DocumentConsumer& consume) const;
+
+    // все найденные документы по одному передаются в consume, не накапливаясь:
+    // полный перебор идет окнами по STREAMED_SCORING_WINDOW id, кандидаты обязательных слов - по возрастанию id
+    template <typename DocumentFilter, typename DocumentConsumer>
+    void ForEachMatchedDocument(const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, DocumentConsumer consume) const;
+    // полный перебор в range_count диапазонах id параллельно; число выполненных задач - в stats->parallel_tasks
+    template <typename DocumentFilter>
+    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, size_t range_count, QueryStats* stats) const;
 
     static bool IsValidWord(const std::string_view word);
+    // терм встречается хотя бы в одном документе: слова удаленных документов остаются в индексе с пустыми постингами,
+    // поэтому раскрытие префиксов, исправление опечаток, индекс вкладов и статистика их пропускают
+    static bool IsLiveTerm(const TermPostings& postings);
 };
 
 template <typename StringCollection>
-SearchServer::SearchServer(const StringCollection& stop_words) {
+SearchServer::SearchServer(const StringCollection& stop_words, std::pmr::memory_resource* upstream)
+    : SearchServer(upstream) {
     for(const auto& it : stop_words) {
         // Наличие спецсимволов — то есть символов с кодами в диапазоне от 0 до 31 включительно
         if(!IsValidWord(it))
@@ -130,28 +635,47 @@ SearchServer::SearchServer(const StringCollection& stop_words) {
         // если слово it не пустое, то добавляем
         // stop_words_ это множество set, соответственно дубликаты отсеются
         if(!it.empty())
-            stop_words_.insert(static_cast<std::string>(it));
+            stop_words_.emplace(std::string_view(it));
     }
 }
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    const QueryLogScope log_scope(query_log_, raw_query, document_predicate);
+    StageTimer query_timer(metrics_.query_duration);
+    StageTimer stage(metrics_.query_parse);
     const Query query = ParseQuery(raw_query);
+    const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+    stage.Stop();
 
-    std::vector<Document> result = FindAllDocuments(query, document_predicate);
-        
-    sort(result.begin(), result.end(),
-         [](const Document& lhs, const Document& rhs) {
-            if(std::abs(lhs.relevance - rhs.relevance) < EPSILON_DOUBLE) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-         });
-    if(result.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        result.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+    // в выдачу попадают только MAX_RESULT_DOCUMENT_COUNT документов - остальные не досчитываем
+    std::vector<Document> result = EvaluateApproximately(query, inverse_document_freqs, nullptr,
+        [this, &document_predicate](const Query& evaluated_query, const std::vector<double>& evaluated_inverse_document_freqs) {
+            return FindTopDocumentsSeq(evaluated_query, evaluated_inverse_document_freqs, document_predicate, nullptr);
+        });
 
+    metrics_.queries.Add();
+    metrics_.documents_returned.Add(result.size());
+    return result;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const {
+    const QueryLogScope log_scope(query_log_, raw_query, document_predicate);
+    StageTimer query_timer(metrics_.query_duration);
+    StageTimer stage(metrics_.query_parse);
+    const Query query = ParseQuery(raw_query);
+    const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+    stage.Stop();
+
+    stats = QueryStats();
+    std::vector<Document> result = EvaluateApproximately(query, inverse_document_freqs, &stats,
+        [this, &document_predicate, &stats](const Query& evaluated_query, const std::vector<double>& evaluated_inverse_document_freqs) {
+            return FindTopDocumentsSeq(evaluated_query, evaluated_inverse_document_freqs, document_predicate, &stats);
+        });
+
+    metrics_.queries.Add();
+    metrics_.documents_returned.Add(result.size());
     return result;
 }
 
@@ -162,109 +686,931 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::execution::seque
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    const QueryLogScope log_scope(query_log_, raw_query, document_predicate);
+    StageTimer query_timer(metrics_.query_duration);
+    StageTimer stage(metrics_.query_parse);
+    const Query query = ParseQuery(raw_query);
+    const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+    stage.Stop();
+
+    std::vector<Document> result = EvaluateApproximately(query, inverse_document_freqs, nullptr,
+        [this, &document_predicate](const Query& evaluated_query, const std::vector<double>& evaluated_inverse_document_freqs) {
+            return FindTopDocumentsExhaustiveParallel(evaluated_query, evaluated_inverse_document_freqs, document_predicate,
+                std::max(1u, std::thread::hardware_concurrency()), nullptr);
+        });
+
+    metrics_.queries.Add();
+    metrics_.documents_returned.Add(result.size());
+    return result;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    QueryStats stats;
+    return FindTopDocuments(auto_execution, raw_query, document_predicate, stats);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const {
+    const QueryLogScope log_scope(query_log_, raw_query, document_predicate);
+    StageTimer query_timer(metrics_.query_duration);
+    StageTimer stage(metrics_.query_parse);
+    const Query query = ParseQuery(raw_query);
+    const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+    const PlannerThresholds thresholds = GetPlannerThresholds();
+    const size_t parallelism = thresholds.parallelism > 0 ? thresholds.parallelism : std::thread::hardware_concurrency();
+    stage.Stop();
+
+    // план строится по запросу, который действительно выполняется: без слов, отброшенных приближенным поиском
+    stats = QueryStats();
+    std::vector<Document> result = EvaluateApproximately(query, inverse_document_freqs, &stats,
+        [&](const Query& evaluated_query, const std::vector<double>& evaluated_inverse_document_freqs) {
+            const QueryWorkEstimate estimate = EstimateQueryWork(evaluated_query, document_predicate);
+            const QueryPlan plan = PlanQuery(estimate, thresholds, parallelism);
+            std::vector<Document> documents = FindTopDocumentsPlanned(evaluated_query, evaluated_inverse_document_freqs, document_predicate, plan, &stats);
+            stats.estimated_postings = estimate.postings;
+            return documents;
+        });
+
+    metrics_.queries.Add();
+    metrics_.documents_returned.Add(result.size());
+    return result;
+}
+
+template <typename DocumentPredicate>
+SearchPage SearchServer::FindTopDocumentsAfter(const std::string_view raw_query, const SearchCursor& cursor, int page_size, DocumentPredicate document_predicate) const {
+    if(page_size <= 0)
+        throw std::invalid_argument("Page size must be positive");
+
+    StageTimer query_timer(metrics_.query_duration);
+    StageTimer stage(metrics_.query_parse);
     const Query query = ParseQuery(raw_query);
+    const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+    stage.Stop();
 
-    std::vector<Document> result = FindAllDocuments(std::execution::par, query, document_predicate);
+    // куча ограниченного размера: на вершине худший из отобранных документов
+    // отбираем на один документ больше страницы, чтобы узнать, есть ли продолжение;
+    // документы приходят прямо из перебора, поэтому память - размер страницы, а не число найденных
+    const size_t heap_limit = static_cast<size_t>(page_size) + 1;
+    std::vector<Document> heap;
+    heap.reserve(heap_limit);
 
-    sort(std::execution::par, result.begin(), result.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if(std::abs(lhs.relevance - rhs.relevance) < EPSILON_DOUBLE) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
+    ForEachMatchedDocument(query, inverse_document_freqs, document_predicate,
+        [&cursor, heap_limit, &heap](const Document& document) {
+            // порог снизу - курсор, порог сверху - худший документ в заполненной куче
+            if(!cursor.IsBefore(document)) {
+                return;
             }
+            if(heap.size() == heap_limit) {
+                if(!IsRankedBefore(document, heap.front())) {
+                    return;
+                }
+                std::pop_heap(heap.begin(), heap.end(), IsRankedBefore);
+                heap.pop_back();
+            }
+            heap.push_back(document);
+            std::push_heap(heap.begin(), heap.end(), IsRankedBefore);
         });
 
+    StageTimer sort_stage(metrics_.query_sort);
+    std::sort_heap(heap.begin(), heap.end(), IsRankedBefore);
+
+    SearchPage page;
+    page.has_more = heap.size() == heap_limit;
+    if(page.has_more) {
+        heap.pop_back();
+    }
+    page.next_cursor = heap.empty() ? cursor : SearchCursor(heap.back());
+    page.documents = std::move(heap);
+    sort_stage.Stop();
+
+    metrics_.queries.Add();
+    metrics_.documents_returned.Add(page.documents.size());
+    return page;
+}
+
+template <typename DocumentPredicate>
+std::pair<size_t, size_t> SearchServer::GetStatusRange(const DocumentPredicate& document_predicate) {
+    (void)document_predicate;
+    return {0, STATUS_COUNT};
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::IsAcceptedDocument(int document_id, DocumentPredicate& document_predicate) const {
+    const auto& document_data = documents_.at(document_id);
+    return document_predicate(document_id, document_data.status, document_data.rating);
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::IsEmptyFilter(const DocumentPredicate& document_predicate) const {
+    (void)document_predicate;
+    return false;
+}
+
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindTopDocumentsPruned(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryStats* stats) const {
+    if(stats) {
+        stats->evaluator = QueryEvaluator::MAX_SCORE;
+    }
+    if(IsEmptyFilter(document_filter)) {
+        return {};
+    }
+    const std::vector<int> candidates = FindPrunedCandidates(query, inverse_document_freqs, document_filter, ALL_DOCUMENTS, stats);
+
+    // релевантность кандидатов пересчитываем в порядке слов запроса, как при полном переборе,
+    // чтобы результат совпадал побитово
+    StageTimer stage(metrics_.query_sort);
+    return RankCandidates(query, inverse_document_freqs, candidates);
+}
+
+template <typename DocumentFilter>
+std::vector<int> SearchServer::FindPrunedCandidates(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, DocumentRange range, QueryStats* stats) const {
+    const auto [first_status, last_status] = GetStatusRange(document_filter);
+
+    StageTimer stage(metrics_.query_filter);
+    std::vector<const PostingList*> minus_postings;
+    for(const std::string_view& word : query.minus_words) {
+        const auto postings_it = word_to_document_freqs_.find(word);
+        if(postings_it == word_to_document_freqs_.end()) {
+            continue;
+        }
+        for(size_t status = first_status; status < last_status; ++status) {
+            if(!postings_it->second.by_status[status].freqs.empty()) {
+                minus_postings.push_back(&postings_it->second.by_status[status]);
+            }
+        }
+    }
+
+    stage.Switch(metrics_.query_score);
+
+    // курсор по части списка постингов одного терма в одном разделе статуса, попадающей в диапазон
+    struct PostingCursor {
+        std::pmr::map<int, double>::const_iterator it;
+        std::pmr::map<int, double>::const_iterator end;
+        const PostingList* postings;
+        double inverse_document_freq;
+        double upper_bound; // максимальный вклад списка в релевантность
+    };
+
+    std::vector<PostingCursor> cursors;
+    for(size_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto postings_it = word_to_document_freqs_.find(query.plus_words[i]);
+        if(postings_it == word_to_document_freqs_.end()) {
+            continue;
+        }
+        for(size_t status = first_status; status < last_status; ++status) {
+            const PostingList& postings = postings_it->second.by_status[status];
+            const auto begin = postings.freqs.lower_bound(range.first);
+            const auto end = postings.freqs.upper_bound(range.last);
+            if(begin != end) {
+                cursors.push_back({begin, end, &postings,
+                                   inverse_document_freqs[i], postings.max_term_freq * inverse_document_freqs[i]});
+            }
+        }
+    }
+
+    // списки по возрастанию оценки; bound_prefix[i] - сумма оценок списков 0..i
+    std::sort(cursors.begin(), cursors.end(),
+        [](const PostingCursor& lhs, const PostingCursor& rhs) { return lhs.upper_bound < rhs.upper_bound; });
+    std::vector<double> bound_prefix(cursors.size());
+    double bound_sum = 0.0;
+    for(size_t i = 0; i < cursors.size(); ++i) {
+        bound_sum += cursors[i].upper_bound;
+        bound_prefix[i] = bound_sum;
+    }
+
+    // документ с релевантностью ниже K-й лучшей больше чем на EPSILON_DOUBLE в выдачу не попадет
+    // при любом рейтинге; второй EPSILON_DOUBLE - запас на округление при суммировании в другом порядке
+    const double threshold_margin = 2 * EPSILON_DOUBLE;
+    double threshold = -std::numeric_limits<double>::infinity();
+    std::priority_queue<double, std::vector<double>, std::greater<double>> top_relevances;
+    std::vector<int> candidates;
+
+    // списки 0..first_essential-1 вместе не могут дать порог - новых кандидатов берем только из остальных
+    size_t first_essential = 0;
+    size_t postings_scanned = 0;
+    size_t documents_scored = 0;
+    while(true) {
+        while(first_essential < cursors.size() && bound_prefix[first_essential] < threshold) {
+            ++first_essential;
+        }
+        if(first_essential == cursors.size()) {
+            break;
+        }
+
+        int document_id = std::numeric_limits<int>::max();
+        for(size_t i = first_essential; i < cursors.size(); ++i) {
+            if(cursors[i].it != cursors[i].end) {
+                document_id = std::min(document_id, cursors[i].it->first);
+            }
+        }
+        if(document_id == std::numeric_limits<int>::max()) {
+            break;
+        }
+
+        double relevance = 0.0;
+        for(size_t i = first_essential; i < cursors.size(); ++i) {
+            if(cursors[i].it != cursors[i].end && cursors[i].it->first == document_id) {
+                relevance += cursors[i].it->second * cursors[i].inverse_document_freq;
+                ++cursors[i].it;
+                ++postings_scanned;
+            }
+        }
+        ++documents_scored;
+
+        if(first_essential > 0) {
+            // сначала оценка по блокам, затем точный поиск в неосновных списках с отсечением
+            const int block = GetPostingBlock(document_id);
+            double block_bound = 0.0;
+            for(size_t i = 0; i < first_essential; ++i) {
+                block_bound += GetBlockMaxTermFreq(*cursors[i].postings, block) * cursors[i].inverse_document_freq;
+            }
+            if(relevance + block_bound < threshold) {
+                continue;
+            }
+
+            bool is_pruned = false;
+            for(size_t i = first_essential; i-- > 0;) {
+                if(relevance + bound_prefix[i] < threshold) {
+                    is_pruned = true;
+                    break;
+                }
+                const auto it = cursors[i].postings->freqs.find(document_id);
+                ++postings_scanned;
+                if(it != cursors[i].postings->freqs.end()) {
+                    relevance += it->second * cursors[i].inverse_document_freq;
+                }
+            }
+            if(is_pruned) {
+                continue;
+            }
+        }
+
+        if(relevance < threshold) {
+            continue;
+        }
+        if(std::any_of(minus_postings.begin(), minus_postings.end(),
+            [document_id](const PostingList* postings) { return postings->freqs.count(document_id) > 0; })) {
+            continue;
+        }
+        if(!IsAcceptedDocument(document_id, document_filter)) {
+            continue;
+        }
+
+        candidates.push_back(document_id);
+        top_relevances.push(relevance);
+        if(top_relevances.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            top_relevances.pop();
+        }
+        if(top_relevances.size() == MAX_RESULT_DOCUMENT_COUNT) {
+            threshold = top_relevances.top() - threshold_margin;
+        }
+    }
+
+    if(stats) {
+        stats->postings_scanned = postings_scanned;
+        stats->documents_scored = documents_scored;
+        stats->early_terminated = first_essential == cursors.size() && !cursors.empty();
+    }
+
+    return candidates;
+}
+
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindTopDocumentsByImpact(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryStats* stats) const {
+    if(stats) {
+        stats->evaluator = QueryEvaluator::IMPACT_ORDERED;
+    }
+    if(IsEmptyFilter(document_filter)) {
+        return {};
+    }
+    const auto [first_status, last_status] = GetStatusRange(document_filter);
+
+    StageTimer stage(metrics_.query_filter);
+    std::vector<const PostingList*> minus_postings;
+    for(const std::string_view& word : query.minus_words) {
+        const auto postings_it = word_to_document_freqs_.find(word);
+        if(postings_it == word_to_document_freqs_.end()) {
+            continue;
+        }
+        for(size_t status = first_status; status < last_status; ++status) {
+            if(!postings_it->second.by_status[status].freqs.empty()) {
+                minus_postings.push_back(&postings_it->second.by_status[status]);
+            }
+        }
+    }
+
+    stage.Switch(metrics_.query_score);
+
+    // список постингов одного терма в одном разделе статуса и номер его следующего сегмента
+    struct ImpactList {
+        const ImpactPostings* postings;
+        double inverse_document_freq;
+        size_t next_segment;
+    };
+
+    const auto segment_impact = [](const ImpactList& list) {
+        // первый постинг сегмента - максимальный по частоте
+        return list.next_segment * IMPACT_SEGMENT_SIZE < list.postings->size()
+            ? (*list.postings)[list.next_segment * IMPACT_SEGMENT_SIZE].second * list.inverse_document_freq
+            : 0.0;
+    };
+
+    std::vector<ImpactList> lists;
+    size_t segments_total = 0;
+    for(size_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto postings_it = impact_index_.find(query.plus_words[i]);
+        if(postings_it == impact_index_.end()) {
+            continue;
+        }
+        for(size_t status = first_status; status < last_status; ++status) {
+            const ImpactPostings& postings = postings_it->second.by_status[status];
+            if(!postings.empty()) {
+                lists.push_back({&postings, inverse_document_freqs[i], 0});
+                segments_total += (postings.size() + IMPACT_SEGMENT_SIZE - 1) / IMPACT_SEGMENT_SIZE;
+            }
+        }
+    }
+
+    // очередь списков по вкладу следующего сегмента
+    std::priority_queue<std::pair<double, size_t>> segment_queue;
+    // сумма вкладов следующих сегментов - верхняя оценка того, что документ еще может добрать
+    double remaining_bound = 0.0;
+    for(size_t i = 0; i < lists.size(); ++i) {
+        segment_queue.push({segment_impact(lists[i]), i});
+        remaining_bound += segment_impact(lists[i]);
+    }
+
+    // накопленная релевантность; NaN - документ исключен минус-словом или фильтром
+    std::unordered_map<int, double> accumulators;
+    const double excluded = std::numeric_limits<double>::quiet_NaN();
+    const double threshold_margin = 2 * EPSILON_DOUBLE;
+
+    size_t postings_scanned = 0;
+    size_t segments_processed = 0;
+    size_t next_check = 1;
+    bool is_terminated = false;
+    std::vector<int> candidates;
+
+    while(!segment_queue.empty()) {
+        const auto [impact, list_index] = segment_queue.top();
+        segment_queue.pop();
+        ImpactList& list = lists[list_index];
+        remaining_bound -= impact;
+
+        const size_t begin = list.next_segment * IMPACT_SEGMENT_SIZE;
+        const size_t end = std::min(begin + IMPACT_SEGMENT_SIZE, list.postings->size());
+        for(size_t i = begin; i < end; ++i) {
+            const auto [document_id, term_freq] = (*list.postings)[i];
+            auto [it, is_new] = accumulators.try_emplace(document_id, 0.0);
+            if(is_new) {
+                const bool is_minus = std::any_of(minus_postings.begin(), minus_postings.end(),
+                    [document_id = document_id](const PostingList* postings) { return postings->freqs.count(document_id) > 0; });
+                if(is_minus || !IsAcceptedDocument(document_id, document_filter)) {
+                    it->second = excluded;
+                }
+            }
+            it->second += term_freq * list.inverse_document_freq;
+        }
+        postings_scanned += end - begin;
+        ++segments_processed;
+
+        ++list.next_segment;
+        const double next_impact = segment_impact(list);
+        if(list.next_segment * IMPACT_SEGMENT_SIZE < list.postings->size()) {
+            segment_queue.push({next_impact, list_index});
+            remaining_bound += next_impact;
+        }
+
+        // проверка остановки дорогая (проход по накопителям), поэтому выполняется все реже
+        if(segments_processed < next_check || segment_queue.empty()) {
+            continue;
+        }
+        next_check *= 2;
+
+        std::vector<double> relevances;
+        relevances.reserve(accumulators.size());
+        for(const auto& [_, relevance] : accumulators) {
+            (void)_;
+            if(!std::isnan(relevance)) {
+                relevances.push_back(relevance);
+            }
+        }
+        if(relevances.size() < MAX_RESULT_DOCUMENT_COUNT) {
+            continue;
+        }
+        std::nth_element(relevances.begin(), relevances.begin() + (MAX_RESULT_DOCUMENT_COUNT - 1), relevances.end(), std::greater<double>());
+        // накопленная релевантность только растет, поэтому K-я накопленная - нижняя оценка K-й итоговой
+        const double threshold = relevances[MAX_RESULT_DOCUMENT_COUNT - 1] - threshold_margin;
+
+        // ни один еще не встреченный документ не доберет порог
+        if(remaining_bound >= threshold) {
+            continue;
+        }
+        // кандидаты - встреченные документы, которые с остатком еще могут добрать порог
+        candidates.clear();
+        for(const auto& [document_id, relevance] : accumulators) {
+            if(!std::isnan(relevance) && relevance + remaining_bound >= threshold) {
+                candidates.push_back(document_id);
+            }
+        }
+        is_terminated = true;
+        break;
+    }
+
+    if(!is_terminated) {
+        for(const auto& [document_id, relevance] : accumulators) {
+            if(!std::isnan(relevance)) {
+                candidates.push_back(document_id);
+            }
+        }
+    }
+
+    if(stats) {
+        stats->postings_scanned = postings_scanned;
+        stats->documents_scored = accumulators.size();
+        stats->segments_processed = segments_processed;
+        stats->segments_total = segments_total;
+        stats->early_terminated = is_terminated;
+    }
+
+    // итоговый порядок среди оставшихся кандидатов требует точной релевантности
+    stage.Switch(metrics_.query_sort);
+    return RankCandidates(query, inverse_document_freqs, candidates);
+}
+
+template <typename DocumentFilter>
+std::vector<int> SearchServer::FindRequiredCandidates(const SearchServer::Query& query, DocumentFilter document_filter, QueryStats* stats) const {
+    const auto [first_status, last_status] = GetStatusRange(document_filter);
+
+    StageTimer stage(metrics_.query_filter);
+    std::vector<const TermPostings*> required_postings;
+    for(const std::string_view& word : query.required_words) {
+        const auto postings_it = word_to_document_freqs_.find(word);
+        if(postings_it == word_to_document_freqs_.end()) {
+            return {};
+        }
+        required_postings.push_back(&postings_it->second);
+    }
+    std::vector<const PostingList*> minus_postings;
+    for(const std::string_view& word : query.minus_words) {
+        const auto postings_it = word_to_document_freqs_.find(word);
+        if(postings_it == word_to_document_freqs_.end()) {
+            continue;
+        }
+        for(size_t status = first_status; status < last_status; ++status) {
+            if(!postings_it->second.by_status[status].freqs.empty()) {
+                minus_postings.push_back(&postings_it->second.by_status[status]);
+            }
+        }
+    }
+
+    stage.Switch(metrics_.query_score);
+    std::vector<int> candidates;
+    size_t postings_scanned = 0;
+    // документ лежит в разделе одного статуса - пересекаем списки внутри каждого раздела
+    std::vector<const PostingList*> lists(required_postings.size());
+    std::vector<std::pmr::map<int, double>::const_iterator> cursors(required_postings.size());
+    for(size_t status = first_status; status < last_status; ++status) {
+        for(size_t i = 0; i < required_postings.size(); ++i) {
+            lists[i] = &required_postings[i]->by_status[status];
+        }
+        std::sort(lists.begin(), lists.end(),
+            [](const PostingList* lhs, const PostingList* rhs) { return lhs->freqs.size() < rhs->freqs.size(); });
+        if(lists.front()->freqs.empty()) {
+            continue;
+        }
+        for(size_t i = 0; i < lists.size(); ++i) {
+            cursors[i] = lists[i]->freqs.begin();
+        }
+
+        const auto& lead = lists.front()->freqs;
+        while(cursors[0] != lead.end()) {
+            const int document_id = cursors[0]->first;
+            ++postings_scanned;
+            // первый список, в котором документа нет; lists.size() - документ есть во всех
+            size_t missing = lists.size();
+            bool is_exhausted = false;
+            for(size_t i = 1; i < lists.size(); ++i) {
+                if(cursors[i]->first < document_id) {
+                    cursors[i] = lists[i]->freqs.lower_bound(document_id);
+                    ++postings_scanned;
+                }
+                if(cursors[i] == lists[i]->freqs.end()) {
+                    is_exhausted = true;
+                    break;
+                }
+                if(cursors[i]->first != document_id) {
+                    missing = i;
+                    break;
+                }
+            }
+            if(is_exhausted) {
+                break;
+            }
+            if(missing < lists.size()) {
+                // следующий возможный общий документ не меньше текущего id списка, где документа нет
+                cursors[0] = lead.lower_bound(cursors[missing]->first);
+                continue;
+            }
+
+            ++cursors[0];
+            if(std::any_of(minus_postings.begin(), minus_postings.end(),
+                [document_id](const PostingList* postings) { return postings->freqs.count(document_id) > 0; })) {
+                continue;
+            }
+            if(IsAcceptedDocument(document_id, document_filter)) {
+                candidates.push_back(document_id);
+            }
+        }
+    }
+    // разделы статусов обходятся по очереди - восстанавливаем порядок id
+    std::sort(candidates.begin(), candidates.end());
+
+    if(stats) {
+        stats->postings_scanned = postings_scanned;
+        stats->documents_scored = candidates.size();
+    }
+    return candidates;
+}
+
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindTopDocumentsSeq(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryStats* stats) const {
+    if(!query.required_words.empty()) {
+        if(stats) {
+            stats->evaluator = QueryEvaluator::CONJUNCTIVE;
+        }
+        if(IsEmptyFilter(document_filter)) {
+            return {};
+        }
+        const std::vector<int> candidates = FindRequiredCandidates(query, document_filter, stats);
+        StageTimer stage(metrics_.query_sort);
+        return RankCandidates(query, inverse_document_freqs, candidates);
+    }
+    if(has_impact_index_ && query.plus_words.size() <= IMPACT_QUERY_WORD_LIMIT) {
+        return FindTopDocumentsByImpact(query, inverse_document_freqs, document_filter, stats);
+    }
+    return FindTopDocumentsPruned(query, inverse_document_freqs, document_filter, stats);
+}
+
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindTopDocumentsExhaustiveParallel(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, size_t range_count, QueryStats* stats) const {
+    if(stats) {
+        stats->evaluator = QueryEvaluator::EXHAUSTIVE;
+    }
+    std::vector<Document> result = FindAllDocuments(std::execution::par, query, inverse_document_freqs, document_filter, range_count, stats);
+
+    StageTimer stage(metrics_.query_sort);
+    sort(std::execution::par, result.begin(), result.end(), IsRankedBefore);
+
     if(result.size() > MAX_RESULT_DOCUMENT_COUNT) {
         result.resize(MAX_RESULT_DOCUMENT_COUNT);
     }
+    return result;
+}
+
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindTopDocumentsRangeParallel(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, size_t range_count, QueryStats* stats) const {
+    if(stats) {
+        stats->evaluator = QueryEvaluator::MAX_SCORE;
+    }
+    if(IsEmptyFilter(document_filter) || documents_id_.empty()) {
+        return {};
+    }
 
-    return result;    
+    // промежуток id делится на равные диапазоны; id распределены по нему примерно равномерно
+    const long long first_id = *documents_id_.begin();
+    const long long id_span = static_cast<long long>(*documents_id_.rbegin()) - first_id + 1;
+    range_count = std::max<size_t>(std::min<long long>(static_cast<long long>(range_count), id_span), 1);
+    if(stats) {
+        stats->parallel_tasks = range_count;
+    }
+    std::vector<DocumentRange> ranges(range_count);
+    for(size_t r = 0; r < range_count; ++r) {
+        ranges[r].first = static_cast<int>(first_id + id_span * static_cast<long long>(r) / static_cast<long long>(range_count));
+        ranges[r].last = static_cast<int>(first_id + id_span * static_cast<long long>(r + 1) / static_cast<long long>(range_count) - 1);
+    }
+
+    // в каждом диапазоне свой верхний K: общий верхний K - подмножество их объединения
+    std::vector<std::vector<int>> range_candidates(range_count);
+    std::vector<QueryStats> range_stats(range_count);
+    for_each(std::execution::par, ranges.begin(), ranges.end(),
+        [this, &query, &inverse_document_freqs, &document_filter, &ranges, &range_candidates, &range_stats](const DocumentRange& range) {
+            const size_t r = &range - ranges.data();
+            range_candidates[r] = FindPrunedCandidates(query, inverse_document_freqs, document_filter, range, &range_stats[r]);
+        });
+
+    std::vector<int> candidates;
+    for(size_t r = 0; r < range_count; ++r) {
+        candidates.insert(candidates.end(), range_candidates[r].begin(), range_candidates[r].end());
+        if(stats) {
+            stats->postings_scanned += range_stats[r].postings_scanned;
+            stats->documents_scored += range_stats[r].documents_scored;
+            stats->early_terminated = stats->early_terminated || range_stats[r].early_terminated;
+        }
+    }
+
+    StageTimer stage(metrics_.query_sort);
+    return RankCandidates(query, inverse_document_freqs, candidates);
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const SearchServer::Query& query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for(const std::string_view& word : query.plus_words) {
-        if(word_to_document_freqs_.count(word) == 0) {
+template <typename Evaluator>
+std::vector<Document> SearchServer::EvaluateApproximately(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, QueryStats* stats, Evaluator evaluate) const {
+    Query reduced_query;
+    std::vector<double> reduced_inverse_document_freqs;
+    if(!DropLowIdfWords(query, inverse_document_freqs, reduced_query, reduced_inverse_document_freqs)) {
+        return evaluate(query, inverse_document_freqs);
+    }
+
+    const std::vector<Document> selected = evaluate(reduced_query, reduced_inverse_document_freqs);
+    const size_t words_skipped = query.plus_words.size() - reduced_query.plus_words.size();
+    if(stats) {
+        stats->words_skipped = words_skipped;
+    }
+    metrics_.query_words_skipped.Add(words_skipped);
+
+    std::vector<int> candidates;
+    candidates.reserve(selected.size());
+    for(const Document& document : selected) {
+        candidates.push_back(document.id);
+    }
+    return RankCandidates(query, inverse_document_freqs, candidates);
+}
+
+template <typename DocumentFilter>
+QueryWorkEstimate SearchServer::EstimateQueryWork(const SearchServer::Query& query, const DocumentFilter& document_filter) const {
+    const auto [first_status, last_status] = GetStatusRange(document_filter);
+    QueryWorkEstimate estimate;
+    const auto add_postings = [&](const std::string_view word) {
+        const auto postings_it = word_to_document_freqs_.find(word);
+        if(postings_it != word_to_document_freqs_.end()) {
+            for(size_t status = first_status; status < last_status; ++status) {
+                estimate.postings += postings_it->second.by_status[status].freqs.size();
+            }
+        }
+    };
+    for(const std::string_view word : query.plus_words) {
+        add_postings(word);
+    }
+    for(const std::string_view word : query.minus_words) {
+        add_postings(word);
+    }
+    return estimate;
+}
+
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindTopDocumentsPlanned(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, QueryPlan plan, QueryStats* stats) const {
+    // пересечение обходит только самый редкий список - делить на задачи нечего
+    if(!query.required_words.empty()) {
+        plan = QueryPlan{};
+    }
+    // параллельные способы уточняют parallel_tasks: задач может получиться меньше, чем в плане
+    if(stats) {
+        stats->strategy = plan.strategy;
+        stats->parallel_tasks = plan.tasks;
+    }
+    switch(plan.strategy) {
+        case ExecutionStrategy::SEQUENTIAL:
+            return FindTopDocumentsSeq(query, inverse_document_freqs, document_filter, stats);
+        case ExecutionStrategy::EXHAUSTIVE_RANGE_PARALLEL:
+            return FindTopDocumentsExhaustiveParallel(query, inverse_document_freqs, document_filter, plan.tasks, stats);
+        case ExecutionStrategy::DOC_RANGE_PARALLEL:
+            return FindTopDocumentsRangeParallel(query, inverse_document_freqs, document_filter, plan.tasks, stats);
+    }
+    return {};
+}
+
+template <typename DocumentFilter>
+SearchServer::ScoringPlan SearchServer::BuildScoringPlan(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, const DocumentFilter& document_filter) const {
+    const auto [first_status, last_status] = GetStatusRange(document_filter);
+
+    ScoringPlan plan;
+    for(size_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto postings_it = word_to_document_freqs_.find(query.plus_words[i]);
+        if(postings_it == word_to_document_freqs_.end()) {
             continue;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for(const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if(document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        for(size_t status = first_status; status < last_status; ++status) {
+            const PostingList& postings = postings_it->second.by_status[status];
+            if(postings.freqs.empty()) {
+                continue;
+            }
+            if(!plan.terms.empty() && postings.freqs.size() > plan.terms[plan.longest_term].postings->freqs.size()) {
+                plan.longest_term = plan.terms.size();
             }
+            plan.terms.push_back({&postings, inverse_document_freqs[i]});
+            plan.first_document_id = std::min(plan.first_document_id, postings.freqs.begin()->first);
+            plan.last_document_id = std::max(plan.last_document_id, postings.freqs.rbegin()->first);
+            plan.postings_count += postings.freqs.size();
         }
     }
+    if(plan.terms.empty()) {
+        return plan;
+    }
 
     for(const std::string_view& word : query.minus_words) {
-        if(word_to_document_freqs_.count(word) == 0) {
+        const auto postings_it = word_to_document_freqs_.find(word);
+        if(postings_it == word_to_document_freqs_.end()) {
             continue;
         }
-        for(const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            (void)_; // убираем предупреждение об неиспользуемой переменной
-            document_to_relevance.erase(document_id);
+        for(size_t status = first_status; status < last_status; ++status) {
+            for(const auto& [document_id, _] : postings_it->second.by_status[status].freqs) {
+                (void)_; // убираем предупреждение об неиспользуемой переменной
+                plan.excluded.Set(document_id);
+            }
+        }
+    }
+    return plan;
+}
+
+template <typename DocumentFilter, typename DocumentConsumer>
+void SearchServer::ScoreDense(const SearchServer::ScoringPlan& plan, DocumentFilter document_filter, SearchServer::DocumentRange window, DocumentConsumer& consume) const {
+    const size_t document_range = static_cast<size_t>(window.last - window.first) + 1;
+    std::vector<double> scores(document_range, NO_SCORE);
+
+    std::vector<uint32_t> chunk_offsets(DENSE_SCORING_CHUNK_SIZE);
+    std::vector<double> chunk_freqs(DENSE_SCORING_CHUNK_SIZE);
+    for(const ScoringTerm& term : plan.terms) {
+        size_t chunk_size = 0;
+        const auto end = term.postings->freqs.upper_bound(window.last);
+        for(auto it = term.postings->freqs.lower_bound(window.first); it != end; ++it) {
+            chunk_offsets[chunk_size] = static_cast<uint32_t>(it->first - window.first);
+            chunk_freqs[chunk_size] = it->second;
+            if(++chunk_size == DENSE_SCORING_CHUNK_SIZE) {
+                AccumulateScores(chunk_offsets.data(), chunk_freqs.data(), chunk_size, term.inverse_document_freq, scores.data());
+                chunk_size = 0;
+            }
+        }
+        AccumulateScores(chunk_offsets.data(), chunk_freqs.data(), chunk_size, term.inverse_document_freq, scores.data());
+    }
+
+    if(!plan.excluded.Empty()) {
+        std::vector<uint64_t> mask((document_range + 63) / 64, ~uint64_t(0));
+        plan.excluded.ForEach([window, &mask](int document_id) {
+            if(document_id >= window.first && document_id <= window.last) {
+                const size_t offset = static_cast<size_t>(document_id - window.first);
+                mask[offset / 64] &= ~(uint64_t(1) << (offset % 64));
+            }
+        });
+        ApplyScoreMask(mask.data(), document_range, scores.data());
+    }
+
+    // сжатие пишет в начало тех же буферов: выбранные оценки не обгоняют читаемые
+    std::vector<uint32_t> offsets(document_range);
+    const size_t found_count = CompactScores(scores.data(), document_range, offsets.data(), scores.data());
+
+    for(size_t i = 0; i < found_count; ++i) {
+        const int document_id = window.first + static_cast<int>(offsets[i]);
+        if(IsAcceptedDocument(document_id, document_filter)) {
+            consume(Document{
+                document_id,
+                scores[i],
+                documents_.at(document_id).rating
+            });
+        }
+    }
+}
+
+template <typename DocumentFilter, typename DocumentConsumer>
+void SearchServer::ScoreRange(const SearchServer::ScoringPlan& plan, DocumentFilter document_filter, SearchServer::DocumentRange range, DocumentConsumer& consume) const {
+    const DocumentRange window{std::max(range.first, plan.first_document_id), std::min(range.last, plan.last_document_id)};
+    if(plan.terms.empty() || window.first > window.last) {
+        return;
+    }
+    // плотность оценивается по всему плану: задачи par делят его по квантилям самого длинного списка,
+    // и в окне задачи постингов на документ примерно столько же
+    if(static_cast<size_t>(plan.last_document_id - plan.first_document_id) < DENSE_SCORING_MAX_SPREAD * plan.postings_count) {
+        ScoreDense(plan, document_filter, window, consume);
+    } else {
+        ScoreInMap(plan, document_filter, window, consume);
+    }
+}
+
+template <typename DocumentFilter, typename DocumentConsumer>
+void SearchServer::ScoreInMap(const SearchServer::ScoringPlan& plan, DocumentFilter document_filter, SearchServer::DocumentRange range, DocumentConsumer& consume) const {
+    std::map<int, double> document_to_relevance;
+    for(const ScoringTerm& term : plan.terms) {
+        const auto end = term.postings->freqs.upper_bound(range.last);
+        for(auto it = term.postings->freqs.lower_bound(range.first); it != end; ++it) {
+            if(!plan.excluded.Test(it->first) && IsAcceptedDocument(it->first, document_filter)) {
+                document_to_relevance[it->first] += it->second * term.inverse_document_freq;
+            }
         }
     }
 
-    std::vector<Document> matched_documents;
-    matched_documents.reserve(document_to_relevance.size());
     for(const auto& [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({
+        consume(Document{
             document_id,
             relevance,
             documents_.at(document_id).rating
         });
     }
-
-    return matched_documents;
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const SearchServer::Query& query, DocumentPredicate document_predicate) const {
-    return FindAllDocuments(query, document_predicate);
-}
+template <typename DocumentFilter, typename DocumentConsumer>
+void SearchServer::ForEachMatchedDocument(const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, DocumentConsumer consume) const {
+    if(IsEmptyFilter(document_filter)) {
+        return;
+    }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const SearchServer::Query& query, DocumentPredicate document_predicate) const {
-        ConcurrentMap<int, double> concurrent_document_to_relevance;
+    if(!query.required_words.empty()) {
+        const std::vector<int> candidates = FindRequiredCandidates(query, document_filter, nullptr);
+        StageTimer stage(metrics_.query_score);
+        for(const int document_id : candidates) {
+            consume(ScoreCandidate(query, inverse_document_freqs, document_id));
+        }
+        return;
+    }
 
-        // проход по плюс словам
-        for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-            [this, &document_predicate, &concurrent_document_to_relevance](const std::string_view word) {
-                if(word_to_document_freqs_.count(word) == 0) {
-                    return;
-                }
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for(const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if(document_predicate(document_id, document_data.status, document_data.rating)) {
-                        concurrent_document_to_relevance[document_id] += term_freq * inverse_document_freq;
-                    }
-                }
-            });
+    StageTimer stage(metrics_.query_filter);
+    const ScoringPlan plan = BuildScoringPlan(query, inverse_document_freqs, document_filter);
+    if(plan.terms.empty()) {
+        return;
+    }
 
-        // проход по минус словам
-        for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-            [this, &concurrent_document_to_relevance](const std::string_view word) {
-                if(word_to_document_freqs_.count(word) == 0) {
-                    return;
-                }
-                for(const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-                    (void)_;
-                    concurrent_document_to_relevance.erase(document_id);
-                }
-            });
+    stage.Switch(metrics_.query_score);
+    DocumentRange window{plan.first_document_id, 0};
+    while(true) {
+        window.last = window.first > plan.last_document_id - (STREAMED_SCORING_WINDOW - 1)
+            ? plan.last_document_id : window.first + (STREAMED_SCORING_WINDOW - 1);
+        ScoreRange(plan, document_filter, window, consume);
+        if(window.last == plan.last_document_id) {
+            break;
+        }
+        // пустые окна пропускаются: следующее начинается с ближайшего постинга после текущего
+        window.first = plan.last_document_id;
+        for(const ScoringTerm& term : plan.terms) {
+            const auto it = term.postings->freqs.upper_bound(window.last);
+            if(it != term.postings->freqs.end()) {
+                window.first = std::min(window.first, it->first);
+            }
+        }
+    }
+}
+
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, DocumentFilter document_filter, size_t range_count, QueryStats* stats) const {
+    if(stats) {
+        stats->parallel_tasks = 1;
+    }
+    if(IsEmptyFilter(document_filter)) {
+        return {};
+    }
 
-        std::map<int, double> document_to_relevance = concurrent_document_to_relevance.BuildOrdinaryMap();
+    // кандидатов пересечения мало - релевантность считается в одном потоке
+    if(!query.required_words.empty()) {
+        const std::vector<int> candidates = FindRequiredCandidates(query, document_filter, nullptr);
+        StageTimer stage(metrics_.query_score);
+        return ScoreCandidates(query, inverse_document_freqs, candidates);
+    }
 
-        std::vector<Document> matched_documents(document_to_relevance.size());
+    StageTimer stage(metrics_.query_filter);
+    const ScoringPlan plan = BuildScoringPlan(query, inverse_document_freqs, document_filter);
+    if(plan.terms.empty()) {
+        return {};
+    }
 
-        transform(std::execution::par, document_to_relevance.begin(), document_to_relevance.end(), matched_documents.begin(),
-            [this](const auto& it) {
-                return Document(it.first, it.second, documents_.at(it.first).rating);
-            });
+    // задачи делят промежуток id по квантилям блоков самого длинного списка: обходится мапа блоков
+    // (узел на блок из 2^POSTING_BLOCK_BITS id), а не мапа постингов, и работа делится примерно поровну;
+    // документ целиком попадает в одну задачу и его релевантность суммируется в порядке слов запроса,
+    // как в последовательной версии
+    const auto& longest_blocks = plan.terms[plan.longest_term].postings->block_max_term_freqs;
+    range_count = std::min<size_t>(std::max<size_t>(range_count, 1), longest_blocks.size());
+    std::vector<DocumentRange> ranges;
+    ranges.reserve(range_count);
+    auto boundary_it = longest_blocks.begin();
+    int range_first = 0;
+    for(size_t r = 1; r < range_count; ++r) {
+        std::advance(boundary_it, longest_blocks.size() * r / range_count - longest_blocks.size() * (r - 1) / range_count);
+        const int boundary_id = boundary_it->first << POSTING_BLOCK_BITS;
+        ranges.push_back({range_first, boundary_id - 1});
+        range_first = boundary_id;
+    }
+    ranges.push_back({range_first, std::numeric_limits<int>::max()});
+    if(stats) {
+        stats->parallel_tasks = ranges.size();
+    }
 
-        return matched_documents;
+    // диапазоны не пересекаются: у каждой задачи своя мапа без блокировок
+    std::vector<std::vector<Document>> range_documents(ranges.size());
+    stage.Switch(metrics_.query_score);
+    for_each(std::execution::par, ranges.begin(), ranges.end(),
+        [this, &plan, &document_filter, &ranges, &range_documents](const DocumentRange& range) {
+            std::vector<Document>& documents = range_documents[&range - ranges.data()];
+            const auto consume = [&documents](const Document& document) { documents.push_back(document); };
+            ScoreRange(plan, document_filter, range, consume);
+        });
+    stage.Stop();
+
+    // диапазоны идут по возрастанию id - склейка по порядку сохраняет порядок по id
+    size_t matched_count = 0;
+    for(const std::vector<Document>& documents : range_documents) {
+        matched_count += documents.size();
+    }
+    std::vector<Document> matched_documents;
+    matched_documents.reserve(matched_count);
+    for(const std::vector<Document>& documents : range_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    return matched_documents;
 }
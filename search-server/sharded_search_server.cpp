@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <exception>
+#include <numeric>
+
+#include "sharded_search_server.h"
+
+using namespace std;
+
+void ShardedSearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
+    shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+    documents_id_.insert(document_id);
+}
+
+void ShardedSearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    const auto errors = AddDocumentsToShards(documents, true);
+    if(!errors.empty()) {
+        rethrow_exception(errors.front().second);
+    }
+}
+
+vector<pair<size_t, exception_ptr>> ShardedSearchServer::TryAddDocuments(const vector<DocumentInput>& documents) {
+    return AddDocumentsToShards(documents, false);
+}
+
+vector<pair<size_t, exception_ptr>> ShardedSearchServer::AddDocumentsToShards(const vector<DocumentInput>& documents, bool stop_on_error) {
+    vector<vector<size_t>> shard_documents(shards_.size());
+    for(size_t i = 0; i < documents.size(); ++i) {
+        shard_documents[GetShardIndex(documents[i].id)].push_back(i);
+    }
+
+    // у каждого шарда свои структуры, поэтому потоки не пересекаются
+    vector<vector<int>> added_ids(shards_.size());
+    vector<vector<pair<size_t, exception_ptr>>> shard_errors(shards_.size());
+    vector<size_t> shard_indexes(shards_.size());
+    iota(shard_indexes.begin(), shard_indexes.end(), 0);
+    for_each(execution::par, shard_indexes.begin(), shard_indexes.end(),
+        [this, &documents, &shard_documents, &added_ids, &shard_errors, stop_on_error](size_t shard_index) {
+            for(const size_t i : shard_documents[shard_index]) {
+                const DocumentInput& document = documents[i];
+                // исключение не должно покинуть параллельный алгоритм - иначе std::terminate
+                try {
+                    shards_[shard_index]->AddDocument(document.id, document.text, document.status, document.ratings);
+                    added_ids[shard_index].push_back(document.id);
+                } catch(...) {
+                    shard_errors[shard_index].emplace_back(i, current_exception());
+                    if(stop_on_error) {
+                        return;
+                    }
+                }
+            }
+        });
+
+    vector<pair<size_t, exception_ptr>> errors;
+    for(size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+        documents_id_.insert(added_ids[shard_index].begin(), added_ids[shard_index].end());
+        errors.insert(errors.end(), shard_errors[shard_index].begin(), shard_errors[shard_index].end());
+    }
+    sort(errors.begin(), errors.end(),
+        [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    return errors;
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
+    return FindTopDocumentsInShards(raw_query, status, nullptr, false);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status, QueryStats& stats) const {
+    return FindTopDocumentsInShards(raw_query, status, &stats, false);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const execution::sequenced_policy&, const string_view raw_query, DocumentStatus status) const {
+    return FindTopDocumentsInShards(raw_query, status, nullptr, false);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const execution::sequenced_policy&, const string_view raw_query) const {
+    return FindTopDocuments(execution::seq, raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const execution::parallel_policy&, const string_view raw_query, DocumentStatus status) const {
+    return FindTopDocumentsInShards(raw_query, status, nullptr, true);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const execution::parallel_policy&, const string_view raw_query) const {
+    return FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const AutoExecutionPolicy&, const string_view raw_query, DocumentStatus status) const {
+    return FindTopDocumentsPlannedInShards(raw_query, status, nullptr);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const AutoExecutionPolicy&, const string_view raw_query) const {
+    return FindTopDocuments(auto_execution, raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const AutoExecutionPolicy&, const string_view raw_query, DocumentStatus status, QueryStats& stats) const {
+    return FindTopDocumentsPlannedInShards(raw_query, status, &stats);
+}
+
+void ShardedSearchServer::SetPlannerThresholds(const PlannerThresholds& thresholds) {
+    for(const auto& shard : shards_) {
+        shard->SetPlannerThresholds(thresholds);
+    }
+}
+
+PlannerThresholds ShardedSearchServer::GetPlannerThresholds() const {
+    return shards_.front()->GetPlannerThresholds();
+}
+
+void ShardedSearchServer::MergeShardStats(const vector<QueryStats>& shard_stats, QueryStats& stats) {
+    stats = QueryStats();
+    stats.parallel_tasks = 0;
+    size_t busiest_postings = 0;
+    for(const QueryStats& shard : shard_stats) {
+        if(shard.postings_scanned >= busiest_postings) {
+            busiest_postings = shard.postings_scanned;
+            stats.evaluator = shard.evaluator;
+            stats.strategy = shard.strategy;
+        }
+        stats.parallel_tasks += shard.parallel_tasks;
+        stats.estimated_postings += shard.estimated_postings;
+        stats.postings_scanned += shard.postings_scanned;
+        stats.documents_scored += shard.documents_scored;
+        stats.segments_processed += shard.segments_processed;
+        stats.segments_total += shard.segments_total;
+        stats.early_terminated = stats.early_terminated || shard.early_terminated;
+        // порог IDF общий, поэтому шарды отбрасывают одни и те же слова
+        stats.words_skipped = max(stats.words_skipped, shard.words_skipped);
+    }
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)]->MatchDocument(raw_query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const execution::sequenced_policy&, const string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)]->MatchDocument(execution::seq, raw_query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const execution::parallel_policy&, const string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)]->MatchDocument(execution::par, raw_query, document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)]->RemoveDocument(document_id);
+    documents_id_.erase(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(const execution::sequenced_policy&, int document_id) {
+    RemoveDocument(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(const execution::parallel_policy&, int document_id) {
+    shards_[GetShardIndex(document_id)]->RemoveDocument(execution::par, document_id);
+    documents_id_.erase(document_id);
+}
+
+void ShardedSearchServer::UpdateDocumentStatus(int document_id, DocumentStatus status) {
+    shards_[GetShardIndex(document_id)]->UpdateDocumentStatus(document_id, status);
+}
+
+void ShardedSearchServer::UpdateDocumentRating(int document_id, const vector<int>& ratings) {
+    shards_[GetShardIndex(document_id)]->UpdateDocumentRating(document_id, ratings);
+}
+
+void ShardedSearchServer::UpdateDocument(int document_id, const string_view document) {
+    shards_[GetShardIndex(document_id)]->UpdateDocument(document_id, document);
+}
+
+void ShardedSearchServer::BuildImpactIndex() {
+    for_each(execution::par, shards_.begin(), shards_.end(),
+        [](const unique_ptr<SearchServer>& shard) {
+            shard->BuildImpactIndex();
+        });
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    return documents_id_.size();
+}
+
+set<int>::const_iterator ShardedSearchServer::begin() const {
+    return documents_id_.begin();
+}
+
+set<int>::const_iterator ShardedSearchServer::end() const {
+    return documents_id_.end();
+}
+
+const SearchServer::WordFrequencies& ShardedSearchServer::GetWordFrequencies(int document_id) const {
+    return shards_[GetShardIndex(document_id)]->GetWordFrequencies(document_id);
+}
+
+string ShardedSearchServer::GetDocumentText(int document_id) const {
+    return shards_[GetShardIndex(document_id)]->GetDocumentText(document_id);
+}
+
+void ShardedSearchServer::SetTypoTolerance(int max_edit_distance) {
+    for(const auto& shard : shards_) {
+        shard->SetTypoTolerance(max_edit_distance);
+    }
+}
+
+int ShardedSearchServer::GetTypoTolerance() const {
+    return shards_.front()->GetTypoTolerance();
+}
+
+void ShardedSearchServer::SetApproximateIdfThreshold(double threshold) {
+    for(const auto& shard : shards_) {
+        shard->SetApproximateIdfThreshold(threshold);
+    }
+}
+
+double ShardedSearchServer::GetApproximateIdfThreshold() const {
+    return shards_.front()->GetApproximateIdfThreshold();
+}
+
+void ShardedSearchServer::SetQueryLog(QueryLogWriter* query_log) {
+    query_log_ = query_log;
+}
+
+void ShardedSearchServer::SetTextStorage(TextStorage storage, const string& path) {
+    for(size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+        shards_[shard_index]->SetTextStorage(storage, storage == TextStorage::FILE ? path + "."s + to_string(shard_index) : path);
+    }
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    // перемешивание битов: подряд идущие id расходятся по шардам равномерно
+    return MixFingerprintBits(static_cast<uint32_t>(document_id)) % shards_.size();
+}
+
+const SearchServer& ShardedSearchServer::GetShard(size_t shard_index) const {
+    return *shards_.at(shard_index);
+}
+
+void ShardedSearchServer::CorrectQueryTypos(SearchServer::Query& query) const {
+    const int tolerance = GetTypoTolerance();
+    if(tolerance == 0) {
+        return;
+    }
+    vector<string_view> corrections;
+    auto word_it = query.plus_words.begin();
+    while(word_it != query.plus_words.end()) {
+        const string_view word = *word_it;
+        const bool is_known = any_of(shards_.begin(), shards_.end(),
+            [word](const auto& shard) { return shard->GetWordDocumentCount(word) > 0; });
+        if(is_known || find(query.required_words.begin(), query.required_words.end(), word) != query.required_words.end()) {
+            ++word_it;
+            continue;
+        }
+        // ближайшие термы объединения - среди ближайших термов каждого шарда
+        const int max_distance = SearchServer::GetTypoDistanceLimit(word.size(), tolerance);
+        vector<pair<string_view, int>> word_corrections;
+        for(const auto& shard : shards_) {
+            const auto shard_corrections = shard->FindTypoCorrections(word, max_distance);
+            word_corrections.insert(word_corrections.end(), shard_corrections.begin(), shard_corrections.end());
+        }
+        SearchServer::SelectTypoCorrections(word_corrections);
+        if(word_corrections.empty()) {
+            ++word_it;
+            continue;
+        }
+        for(const auto& [term, _] : word_corrections) {
+            (void)_;
+            corrections.push_back(term);
+        }
+        word_it = query.plus_words.erase(word_it);
+    }
+    SearchServer::AddQueryWords(query.plus_words, corrections);
+}
+
+void ShardedSearchServer::ExpandQueryPrefixes(SearchServer::Query& query) const {
+    // первые по алфавиту термы объединения - среди первых термов каждого шарда
+    const auto expand_prefix = [this](const string_view prefix, size_t limit) {
+        vector<string_view> terms;
+        for(const auto& shard : shards_) {
+            const vector<string_view> shard_terms = shard->ExpandPrefix(prefix, limit);
+            terms.insert(terms.end(), shard_terms.begin(), shard_terms.end());
+        }
+        sort(terms.begin(), terms.end());
+        terms.erase(unique(terms.begin(), terms.end()), terms.end());
+        if(terms.size() > limit) {
+            terms.resize(limit);
+        }
+        return terms;
+    };
+
+    for(const string_view prefix : query.plus_prefixes) {
+        SearchServer::AddQueryWords(query.plus_words, expand_prefix(prefix, MAX_PREFIX_EXPANSION_COUNT));
+    }
+    // минус-префикс, как и в SearchServer, раскрывается целиком
+    for(const string_view prefix : query.minus_prefixes) {
+        SearchServer::AddQueryWords(query.minus_words, expand_prefix(prefix, numeric_limits<size_t>::max()));
+    }
+}
+
+vector<double> ShardedSearchServer::ComputeInverseDocumentFreqs(const SearchServer::Query& query) const {
+    // та же формула, что в SearchServer::ComputeWordInverseDocumentFreq, по суммарным числам
+    const int document_count = GetDocumentCount();
+    vector<double> inverse_document_freqs(query.plus_words.size(), 0.0);
+    for(size_t i = 0; i < query.plus_words.size(); ++i) {
+        size_t word_document_count = 0;
+        for(const auto& shard : shards_) {
+            word_document_count += shard->GetWordDocumentCount(query.plus_words[i]);
+        }
+        if(word_document_count > 0) {
+            inverse_document_freqs[i] = log(document_count * 1.0 / word_document_count);
+        }
+    }
+    return inverse_document_freqs;
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <execution>
+#include <memory>
+#include <numeric>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "search_server.h"
+
+// документ для пакетного добавления
+struct DocumentInput {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
+
+// поисковый сервер, разбитый на шарды: документ попадает в шард по хешу id
+//
+// запрос разбирается один раз, IDF считается по суммарным по всем шардам числам документов,
+// поэтому релевантность документа та же, что у одного SearchServer с теми же документами;
+// каждый шард отбирает свои MAX_RESULT_DOCUMENT_COUNT лучших, выдача - лучшие из объединения
+class ShardedSearchServer {
+public:
+    // shard_count == 0 - по числу аппаратных потоков
+    template <typename StringCollection>
+    explicit ShardedSearchServer(const StringCollection& stop_words, size_t shard_count = 0);
+
+    explicit ShardedSearchServer(const std::string& text, size_t shard_count = 0)
+        : ShardedSearchServer(SplitIntoWords(text), shard_count) {};
+
+    explicit ShardedSearchServer(const std::string_view text, size_t shard_count = 0)
+        : ShardedSearchServer(SplitIntoWords(text), shard_count) {};
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // документы раскладываются по шардам, шарды заполняются параллельно
+    // шард останавливается на первом ошибочном документе, остальные шарды добавляют свои документы;
+    // после этого бросается исключение самого раннего в пакете ошибочного документа
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+
+    // то же без остановки: ошибочные документы пропускаются
+    // возвращает номера ошибочных документов в пакете и их исключения, по возрастанию номера
+    std::vector<std::pair<size_t, std::exception_ptr>> TryAddDocuments(const std::vector<DocumentInput>& documents);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+
+    // статистика - сумма по шардам (и parallel_tasks); evaluator и strategy - шарда с наибольшим числом просмотренных постингов
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status, QueryStats& stats) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query) const;
+
+    // шарды обрабатывают запрос параллельно
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query) const;
+
+    // планировщик по суммарной оценке объема работы решает, обрабатывать ли шарды параллельно;
+    // каждый шард строит свой план по своей части работы, при параллельной обработке шардов - на свою долю потоков
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const;
+    std::vector<Document> FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentStatus status, QueryStats& stats) const;
+
+    // пороги планировщика всех шардов, как SearchServer::SetPlannerThresholds
+    void SetPlannerThresholds(const PlannerThresholds& thresholds);
+    PlannerThresholds GetPlannerThresholds() const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const;
+
+    void RemoveDocument(int document_id);
+    void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
+    void RemoveDocument(const std::execution::parallel_policy&, int document_id);
+
+    // документ меняется в своем шарде; IDF по шардам считается при запросе, поэтому остается согласованным
+    void UpdateDocumentStatus(int document_id, DocumentStatus status);
+    void UpdateDocumentRating(int document_id, const std::vector<int>& ratings);
+    void UpdateDocument(int document_id, const std::string_view document);
+
+    // индексы вкладов всех шардов, строятся параллельно
+    void BuildImpactIndex();
+
+    int GetDocumentCount() const;
+
+    // константные итераторы на начало и конец множества с id документов всех шардов
+    std::set<int>::const_iterator begin() const;
+    std::set<int>::const_iterator end() const;
+
+    const SearchServer::WordFrequencies& GetWordFrequencies(int document_id) const;
+
+    std::string GetDocumentText(int document_id) const;
+    // опечатки исправляются по объединению словарей шардов
+    void SetTypoTolerance(int max_edit_distance);
+    int GetTypoTolerance() const;
+    // порог сравнивается с IDF по всем шардам; каждый шард отбирает свои K документов без слов ниже порога
+    void SetApproximateIdfThreshold(double threshold);
+    double GetApproximateIdfThreshold() const;
+    // журнал запросов FindTopDocuments всего сервера, как SearchServer::SetQueryLog; шарды в журнал не пишут
+    void SetQueryLog(QueryLogWriter* query_log);
+    // для TextStorage::FILE шард i пишет тексты в файл path.i
+    void SetTextStorage(TextStorage storage, const std::string& path = {});
+
+    size_t GetShardCount() const;
+    size_t GetShardIndex(int document_id) const;
+    const SearchServer& GetShard(size_t shard_index) const;
+
+private:
+    // SearchServer нельзя перемещать - шарды хранятся по указателю
+    std::vector<std::unique_ptr<SearchServer>> shards_;
+    // множество из id документов всех шардов
+    std::set<int> documents_id_;
+    QueryLogWriter* query_log_ = nullptr;
+
+    // IDF плюс-слов запроса по всем шардам
+    std::vector<double> ComputeInverseDocumentFreqs(const SearchServer::Query& query) const;
+    // префиксы раскрываются по объединению словарей шардов с тем же ограничением, что у одного сервера
+    void ExpandQueryPrefixes(SearchServer::Query& query) const;
+    // слово без документов во всех шардах заменяется ближайшими термами всех шардов
+    void CorrectQueryTypos(SearchServer::Query& query) const;
+
+    std::vector<std::pair<size_t, std::exception_ptr>> AddDocumentsToShards(const std::vector<DocumentInput>& documents, bool stop_on_error);
+
+    // запрос разбирается один раз; is_parallel(query) решает, обрабатывать ли шарды параллельно,
+    // evaluate(shard, query, inverse_document_freqs, shard_stats) считает выдачу шарда
+    template <typename DocumentFilter, typename ParallelChoice, typename ShardEvaluator>
+    std::vector<Document> FindTopDocumentsInShards(const std::string_view raw_query, const DocumentFilter& document_filter, QueryStats* stats,
+                                                   ParallelChoice is_parallel, ShardEvaluator evaluate) const;
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsInShards(const std::string_view raw_query, const DocumentFilter& document_filter, QueryStats* stats, bool in_parallel) const;
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsPlannedInShards(const std::string_view raw_query, const DocumentFilter& document_filter, QueryStats* stats) const;
+    static void MergeShardStats(const std::vector<QueryStats>& shard_stats, QueryStats& stats);
+};
+
+template <typename StringCollection>
+ShardedSearchServer::ShardedSearchServer(const StringCollection& stop_words, size_t shard_count) {
+    if(shard_count == 0) {
+        shard_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    shards_.reserve(shard_count);
+    for(size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_unique<SearchServer>(stop_words));
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocumentsInShards(raw_query, document_predicate, nullptr, false);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const {
+    return FindTopDocumentsInShards(raw_query, document_predicate, &stats, false);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocumentsInShards(raw_query, document_predicate, nullptr, false);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocumentsInShards(raw_query, document_predicate, nullptr, true);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocumentsPlannedInShards(raw_query, document_predicate, nullptr);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const AutoExecutionPolicy&, const std::string_view raw_query, DocumentPredicate document_predicate, QueryStats& stats) const {
+    return FindTopDocumentsPlannedInShards(raw_query, document_predicate, &stats);
+}
+
+template <typename DocumentFilter>
+std::vector<Document> ShardedSearchServer::FindTopDocumentsInShards(const std::string_view raw_query, const DocumentFilter& document_filter, QueryStats* stats, bool in_parallel) const {
+    return FindTopDocumentsInShards(raw_query, document_filter, stats,
+        [in_parallel](const SearchServer::Query&) { return in_parallel; },
+        [&document_filter](const SearchServer& shard, const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, QueryStats* shard_stats) {
+            return shard.FindTopDocumentsSeq(query, inverse_document_freqs, document_filter, shard_stats);
+        });
+}
+
+template <typename DocumentFilter>
+std::vector<Document> ShardedSearchServer::FindTopDocumentsPlannedInShards(const std::string_view raw_query, const DocumentFilter& document_filter, QueryStats* stats) const {
+    const PlannerThresholds thresholds = GetPlannerThresholds();
+    const size_t parallelism = thresholds.parallelism > 0 ? thresholds.parallelism : std::thread::hardware_concurrency();
+    // при параллельной обработке шардов потоки делятся между ними
+    size_t shard_parallelism = parallelism;
+    return FindTopDocumentsInShards(raw_query, document_filter, stats,
+        [this, &document_filter, &thresholds, parallelism, &shard_parallelism](const SearchServer::Query& query) {
+            QueryWorkEstimate estimate;
+            for(const auto& shard : shards_) {
+                estimate.postings += shard->EstimateQueryWork(query, document_filter).postings;
+            }
+            const bool in_parallel = shards_.size() > 1 && PlanQuery(estimate, thresholds, parallelism).strategy != ExecutionStrategy::SEQUENTIAL;
+            if(in_parallel) {
+                shard_parallelism = parallelism / shards_.size();
+            }
+            return in_parallel;
+        },
+        [&document_filter, &thresholds, &shard_parallelism](const SearchServer& shard, const SearchServer::Query& query, const std::vector<double>& inverse_document_freqs, QueryStats* shard_stats) {
+            const QueryWorkEstimate estimate = shard.EstimateQueryWork(query, document_filter);
+            const QueryPlan plan = PlanQuery(estimate, thresholds, shard_parallelism);
+            std::vector<Document> documents = shard.FindTopDocumentsPlanned(query, inverse_document_freqs, document_filter, plan, shard_stats);
+            if(shard_stats) {
+                shard_stats->estimated_postings = estimate.postings;
+            }
+            return documents;
+        });
+}
+
+template <typename DocumentFilter, typename ParallelChoice, typename ShardEvaluator>
+std::vector<Document> ShardedSearchServer::FindTopDocumentsInShards(const std::string_view raw_query, const DocumentFilter& document_filter, QueryStats* stats,
+                                                                    ParallelChoice is_parallel, ShardEvaluator evaluate) const {
+    const QueryLogScope log_scope(query_log_, raw_query, document_filter);
+    // стоп-слова у всех шардов общие, поэтому запрос разбирает любой из них
+    SearchServer::Query query = shards_.front()->ParseQueryWords(raw_query);
+    CorrectQueryTypos(query);
+    ExpandQueryPrefixes(query);
+    const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+
+    std::vector<std::vector<Document>> shard_results(shards_.size());
+    std::vector<QueryStats> shard_stats(stats ? shards_.size() : 0);
+    std::vector<size_t> shard_indexes(shards_.size());
+    std::iota(shard_indexes.begin(), shard_indexes.end(), 0);
+    const auto evaluate_shard = [this, &query, &inverse_document_freqs, &shard_stats, &evaluate](size_t shard_index) {
+        const SearchServer& shard = *shards_[shard_index];
+        QueryStats* const query_stats = shard_stats.empty() ? nullptr : &shard_stats[shard_index];
+        return shard.EvaluateApproximately(query, inverse_document_freqs, query_stats,
+            [&shard, query_stats, &evaluate](const SearchServer::Query& evaluated_query, const std::vector<double>& evaluated_inverse_document_freqs) {
+                return evaluate(shard, evaluated_query, evaluated_inverse_document_freqs, query_stats);
+            });
+    };
+    if(is_parallel(query)) {
+        std::transform(std::execution::par, shard_indexes.begin(), shard_indexes.end(), shard_results.begin(), evaluate_shard);
+    } else {
+        std::transform(shard_indexes.begin(), shard_indexes.end(), shard_results.begin(), evaluate_shard);
+    }
+    if(stats) {
+        MergeShardStats(shard_stats, *stats);
+    }
+
+    // лучшие K объединения - среди лучших K каждого шарда
+    std::vector<Document> result;
+    for(const auto& documents : shard_results) {
+        result.insert(result.end(), documents.begin(), documents.end());
+    }
+    std::sort(result.begin(), result.end(), SearchServer::IsRankedBefore);
+    if(result.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        result.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+
+    return result;
+}
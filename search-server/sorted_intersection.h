@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+
+// во сколько раз один массив должен быть длиннее другого,
+// чтобы вместо слияния выгоднее был галопирующий поиск
+inline constexpr size_t GALLOP_RATIO = 8;
+
+// галопирующий (экспоненциальный) поиск первого элемента, не меньшего value
+// сложность O(log d), где d - расстояние от first до результата
+template <typename Iterator, typename T>
+Iterator GallopLowerBound(Iterator first, Iterator last, const T& value) {
+    typename std::iterator_traits<Iterator>::difference_type step = 1;
+    Iterator it = first;
+    while(it != last && *it < value) {
+        first = it;
+        if(std::distance(it, last) <= step) {
+            it = last;
+            break;
+        }
+        std::advance(it, step);
+        step *= 2;
+    }
+    return std::lower_bound(first, it, value);
+}
+
+// пересечение двух отсортированных диапазонов без повторов
+// для диапазонов сравнимой длины - слияние, иначе галопирующий поиск по длинному диапазону
+template <typename Iterator1, typename Iterator2, typename Callback>
+void ForEachCommon(Iterator1 first1, Iterator1 last1, Iterator2 first2, Iterator2 last2, Callback callback) {
+    const auto size1 = static_cast<size_t>(std::distance(first1, last1));
+    const auto size2 = static_cast<size_t>(std::distance(first2, last2));
+
+    if(size1 * GALLOP_RATIO < size2) {
+        for(; first1 != last1 && first2 != last2; ++first1) {
+            first2 = GallopLowerBound(first2, last2, *first1);
+            if(first2 != last2 && !(*first1 < *first2)) {
+                callback(*first1);
+                ++first2;
+            }
+        }
+        return;
+    }
+    if(size2 * GALLOP_RATIO < size1) {
+        for(; first1 != last1 && first2 != last2; ++first2) {
+            first1 = GallopLowerBound(first1, last1, *first2);
+            if(first1 != last1 && !(*first2 < *first1)) {
+                callback(*first1);
+                ++first1;
+            }
+        }
+        return;
+    }
+
+    while(first1 != last1 && first2 != last2) {
+        if(*first1 < *first2) {
+            ++first1;
+        } else if(*first2 < *first1) {
+            ++first2;
+        } else {
+            callback(*first1);
+            ++first1;
+            ++first2;
+        }
+    }
+}
+
+// есть ли у двух отсортированных диапазонов общий элемент
+template <typename Iterator1, typename Iterator2>
+bool HasCommon(Iterator1 first1, Iterator1 last1, Iterator2 first2, Iterator2 last2) {
+    bool found = false;
+    // ранний выход не нужен: минус-слов в запросе обычно единицы
+    ForEachCommon(first1, last1, first2, last2, [&found](const auto&) { found = true; });
+    return found;
+}
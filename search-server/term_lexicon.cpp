@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "term_lexicon.h"
+
+using namespace std;
+
+TermLexicon::TermLexicon(pmr::memory_resource* resource)
+    : m_chars(resource)
+    , m_offsets(resource)
+    , m_nodes(resource)
+    , m_children(resource)
+    , m_pending(resource) {
+}
+
+void TermLexicon::Insert(string_view term) {
+    m_pending.emplace(term);
+    if(m_pending.size() >= max(MIN_PENDING_MERGE, GetArrayTermCount() / MAX_PENDING_SHARE)) {
+        Rebuild();
+    }
+}
+
+void TermLexicon::Clear() {
+    m_chars.clear();
+    m_chars.shrink_to_fit();
+    m_offsets.clear();
+    m_offsets.shrink_to_fit();
+    m_nodes.clear();
+    m_nodes.shrink_to_fit();
+    m_children.clear();
+    m_children.shrink_to_fit();
+    m_pending.clear();
+}
+
+size_t TermLexicon::GetArrayTermCount() const {
+    return m_offsets.empty() ? 0 : m_offsets.size() - 1;
+}
+
+size_t TermLexicon::GetTermCount() const {
+    return GetArrayTermCount() + m_pending.size();
+}
+
+string_view TermLexicon::GetTerm(size_t index) const {
+    return string_view(m_chars).substr(m_offsets[index], m_offsets[index + 1] - m_offsets[index]);
+}
+
+void TermLexicon::AppendTerm(string_view term) {
+    if(m_chars.size() + term.size() > numeric_limits<uint32_t>::max()) {
+        throw length_error("Too many term bytes for TermLexicon");
+    }
+    if(m_offsets.empty()) {
+        m_offsets.push_back(0);
+    }
+    m_chars.append(term);
+    m_offsets.push_back(static_cast<uint32_t>(m_chars.size()));
+}
+
+void TermLexicon::Rebuild() {
+    if(!m_pending.empty()) {
+        // слияние двух упорядоченных последовательностей в новый массив
+        pmr::string chars(m_chars.get_allocator());
+        pmr::vector<uint32_t> offsets(m_offsets.get_allocator());
+        chars.swap(m_chars);
+        offsets.swap(m_offsets);
+        m_chars.reserve(chars.size());
+        m_offsets.reserve(offsets.size() + m_pending.size() + 1);
+
+        auto pending_it = m_pending.begin();
+        for(size_t i = 0; i + 1 < offsets.size(); ++i) {
+            const string_view term = string_view(chars).substr(offsets[i], offsets[i + 1] - offsets[i]);
+            for(; pending_it != m_pending.end() && *pending_it < term; ++pending_it) {
+                AppendTerm(*pending_it);
+            }
+            AppendTerm(term);
+        }
+        for(; pending_it != m_pending.end(); ++pending_it) {
+            AppendTerm(*pending_it);
+        }
+        m_pending.clear();
+    }
+
+    m_nodes.clear();
+    m_children.clear();
+    if(GetArrayTermCount() > 0) {
+        BuildNode(0, GetArrayTermCount(), 0);
+    }
+}
+
+uint32_t TermLexicon::BuildNode(size_t first, size_t last, size_t depth) {
+    const uint32_t node_index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back({static_cast<uint32_t>(first), static_cast<uint32_t>(last), 0, 0});
+    if(last - first <= LEAF_SIZE) {
+        return node_index;
+    }
+
+    // терм, равный префиксу узла, - первый в отрезке; остальные делятся на ребра по байту depth
+    size_t begin = GetTerm(first).size() == depth ? first + 1 : first;
+    vector<size_t> boundaries = {begin};
+    while(begin < last) {
+        const char byte = GetTerm(begin)[depth];
+        begin = partition_point(m_offsets.begin() + begin, m_offsets.begin() + last,
+            [this, depth, byte](const uint32_t& offset) {
+                return m_chars[offset + depth] == byte;
+            }) - m_offsets.begin();
+        boundaries.push_back(begin);
+    }
+
+    // ребра узла подряд: место под них занимается до построения детей
+    const size_t first_child = m_children.size();
+    m_nodes[node_index].first_child = static_cast<uint32_t>(first_child);
+    m_nodes[node_index].child_count = static_cast<uint32_t>(boundaries.size() - 1);
+    for(size_t i = 0; i + 1 < boundaries.size(); ++i) {
+        m_children.push_back({GetTerm(boundaries[i])[depth], 0});
+    }
+    for(size_t i = 0; i + 1 < boundaries.size(); ++i) {
+        const uint32_t child = BuildNode(boundaries[i], boundaries[i + 1], depth + 1);
+        m_children[first_child + i].node = child;
+    }
+    return node_index;
+}
+
+vector<pair<string_view, int>> TermLexicon::FindFuzzyMatches(string_view word, int max_distance) const {
+    vector<pair<string_view, int>> matches;
+    if(!m_nodes.empty()) {
+        LevenshteinAutomaton automaton(word, max_distance);
+        VisitNode(m_nodes.front(), 0, automaton, max_distance, matches);
+    }
+    ForEachFuzzyMatch(m_pending, word, max_distance,
+        [&matches](const auto& it, int distance) {
+            matches.emplace_back(*it, distance);
+        });
+    return matches;
+}
+
+void TermLexicon::VisitNode(const Node& node, size_t depth, LevenshteinAutomaton& automaton, int max_distance,
+                            vector<pair<string_view, int>>& matches) const {
+    if(node.child_count == 0) {
+        VisitLeaf(node.first, node.last, depth, automaton, max_distance, matches);
+        return;
+    }
+    const string_view first_term = GetTerm(node.first);
+    if(first_term.size() == depth) {
+        const int distance = automaton.GetDistance(depth);
+        if(distance <= max_distance) {
+            matches.emplace_back(first_term, distance);
+        }
+    }
+    // байты не из слова переводят автомат одинаково: если такой переход мертв, проверяются только байты слова
+    const bool is_other_byte_live = automaton.IsOtherByteLive(depth);
+    for(uint32_t i = node.first_child; i < node.first_child + node.child_count; ++i) {
+        const Child& child = m_children[i];
+        if(!is_other_byte_live && !automaton.IsWordByte(child.byte)) {
+            continue;
+        }
+        if(automaton.Advance(depth, child.byte) <= max_distance) {
+            VisitNode(m_nodes[child.node], depth + 1, automaton, max_distance, matches);
+        }
+    }
+}
+
+void TermLexicon::VisitLeaf(size_t first, size_t last, size_t depth, LevenshteinAutomaton& automaton, int max_distance,
+                            vector<pair<string_view, int>>& matches) const {
+    // строки автомата посчитаны для префикса previous длины computed; dead - префикс этой длины тупиковый
+    string_view previous;
+    size_t computed = depth;
+    bool dead = false;
+    for(size_t i = first; i < last; ++i) {
+        const string_view term = GetTerm(i);
+        size_t common = depth;
+        const size_t common_limit = min(term.size(), previous.size());
+        while(common < common_limit && term[common] == previous[common]) {
+            ++common;
+        }
+        // терм продолжает тупиковый префикс предыдущего
+        if(dead && common >= computed) {
+            continue;
+        }
+        size_t level = i == first ? depth : min(common, computed);
+        dead = false;
+        for(; level < term.size(); ++level) {
+            if(automaton.Advance(level, term[level]) > max_distance) {
+                dead = true;
+                ++level;
+                break;
+            }
+        }
+        previous = term;
+        computed = level;
+        if(!dead) {
+            const int distance = automaton.GetDistance(level);
+            if(distance <= max_distance) {
+                matches.emplace_back(term, distance);
+            }
+        }
+    }
+}
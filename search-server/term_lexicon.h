@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "levenshtein_automaton.h"
+
+// компактный словарь термов для поиска с опечатками
+//
+// термы лежат подряд в одной строке в порядке возрастания, над ними - бор по первым байтам: узел бора -
+// отрезок массива с общим префиксом, ребра узла - подряд в одном массиве. Узлы строятся только для отрезков
+// длиннее LEAF_SIZE термов, короткий отрезок автомат читает терм за термом. Автомат Левенштейна идет по бору
+// в глубину и переходит только по живым ребрам: по байтам слова, а по остальным - только если живой
+// переход по байту не из слова
+//
+// новые термы копятся в дереве и вливаются в массив, когда их больше MAX_PENDING_SHARE массива
+// (и не меньше MIN_PENDING_MERGE): слияние линейное, поэтому добавление терма в среднем O(1) перестроек
+// на терм; термы не удаляются
+class TermLexicon {
+public:
+    inline static constexpr size_t LEAF_SIZE = 16;
+    inline static constexpr size_t MIN_PENDING_MERGE = 1024;
+    inline static constexpr size_t MAX_PENDING_SHARE = 32;
+
+    explicit TermLexicon(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // заменяет содержимое термами из упорядоченного по возрастанию диапазона без повторов (строки или ключи мапы)
+    template <typename Iterator>
+    void Assign(Iterator begin, Iterator end);
+    // добавляет терм, которого еще нет в словаре; до слияния терм хранится ссылкой, поэтому строка
+    // должна жить дольше словаря (как ключи словаря термов сервера)
+    void Insert(std::string_view term);
+    void Clear();
+
+    size_t GetTermCount() const;
+
+    // термы на расстоянии Левенштейна не больше max_distance от слова с расстояниями, порядок не определен;
+    // string_view ссылаются на словарь и живут до следующего изменения
+    std::vector<std::pair<std::string_view, int>> FindFuzzyMatches(std::string_view word, int max_distance) const;
+
+private:
+    // узел бора: термы [first, last) с общим префиксом длины глубины узла; ребра - [first_child, first_child + child_count)
+    // узел без ребер - лист, его термы читаются подряд
+    struct Node {
+        uint32_t first;
+        uint32_t last;
+        uint32_t first_child;
+        uint32_t child_count;
+    };
+
+    struct Child {
+        char byte;
+        uint32_t node;
+    };
+
+    std::string_view GetTerm(size_t index) const;
+    size_t GetArrayTermCount() const;
+    void AppendTerm(std::string_view term);
+    // вливает m_pending в массив и строит бор заново
+    void Rebuild();
+    uint32_t BuildNode(size_t first, size_t last, size_t depth);
+    void VisitNode(const Node& node, size_t depth, LevenshteinAutomaton& automaton, int max_distance,
+                   std::vector<std::pair<std::string_view, int>>& matches) const;
+    void VisitLeaf(size_t first, size_t last, size_t depth, LevenshteinAutomaton& automaton, int max_distance,
+                   std::vector<std::pair<std::string_view, int>>& matches) const;
+
+    // байты термов подряд; терм i - [m_offsets[i], m_offsets[i + 1])
+    std::pmr::string m_chars;
+    std::pmr::vector<uint32_t> m_offsets;
+    std::pmr::vector<Node> m_nodes;
+    std::pmr::vector<Child> m_children;
+    // добавленные после последнего слияния термы
+    std::pmr::set<std::string_view> m_pending;
+};
+
+template <typename Iterator>
+void TermLexicon::Assign(Iterator begin, Iterator end) {
+    Clear();
+    for(; begin != end; ++begin) {
+        AppendTerm(GetFuzzyKey(*begin));
+    }
+    Rebuild();
+}
@@ -1,7 +1,24 @@
 #include <cmath>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
 
 #include "test_example_functions.h"
 #include "search_server.h"
+#include "sharded_search_server.h"
+#include "request_queue.h"
+#include "query_protocol.h"
+#include "corpus_loader.h"
+#include "concurrent_map.h"
+#include "remove_duplicates.h"
+#include "near_duplicates.h"
+#include "paginator.h"
+#include "search_paginator.h"
+#include "scoring_kernels.h"
 
 using namespace std;
 
@@ -198,6 +215,44 @@ void TestDocumentMatch()
     ASSERT(DocumentStatus::ACTUAL == stat4);
 }
 
+// Пакетный и параллельный матчинг должны совпадать с последовательным матчингом по одному документу
+void TestMatchDocuments()
+{
+    SearchServer server("the"s);
+
+    server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.AddDocument(24, "dog in the town"s, DocumentStatus::ACTUAL, {4, 5, 6});
+    server.AddDocument(11, "is city a small town"s, DocumentStatus::BANNED, {3, 4, 5});
+    server.AddDocument(22, "dog bark at the cat"s, DocumentStatus::ACTUAL, {1, 3, 5});
+
+    const string query = "town cat city -bark horse"s;
+    const vector<int> ids = {42, 24, 11, 22};
+
+    const auto batch = server.MatchDocuments(query, ids);
+    const auto batch_par = server.MatchDocuments(execution::par, query, ids);
+    ASSERT_EQUAL(ids.size(), batch.size());
+    ASSERT_EQUAL(ids.size(), batch_par.size());
+
+    for(size_t i = 0; i < ids.size(); ++i) {
+        const auto [words, status] = server.MatchDocument(query, ids[i]);
+        const auto [words_par, status_par] = server.MatchDocument(execution::par, query, ids[i]);
+        ASSERT(words == get<0>(batch[i]));
+        ASSERT(words == get<0>(batch_par[i]));
+        ASSERT(words == words_par);
+        ASSERT(status == get<1>(batch[i]));
+        ASSERT(status == status_par);
+    }
+
+    // слова возвращаются в алфавитном порядке
+    const auto [words, status] = server.MatchDocument(query, 11);
+    ASSERT_EQUAL(2U, words.size());
+    ASSERT_EQUAL("city"s, string(words[0]));
+    ASSERT_EQUAL("town"s, string(words[1]));
+
+    // минус-слово исключает документ
+    ASSERT(get<0>(batch[3]).empty());
+}
+
 //  Возвращаемые при поиске документов результаты должны быть отсортированы в
 // порядке убывания релевантности
 void TestSortByRelavant()
@@ -307,6 +362,43 @@ void TestSearchByStatus()
     }
 }
 
+// Поиск по статусу через разделы постингов совпадает с поиском по эквивалентному предикату
+void TestSearchByStatusPartitions()
+{
+    SearchServer server;
+
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.AddDocument(2, "cat dog in the town"s, DocumentStatus::BANNED, {4, 5, 6});
+    server.AddDocument(3, "big cat"s, DocumentStatus::BANNED, {3, 4, 5});
+    server.AddDocument(4, "dog bark at the cat"s, DocumentStatus::ACTUAL, {1, 3, 5});
+    server.AddDocument(5, "cat cat cat"s, DocumentStatus::IRRELEVANT, {1});
+
+    const string query = "cat city dog -bark"s;
+    for(const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+        const auto by_predicate = server.FindTopDocuments(query,
+            [status](int, DocumentStatus document_status, int) { return document_status == status; });
+        const auto by_status = server.FindTopDocuments(query, status);
+        const auto by_status_par = server.FindTopDocuments(execution::par, query, status);
+        ASSERT_EQUAL(by_predicate.size(), by_status.size());
+        ASSERT_EQUAL(by_predicate.size(), by_status_par.size());
+        for(size_t i = 0; i < by_status.size(); ++i) {
+            ASSERT_EQUAL(by_predicate[i].id, by_status[i].id);
+            ASSERT_EQUAL(by_predicate[i].id, by_status_par[i].id);
+            ASSERT(by_predicate[i].relevance == by_status[i].relevance);
+        }
+    }
+
+    ASSERT_EQUAL(2U, server.FindTopDocuments("cat"s, DocumentStatus::BANNED).size());
+    server.RemoveDocument(3);
+    ASSERT_EQUAL(1U, server.FindTopDocuments("cat"s, DocumentStatus::BANNED).size());
+    server.RemoveDocument(execution::par, 2);
+    ASSERT(server.FindTopDocuments("cat"s, DocumentStatus::BANNED).empty());
+    // IDF считается по всем оставшимся документам
+    const auto found_docs = server.FindTopDocuments("city"s);
+    ASSERT_EQUAL(1U, found_docs.size());
+    ASSERT(0.001 > fabs(found_docs[0].relevance - log(3.0) / 4));
+}
+
 // Корректное вычисление релевантности найденных документов
 void TestCalcRelevant()
 {
@@ -332,15 +424,1995 @@ void TestCalcRelevant()
     ASSERT(0.001 > fabs(doc1.relevance - 0.138629));
 }
 
+// Удаление дубликатов: остается документ с минимальным id, порядок и повторы слов не важны
+void TestRemoveDuplicates()
+{
+    SearchServer server("and with"s);
+
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    // дубликат документа 2, отличаются только стоп-слова
+    server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    // другой порядок и повтор слов - тоже дубликат документа 1
+    server.AddDocument(4, "nasty rat funny pet rat"s, DocumentStatus::ACTUAL, {1, 2});
+    // подмножество слов - не дубликат
+    server.AddDocument(5, "funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+    // документы из одних стоп-слов - дубликаты друг друга
+    server.AddDocument(6, "and with"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(7, "with and"s, DocumentStatus::ACTUAL, {1});
+
+    ASSERT(server.GetDocumentFingerprint(2) == server.GetDocumentFingerprint(3));
+    ASSERT(server.GetDocumentFingerprint(1) != server.GetDocumentFingerprint(5));
+
+    RemoveDuplicates(server);
+
+    ASSERT_EQUAL(4, server.GetDocumentCount());
+    const vector<int> ids(server.begin(), server.end());
+    ASSERT(vector<int>({1, 2, 5, 6}) == ids);
+}
+
+// Проверка дубликатов при добавлении документа
+void TestDuplicatePolicy()
+{
+    SearchServer server;
+
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, {1});
+
+    server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+    bool rejected = false;
+    try {
+        server.AddDocument(2, "city the in cat cat"s, DocumentStatus::ACTUAL, {1});
+    } catch(const invalid_argument&) {
+        rejected = true;
+    }
+    ASSERT(rejected);
+    ASSERT_EQUAL(1, server.GetDocumentCount());
+
+    server.SetDuplicatePolicy(DuplicatePolicy::FLAG);
+    server.AddDocument(3, "city the in cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(4, "cat in the town"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(3, server.GetDocumentCount());
+    ASSERT_EQUAL(1U, server.GetFlaggedDuplicates().size());
+    ASSERT_EQUAL(1, server.GetFlaggedDuplicates().at(3));
+
+    // после удаления оригинала и дубликата такой набор слов снова уникален
+    server.RemoveDocument(1);
+    server.RemoveDocument(3);
+    ASSERT(server.GetFlaggedDuplicates().empty());
+    server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+    server.AddDocument(5, "cat in the city"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(2, server.GetDocumentCount());
+}
+
+// Поиск почти-дубликатов: копии, отличающиеся одним словом, попадают в один кластер
+void TestNearDuplicates()
+{
+    SearchServer server;
+
+    const string boilerplate = "welcome to our shop best prices free delivery every day since nineteen ninety "s;
+    server.AddDocument(1, boilerplate + "red bicycle"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, boilerplate + "blue bicycle"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "completely different text about cats and dogs"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(4, boilerplate + "red bicycle"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(5, "completely different text about cats and birds"s, DocumentStatus::ACTUAL, {1});
+
+    NearDuplicateDetector detector(server, {64, 16, 0.7});
+
+    ASSERT(detector.ComputeJaccard(1, 4) == 1.0);
+    ASSERT(detector.ComputeJaccard(1, 3) == 0.0);
+
+    const auto near_first = detector.FindNearDuplicates(1);
+    ASSERT_EQUAL(2U, near_first.size());
+    ASSERT_EQUAL(4, near_first[0].first);
+    ASSERT_EQUAL(2, near_first[1].first);
+
+    const auto clusters = detector.ClusterNearDuplicates();
+    ASSERT_EQUAL(2U, clusters.size());
+    ASSERT(vector<int>({1, 2, 4}) == clusters[0]);
+    ASSERT(vector<int>({3, 5}) == clusters[1]);
+
+    // одна полоса из одной строки: все три документа в одной корзине, первый из них ни на кого не похож,
+    // поэтому 2 и 3 находятся только при сравнении всех пар корзины
+    SearchServer bucket_server;
+    bucket_server.AddDocument(1, "dog cat"s, DocumentStatus::ACTUAL, {1});
+    bucket_server.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {1});
+    bucket_server.AddDocument(3, "cat"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(2U, NearDuplicateDetector(bucket_server, {1, 1, 0.0}).FindNearDuplicates(1).size());
+    const auto bucket_clusters = NearDuplicateDetector(bucket_server, {1, 1, 0.7}).ClusterNearDuplicates();
+    ASSERT_EQUAL(1U, bucket_clusters.size());
+    ASSERT(vector<int>({2, 3}) == bucket_clusters[0]);
+
+    bool rejected = false;
+    try {
+        NearDuplicateDetector(server, {64, 16, 0.7, 0});
+    } catch(const invalid_argument&) {
+        rejected = true;
+    }
+    ASSERT(rejected);
+}
+
+// Постраничный поиск по курсору: страницы не пересекаются и в сумме дают всю выдачу
+void TestSearchAfterCursor()
+{
+    SearchServer server;
+
+    const vector<string> texts = {
+        "cat"s, "cat dog"s, "dog"s, "cat cat dog"s, "bird cat"s, "cat in the city"s,
+        "dog in the town"s, "cat bird dog"s, "big cat"s, "small cat"s, "cat"s, "fat cat dog"s,
+    };
+    for(size_t i = 0; i < texts.size(); ++i) {
+        server.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 3)});
+    }
+
+    const string query = "cat dog"s;
+    const SearchPage full = server.FindTopDocumentsAfter(query, SearchCursor(), 100);
+    ASSERT(!full.has_more);
+    ASSERT_EQUAL(texts.size(), full.documents.size());
+
+    // первая страница совпадает с обычной выдачей
+    const auto top = server.FindTopDocuments(query);
+    const SearchPage first = server.FindTopDocumentsAfter(query, SearchCursor(), MAX_RESULT_DOCUMENT_COUNT);
+    ASSERT_EQUAL(top.size(), first.documents.size());
+    for(size_t i = 0; i < top.size(); ++i) {
+        ASSERT_EQUAL(top[i].id, first.documents[i].id);
+    }
+
+    // курсор проходит через токен, как у клиента
+    vector<int> paged_ids;
+    SearchCursor cursor;
+    for(bool has_more = true; has_more;) {
+        const SearchPage page = server.FindTopDocumentsAfter(query, SearchCursor::FromToken(cursor.ToToken()), 3);
+        for(const Document& document : page.documents) {
+            paged_ids.push_back(document.id);
+        }
+        cursor = page.next_cursor;
+        has_more = page.has_more;
+    }
+    ASSERT_EQUAL(full.documents.size(), paged_ids.size());
+    for(size_t i = 0; i < paged_ids.size(); ++i) {
+        ASSERT_EQUAL(full.documents[i].id, paged_ids[i]);
+    }
+
+    // ленивый пагинатор по курсорам дает те же страницы
+    vector<int> lazy_ids;
+    size_t page_count = 0;
+    for(const vector<Document>& page : Paginate(server, query, 4)) {
+        ASSERT(page.size() <= 4U);
+        ++page_count;
+        for(const Document& document : page) {
+            lazy_ids.push_back(document.id);
+        }
+    }
+    ASSERT_EQUAL(3U, page_count);
+    ASSERT(paged_ids == lazy_ids);
+    // фильтр предикатом дает те же страницы, что фильтр по статусу
+    vector<int> predicate_ids;
+    const auto is_actual = [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; };
+    for(const vector<Document>& page : Paginate(server, query, 4, is_actual)) {
+        for(const Document& document : page) {
+            predicate_ids.push_back(document.id);
+        }
+    }
+    ASSERT(paged_ids == predicate_ids);
+
+    // ленивый пагинатор по диапазону
+    const vector<int> values = {1, 2, 3, 4, 5, 6, 7};
+    const auto pages = Paginate(values, 3);
+    ASSERT_EQUAL(3U, pages.size());
+    vector<size_t> sizes;
+    for(const auto& page : pages) {
+        sizes.push_back(page.size());
+    }
+    ASSERT(vector<size_t>({3, 3, 1}) == sizes);
+
+    // id разбросаны на много окон перебора с пустыми промежутками: найдены все документы
+    SearchServer wide_server;
+    vector<int> wide_ids;
+    for(int i = 0; i < 40; ++i) {
+        const int id = i < 20 ? i * 3 : 100'000 + i * 70'001;
+        wide_server.AddDocument(id, i % 2 == 0 ? "cat dog"s : "cat"s, DocumentStatus::ACTUAL, {i});
+        wide_ids.push_back(id);
+    }
+    wide_server.AddDocument(1'000'000'000, "dog"s, DocumentStatus::ACTUAL, {0});
+    wide_ids.push_back(1'000'000'000);
+    const SearchPage wide_page = wide_server.FindTopDocumentsAfter(query, SearchCursor(), 100);
+    vector<int> found_ids;
+    for(const Document& document : wide_page.documents) {
+        found_ids.push_back(document.id);
+    }
+    sort(found_ids.begin(), found_ids.end());
+    ASSERT(wide_ids == found_ids);
+    const auto wide_top = wide_server.FindTopDocuments(execution::par, query);
+    for(size_t i = 0; i < wide_top.size(); ++i) {
+        ASSERT_EQUAL(wide_top[i].id, wide_page.documents[i].id);
+    }
+}
+
+// Поиск с динамическим отсечением выдает то же, что и полный перебор (параллельная версия)
+void TestPrunedSearchMatchesExhaustive()
+{
+    mt19937 generator(7);
+    vector<string> dictionary;
+    for(int i = 0; i < 60; ++i) {
+        dictionary.push_back("w"s + to_string(i));
+    }
+    // неравномерное распределение слов: частые слова с маленьким IDF и редкие
+    const auto random_word = [&generator, &dictionary]() {
+        const int index = uniform_int_distribution<int>(0, static_cast<int>(dictionary.size()) - 1)(generator);
+        return dictionary[index * index / static_cast<int>(dictionary.size())];
+    };
+
+    SearchServer server;
+    for(int id = 0; id < 600; ++id) {
+        string text;
+        const int length = uniform_int_distribution<int>(1, 12)(generator);
+        for(int i = 0; i < length; ++i) {
+            text += random_word() + " "s;
+        }
+        const auto status = static_cast<DocumentStatus>(uniform_int_distribution<int>(0, 3)(generator));
+        server.AddDocument(id * 3, text, status, {uniform_int_distribution<int>(-5, 5)(generator)});
+    }
+    // удаление ослабляет оценки терма - результат все равно должен совпадать
+    for(int id = 0; id < 600; id += 7) {
+        server.RemoveDocument(id * 3);
+    }
+
+    const auto assert_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for(size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT(lhs[i].relevance == rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+
+    for(int q = 0; q < 200; ++q) {
+        string query;
+        const int length = uniform_int_distribution<int>(1, 8)(generator);
+        for(int i = 0; i < length; ++i) {
+            query += (uniform_int_distribution<int>(0, 5)(generator) == 0 ? "-"s : ""s) + random_word() + " "s;
+        }
+        assert_same(server.FindTopDocuments(query), server.FindTopDocuments(execution::par, query));
+        assert_same(server.FindTopDocuments(query, DocumentStatus::BANNED), server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED));
+        const auto predicate = [](int document_id, DocumentStatus, int rating) { return document_id % 2 == 0 && rating >= 0; };
+        assert_same(server.FindTopDocuments(query, predicate), server.FindTopDocuments(execution::par, query, predicate));
+    }
+}
+
+// Поиск по индексу вкладов с ранней остановкой выдает то же, что и полный перебор
+void TestImpactOrderedSearch()
+{
+    mt19937 generator(11);
+    const auto random_word = [&generator]() {
+        // экспоненциальное распределение: несколько очень частых слов и длинный хвост
+        return "w"s + to_string(static_cast<int>(exponential_distribution<>(0.15)(generator)));
+    };
+
+    SearchServer server;
+    for(int id = 0; id < 3000; ++id) {
+        string text;
+        const int length = uniform_int_distribution<int>(2, 20)(generator);
+        for(int i = 0; i < length; ++i) {
+            text += random_word() + " "s;
+        }
+        server.AddDocument(id, text, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 7});
+    }
+
+    server.BuildImpactIndex();
+    ASSERT(server.HasImpactIndex());
+
+    size_t early_terminated = 0;
+    for(int q = 0; q < 100; ++q) {
+        string query = random_word() + " "s + random_word();
+        if(q % 4 == 0) {
+            query += " -"s + random_word();
+        }
+
+        QueryStats stats;
+        const auto impact = server.FindTopDocuments(query, DocumentStatus::ACTUAL, stats);
+        ASSERT(stats.evaluator == QueryEvaluator::IMPACT_ORDERED);
+        ASSERT(stats.segments_processed <= stats.segments_total);
+        early_terminated += stats.early_terminated;
+
+        const auto exhaustive = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL);
+        ASSERT_EQUAL(exhaustive.size(), impact.size());
+        for(size_t i = 0; i < impact.size(); ++i) {
+            ASSERT_EQUAL(exhaustive[i].id, impact[i].id);
+            ASSERT(exhaustive[i].relevance == impact[i].relevance);
+        }
+    }
+    ASSERT(early_terminated > 0);
+
+    // любое изменение документов сбрасывает индекс вкладов
+    server.RemoveDocument(0);
+    ASSERT(!server.HasImpactIndex());
+    QueryStats stats;
+    server.FindTopDocuments("w0"s, DocumentStatus::ACTUAL, stats);
+    ASSERT(stats.evaluator == QueryEvaluator::MAX_SCORE);
+}
+
+// Проверка метрик
+void TestMetrics()
+{
+    // корзины гистограммы: точные до 4 нс, дальше по 4 на степень двойки
+    ASSERT_EQUAL(3u, LatencyHistogram::GetBucketIndex(3));
+    ASSERT_EQUAL(4u, LatencyHistogram::GetBucketIndex(4));
+    ASSERT_EQUAL(LatencyHistogram::GetBucketIndex(8), LatencyHistogram::GetBucketIndex(9));
+    ASSERT(LatencyHistogram::GetBucketIndex(9) != LatencyHistogram::GetBucketIndex(10));
+    for(const uint64_t value : {uint64_t(0), uint64_t(5), uint64_t(1000), uint64_t(123456789), ~uint64_t(0)}) {
+        const size_t bucket = LatencyHistogram::GetBucketIndex(value);
+        ASSERT(bucket < LatencyHistogram::BUCKET_COUNT);
+        ASSERT(value <= LatencyHistogram::GetBucketUpperBound(bucket));
+        ASSERT(bucket == 0 || value > LatencyHistogram::GetBucketUpperBound(bucket - 1));
+    }
+
+#ifndef SEARCH_SERVER_NO_METRICS
+    // запись из нескольких потоков складывается при чтении
+    LatencyHistogram histogram;
+    MetricsCounter counter;
+    vector<thread> threads;
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram, &counter]() {
+            for(uint64_t value = 1; value <= 1000; ++value) {
+                histogram.RecordNanoseconds(value);
+                counter.Add();
+            }
+        });
+    }
+    for(thread& t : threads) {
+        t.join();
+    }
+    const HistogramSnapshot snapshot = histogram.Collect();
+    ASSERT_EQUAL(4000u, snapshot.count);
+    ASSERT_EQUAL(4u * 500500u, snapshot.sum_ns);
+    ASSERT_EQUAL(4000u, counter.Value());
+    // медиана 500 попадает в корзину [448, 511]
+    ASSERT_EQUAL(511u, snapshot.Quantile(0.5));
+
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and collar"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, {2});
+    try {
+        server.AddDocument(-1, "bad id"s, DocumentStatus::ACTUAL, {});
+    } catch(const invalid_argument&) {
+    }
+    server.FindTopDocuments("cat -dog"s);
+    server.FindTopDocuments(execution::par, "dog"s);
+    server.RemoveDocument(2);
+
+    ostringstream output;
+    server.WriteMetrics(output);
+    const string text = output.str();
+    ASSERT(text.find("search_server_queries_total 2\n"s) != string::npos);
+    ASSERT(text.find("search_server_documents_returned_total 2\n"s) != string::npos);
+    ASSERT(text.find("search_server_documents_added_total 2\n"s) != string::npos);
+    ASSERT(text.find("search_server_documents_rejected_total 1\n"s) != string::npos);
+    ASSERT(text.find("search_server_documents_removed_total 1\n"s) != string::npos);
+    ASSERT(text.find("search_server_query_parse_ns_count 2\n"s) != string::npos);
+    ASSERT(text.find("search_server_add_tokenize_ns_count 2\n"s) != string::npos);
+    ASSERT(text.find("# TYPE search_server_query_duration_ns histogram\n"s) != string::npos);
+#endif
+}
+
+// Проверка учета памяти
+void TestMemoryStats()
+{
+    SearchServer server("and in"s);
+    const MemoryStats empty_stats = server.GetMemoryStats();
+    ASSERT(empty_stats.stop_words.bytes > 0);
+    ASSERT_EQUAL(empty_stats.stop_words.bytes, empty_stats.TotalBytes());
+
+    // все выделения индекса идут через ресурсы сервера, а не через ресурс по умолчанию
+    CountingMemoryResource default_memory;
+    std::pmr::memory_resource* const old_default = std::pmr::set_default_resource(&default_memory);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::BANNED, {2});
+    server.AddDocument(3, "groomed dog expressive eyes in collar"s, DocumentStatus::ACTUAL, {3});
+    std::pmr::set_default_resource(old_default);
+    ASSERT_EQUAL(0u, default_memory.GetUsage().peak_bytes);
+
+    const MemoryStats stats = server.GetMemoryStats();
+    ASSERT(stats.document_text.bytes >= "white cat and fashionable collar"s.size());
+    ASSERT(stats.inverted_index.bytes > 0);
+    ASSERT(stats.forward_index.bytes > 0);
+    ASSERT(stats.document_metadata.bytes > 0);
+    ASSERT(stats.dictionary.bytes > 0);
+    // битовые множества статусов
+    ASSERT(stats.auxiliary.bytes > 0);
+
+    // 3 документа: 4, 3 и 5 различных слов
+    ASSERT(vector<size_t>({0, 1, 2}) == stats.document_lengths);
+    // 10 слов: cat и collar встречаются в двух документах
+    ASSERT(vector<size_t>({8, 2}) == stats.posting_lengths);
+
+    server.BuildImpactIndex();
+    ASSERT(server.GetMemoryStats().auxiliary.bytes > stats.auxiliary.bytes);
+
+    for(const int document_id : {1, 2, 3}) {
+        server.RemoveDocument(document_id);
+    }
+    const MemoryStats removed_stats = server.GetMemoryStats();
+    ASSERT_EQUAL(0u, removed_stats.document_text.bytes);
+    ASSERT_EQUAL(0u, removed_stats.forward_index.bytes);
+    ASSERT_EQUAL(0u, removed_stats.document_metadata.bytes);
+    ASSERT(removed_stats.document_text.peak_bytes >= stats.document_text.bytes);
+    ASSERT(removed_stats.posting_lengths.empty());
+}
+
+// Проверка выделения памяти индекса из внешнего ресурса
+void TestIndexMemory()
+{
+    const vector<string> texts = {
+        "white cat and fashionable collar"s,
+        "fluffy cat fluffy tail"s,
+        "groomed dog expressive eyes"s,
+        "groomed starling eugene"s,
+    };
+
+    SearchServer heap_server("and in"s);
+    for(size_t id = 0; id < texts.size(); ++id) {
+        heap_server.AddDocument(static_cast<int>(id), texts[id], DocumentStatus::ACTUAL, {static_cast<int>(id)});
+    }
+    const vector<Document> expected = heap_server.FindTopDocuments("fluffy groomed cat"s);
+
+    // вся память сервера проходит через переданный ресурс
+    CountingMemoryResource upstream;
+    {
+        SearchServer server("and in"s, &upstream);
+        for(size_t id = 0; id < texts.size(); ++id) {
+            server.AddDocument(static_cast<int>(id), texts[id], DocumentStatus::ACTUAL, {static_cast<int>(id)});
+        }
+        ASSERT_EQUAL(server.GetMemoryStats().TotalBytes(), upstream.GetUsage().bytes);
+    }
+    ASSERT_EQUAL(0u, upstream.GetUsage().bytes);
+
+    for(const IndexMemory memory : {IndexMemory::HEAP, IndexMemory::POOL, IndexMemory::ARENA}) {
+        const auto resource = MakeIndexMemoryResource(memory);
+        SearchServer server("and in"s, resource.get());
+        for(size_t id = 0; id < texts.size(); ++id) {
+            server.AddDocument(static_cast<int>(id), texts[id], DocumentStatus::ACTUAL, {static_cast<int>(id)});
+        }
+        server.BuildImpactIndex();
+
+        const vector<Document> found = server.FindTopDocuments("fluffy groomed cat"s);
+        ASSERT_EQUAL(expected.size(), found.size());
+        for(size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(expected[i].id, found[i].id);
+        }
+
+        server.RemoveDocument(execution::par, 1);
+        ASSERT_EQUAL(3, server.GetDocumentCount());
+        ASSERT(server.GetMemoryStats().inverted_index.bytes > 0);
+        // куча - сам счетчик выделений, без промежуточных оберток
+        if(memory == IndexMemory::HEAP) {
+            const auto* counting = dynamic_cast<const CountingMemoryResource*>(resource.get());
+            ASSERT(counting != nullptr);
+            ASSERT_EQUAL(server.GetMemoryStats().TotalBytes(), counting->GetUsage().bytes);
+        }
+    }
+
+    // арена выделяет из нескольких потоков одновременно: у каждого потока своя арена, блоки не пересекаются
+    const auto arena = MakeIndexMemoryResource(IndexMemory::ARENA);
+    vector<vector<int*>> blocks(4);
+    vector<thread> threads;
+    for(size_t t = 0; t < blocks.size(); ++t) {
+        threads.emplace_back([&arena, &blocks, t]() {
+            for(int i = 0; i < 1000; ++i) {
+                int* const block = static_cast<int*>(arena->allocate(4 * sizeof(int), alignof(int)));
+                fill(block, block + 4, static_cast<int>(t));
+                blocks[t].push_back(block);
+            }
+        });
+    }
+    for(thread& worker : threads) {
+        worker.join();
+    }
+    for(size_t t = 0; t < blocks.size(); ++t) {
+        for(const int* block : blocks[t]) {
+            ASSERT(all_of(block, block + 4, [t](int value) { return value == static_cast<int>(t); }));
+        }
+    }
+}
+
+// Шардированный сервер выдает то же, что и один сервер с теми же документами
+void TestShardedSearchServer()
+{
+    mt19937 generator(11);
+    vector<string> dictionary;
+    for(int i = 0; i < 40; ++i) {
+        dictionary.push_back("w"s + to_string(i));
+    }
+    const auto random_word = [&generator, &dictionary]() {
+        const int index = uniform_int_distribution<int>(0, static_cast<int>(dictionary.size()) - 1)(generator);
+        return dictionary[index * index / static_cast<int>(dictionary.size())];
+    };
+
+    SearchServer server("w1"s);
+    ShardedSearchServer sharded("w1"s, 4);
+    ASSERT_EQUAL(4u, sharded.GetShardCount());
+
+    vector<string> texts;
+    for(int id = 0; id < 400; ++id) {
+        string text;
+        const int length = uniform_int_distribution<int>(1, 10)(generator);
+        for(int i = 0; i < length; ++i) {
+            text += random_word() + " "s;
+        }
+        texts.push_back(text);
+    }
+    vector<DocumentInput> batch;
+    for(int id = 0; id < 400; ++id) {
+        const auto status = static_cast<DocumentStatus>(uniform_int_distribution<int>(0, 3)(generator));
+        const vector<int> ratings = {uniform_int_distribution<int>(-5, 5)(generator)};
+        server.AddDocument(id, texts[id], status, ratings);
+        if(id % 2 == 0) {
+            sharded.AddDocument(id, texts[id], status, ratings);
+        } else {
+            batch.push_back({id, texts[id], status, ratings});
+        }
+    }
+    sharded.AddDocuments(batch);
+    ASSERT_EQUAL(server.GetDocumentCount(), sharded.GetDocumentCount());
+    // документы разошлись по всем шардам
+    for(size_t i = 0; i < sharded.GetShardCount(); ++i) {
+        ASSERT(sharded.GetShard(i).GetDocumentCount() > 0);
+    }
+
+    for(int id = 0; id < 400; id += 9) {
+        server.RemoveDocument(id);
+        sharded.RemoveDocument(execution::par, id);
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), sharded.GetDocumentCount());
+    ASSERT(equal(server.begin(), server.end(), sharded.begin(), sharded.end()));
+
+    const auto assert_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for(size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT(lhs[i].relevance == rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+
+    for(int q = 0; q < 100; ++q) {
+        string query;
+        const int length = uniform_int_distribution<int>(1, 6)(generator);
+        for(int i = 0; i < length; ++i) {
+            query += (uniform_int_distribution<int>(0, 5)(generator) == 0 ? "-"s : ""s) + random_word() + " "s;
+        }
+        assert_same(server.FindTopDocuments(query), sharded.FindTopDocuments(query));
+        assert_same(server.FindTopDocuments(query, DocumentStatus::BANNED), sharded.FindTopDocuments(execution::par, query, DocumentStatus::BANNED));
+        const auto predicate = [](int document_id, DocumentStatus, int rating) { return document_id % 2 == 0 && rating >= 0; };
+        assert_same(server.FindTopDocuments(query, predicate), sharded.FindTopDocuments(execution::par, query, predicate));
+    }
+
+    const auto [words, status] = sharded.MatchDocument("w2 w3 w5"s, 1);
+    const auto [expected_words, expected_status] = server.MatchDocument("w2 w3 w5"s, 1);
+    ASSERT(words == expected_words);
+    ASSERT(status == expected_status);
+
+    // ошибка в пакете не мешает добавить документы других шардов
+    ShardedSearchServer partial(""s, 2);
+    vector<DocumentInput> bad_batch;
+    for(int id = 0; id < 20; ++id) {
+        bad_batch.push_back({id, "cat"sv, DocumentStatus::ACTUAL, {id}});
+    }
+    bad_batch.push_back({-1, "dog"sv, DocumentStatus::ACTUAL, {1}});
+    try {
+        partial.AddDocuments(bad_batch);
+        ASSERT_HINT(false, "invalid document id must throw"s);
+    } catch(const invalid_argument&) {
+    }
+    // ошибочный документ последний в пакете - все остальные добавлены
+    ASSERT_EQUAL(20, partial.GetDocumentCount());
+    ASSERT_EQUAL(20, partial.GetShard(0).GetDocumentCount() + partial.GetShard(1).GetDocumentCount());
+}
+
+// Кодирование и разбор кадров сетевого протокола, выполнение запросов
+void TestQueryProtocol()
+{
+    using namespace protocol;
+
+    SearchServer server("and in"s);
+    vector<Request> requests(5);
+    requests[0].type = RequestType::ADD;
+    requests[0].document_id = 1;
+    requests[0].ratings = {7, 2, -3};
+    requests[0].text = "white cat and fashionable collar"s;
+    requests[1].type = RequestType::ADD;
+    requests[1].document_id = 2;
+    requests[1].status = DocumentStatus::BANNED;
+    requests[1].text = "fluffy cat fluffy tail"s;
+    requests[2].type = RequestType::SEARCH;
+    requests[2].text = "white cat"s;
+    requests[3].type = RequestType::MATCH;
+    requests[3].document_id = 2;
+    requests[3].text = "fluffy -collar"s;
+    requests[4].type = RequestType::REMOVE;
+    requests[4].document_id = 1;
+
+    // несколько кадров подряд в одном буфере
+    string buffer;
+    for(size_t i = 0; i < requests.size(); ++i) {
+        requests[i].request_id = static_cast<uint32_t>(100 + i);
+        AppendRequest(buffer, requests[i]);
+    }
+    // неполный кадр не разбирается
+    Request parsed;
+    ASSERT_EQUAL(0u, ParseRequest(string_view(buffer).substr(0, 3), parsed));
+    ASSERT_EQUAL(0u, ParseRequest(string_view(buffer).substr(0, 10), parsed));
+
+    string responses;
+    size_t offset = 0;
+    for(const Request& request : requests) {
+        const size_t frame_size = ParseRequest(string_view(buffer).substr(offset), parsed);
+        ASSERT(frame_size > 0);
+        offset += frame_size;
+        ASSERT(parsed.type == request.type);
+        ASSERT_EQUAL(parsed.request_id, request.request_id);
+        ASSERT_EQUAL(parsed.document_id, request.document_id);
+        ASSERT(parsed.status == request.status);
+        ASSERT(parsed.ratings == request.ratings);
+        ASSERT_EQUAL(parsed.text, request.text);
+        AppendResponse(responses, ExecuteRequest(server, parsed));
+    }
+    ASSERT_EQUAL(offset, buffer.size());
+    ASSERT_EQUAL(1, server.GetDocumentCount());
+
+    vector<Response> parsed_responses(requests.size());
+    offset = 0;
+    for(size_t i = 0; i < requests.size(); ++i) {
+        parsed_responses[i].type = requests[i].type;
+        offset += ParseResponse(string_view(responses).substr(offset), parsed_responses[i]);
+        ASSERT_EQUAL(parsed_responses[i].request_id, requests[i].request_id);
+        ASSERT(parsed_responses[i].code == ResponseCode::OK);
+    }
+    ASSERT_EQUAL(offset, responses.size());
+    ASSERT_EQUAL(1u, parsed_responses[2].documents.size());
+    ASSERT_EQUAL(1, parsed_responses[2].documents[0].id);
+    ASSERT_EQUAL(2, parsed_responses[2].documents[0].rating);
+    ASSERT(parsed_responses[2].documents[0].relevance > 0.0);
+    ASSERT(parsed_responses[3].status == DocumentStatus::BANNED);
+    ASSERT(parsed_responses[3].words == vector<string>{"fluffy"s});
+
+    // ошибка сервера возвращается ответом, а не рвет соединение
+    Request bad_query;
+    bad_query.request_id = 7;
+    bad_query.text = "cat --collar"s;
+    Response error = ExecuteRequest(server, bad_query);
+    ASSERT(error.code == ResponseCode::ERROR);
+    string error_frame;
+    AppendResponse(error_frame, error);
+    Response parsed_error;
+    ParseResponse(error_frame, parsed_error);
+    ASSERT(parsed_error.code == ResponseCode::ERROR);
+    ASSERT_EQUAL(parsed_error.error, error.error);
+
+    // испорченный кадр - исключение
+    string corrupted = buffer;
+    corrupted[FRAME_HEADER_SIZE] = 42;
+    try {
+        ParseRequest(corrupted, parsed);
+        ASSERT_HINT(false, "unknown request type must throw"s);
+    } catch(const invalid_argument&) {
+    }
+}
+
+// Загрузка корпуса из файла: разбор записей, ошибки со смещениями, независимость от разбиения на куски
+void TestCorpusLoader()
+{
+    const string corpus =
+        "# id\tstatus\tratings\ttext\n"s                            // смещение 0: комментарий
+        "1\tACTUAL\t8 -3\twhite cat and fashionable collar\n"s      // 25
+        "2\tBANNED\t\tfluffy cat fluffy tail\r\n"s                  // 72
+        "\n"s                                                       // 106
+        "x\tACTUAL\t1\tbad id\n"s                                   // 107
+        "3\tSLEEPING\t1\tbad status\n"s                             // 125
+        "4\tACTUAL\t1 two\tbad rating\n"s                           // 149
+        "1\tACTUAL\t1\tduplicate id\n"s                             // 175
+        "5\tIRRELEVANT\t5 5\tgroomed dog expressive eyes"s;         // 199, без перевода строки в конце
+
+    vector<CorpusRecord> records;
+    vector<CorpusError> errors;
+    ASSERT_EQUAL(9u, ParseCorpus(corpus, 0, records, errors));
+    ASSERT_EQUAL(4u, records.size());
+    ASSERT_EQUAL(1, records[0].id);
+    ASSERT(records[0].ratings == vector<int>({8, -3}));
+    ASSERT_EQUAL(records[0].text, "white cat and fashionable collar"sv);
+    ASSERT(records[1].status == DocumentStatus::BANNED);
+    ASSERT(records[1].ratings.empty());
+    ASSERT_EQUAL(records[1].text, "fluffy cat fluffy tail"sv);
+    ASSERT_EQUAL(9u, records[3].line);
+    ASSERT_EQUAL(3u, errors.size());
+    ASSERT_EQUAL(107u, errors[0].offset);
+    ASSERT_EQUAL(5u, errors[0].line);
+    ASSERT_EQUAL(125u, errors[1].offset);
+    ASSERT_EQUAL(149u, errors[2].offset);
+
+    const filesystem::path path = filesystem::temp_directory_path() / "search_server_test_corpus.tsv";
+    {
+        ofstream file(path, ios::binary);
+        file << corpus;
+    }
+    // любое разбиение на куски дает один и тот же результат
+    for(const size_t chunk_count : {1u, 2u, 3u, 7u, 100u}) {
+        SearchServer server;
+        const CorpusLoadResult result = LoadCorpus(server, path.string(), chunk_count);
+        ASSERT_EQUAL(corpus.size(), result.bytes);
+        ASSERT_EQUAL(3u, result.documents_added);
+        ASSERT_EQUAL(3, server.GetDocumentCount());
+        ASSERT_EQUAL(4u, result.errors.size());
+        ASSERT_EQUAL(175u, result.errors[3].offset);
+        ASSERT_EQUAL(8u, result.errors[3].line);
+
+        const vector<Document> found = server.FindTopDocuments("fluffy groomed"s, DocumentStatus::BANNED);
+        ASSERT_EQUAL(1u, found.size());
+        ASSERT_EQUAL(2, found[0].id);
+
+        // шардированный сервер заполняется пакетами с теми же ошибками
+        ShardedSearchServer sharded(""s, 2);
+        const CorpusLoadResult sharded_result = LoadCorpus(sharded, path.string(), chunk_count);
+        ASSERT_EQUAL(3u, sharded_result.documents_added);
+        ASSERT_EQUAL(3, sharded.GetDocumentCount());
+        ASSERT_EQUAL(result.errors.size(), sharded_result.errors.size());
+        for(size_t i = 0; i < result.errors.size(); ++i) {
+            ASSERT_EQUAL(result.errors[i].offset, sharded_result.errors[i].offset);
+            ASSERT_EQUAL(result.errors[i].line, sharded_result.errors[i].line);
+            ASSERT_EQUAL(result.errors[i].message, sharded_result.errors[i].message);
+        }
+    }
+    filesystem::remove(path);
+
+    // куски начинаются с начала строки
+    const vector<size_t> boundaries = SplitCorpusIntoChunks(corpus, 5);
+    ASSERT_EQUAL(0u, boundaries.front());
+    ASSERT_EQUAL(corpus.size(), boundaries.back());
+    for(size_t i = 1; i + 1 < boundaries.size(); ++i) {
+        ASSERT_EQUAL(corpus[boundaries[i] - 1], '\n');
+    }
+
+    try {
+        SearchServer server;
+        LoadCorpus(server, (filesystem::temp_directory_path() / "search_server_missing_corpus.tsv").string());
+        ASSERT_HINT(false, "missing corpus file must throw"s);
+    } catch(const runtime_error&) {
+    }
+}
+
+// Планировщик выбирает способ выполнения по объему работы, любой способ выдает тот же результат
+void TestExecutionPlanner()
+{
+    // выбор способа по порогам
+    PlannerThresholds thresholds;
+    thresholds.parallel_min_postings = 1000;
+    thresholds.exhaustive_parallel_min_postings = 50000;
+    thresholds.range_min_postings = 500;
+    ASSERT(PlanQuery({999}, thresholds, 8).strategy == ExecutionStrategy::SEQUENTIAL);
+    ASSERT(PlanQuery({100000}, thresholds, 1).strategy == ExecutionStrategy::SEQUENTIAL);
+    const QueryPlan range_plan = PlanQuery({2000}, thresholds, 8);
+    ASSERT(range_plan.strategy == ExecutionStrategy::DOC_RANGE_PARALLEL);
+    ASSERT_EQUAL(range_plan.tasks, 4u);
+    ASSERT(PlanQuery({49999}, thresholds, 8).strategy == ExecutionStrategy::DOC_RANGE_PARALLEL);
+    // число задач полного перебора - тоже из parallelism, а не из числа слов запроса
+    const QueryPlan exhaustive_plan = PlanQuery({100000}, thresholds, 6);
+    ASSERT(exhaustive_plan.strategy == ExecutionStrategy::EXHAUSTIVE_RANGE_PARALLEL);
+    ASSERT_EQUAL(exhaustive_plan.tasks, 6u);
+    // на одну задачу работы не хватает - последовательно
+    thresholds.range_min_postings = 1500;
+    ASSERT(PlanQuery({2000}, thresholds, 8).strategy == ExecutionStrategy::SEQUENTIAL);
+
+    // пороги по замерам: параллельные способы дороже на старте и дешевле на постинг
+    vector<PlannerCalibrationSample> samples;
+    for(size_t postings = 1000; postings <= 16000; postings *= 2) {
+        samples.push_back({postings, 10.0 * postings, 40000.0 + 2.0 * postings, 20000.0 + 4.0 * postings});
+    }
+    const PlannerThresholds fitted = FitPlannerThresholds(samples, 4);
+    ASSERT_EQUAL(fitted.parallel_min_postings, 3334u);             // 10x = 20000 + 4x
+    ASSERT_EQUAL(fitted.exhaustive_parallel_min_postings, 10000u); // 20000 + 4x = 40000 + 2x
+    // на одном потоке параллельные способы не выбираются
+    ASSERT_EQUAL(FitPlannerThresholds(samples, 1).parallel_min_postings, PlannerThresholds::NEVER);
+    // параллельный способ никогда не выигрывает
+    for(PlannerCalibrationSample& sample : samples) {
+        sample.range_parallel_ns = sample.exhaustive_parallel_ns = 2.0 * sample.sequential_ns;
+    }
+    ASSERT_EQUAL(FitPlannerThresholds(samples, 4).parallel_min_postings, PlannerThresholds::NEVER);
+    ASSERT_EQUAL(FitPlannerThresholds(samples, 4).exhaustive_parallel_min_postings, PlannerThresholds::NEVER);
+
+    // сохраненные пороги читаются обратно без потерь, пропущенные поля - по умолчанию
+    const PlannerThresholds parsed = ParsePlannerThresholds(FormatPlannerThresholds(fitted));
+    ASSERT_EQUAL(parsed.parallel_min_postings, fitted.parallel_min_postings);
+    ASSERT_EQUAL(parsed.exhaustive_parallel_min_postings, fitted.exhaustive_parallel_min_postings);
+    ASSERT_EQUAL(parsed.range_min_postings, fitted.range_min_postings);
+    ASSERT_EQUAL(parsed.parallelism, fitted.parallelism);
+    const PlannerThresholds partial = ParsePlannerThresholds("parallelism=3\n"s);
+    ASSERT_EQUAL(partial.parallelism, 3u);
+    ASSERT_EQUAL(partial.parallel_min_postings, PlannerThresholds::NEVER);
+    for(const string& malformed : {"parallelism"s, "parallelism=x"s, "parallelism=3x"s, "threads=3"s}) {
+        bool rejected = false;
+        try {
+            ParsePlannerThresholds(malformed);
+        } catch(const invalid_argument&) {
+            rejected = true;
+        }
+        ASSERT_HINT(rejected, malformed);
+    }
+    // сервер сам не калибруется: без заданных порогов запросы выполняются последовательно
+    ASSERT_EQUAL(SearchServer().GetPlannerThresholds().parallel_min_postings, PlannerThresholds::NEVER);
+
+    // результат не зависит от выбранного способа
+    mt19937 generator(13);
+    const auto random_word = [&generator]() {
+        const int index = uniform_int_distribution<int>(0, 29)(generator);
+        return "w"s + to_string(index * index / 30);
+    };
+    SearchServer server;
+    ShardedSearchServer sharded(""s, 2);
+    for(int id = 0; id < 500; ++id) {
+        string text;
+        const int length = uniform_int_distribution<int>(1, 10)(generator);
+        for(int i = 0; i < length; ++i) {
+            text += random_word() + " "s;
+        }
+        const auto status = static_cast<DocumentStatus>(uniform_int_distribution<int>(0, 3)(generator));
+        const int rating = uniform_int_distribution<int>(-5, 5)(generator);
+        server.AddDocument(id * 5 + 2, text, status, {rating});
+        sharded.AddDocument(id * 5 + 2, text, status, {rating});
+    }
+
+    const auto assert_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for(size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT(lhs[i].relevance == rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+
+    PlannerThresholds range_only;
+    range_only.parallel_min_postings = 0;
+    range_only.range_min_postings = 1;
+    range_only.parallelism = 4;
+    PlannerThresholds exhaustive_only = range_only;
+    exhaustive_only.exhaustive_parallel_min_postings = 0;
+
+    for(int q = 0; q < 100; ++q) {
+        string query;
+        const int length = uniform_int_distribution<int>(1, 6)(generator);
+        for(int i = 0; i < length; ++i) {
+            query += (uniform_int_distribution<int>(0, 5)(generator) == 0 ? "-"s : ""s) + random_word() + " "s;
+        }
+        const auto predicate = [](int document_id, DocumentStatus, int rating) { return document_id % 3 != 0 && rating >= -2; };
+        const vector<Document> expected = server.FindTopDocuments(query);
+        const vector<Document> expected_banned = server.FindTopDocuments(query, DocumentStatus::BANNED);
+        const vector<Document> expected_predicate = server.FindTopDocuments(query, predicate);
+
+        server.SetPlannerThresholds(range_only);
+        QueryStats stats;
+        assert_same(expected, server.FindTopDocuments(auto_execution, query, DocumentStatus::ACTUAL, stats));
+        if(stats.estimated_postings > 0) {
+            ASSERT(stats.strategy == ExecutionStrategy::DOC_RANGE_PARALLEL);
+            ASSERT(stats.parallel_tasks >= 2);
+        }
+        assert_same(expected_banned, server.FindTopDocuments(auto_execution, query, DocumentStatus::BANNED));
+        assert_same(expected_predicate, server.FindTopDocuments(auto_execution, query, predicate));
+
+        server.SetPlannerThresholds(exhaustive_only);
+        assert_same(expected, server.FindTopDocuments(auto_execution, query, DocumentStatus::ACTUAL, stats));
+        if(stats.estimated_postings > 0) {
+            ASSERT(stats.strategy == ExecutionStrategy::EXHAUSTIVE_RANGE_PARALLEL);
+            // задач - не больше parallelism из порогов и не больше, чем реально выполнено
+            ASSERT(stats.parallel_tasks >= 1 && stats.parallel_tasks <= exhaustive_only.parallelism);
+        }
+        assert_same(expected_predicate, server.FindTopDocuments(auto_execution, query, predicate, stats));
+
+        server.SetPlannerThresholds(PlannerThresholds{});
+        assert_same(expected, server.FindTopDocuments(auto_execution, query, DocumentStatus::ACTUAL, stats));
+        ASSERT(stats.strategy == ExecutionStrategy::SEQUENTIAL);
+        ASSERT_EQUAL(stats.parallel_tasks, 1u);
+    }
+
+    // число диапазонов полного перебора задает parallelism порогов, а не число потоков машины
+    server.SetPlannerThresholds(exhaustive_only);
+    QueryStats stats;
+    server.FindTopDocuments(auto_execution, "w0"s, DocumentStatus::ACTUAL, stats);
+    ASSERT(stats.strategy == ExecutionStrategy::EXHAUSTIVE_RANGE_PARALLEL);
+    ASSERT_EQUAL(stats.parallel_tasks, exhaustive_only.parallelism);
+    server.SetPlannerThresholds(PlannerThresholds{});
+
+    // шардированный сервер: тот же результат, каждый шард планирует свою часть работы на свою долю потоков
+    const vector<pair<PlannerThresholds, ExecutionStrategy>> sharded_plans = {
+        {PlannerThresholds{}, ExecutionStrategy::SEQUENTIAL},
+        {range_only, ExecutionStrategy::DOC_RANGE_PARALLEL},
+        {exhaustive_only, ExecutionStrategy::EXHAUSTIVE_RANGE_PARALLEL},
+    };
+    for(const auto& [thresholds, strategy] : sharded_plans) {
+        sharded.SetPlannerThresholds(thresholds);
+        ASSERT_EQUAL(sharded.GetPlannerThresholds().parallelism, thresholds.parallelism);
+        for(const string& query : {"w0"s, "w1 w4 -w9"s, "w2 w3 w16 w25"s}) {
+            QueryStats expected_stats;
+            const vector<Document> expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, expected_stats);
+            QueryStats sharded_stats;
+            assert_same(expected, sharded.FindTopDocuments(query, DocumentStatus::ACTUAL, sharded_stats));
+            ASSERT_EQUAL(sharded_stats.parallel_tasks, sharded.GetShardCount());
+            assert_same(expected, sharded.FindTopDocuments(auto_execution, query));
+            assert_same(expected, sharded.FindTopDocuments(auto_execution, query, DocumentStatus::ACTUAL, sharded_stats));
+            server.FindTopDocuments(auto_execution, query, DocumentStatus::ACTUAL, expected_stats);
+            ASSERT_EQUAL(sharded_stats.estimated_postings, expected_stats.estimated_postings);
+            ASSERT(sharded_stats.strategy == strategy);
+            const auto predicate = [](int document_id, DocumentStatus status, int) { return status != DocumentStatus::BANNED && document_id % 2 == 0; };
+            assert_same(server.FindTopDocuments(query, predicate), sharded.FindTopDocuments(auto_execution, query, predicate, sharded_stats));
+        }
+    }
+}
+
+// Минус-слова исключают документы до вычисления релевантности: полный перебор seq и par совпадает побитово
+void TestMinusWordExclusion()
+{
+    mt19937 generator(17);
+    const auto random_word = [&generator]() {
+        const int index = uniform_int_distribution<int>(0, 24)(generator);
+        return "w"s + to_string(index * index / 25);
+    };
+    SearchServer server;
+    for(int id = 0; id < 700; ++id) {
+        string text;
+        const int length = uniform_int_distribution<int>(1, 8)(generator);
+        for(int i = 0; i < length; ++i) {
+            text += random_word() + " "s;
+        }
+        const auto status = static_cast<DocumentStatus>(uniform_int_distribution<int>(0, 3)(generator));
+        // id с большими промежутками - документы попадают в разные блоки битовой карты
+        server.AddDocument(id * 331, text, status, {uniform_int_distribution<int>(-5, 5)(generator)});
+    }
+
+    const auto assert_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for(size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT(lhs[i].relevance == rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+
+    for(int q = 0; q < 150; ++q) {
+        string query;
+        const int length = uniform_int_distribution<int>(1, 7)(generator);
+        for(int i = 0; i < length; ++i) {
+            query += (uniform_int_distribution<int>(0, 2)(generator) == 0 ? "-"s : ""s) + random_word() + " "s;
+        }
+        const auto predicate = [](int document_id, DocumentStatus status, int) { return document_id % 2 == 1 || status == DocumentStatus::BANNED; };
+        // постраничная выдача построена на последовательном полном переборе
+        const vector<Document> exhaustive = server.FindTopDocumentsAfter(query, SearchCursor(), MAX_RESULT_DOCUMENT_COUNT).documents;
+        assert_same(exhaustive, server.FindTopDocuments(execution::par, query));
+        assert_same(exhaustive, server.FindTopDocuments(query));
+        assert_same(server.FindTopDocumentsAfter(query, SearchCursor(), MAX_RESULT_DOCUMENT_COUNT, predicate).documents,
+                    server.FindTopDocuments(execution::par, query, predicate));
+    }
+
+    // документы с минус-словом не попадают в выдачу, неизвестные и пустые слова не мешают
+    SearchServer small;
+    small.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    small.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, {1});
+    small.AddDocument(3, "dog bird"s, DocumentStatus::BANNED, {1});
+    const vector<Document> result = small.FindTopDocuments(execution::par, "cat unknown -dog"s);
+    ASSERT_EQUAL(result.size(), 1u);
+    ASSERT_EQUAL(result[0].id, 2);
+    ASSERT(small.FindTopDocuments(execution::par, "unknown -cat"s).empty());
+    // слово есть только у документа другого статуса
+    ASSERT(small.FindTopDocuments(execution::par, "bird -cat"s).empty());
+}
+
+// Обязательные слова (+слово): в выдаче только документы со всеми такими словами
+void TestRequiredWords()
+{
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {8});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5});
+    server.AddDocument(4, "white dog fluffy tail"s, DocumentStatus::BANNED, {3});
+
+    const auto ids = [](const vector<Document>& documents) {
+        vector<int> result;
+        for(const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        sort(result.begin(), result.end());
+        return result;
+    };
+
+    ASSERT(ids(server.FindTopDocuments("+cat tail"s)) == vector<int>({1, 2}));
+    ASSERT(ids(server.FindTopDocuments("+cat +tail"s)) == vector<int>({2}));
+    ASSERT(ids(server.FindTopDocuments("+fluffy"s, DocumentStatus::BANNED)) == vector<int>({4}));
+    ASSERT(server.FindTopDocuments("+cat +dog"s).empty());
+    // неизвестное обязательное слово - пустая выдача
+    ASSERT(server.FindTopDocuments("cat +parrot"s).empty());
+    ASSERT(server.FindTopDocuments(execution::par, "cat +parrot"s).empty());
+    // минус-слово сильнее обязательного, стоп-слово с '+' игнорируется
+    ASSERT(ids(server.FindTopDocuments("+cat -collar"s)) == vector<int>({2}));
+    ASSERT(ids(server.FindTopDocuments("+cat +and"s)) == vector<int>({1, 2}));
+
+    // обязательное слово участвует в релевантности как обычное плюс-слово
+    const vector<Document> plain = server.FindTopDocuments("cat tail"s);
+    const vector<Document> required = server.FindTopDocuments("cat +tail"s);
+    ASSERT_EQUAL(required.size(), 1u);
+    ASSERT_EQUAL(required[0].id, 2);
+    ASSERT(required[0].relevance == plain[0].relevance);
+
+    {
+        const auto [words, status] = server.MatchDocument("+cat +tail fluffy"s, 2);
+        ASSERT(words == vector<string_view>({"cat"sv, "fluffy"sv, "tail"sv}));
+        ASSERT(status == DocumentStatus::ACTUAL);
+        ASSERT(get<0>(server.MatchDocument("+cat +tail"s, 1)).empty());
+        ASSERT(get<0>(server.MatchDocument(execution::par, "cat +parrot"s, 1)).empty());
+    }
+
+    for(const string& query : {"+"s, "++cat"s, "+-cat"s}) {
+        try {
+            server.FindTopDocuments(query);
+            ASSERT_HINT(false, "query "s + query + " must throw"s);
+        } catch(const invalid_argument&) {
+        }
+    }
+
+    // пересечение обходит только самый редкий список
+    SearchServer large;
+    for(int id = 0; id < 2000; ++id) {
+        const string text = "common"s + (id % 500 == 0 ? " rare"s : ""s) + (id % 2 == 0 ? " even"s : ""s);
+        large.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 7});
+    }
+    QueryStats stats;
+    ASSERT(ids(large.FindTopDocuments("+common +even +rare"s, DocumentStatus::ACTUAL, stats)) == vector<int>({0, 500, 1000, 1500}));
+    ASSERT(stats.evaluator == QueryEvaluator::CONJUNCTIVE);
+    ASSERT(stats.postings_scanned <= 4u * 3u);
+
+    // все способы выполнения совпадают с полным перебором с последующей проверкой слов
+    mt19937 generator(23);
+    const auto random_word = [&generator]() {
+        const int index = uniform_int_distribution<int>(0, 19)(generator);
+        return "w"s + to_string(index * index / 20);
+    };
+    SearchServer random_server;
+    ShardedSearchServer sharded(""s, 3);
+    map<int, set<string>> document_words;
+    map<int, DocumentStatus> document_statuses;
+    for(int id = 0; id < 400; ++id) {
+        string text;
+        const int length = uniform_int_distribution<int>(1, 8)(generator);
+        for(int i = 0; i < length; ++i) {
+            const string word = random_word();
+            document_words[id].insert(word);
+            text += word + " "s;
+        }
+        const auto status = static_cast<DocumentStatus>(uniform_int_distribution<int>(0, 3)(generator));
+        const vector<int> ratings = {uniform_int_distribution<int>(-5, 5)(generator)};
+        document_statuses[id] = status;
+        random_server.AddDocument(id, text, status, ratings);
+        sharded.AddDocument(id, text, status, ratings);
+    }
+    const auto assert_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for(size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT(lhs[i].relevance == rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+    for(int q = 0; q < 100; ++q) {
+        string query;
+        vector<string> required_words;
+        const int length = uniform_int_distribution<int>(1, 5)(generator);
+        for(int i = 0; i < length; ++i) {
+            const string word = random_word();
+            if(i == 0 || uniform_int_distribution<int>(0, 2)(generator) == 0) {
+                required_words.push_back(word);
+                query += "+"s + word + " "s;
+            } else {
+                query += word + " "s;
+            }
+        }
+        const vector<Document> exhaustive = random_server.FindTopDocumentsAfter(query, SearchCursor(), 1000).documents;
+        for(const Document& document : exhaustive) {
+            for(const string& word : required_words) {
+                ASSERT(document_words[document.id].count(word) > 0);
+            }
+        }
+        // документы со всеми обязательными словами не теряются
+        size_t expected_count = 0;
+        for(const auto& [id, words] : document_words) {
+            if(document_statuses[id] == DocumentStatus::ACTUAL && all_of(required_words.begin(), required_words.end(),
+                [&words = words](const string& word) { return words.count(word) > 0; })) {
+                ++expected_count;
+            }
+        }
+        ASSERT_EQUAL(exhaustive.size(), expected_count);
+
+        vector<Document> top = exhaustive;
+        if(top.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            top.resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
+        assert_same(top, random_server.FindTopDocuments(query));
+        assert_same(top, random_server.FindTopDocuments(execution::par, query));
+        assert_same(top, random_server.FindTopDocuments(auto_execution, query));
+        assert_same(top, sharded.FindTopDocuments(query));
+    }
+}
+
+// Конкурентная хеш-таблица: произвольные ключи, обновление на месте, обход без блокировок
+void TestConcurrentMap()
+{
+    // число корзин округляется до степени двойки
+    ASSERT_EQUAL((ConcurrentMap<int, int>(5).GetBucketCount()), 8u);
+    ASSERT((ConcurrentMap<int, int>().GetBucketCount() >= thread::hardware_concurrency()));
+
+    // строковые ключи со своим хешером
+    struct LengthHash {
+        size_t operator()(const string& key) const {
+            return key.size();
+        }
+    };
+    ConcurrentMap<string, int, LengthHash> words(4);
+    words["cat"s] += 2;
+    words.Update("dog"s, [](int& value) { value = 5; });
+    words.Update("cat"s, [](int& value) { value *= 10; });
+    int found = 0;
+    const auto store_found = [&found](const int& value) { found = value; };
+    ASSERT(words.Visit("cat"s, store_found));
+    ASSERT_EQUAL(found, 20);
+    ASSERT(!words.Visit("bird"s, [](const int&) {}));
+    words.erase("dog"s);
+    const map<string, int> ordinary = words.BuildOrdinaryMap();
+    ASSERT_EQUAL(ordinary.size(), 1u);
+    ASSERT_EQUAL(ordinary.at("cat"s), 20);
+
+    // одновременные обновления из нескольких потоков не теряются
+    const int thread_count = 8;
+    const int key_count = 1000;
+    const int rounds = 50;
+    ConcurrentMap<int, int> counters;
+    vector<thread> threads;
+    for(int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&counters, t]() {
+            for(int round = 0; round < rounds; ++round) {
+                for(int key = 0; key < key_count; ++key) {
+                    if((key + t) % 2 == 0) {
+                        counters[key] += 1;
+                    } else {
+                        counters.Update(key, [](int& value) { ++value; });
+                    }
+                }
+            }
+        });
+    }
+    for(thread& worker : threads) {
+        worker.join();
+    }
+
+    int total = 0;
+    size_t keys = 0;
+    counters.ForEach([&total, &keys](int key, int value) {
+        ASSERT(key >= 0 && key < key_count);
+        ASSERT_EQUAL(value, thread_count * rounds);
+        total += value;
+        ++keys;
+    });
+    ASSERT_EQUAL(keys, static_cast<size_t>(key_count));
+    ASSERT_EQUAL(total, thread_count * rounds * key_count);
+
+    vector<pair<int, int>> extracted = counters.Extract();
+    ASSERT_EQUAL(extracted.size(), static_cast<size_t>(key_count));
+    sort(extracted.begin(), extracted.end());
+    ASSERT_EQUAL(extracted.front().first, 0);
+    ASSERT_EQUAL(extracted.back().first, key_count - 1);
+    ASSERT(counters.BuildOrdinaryMap().empty());
+}
+
+// true, если function бросает исключение типа Exception
+template <typename Exception, typename Function>
+bool Throws(Function function) {
+    try {
+        function();
+    } catch(const Exception&) {
+        return true;
+    }
+    return false;
+}
+
+// Проверка сжатого хранилища текстов документов
+void TestTextStore()
+{
+    // сжатие без потерь: пустой, короткий, повторяющийся и случайный текст
+    mt19937 generator(7);
+    string random_text;
+    for(int i = 0; i < 5000; ++i) {
+        random_text.push_back(static_cast<char>(generator() & 0xFF));
+    }
+    string repeated_text;
+    for(int i = 0; i < 2000; ++i) {
+        repeated_text += "fluffy cat "s;
+    }
+    for(const string& text : {""s, "cat"s, "white cat and fashionable collar"s, repeated_text, random_text}) {
+        ASSERT_EQUAL(text, DecompressText(CompressText(text), text.size()));
+    }
+    ASSERT(CompressText(repeated_text).size() < repeated_text.size() / 10);
+
+    // испорченный блок не читается за пределами буфера, а бросает исключение
+    string corrupted = CompressText(repeated_text);
+    corrupted.resize(corrupted.size() / 2);
+    ASSERT(Throws<runtime_error>([&]() { DecompressText(corrupted, repeated_text.size()); }));
+    ASSERT(Throws<runtime_error>([&]() { DecompressText(CompressText("cat"s), 4); }));
+
+    // записи в нескольких блоках, включая текст длиннее блока
+    const filesystem::path path = filesystem::temp_directory_path() / "search_server_test_texts.lz";
+    for(const bool in_file : {false, true}) {
+        CountingMemoryResource memory;
+        TextStore store = in_file ? TextStore(path.string(), &memory) : TextStore(&memory);
+        vector<string> texts;
+        vector<size_t> records;
+        for(int i = 0; i < 3000; ++i) {
+            texts.push_back("document "s + to_string(i) + " fluffy cat "s + to_string(i * 7));
+            if(i == 1500) {
+                texts.back() += string(TextStore::BLOCK_SIZE + 100, 'x');
+            }
+            records.push_back(store.Append(texts.back()));
+        }
+        const TextStoreStats stats = store.GetStats();
+        ASSERT_EQUAL(3000u, stats.live_records);
+        ASSERT(stats.blocks >= 2);
+        ASSERT(stats.compressed_bytes < stats.raw_bytes);
+        // вперемешку по блокам, чтобы кэш блока вытеснялся
+        for(size_t i = 0; i < texts.size(); i += 7) {
+            ASSERT_EQUAL(texts[i], store.Get(records[i]));
+            ASSERT_EQUAL(texts[texts.size() - 1 - i], store.Get(records[texts.size() - 1 - i]));
+        }
+
+        store.Release(records[0]);
+        ASSERT(Throws<out_of_range>([&]() { store.Get(records[0]); }));
+        ASSERT(Throws<out_of_range>([&]() { store.Get(TextStore::NO_RECORD); }));
+        ASSERT_EQUAL(texts[1], store.Get(records[1]));
+        // после освобождения всех записей уплотнение очищает хранилище
+        for(const size_t record : records) {
+            store.Release(record);
+        }
+        ASSERT_EQUAL(3000u, store.GetStats().records);
+        store.CompactIfSparse();
+        ASSERT_EQUAL(0u, store.GetStats().records);
+        ASSERT_EQUAL(0u, memory.GetUsage().bytes);
+    }
+    ASSERT_EQUAL(0u, filesystem::file_size(path));
+
+    // повторная замена одного текста: мертвые тексты убирает уплотнение, память и файл не растут
+    for(const bool in_file : {false, true}) {
+        CountingMemoryResource memory;
+        TextStore store = in_file ? TextStore(path.string(), &memory) : TextStore(&memory);
+        const size_t first = store.Append("first document"s);
+        const size_t updated = store.Append("updated document"s);
+        const size_t last = store.Append("last document"s);
+        size_t peak_file_size = 0;
+        string text;
+        for(int i = 0; i < 2000; ++i) {
+            text = "version "s + to_string(i) + string(1000, static_cast<char>('a' + i % 26));
+            store.Replace(updated, text);
+            store.CompactIfSparse();
+            if(in_file) {
+                peak_file_size = max<size_t>(peak_file_size, filesystem::file_size(path));
+            }
+        }
+        ASSERT_EQUAL(text, store.Get(updated));
+        ASSERT_EQUAL("first document"s, store.Get(first));
+        ASSERT_EQUAL("last document"s, store.Get(last));
+        const TextStoreStats stats = store.GetStats();
+        ASSERT_EQUAL(3u, stats.records);
+        ASSERT(stats.raw_bytes <= 2 * TextStore::BLOCK_SIZE + text.size());
+        // 2000 версий по 1 КиБ без уплотнения заняли бы десятки блоков
+        ASSERT(memory.GetUsage().peak_bytes < 4 * TextStore::BLOCK_SIZE);
+        ASSERT(peak_file_size < 2 * TextStore::BLOCK_SIZE);
+        ASSERT(Throws<out_of_range>([&]() { store.Replace(TextStore::NO_RECORD, "text"s); }));
+
+        // номер освобожденной записи переиспользуется
+        store.Release(first);
+        ASSERT(Throws<out_of_range>([&]() { store.Replace(first, "text"s); }));
+        ASSERT_EQUAL(first, store.Append("new document"s));
+        ASSERT_EQUAL(3u, store.GetStats().records);
+        ASSERT_EQUAL("new document"s, store.Get(first));
+    }
+    filesystem::remove(path);
+
+    // файл не открывается заново при очистке - исключение, а не молчаливый переход на память
+    {
+        const filesystem::path directory = filesystem::temp_directory_path() / "search_server_test_text_dir";
+        filesystem::create_directories(directory);
+        TextStore store((directory / "texts.lz").string());
+        const size_t removed = store.Append("fluffy cat "s + string(TextStore::BLOCK_SIZE, 'x'));
+        const size_t record = store.Append("white cat"s);
+        filesystem::remove_all(directory);
+        // неудачное уплотнение и неудачная очистка оставляют хранилище прежним
+        store.Release(removed);
+        ASSERT(Throws<runtime_error>([&]() { store.CompactIfSparse(); }));
+        ASSERT_EQUAL("white cat"s, store.Get(record));
+        ASSERT_EQUAL(1u, store.GetStats().live_records);
+        store.Release(record);
+        ASSERT(Throws<runtime_error>([&]() { store.CompactIfSparse(); }));
+        ASSERT_EQUAL(2u, store.GetStats().records);
+    }
+
+    // ошибка уплотнения не отменяет удаление документа, а ошибка записи текста - не оставляет документ добавленным наполовину
+    {
+        const filesystem::path directory = filesystem::temp_directory_path() / "search_server_test_text_dir";
+        filesystem::create_directories(directory);
+        SearchServer server("and in"s);
+        server.SetTextStorage(TextStorage::FILE, (directory / "texts.lz").string());
+        server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+        filesystem::remove_all(directory);
+        server.RemoveDocument(1);
+        ASSERT_EQUAL(0, server.GetDocumentCount());
+        ASSERT(server.begin() == server.end());
+        ASSERT(server.FindTopDocuments("cat"s).empty());
+        ostringstream metrics;
+        server.WriteMetrics(metrics);
+        ASSERT(metrics.str().find("search_server_text_store_compaction_failures_total 1\n"s) != string::npos);
+
+        // в /dev/full запись не проходит: несжимаемый блок не помещается в буфер потока и пишется сразу
+        if(filesystem::exists("/dev/full"s)) {
+            SearchServer full_server("and in"s);
+            full_server.SetTextStorage(TextStorage::FILE, "/dev/full"s);
+            mt19937 generator(44);
+            string text = "fluffy cat"s;
+            while(text.size() < TextStore::BLOCK_SIZE) {
+                text += uniform_int_distribution<int>(0, 7)(generator) == 0 ? ' ' : static_cast<char>('a' + uniform_int_distribution<int>(0, 25)(generator));
+            }
+            ASSERT(Throws<runtime_error>([&]() { full_server.AddDocument(2, text, DocumentStatus::ACTUAL, {2}); }));
+            ASSERT_EQUAL(0, full_server.GetDocumentCount());
+            ASSERT(full_server.begin() == full_server.end());
+        }
+    }
+
+    {
+        SearchServer server("and in"s);
+        server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {1});
+        for(int i = 0; i < 2000; ++i) {
+            server.UpdateDocument(1, "fluffy cat "s + to_string(i) + string(1000, 'x'));
+        }
+        ASSERT_EQUAL("fluffy cat 1999"s + string(1000, 'x'), server.GetDocumentText(1));
+        ASSERT(server.GetMemoryStats().document_text.peak_bytes < 4 * TextStore::BLOCK_SIZE);
+    }
+
+    // тексты документов сервера во всех режимах хранения
+    for(const TextStorage storage : {TextStorage::MEMORY, TextStorage::FILE, TextStorage::NONE}) {
+        SearchServer server("and in"s);
+        server.SetTextStorage(storage, path.string());
+        ASSERT(storage == server.GetTextStorage());
+        server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {2});
+        // хранилище текстов не влияет на поиск
+        ASSERT_EQUAL(2, server.FindTopDocuments("fluffy"s)[0].id);
+        if(storage == TextStorage::NONE) {
+            ASSERT(Throws<logic_error>([&]() { server.GetDocumentText(1); }));
+            ASSERT_EQUAL(0u, server.GetTextStoreStats().records);
+        } else {
+            ASSERT_EQUAL("white cat and fashionable collar"s, server.GetDocumentText(1));
+            ASSERT_EQUAL("fluffy cat fluffy tail"s, server.GetDocumentText(2));
+            ASSERT_EQUAL(2u, server.GetTextStoreStats().live_records);
+        }
+        ASSERT(Throws<out_of_range>([&]() { server.GetDocumentText(3); }));
+        // сменить хранилище можно только у пустого сервера
+        ASSERT(Throws<logic_error>([&]() { server.SetTextStorage(TextStorage::MEMORY); }));
+    }
+    filesystem::remove(path);
+
+    ShardedSearchServer sharded_server("and in"s, 2);
+    sharded_server.SetTextStorage(TextStorage::NONE);
+    sharded_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    ASSERT(Throws<logic_error>([&]() { sharded_server.GetDocumentText(1); }));
+}
+
+// Проверка изменения документов на месте: сервер после изменений совпадает с собранным заново
+void TestUpdateDocument()
+{
+    mt19937 generator(45);
+    const auto random_text = [&generator]() {
+        string text;
+        const int length = uniform_int_distribution<int>(1, 12)(generator);
+        for(int i = 0; i < length; ++i) {
+            text += "w"s + to_string(static_cast<int>(exponential_distribution<>(0.2)(generator))) + " "s;
+        }
+        return text;
+    };
+    const vector<DocumentStatus> statuses = {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED};
+
+    struct State {
+        string text;
+        DocumentStatus status;
+        int rating;
+    };
+    vector<State> states;
+    SearchServer server("w0"s);
+    for(int id = 0; id < 400; ++id) {
+        states.push_back({random_text(), statuses[id % 2], id % 5});
+        server.AddDocument(id, states[id].text, states[id].status, {states[id].rating});
+    }
+    // индекс вкладов правится на месте, а не сбрасывается
+    server.BuildImpactIndex();
+
+    for(int i = 0; i < 1500; ++i) {
+        const int id = uniform_int_distribution<int>(0, 399)(generator);
+        switch(i % 3) {
+            case 0:
+                states[id].status = statuses[uniform_int_distribution<size_t>(0, statuses.size() - 1)(generator)];
+                server.UpdateDocumentStatus(id, states[id].status);
+                break;
+            case 1:
+                states[id].rating = uniform_int_distribution<int>(-5, 5)(generator);
+                server.UpdateDocumentRating(id, {states[id].rating});
+                break;
+            case 2:
+                // иногда текст с теми же словами в другом порядке - частоты не меняются
+                states[id].text = i % 2 ? random_text() : states[id].text + " "s;
+                server.UpdateDocument(id, states[id].text);
+                break;
+        }
+    }
+    ASSERT(server.HasImpactIndex());
+
+    SearchServer rebuilt_server("w0"s);
+    for(int id = 0; id < 400; ++id) {
+        rebuilt_server.AddDocument(id, states[id].text, states[id].status, {states[id].rating});
+    }
+    rebuilt_server.BuildImpactIndex();
+
+    for(int id = 0; id < 400; ++id) {
+        ASSERT(server.GetWordFrequencies(id) == rebuilt_server.GetWordFrequencies(id));
+        ASSERT_EQUAL(states[id].text, server.GetDocumentText(id));
+    }
+    for(int q = 0; q < 60; ++q) {
+        const string query = random_text() + (q % 3 == 0 ? " -w1"s : ""s);
+        const DocumentStatus status = statuses[q % statuses.size()];
+        for(const bool use_impact_index : {true, false}) {
+            const auto expected = use_impact_index
+                ? rebuilt_server.FindTopDocuments(query, status)
+                : rebuilt_server.FindTopDocuments(execution::par, query, status);
+            const auto actual = use_impact_index
+                ? server.FindTopDocuments(query, status)
+                : server.FindTopDocuments(execution::par, query, status);
+            ASSERT_EQUAL(expected.size(), actual.size());
+            for(size_t i = 0; i < actual.size(); ++i) {
+                ASSERT_EQUAL(expected[i].id, actual[i].id);
+                ASSERT(expected[i].relevance == actual[i].relevance);
+                ASSERT_EQUAL(expected[i].rating, actual[i].rating);
+            }
+        }
+        const int id = q * 6;
+        ASSERT(server.MatchDocument(query, id) == rebuilt_server.MatchDocument(query, id));
+    }
+
+    // отклоненное изменение не меняет документ
+    SearchServer reject_server;
+    reject_server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+    reject_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    reject_server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, {1});
+    // совпадение с собой дубликатом не считается
+    reject_server.UpdateDocument(2, "dog black"s);
+    ASSERT(Throws<invalid_argument>([&]() { reject_server.UpdateDocument(2, "cat white"s); }));
+    ASSERT_EQUAL("dog black"s, reject_server.GetDocumentText(2));
+    ASSERT_EQUAL(2, reject_server.FindTopDocuments("dog"s)[0].id);
+    ASSERT(Throws<out_of_range>([&]() { reject_server.UpdateDocumentStatus(3, DocumentStatus::BANNED); }));
+    ASSERT(Throws<out_of_range>([&]() { reject_server.UpdateDocument(3, "cat"s); }));
+
+    // отметки дубликатов обновленного документа сверяются с его новым текстом
+    SearchServer flag_server;
+    flag_server.SetDuplicatePolicy(DuplicatePolicy::FLAG);
+    flag_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    flag_server.AddDocument(2, "cat white"s, DocumentStatus::ACTUAL, {1});
+    flag_server.AddDocument(3, "white cat white"s, DocumentStatus::ACTUAL, {1});
+    flag_server.AddDocument(4, "black dog"s, DocumentStatus::ACTUAL, {1});
+    flag_server.AddDocument(5, "dog black"s, DocumentStatus::ACTUAL, {1});
+    const auto flagged = [&flag_server]() {
+        return map<int, int>(flag_server.GetFlaggedDuplicates().begin(), flag_server.GetFlaggedDuplicates().end());
+    };
+    ASSERT((map<int, int>{{2, 1}, {3, 1}, {5, 4}}) == flagged());
+    // 2 и 3 остались дубликатами друг друга: оригинал - меньший id, а не взаимные ссылки
+    flag_server.UpdateDocument(1, "grey mouse"s);
+    ASSERT((map<int, int>{{3, 2}, {5, 4}}) == flagged());
+    // у 5 другого оригинала нет - отметка снимается
+    flag_server.UpdateDocument(4, "red fox"s);
+    ASSERT((map<int, int>{{3, 2}}) == flagged());
+    // новый текст совпал с текстом дубликата - отметка остается
+    flag_server.UpdateDocument(2, "mouse grey"s);
+    ASSERT((map<int, int>{{2, 1}}) == flagged());
+
+    ShardedSearchServer sharded_server(""s, 3);
+    sharded_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    sharded_server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, {2});
+    sharded_server.UpdateDocumentStatus(2, DocumentStatus::BANNED);
+    sharded_server.UpdateDocument(1, "white dog"s);
+    ASSERT(sharded_server.FindTopDocuments("cat"s).empty());
+    ASSERT_EQUAL(2, sharded_server.FindTopDocuments("cat"s, DocumentStatus::BANNED)[0].id);
+    ASSERT_EQUAL(1, sharded_server.FindTopDocuments("dog"s)[0].id);
+}
+
+// Проверка префиксных запросов (слово*)
+void TestPrefixQuery()
+{
+    SearchServer server("in the"s);
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "caterpillar and catalog"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "dog inside the category"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "cart with dog"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(5, "castle"s, DocumentStatus::ACTUAL, {5});
+
+    // префикс равносилен запросу из всех термов с этим префиксом
+    const auto compare_queries = [&server](const string& prefix_query, const string& expanded_query) {
+        const auto expected = server.FindTopDocuments(expanded_query);
+        for(const auto& actual : {server.FindTopDocuments(prefix_query), server.FindTopDocuments(execution::par, prefix_query)}) {
+            ASSERT_EQUAL(expected.size(), actual.size());
+            for(size_t i = 0; i < actual.size(); ++i) {
+                ASSERT_EQUAL(expected[i].id, actual[i].id);
+                ASSERT(expected[i].relevance == actual[i].relevance);
+            }
+        }
+    };
+    compare_queries("cat*"s, "cat caterpillar catalog category"s);
+    compare_queries("cat* dog"s, "cat caterpillar catalog category dog"s);
+    compare_queries("cat catal*"s, "cat catalog"s);
+    compare_queries("ca* -cate*"s, "cat catalog cart castle -category -caterpillar"s);
+    // префикс стоп-слова раскрывается в обычные термы
+    compare_queries("in*"s, "inside"s);
+    ASSERT(server.FindTopDocuments("xyz*"s).empty());
+
+    const auto [words, status] = server.MatchDocument("cat* -dog"s, 2);
+    ASSERT((vector<string_view>{"catalog"sv, "caterpillar"sv}) == words);
+    ASSERT(get<0>(server.MatchDocument("cat* -dog*"s, 3)).empty());
+
+    // термы удаленных документов не раскрываются
+    server.RemoveDocument(5);
+    server.AddDocument(6, "cast"s, DocumentStatus::ACTUAL, {6});
+    ASSERT((vector<string_view>{"cast"sv}) == get<0>(server.MatchDocument("cas*"s, 6)));
+    compare_queries("cas*"s, "cast"s);
+
+    for(const string& query : {"*"s, "-*"s, "cat**"s, "+cat*"s}) {
+        ASSERT_HINT(Throws<invalid_argument>([&]() { server.FindTopDocuments(query); }), query);
+    }
+
+    // раскрытие ограничено первыми по алфавиту термами, в том числе по словарям шардов
+    SearchServer wide_server;
+    ShardedSearchServer sharded_server(""s, 3);
+    for(int id = 0; id < 100; ++id) {
+        const string number = to_string(id);
+        const string text = "p"s + string(3 - number.size(), '0') + number;
+        wide_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id});
+        sharded_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id});
+    }
+    string expanded_query;
+    for(int id = 0; id < static_cast<int>(MAX_PREFIX_EXPANSION_COUNT); ++id) {
+        const string number = to_string(id);
+        expanded_query += " p"s + string(3 - number.size(), '0') + number;
+    }
+    ASSERT((vector<string_view>{"p000"sv}) == get<0>(wide_server.MatchDocument("p*"s, 0)));
+    ASSERT(get<0>(wide_server.MatchDocument("p*"s, 99)).empty());
+    const auto expected = wide_server.FindTopDocuments(expanded_query);
+    for(const auto& actual : {wide_server.FindTopDocuments("p*"s), sharded_server.FindTopDocuments("p*"s)}) {
+        ASSERT_EQUAL(expected.size(), actual.size());
+        for(size_t i = 0; i < actual.size(); ++i) {
+            ASSERT_EQUAL(expected[i].id, actual[i].id);
+            ASSERT(abs(expected[i].relevance - actual[i].relevance) < SearchServer::EPSILON_DOUBLE);
+        }
+    }
+
+    // минус-префикс не ограничен: исключаются документы со всеми 100 термами, а не с первыми 64
+    ASSERT(wide_server.FindTopDocuments("p099 p070 -p*"s).empty());
+    ASSERT(wide_server.FindTopDocuments(execution::par, "p099 p070 -p*"s).empty());
+    ASSERT(sharded_server.FindTopDocuments("p099 p070 -p*"s).empty());
+    ASSERT(get<0>(wide_server.MatchDocument("p099 -p*"s, 99)).empty());
+    ASSERT_EQUAL(2u, wide_server.FindTopDocuments("p099 p070 -p00*"s).size());
+}
+
+// расстояние Левенштейна полной таблицей - эталон для автомата
+int ComputeEditDistance(const string& lhs, const string& rhs) {
+    vector<int> row(rhs.size() + 1);
+    iota(row.begin(), row.end(), 0);
+    for(size_t i = 1; i <= lhs.size(); ++i) {
+        int diagonal = row[0];
+        row[0] = static_cast<int>(i);
+        for(size_t j = 1; j <= rhs.size(); ++j) {
+            const int above = row[j];
+            row[j] = min({row[j] + 1, row[j - 1] + 1, diagonal + (lhs[i - 1] != rhs[j - 1] ? 1 : 0)});
+            diagonal = above;
+        }
+    }
+    return row.back();
+}
+
+// Проверка исправления опечаток автоматом Левенштейна
+void TestTypoTolerance()
+{
+    {
+        // с тупика "b" автомат слова cat без опечаток переходит к "c", с тупика "cb" - дальше некуда
+        LevenshteinAutomaton automaton("cat"sv, 0);
+        string next_live;
+        ASSERT_EQUAL(1u, automaton.Feed("bz"sv));
+        ASSERT(automaton.FindNextLiveString(1, next_live));
+        ASSERT_EQUAL("c"s, next_live);
+        ASSERT_EQUAL(LevenshteinAutomaton::NO_DEAD_PREFIX, automaton.Feed("cat"sv));
+        ASSERT_EQUAL(0, automaton.GetDistance());
+        ASSERT_EQUAL(2u, automaton.Feed("cb"sv));
+        ASSERT(!automaton.FindNextLiveString(2, next_live));
+    }
+
+    // обход словаря автоматом находит те же термы, что полный перебор
+    mt19937 generator(47);
+    map<string, int> dictionary;
+    for(int i = 0; i < 3000; ++i) {
+        string term;
+        const int length = uniform_int_distribution<int>(1, 8)(generator);
+        for(int j = 0; j < length; ++j) {
+            term.push_back(static_cast<char>('a' + uniform_int_distribution<int>(0, 4)(generator)));
+        }
+        dictionary[term] = i;
+    }
+    // компактный словарь: половина термов в массиве, остальные добавлены по одному - часть влита слиянием,
+    // часть еще ждет его
+    TermLexicon lexicon;
+    const auto middle = next(dictionary.begin(), dictionary.size() / 2);
+    lexicon.Assign(dictionary.begin(), middle);
+    for(auto it = middle; it != dictionary.end(); ++it) {
+        lexicon.Insert(it->first);
+    }
+    ASSERT_EQUAL(dictionary.size(), lexicon.GetTermCount());
+    for(int q = 0; q < 200; ++q) {
+        const string word = next(dictionary.begin(), uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator))->first + (q % 2 ? "e"s : "x"s);
+        for(int max_distance = 0; max_distance <= MAX_TYPO_EDIT_DISTANCE; ++max_distance) {
+            vector<pair<string, int>> expected;
+            for(const auto& [term, _] : dictionary) {
+                const int distance = ComputeEditDistance(term, word);
+                if(distance <= max_distance) {
+                    expected.emplace_back(term, distance);
+                }
+            }
+            vector<pair<string, int>> actual;
+            ForEachFuzzyMatch(dictionary, word, max_distance,
+                [&actual](const auto& it, int distance) { actual.emplace_back(it->first, distance); });
+            ASSERT(expected == actual);
+
+            actual.clear();
+            for(const auto& [term, distance] : lexicon.FindFuzzyMatches(word, max_distance)) {
+                actual.emplace_back(string(term), distance);
+            }
+            sort(actual.begin(), actual.end());
+            ASSERT(expected == actual);
+        }
+    }
+
+    SearchServer server("and with"s);
+    server.AddDocument(1, "fluffy kitten with collar"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "groomed kettle"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "black cat and dog"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "collars and kittens"s, DocumentStatus::BANNED, {4});
+
+    // по умолчанию опечатки не исправляются
+    ASSERT_EQUAL(0, server.GetTypoTolerance());
+    ASSERT(server.FindTopDocuments("kiten"s).empty());
+    ASSERT(Throws<invalid_argument>([&]() { server.SetTypoTolerance(MAX_TYPO_EDIT_DISTANCE + 1); }));
+
+    server.SetTypoTolerance(2);
+    const auto compare_queries = [&server](const string& typo_query, const string& corrected_query) {
+        const auto expected = server.FindTopDocuments(corrected_query);
+        for(const auto& actual : {server.FindTopDocuments(typo_query), server.FindTopDocuments(execution::par, typo_query)}) {
+            ASSERT_EQUAL(expected.size(), actual.size());
+            for(size_t i = 0; i < actual.size(); ++i) {
+                ASSERT_EQUAL(expected[i].id, actual[i].id);
+                ASSERT(expected[i].relevance == actual[i].relevance);
+            }
+        }
+    };
+    // слово из 6 байт - до двух правок: kittns -> kitten (2), kittens (1); kettle на расстоянии 3
+    compare_queries("kittns"s, "kitten kittens"s);
+    compare_queries("fluffy kittns"s, "fluffy kitten kittens"s);
+    // слово до 5 байт - не больше одной правки: kiten -> kitten, но не kittens; colar -> collar, но не collars
+    compare_queries("kiten"s, "kitten"s);
+    compare_queries("colar"s, "collar"s);
+    // известное слово не исправляется, короткое слово и минус-слово тоже
+    compare_queries("kitten"s, "kitten"s);
+    ASSERT(server.FindTopDocuments("ca"s).empty());
+    compare_queries("black -dogg"s, "black"s);
+    ASSERT(server.FindTopDocuments("+kiten"s).empty());
+
+    const auto [words, status] = server.MatchDocument("kiten colar"s, 1);
+    ASSERT((vector<string_view>{"collar"sv, "kitten"sv}) == words);
+
+    // исправление по словарям всех шардов
+    ShardedSearchServer sharded_server("and with"s, 3);
+    sharded_server.AddDocument(1, "fluffy kitten with collar"s, DocumentStatus::ACTUAL, {1});
+    sharded_server.AddDocument(2, "groomed kettle"s, DocumentStatus::ACTUAL, {2});
+    sharded_server.AddDocument(3, "black cat and dog"s, DocumentStatus::ACTUAL, {3});
+    sharded_server.AddDocument(4, "collars and kittens"s, DocumentStatus::BANNED, {4});
+    sharded_server.SetTypoTolerance(2);
+    ASSERT_EQUAL(2, sharded_server.GetTypoTolerance());
+    const auto expected = server.FindTopDocuments("kittns colar"s, DocumentStatus::BANNED);
+    const auto actual = sharded_server.FindTopDocuments("kittns colar"s, DocumentStatus::BANNED);
+    ASSERT_EQUAL(1u, actual.size());
+    ASSERT_EQUAL(expected.size(), actual.size());
+    ASSERT_EQUAL(4, actual[0].id);
+    ASSERT(abs(expected[0].relevance - actual[0].relevance) < SearchServer::EPSILON_DOUBLE);
+}
+
+void TestApproximateSearch()
+{
+    SearchServer server(""s);
+    ShardedSearchServer sharded(""s, 3);
+    const vector<string> texts = {"cat fluffy"s, "cat the"s, "the parrot"s, "the dog"s, "the fish"s,
+                                  "the horse"s, "the mouse"s, "the snake"s, "the owl"s, "the frog"s};
+    for(size_t i = 0; i < texts.size(); ++i) {
+        server.AddDocument(static_cast<int>(i) + 1, texts[i], DocumentStatus::ACTUAL, {1});
+        sharded.AddDocument(static_cast<int>(i) + 1, texts[i], DocumentStatus::ACTUAL, {1});
+    }
+    const auto ids = [](const vector<Document>& documents) {
+        vector<int> result;
+        for(const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        return result;
+    };
+
+    // по умолчанию поиск точный: документы только со словом the (IDF log(10/9)) добирают выдачу до K
+    ASSERT_EQUAL(0.0, server.GetApproximateIdfThreshold());
+    const auto exact = server.FindTopDocuments("the cat"s);
+    ASSERT_EQUAL(MAX_RESULT_DOCUMENT_COUNT, static_cast<int>(exact.size()));
+    const vector<int> exact_ids = ids(exact);
+    ASSERT((vector<int>{2, 1}) == vector<int>(exact_ids.begin(), exact_ids.begin() + 2));
+
+    ASSERT(Throws<invalid_argument>([&]() { server.SetApproximateIdfThreshold(-1.0); }));
+    server.SetApproximateIdfThreshold(0.5);
+    sharded.SetApproximateIdfThreshold(0.5);
+    ASSERT_EQUAL(0.5, sharded.GetApproximateIdfThreshold());
+
+    // the не участвует в отборе, но релевантность отобранных - полная, и the решает порядок 2 перед 1
+    QueryStats stats;
+    for(const auto& approximate : {server.FindTopDocuments("the cat"s, DocumentStatus::ACTUAL, stats),
+                                   server.FindTopDocuments(execution::par, "the cat"s),
+                                   server.FindTopDocuments(auto_execution, "the cat"s),
+                                   sharded.FindTopDocuments("the cat"s)}) {
+        ASSERT((vector<int>{2, 1}) == ids(approximate));
+        ASSERT(abs(exact[0].relevance - approximate[0].relevance) < SearchServer::EPSILON_DOUBLE);
+        ASSERT(abs(exact[1].relevance - approximate[1].relevance) < SearchServer::EPSILON_DOUBLE);
+    }
+    ASSERT_EQUAL(1u, stats.words_skipped);
+
+    // все плюс-слова ниже порога или частое слово обязательное - запрос выполняется точно
+    ASSERT_EQUAL(MAX_RESULT_DOCUMENT_COUNT, static_cast<int>(server.FindTopDocuments("the"s).size()));
+    server.FindTopDocuments("+the cat"s, DocumentStatus::ACTUAL, stats);
+    ASSERT_EQUAL(0u, stats.words_skipped);
+    const auto required = server.FindTopDocuments("+the cat"s);
+    ASSERT_EQUAL(MAX_RESULT_DOCUMENT_COUNT, static_cast<int>(required.size()));
+    ASSERT_EQUAL(2, required[0].id);
+    // минус-слова работают как прежде
+    ASSERT((vector<int>{1}) == ids(server.FindTopDocuments("the cat -the"s)));
+
+    // слово удаленного документа остается в словаре без документов: IDF 0, и в отборе оно не значимо
+    server.AddDocument(11, "the deadword"s, DocumentStatus::ACTUAL, {1});
+    sharded.AddDocument(11, "the deadword"s, DocumentStatus::ACTUAL, {1});
+    server.RemoveDocument(11);
+    sharded.RemoveDocument(11);
+    const vector<int> the_ids = ids(server.FindTopDocuments("the"s));
+    ASSERT_EQUAL(MAX_RESULT_DOCUMENT_COUNT, static_cast<int>(the_ids.size()));
+    ASSERT(the_ids == ids(server.FindTopDocuments("the deadword"s)));
+    ASSERT(the_ids == ids(sharded.FindTopDocuments("the deadword"s)));
+
+    server.SetApproximateIdfThreshold(0.0);
+    ASSERT(exact_ids == ids(server.FindTopDocuments("the cat"s)));
+}
+
+void TestQueryLog()
+{
+    const filesystem::path path = filesystem::temp_directory_path() / "search_server_test_queries.log";
+    SearchServer server("and"s);
+    server.AddDocument(1, "fluffy cat and collar"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "groomed dog"s, DocumentStatus::BANNED, {2});
+    {
+        QueryLogWriter log(path.string());
+        server.SetQueryLog(&log);
+        server.FindTopDocuments("cat"s);
+        server.FindTopDocuments("dog"s, DocumentStatus::BANNED);
+        server.FindTopDocuments(execution::par, "fluffy"s, [](int, DocumentStatus, int rating) { return rating > 0; });
+        server.FindTopDocuments(auto_execution, "collar"s);
+        // запрос с ошибкой тоже попадает в журнал - при воспроизведении он снова завершится ошибкой
+        ASSERT(Throws<invalid_argument>([&]() { server.FindTopDocuments("--cat"s); }));
+        RequestQueue request_queue(server);
+        request_queue.AddFindRequest("dog"s, DocumentStatus::BANNED);
+        ShardedSearchServer sharded("and"s, 2);
+        sharded.SetQueryLog(&log);
+        sharded.FindTopDocuments("cat"s);
+        ASSERT_EQUAL(7u, log.GetRecordCount());
+
+        // записи больше буфера уходят в файл пакетами
+        for(int i = 0; i < 10000; ++i) {
+            server.FindTopDocuments("query number "s + to_string(i));
+        }
+        server.SetQueryLog(nullptr);
+        server.FindTopDocuments("cat"s);
+        ASSERT_EQUAL(10007u, log.GetRecordCount());
+    }
+
+    const vector<QueryLogRecord> records = ReadQueryLog(path.string());
+    ASSERT_EQUAL(10007u, records.size());
+    const vector<tuple<string, QueryLogFilter, DocumentStatus>> expected = {
+        {"cat"s, QueryLogFilter::STATUS, DocumentStatus::ACTUAL},
+        {"dog"s, QueryLogFilter::STATUS, DocumentStatus::BANNED},
+        {"fluffy"s, QueryLogFilter::PREDICATE, DocumentStatus::ACTUAL},
+        {"collar"s, QueryLogFilter::STATUS, DocumentStatus::ACTUAL},
+        {"--cat"s, QueryLogFilter::STATUS, DocumentStatus::ACTUAL},
+        {"dog"s, QueryLogFilter::STATUS, DocumentStatus::BANNED},
+        {"cat"s, QueryLogFilter::STATUS, DocumentStatus::ACTUAL},
+    };
+    for(size_t i = 0; i < expected.size(); ++i) {
+        ASSERT(expected[i] == make_tuple(records[i].raw_query, records[i].filter, records[i].status));
+    }
+    // запросы выполнялись по одному: время начала не убывает
+    for(size_t i = 1; i < records.size(); ++i) {
+        ASSERT(records[i - 1].start_us <= records[i].start_us);
+    }
+    ASSERT_EQUAL("query number 9999"s, records.back().raw_query);
+
+    // обрезанный журнал - ошибка
+    string data;
+    {
+        ifstream input(path, ios::binary);
+        data.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    {
+        ofstream output(path, ios::binary | ios::trunc);
+        output.write(data.data(), static_cast<streamsize>(data.size() - 1));
+    }
+    ASSERT(Throws<runtime_error>([&]() { ReadQueryLog(path.string()); }));
+    filesystem::remove(path);
+}
+
+void TestScoringKernels()
+{
+    // ядра каждого поддерживаемого набора инструкций совпадают со скалярными до бита
+    mt19937 generator(7);
+    const size_t document_range = 2003;
+    vector<uint32_t> all_offsets(document_range);
+    for(size_t i = 0; i < document_range; ++i) {
+        all_offsets[i] = static_cast<uint32_t>(i);
+    }
+    // три списка разной длины (в том числе не кратной ширине вектора), смещения внутри списка различны
+    vector<vector<uint32_t>> lists;
+    vector<vector<double>> list_freqs;
+    for(const size_t length : {1001u, 37u, 1500u}) {
+        shuffle(all_offsets.begin(), all_offsets.end(), generator);
+        lists.emplace_back(all_offsets.begin(), all_offsets.begin() + length);
+        sort(lists.back().begin(), lists.back().end());
+        vector<double> freqs;
+        for(size_t i = 0; i < length; ++i) {
+            freqs.push_back(uniform_real_distribution<double>(0.0, 1.0)(generator));
+        }
+        list_freqs.push_back(move(freqs));
+    }
+    const vector<double> idfs = {0.7, 0.0, 2.3};
+    vector<uint64_t> mask((document_range + 63) / 64);
+    for(uint64_t& word : mask) {
+        word = uniform_int_distribution<uint64_t>()(generator) | 0xFFFFFFFF00000000ull;
+    }
+    mask[1] = ~uint64_t(0);
+
+    const auto run = [&](ScoringKernelIsa isa, vector<uint32_t>& offsets, vector<double>& compacted) {
+        SetScoringKernelIsa(isa);
+        vector<double> scores(document_range, NO_SCORE);
+        for(size_t i = 0; i < lists.size(); ++i) {
+            AccumulateScores(lists[i].data(), list_freqs[i].data(), lists[i].size(), idfs[i], scores.data());
+        }
+        ApplyScoreMask(mask.data(), document_range, scores.data());
+        offsets.assign(document_range, 0);
+        compacted.assign(document_range, 0.0);
+        const size_t count = CompactScores(scores.data(), document_range, offsets.data(), compacted.data());
+        offsets.resize(count);
+        compacted.resize(count);
+        return scores;
+    };
+
+    const ScoringKernelIsa best = GetBestScoringKernelIsa();
+    vector<uint32_t> expected_offsets;
+    vector<double> expected_compacted;
+    const vector<double> expected_scores = run(ScoringKernelIsa::SCALAR, expected_offsets, expected_compacted);
+    ASSERT(!expected_offsets.empty() && expected_offsets.size() < document_range);
+    for(size_t i = 0; i < expected_offsets.size(); ++i) {
+        ASSERT(!signbit(expected_compacted[i]));
+        ASSERT(i == 0 || expected_offsets[i - 1] < expected_offsets[i]);
+    }
+    for(const ScoringKernelIsa isa : {ScoringKernelIsa::AVX2, ScoringKernelIsa::AVX512}) {
+        if(static_cast<int>(isa) > static_cast<int>(best)) {
+            ASSERT(Throws<invalid_argument>([&]() { SetScoringKernelIsa(isa); }));
+            continue;
+        }
+        vector<uint32_t> offsets;
+        vector<double> compacted;
+        const vector<double> scores = run(isa, offsets, compacted);
+        ASSERT_HINT(memcmp(expected_scores.data(), scores.data(), document_range * sizeof(double)) == 0, GetScoringKernelIsaName(isa));
+        ASSERT_HINT(expected_offsets == offsets, GetScoringKernelIsaName(isa));
+        ASSERT_HINT(memcmp(expected_compacted.data(), compacted.data(), compacted.size() * sizeof(double)) == 0, GetScoringKernelIsaName(isa));
+    }
+
+    // плотный перебор сервера (id подряд), последовательный и параллельный, совпадает до бита с перебором в мапе (id вразброс);
+    // документы только со словом the (IDF 0) находятся, документы с минус-словом - нет
+    SearchServer dense(""s);
+    SearchServer sparse(""s);
+    const vector<string> words = {"cat"s, "dog"s, "bird"s, "fish"s, "owl"s};
+    for(int id = 0; id < 500; ++id) {
+        string text = "the"s;
+        for(int w = 0; w < 4; ++w) {
+            text += " "s + words[uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+        }
+        dense.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 7});
+        sparse.AddDocument(id * 1000, text, DocumentStatus::ACTUAL, {id % 7});
+    }
+    const string query = "the cat bird -owl"s;
+    const auto top = dense.FindTopDocuments(execution::par, query);
+    for(const ScoringKernelIsa isa : {ScoringKernelIsa::SCALAR, ScoringKernelIsa::AVX2, ScoringKernelIsa::AVX512}) {
+        if(static_cast<int>(isa) > static_cast<int>(best)) {
+            continue;
+        }
+        SetScoringKernelIsa(isa);
+        const SearchPage dense_page = dense.FindTopDocumentsAfter(query, SearchCursor(), 1000);
+        const SearchPage sparse_page = sparse.FindTopDocumentsAfter(query, SearchCursor(), 1000);
+        ASSERT_EQUAL(sparse_page.documents.size(), dense_page.documents.size());
+        bool has_zero_relevance = false;
+        for(size_t i = 0; i < dense_page.documents.size(); ++i) {
+            const Document& document = dense_page.documents[i];
+            ASSERT_EQUAL(document.id * 1000, sparse_page.documents[i].id);
+            ASSERT(memcmp(&document.relevance, &sparse_page.documents[i].relevance, sizeof(double)) == 0);
+            ASSERT(get<0>(dense.MatchDocument("owl"s, document.id)).empty());
+            has_zero_relevance = has_zero_relevance || document.relevance == 0.0;
+        }
+        ASSERT(has_zero_relevance);
+        for(size_t i = 0; i < top.size(); ++i) {
+            ASSERT_EQUAL(top[i].id, dense_page.documents[i].id);
+            ASSERT(memcmp(&top[i].relevance, &dense_page.documents[i].relevance, sizeof(double)) == 0);
+        }
+        // параллельный перебор считает плотно в окне каждой задачи
+        const auto dense_top = dense.FindTopDocuments(execution::par, query);
+        const auto sparse_top = sparse.FindTopDocuments(execution::par, query);
+        ASSERT_EQUAL(sparse_top.size(), dense_top.size());
+        for(size_t i = 0; i < dense_top.size(); ++i) {
+            ASSERT_EQUAL(dense_top[i].id * 1000, sparse_top[i].id);
+            ASSERT(memcmp(&dense_top[i].relevance, &sparse_top[i].relevance, sizeof(double)) == 0);
+        }
+    }
+    SetScoringKernelIsa(best);
+}
+
 // Функция TestSearchServer является точкой входа для запуска тестов
 void TestSearchServer() {
     RUN_TEST(TestAddDocument);                               // добавление документов
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);  // учет стоп-слов
     RUN_TEST(TestExcludeMinusWordsFromAddedDocumentContent); // учет минус-слов
     RUN_TEST(TestDocumentMatch);                             // матчинг документов
+    RUN_TEST(TestMatchDocuments);                            // пакетный матчинг документов
     RUN_TEST(TestSortByRelavant);                            // сортировка результата по релевантности
     RUN_TEST(TestCalcRating);                                // вычисление рейтинга
     RUN_TEST(TestFilterByPredicate);                         // фильтрация по предикату
     RUN_TEST(TestSearchByStatus);                            // поиск документов по статусу
+    RUN_TEST(TestSearchByStatusPartitions);                  // поиск по статусу через разделы постингов
     RUN_TEST(TestCalcRelevant);                              // вычисление релевантности
+    RUN_TEST(TestRemoveDuplicates);                          // удаление дубликатов
+    RUN_TEST(TestDuplicatePolicy);                           // проверка дубликатов при добавлении
+    RUN_TEST(TestNearDuplicates);                            // поиск почти-дубликатов
+    RUN_TEST(TestSearchAfterCursor);                         // постраничный поиск по курсору
+    RUN_TEST(TestPrunedSearchMatchesExhaustive);             // динамическое отсечение
+    RUN_TEST(TestImpactOrderedSearch);                       // поиск по индексу вкладов
+    RUN_TEST(TestMetrics);                                   // метрики
+    RUN_TEST(TestMemoryStats);                               // учет памяти
+    RUN_TEST(TestIndexMemory);                               // внешний ресурс памяти индекса
+    RUN_TEST(TestShardedSearchServer);                       // шардированный сервер
+    RUN_TEST(TestQueryProtocol);                             // сетевой протокол
+    RUN_TEST(TestCorpusLoader);                              // загрузка корпуса из файла
+    RUN_TEST(TestExecutionPlanner);                          // выбор способа выполнения запроса
+    RUN_TEST(TestMinusWordExclusion);                        // исключение документов с минус-словами
+    RUN_TEST(TestRequiredWords);                             // обязательные слова запроса
+    RUN_TEST(TestConcurrentMap);                             // конкурентная хеш-таблица
+    RUN_TEST(TestTextStore);                                 // сжатое хранилище текстов
+    RUN_TEST(TestUpdateDocument);                            // изменение документов на месте
+    RUN_TEST(TestPrefixQuery);                               // префиксные запросы
+    RUN_TEST(TestTypoTolerance);                             // исправление опечаток
+    RUN_TEST(TestApproximateSearch);                         // приближенный поиск без частых слов
+    RUN_TEST(TestQueryLog);                                  // журнал запросов
+    RUN_TEST(TestScoringKernels);                            // векторные ядра вычисления релевантности
 }
@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "text_store.h"
+
+using namespace std;
+
+namespace {
+
+// минимальная длина совпадения: короче - ссылка (3 байта) не окупается
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 14;
+
+uint32_t Load32(const char* data) {
+    uint32_t value = 0;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+size_t HashPrefix(const char* data) {
+    return (Load32(data) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// длина больше 14 продолжается байтами: 255 - будет следующий байт
+void WriteLengthTail(string& output, size_t length) {
+    while(length >= 255) {
+        output.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    output.push_back(static_cast<char>(length));
+}
+
+void WriteSequence(string& output, string_view literals, size_t offset, size_t match_length) {
+    const size_t match_code = match_length == 0 ? 0 : match_length - MIN_MATCH;
+    output.push_back(static_cast<char>((min<size_t>(literals.size(), 15) << 4) | min<size_t>(match_code, 15)));
+    if(literals.size() >= 15) {
+        WriteLengthTail(output, literals.size() - 15);
+    }
+    output.append(literals);
+    if(match_length == 0) {
+        return;
+    }
+    output.push_back(static_cast<char>(offset & 0xFF));
+    output.push_back(static_cast<char>(offset >> 8));
+    if(match_code >= 15) {
+        WriteLengthTail(output, match_code - 15);
+    }
+}
+
+class CompressedReader {
+public:
+    explicit CompressedReader(string_view data) : m_data(data) {
+    }
+
+    bool AtEnd() const {
+        return m_position == m_data.size();
+    }
+
+    uint8_t ReadByte() {
+        if(AtEnd()) {
+            throw runtime_error("Corrupted text block: unexpected end"s);
+        }
+        return static_cast<uint8_t>(m_data[m_position++]);
+    }
+
+    size_t ReadLength(size_t code) {
+        size_t length = code;
+        if(code == 15) {
+            uint8_t byte = 0;
+            do {
+                byte = ReadByte();
+                length += byte;
+            } while(byte == 255);
+        }
+        return length;
+    }
+
+    string_view Take(size_t size) {
+        if(size > m_data.size() - m_position) {
+            throw runtime_error("Corrupted text block: literals out of range"s);
+        }
+        const string_view result = m_data.substr(m_position, size);
+        m_position += size;
+        return result;
+    }
+
+private:
+    string_view m_data;
+    size_t m_position = 0;
+};
+
+} // namespace
+
+string CompressText(string_view text) {
+    string output;
+    output.reserve(text.size() / 2 + 16);
+    if(text.size() < MIN_MATCH) {
+        WriteSequence(output, text, 0, 0);
+        return output;
+    }
+
+    // последняя позиция каждого хеша 4-байтового префикса; -1 - позиции еще не было
+    vector<int32_t> table(size_t(1) << HASH_BITS, -1);
+    const char* const data = text.data();
+    size_t anchor = 0;
+    size_t position = 0;
+    while(position + MIN_MATCH <= text.size()) {
+        int32_t& slot = table[HashPrefix(data + position)];
+        const int32_t candidate = slot;
+        slot = static_cast<int32_t>(position);
+        if(candidate < 0 || position - candidate > MAX_OFFSET || Load32(data + candidate) != Load32(data + position)) {
+            ++position;
+            continue;
+        }
+
+        size_t match_length = MIN_MATCH;
+        while(position + match_length < text.size() && data[candidate + match_length] == data[position + match_length]) {
+            ++match_length;
+        }
+        WriteSequence(output, text.substr(anchor, position - anchor), position - candidate, match_length);
+        position += match_length;
+        anchor = position;
+    }
+    WriteSequence(output, text.substr(anchor), 0, 0);
+    return output;
+}
+
+string DecompressText(string_view compressed, size_t size) {
+    // буфер сразу нужного размера: запись по указателю вместо append на каждую последовательность
+    string output(size, '\0');
+    char* const begin = output.data();
+    size_t position = 0;
+    CompressedReader reader(compressed);
+    while(!reader.AtEnd()) {
+        const uint8_t token = reader.ReadByte();
+        const string_view literals = reader.Take(reader.ReadLength(token >> 4));
+        if(literals.size() > size - position) {
+            throw runtime_error("Corrupted text block: literals out of range"s);
+        }
+        memcpy(begin + position, literals.data(), literals.size());
+        position += literals.size();
+        if(reader.AtEnd()) {
+            break;
+        }
+
+        const size_t offset = reader.ReadByte() | (static_cast<size_t>(reader.ReadByte()) << 8);
+        const size_t match_length = reader.ReadLength(token & 0x0F) + MIN_MATCH;
+        if(offset == 0 || offset > position || match_length > size - position) {
+            throw runtime_error("Corrupted text block: invalid match"s);
+        }
+        // совпадение может перекрываться с собой: копируем кусками не длиннее смещения,
+        // тогда каждый кусок уже целиком записан
+        const char* source = begin + position - offset;
+        for(size_t copied = 0; copied < match_length;) {
+            const size_t chunk = min(offset, match_length - copied);
+            memcpy(begin + position, source, chunk);
+            source += chunk;
+            position += chunk;
+            copied += chunk;
+        }
+    }
+    if(position != size) {
+        throw runtime_error("Corrupted text block: size mismatch"s);
+    }
+    return output;
+}
+
+TextStore::TextStore(pmr::memory_resource* resource)
+    : m_resource(resource)
+    , m_records(resource)
+    , m_free_records(resource)
+    , m_blocks(resource)
+    , m_open_block(resource)
+    , m_blob(resource)
+    , m_cached_text(resource) {
+}
+
+TextStore::TextStore(const string& path, pmr::memory_resource* resource)
+    : TextStore(resource) {
+    m_path = path;
+    m_file.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+    if(!m_file) {
+        throw runtime_error("Cannot open text store "s + path);
+    }
+}
+
+size_t TextStore::Append(string_view text) {
+    const Record record = WriteText(text);
+    ++m_live_records;
+    if(!m_free_records.empty()) {
+        const size_t index = m_free_records.back();
+        m_free_records.pop_back();
+        m_records[index] = record;
+        return index;
+    }
+    m_records.push_back(record);
+    return m_records.size() - 1;
+}
+
+string TextStore::Get(size_t record) const {
+    if(record >= m_records.size() || !m_records[record].is_live) {
+        throw out_of_range("Text record "s + to_string(record) + " does not exist"s);
+    }
+    const Record& location = m_records[record];
+    if(location.block == m_blocks.size()) {
+        return string(m_open_block, location.offset, location.size);
+    }
+
+    lock_guard<mutex> guard(m_read_mutex);
+    if(m_cached_block != location.block) {
+        m_cached_text.assign(DecompressBlock(m_blocks[location.block], m_blob, m_file));
+        m_cached_block = location.block;
+    }
+    return string(m_cached_text, location.offset, location.size);
+}
+
+void TextStore::Replace(size_t record, string_view text) {
+    if(record >= m_records.size() || !m_records[record].is_live) {
+        throw out_of_range("Text record "s + to_string(record) + " does not exist"s);
+    }
+    const Record location = WriteText(text);
+    m_dead_bytes += m_records[record].size;
+    m_records[record] = location;
+}
+
+void TextStore::Release(size_t record) {
+    if(record >= m_records.size() || !m_records[record].is_live) {
+        return;
+    }
+    m_records[record].is_live = false;
+    m_dead_bytes += m_records[record].size;
+    --m_live_records;
+    m_free_records.push_back(static_cast<uint32_t>(record));
+}
+
+TextStoreStats TextStore::GetStats() const {
+    TextStoreStats stats;
+    stats.records = m_records.size();
+    stats.live_records = m_live_records;
+    stats.raw_bytes = m_raw_bytes;
+    stats.dead_bytes = m_dead_bytes;
+    stats.blocks = m_blocks.size();
+    for(const Block& block : m_blocks) {
+        stats.compressed_bytes += block.compressed_size;
+    }
+    return stats;
+}
+
+TextStore::Record TextStore::WriteText(string_view text) {
+    if(!m_open_block.empty() && m_open_block.size() + text.size() > BLOCK_SIZE) {
+        SealOpenBlock();
+    }
+    const Record record{static_cast<uint32_t>(m_blocks.size()), static_cast<uint32_t>(m_open_block.size()),
+                        static_cast<uint32_t>(text.size()), true};
+    m_open_block.append(text);
+    m_raw_bytes += text.size();
+    // текст длиннее блока занимает отдельный блок
+    if(m_open_block.size() >= BLOCK_SIZE) {
+        SealOpenBlock();
+    }
+    return record;
+}
+
+void TextStore::SealOpenBlock() {
+    const string compressed = CompressText(m_open_block);
+    Block block{0, static_cast<uint32_t>(compressed.size()), static_cast<uint32_t>(m_open_block.size())};
+    if(!m_path.empty()) {
+        block.position = m_file_size;
+        m_file.seekp(static_cast<streamoff>(m_file_size));
+        m_file.write(compressed.data(), static_cast<streamsize>(compressed.size()));
+        if(!m_file) {
+            throw runtime_error("Cannot write text store "s + m_path);
+        }
+        m_file_size += compressed.size();
+    } else {
+        block.position = m_blob.size();
+        m_blob.append(compressed);
+    }
+    m_blocks.push_back(block);
+    // память открытого блока освобождается, а не переиспользуется: блоки бывают и длиннее BLOCK_SIZE
+    // (присваивание пустой строки сохранило бы буфер - пустая строка короткая и копируется в него)
+    pmr::string(m_resource).swap(m_open_block);
+}
+
+string TextStore::DecompressBlock(const Block& block, string_view blob, fstream& file) const {
+    return !m_path.empty()
+        ? DecompressText(ReadFileBlock(block, file), block.size)
+        : DecompressText(blob.substr(block.position, block.compressed_size), block.size);
+}
+
+string TextStore::ReadFileBlock(const Block& block, fstream& file) const {
+    string compressed(block.compressed_size, '\0');
+    file.seekg(static_cast<streamoff>(block.position));
+    file.read(compressed.data(), static_cast<streamsize>(compressed.size()));
+    if(!file) {
+        file.clear();
+        throw runtime_error("Cannot read text store "s + m_path);
+    }
+    return compressed;
+}
+
+void TextStore::CompactIfSparse() {
+    if(m_live_records == 0) {
+        if(!m_records.empty()) {
+            Clear();
+        }
+        return;
+    }
+    // уплотнение переписывает живые тексты, а их не больше, чем мертвых: на освобожденный байт - O(1) работы
+    if(m_dead_bytes >= BLOCK_SIZE && m_dead_bytes * 2 >= m_raw_bytes) {
+        Compact();
+    }
+}
+
+void TextStore::Compact() {
+    // живые тексты переписываются в новое хранилище (в режиме файла - в соседний файл); состояние меняется
+    // только после того, как переписаны все тексты и новый файл заменил старый: при ошибке хранилище прежнее
+    const string compact_path = m_path + ".compact"s;
+    unique_ptr<TextStore> compacted = m_path.empty()
+        ? make_unique<TextStore>(m_resource)
+        : make_unique<TextStore>(compact_path, m_resource);
+    try {
+        // живые записи в порядке хранения: каждый старый блок распаковывается один раз
+        vector<uint32_t> live_records;
+        live_records.reserve(m_live_records);
+        for(uint32_t index = 0; index < m_records.size(); ++index) {
+            if(m_records[index].is_live) {
+                live_records.push_back(index);
+            }
+        }
+        sort(live_records.begin(), live_records.end(),
+            [this](uint32_t lhs, uint32_t rhs) {
+                return pair(m_records[lhs].block, m_records[lhs].offset) < pair(m_records[rhs].block, m_records[rhs].offset);
+            });
+
+        // записи нового хранилища: мертвые копируются как есть, живые получают новое место
+        compacted->m_records = m_records;
+        string block_text;
+        size_t decompressed_block = NO_RECORD;
+        for(const uint32_t index : live_records) {
+            const Record& record = m_records[index];
+            string_view text;
+            if(record.block == m_blocks.size()) {
+                text = string_view(m_open_block).substr(record.offset, record.size);
+            } else {
+                if(record.block != decompressed_block) {
+                    block_text = DecompressBlock(m_blocks[record.block], m_blob, m_file);
+                    decompressed_block = record.block;
+                }
+                text = string_view(block_text).substr(record.offset, record.size);
+            }
+            compacted->m_records[index] = compacted->WriteText(text);
+        }
+
+        if(!m_path.empty()) {
+            compacted->m_file.flush();
+            if(!compacted->m_file) {
+                throw runtime_error("Cannot write text store "s + compact_path);
+            }
+            // открытый поток нового файла после переименования пишет и читает файл m_path
+            filesystem::rename(compact_path, m_path);
+        }
+    } catch(...) {
+        if(!m_path.empty()) {
+            compacted->m_file.close();
+            error_code ignored;
+            filesystem::remove(compact_path, ignored);
+        }
+        throw;
+    }
+
+    // дальше операции не бросают исключений
+    m_records.swap(compacted->m_records);
+    m_blocks.swap(compacted->m_blocks);
+    m_blob.swap(compacted->m_blob);
+    m_open_block.swap(compacted->m_open_block);
+    m_file.swap(compacted->m_file);
+    m_file_size = compacted->m_file_size;
+    m_raw_bytes = compacted->m_raw_bytes;
+    m_dead_bytes = 0;
+    m_cached_block = NO_RECORD;
+    pmr::string(m_resource).swap(m_cached_text);
+}
+
+void TextStore::Clear() {
+    // новый пустой файл открывается до изменения состояния: при ошибке хранилище прежнее
+    fstream file;
+    if(!m_path.empty()) {
+        file.open(m_path, ios::in | ios::out | ios::binary | ios::trunc);
+        if(!file) {
+            throw runtime_error("Cannot open text store "s + m_path);
+        }
+        m_file.swap(file);
+        m_file_size = 0;
+    }
+    m_records = pmr::vector<Record>(m_resource);
+    m_free_records = pmr::vector<uint32_t>(m_resource);
+    m_blocks = pmr::vector<Block>(m_resource);
+    pmr::string(m_resource).swap(m_open_block);
+    pmr::string(m_resource).swap(m_blob);
+    pmr::string(m_resource).swap(m_cached_text);
+    m_cached_block = NO_RECORD;
+    m_raw_bytes = 0;
+    m_dead_bytes = 0;
+}
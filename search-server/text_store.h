@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// сжатие блока текста LZ77 без внешних зависимостей
+// формат последовательностей как у LZ4: байт-токен (длина литералов и длина совпадения по 4 бита,
+// 15 - продолжение байтами до первого не 255), литералы, смещение совпадения 2 байта little-endian;
+// последняя последовательность - только литералы
+std::string CompressText(std::string_view text);
+// size - длина исходного текста; испорченный блок - исключение
+std::string DecompressText(std::string_view compressed, size_t size);
+
+// способ хранения текстов документов сервера
+enum class TextStorage {
+    NONE,   // тексты не хранятся
+    MEMORY, // сжатые блоки в памяти
+    FILE,   // сжатые блоки в файле, в памяти - только таблицы записей и блоков
+};
+
+struct TextStoreStats {
+    size_t records = 0;          // записей в хранилище, включая освобожденные
+    size_t live_records = 0;     // неосвобожденных записей
+    size_t raw_bytes = 0;        // суммарная длина текстов в блоках, включая мертвые
+    size_t dead_bytes = 0;       // длина освобожденных и замененных текстов, еще не убранных уплотнением
+    size_t compressed_bytes = 0; // размер сжатых блоков
+    size_t blocks = 0;           // сжатых блоков (без открытого)
+};
+
+// хранилище текстов на дописывание
+// тексты копятся в открытом блоке; заполненный блок сжимается и больше не меняется
+// освобожденный или замененный текст остается в блоке мертвым. Когда мертвые тексты занимают не меньше
+// половины хранилища (и не меньше блока), CompactIfSparse уплотняет хранилище: живые тексты переписываются
+// в новые блоки, номера записей сохраняются. Номера освобожденных записей переиспользуются; после освобождения
+// всех записей CompactIfSparse очищает хранилище
+// Release и Replace не уплотняют хранилище сами: владелец вызывает CompactIfSparse, когда его собственные
+// структуры уже согласованы, и ошибка записи уплотнения их не затрагивает
+// чтение потокобезопасно относительно других чтений, запись - нет
+class TextStore {
+public:
+    inline static constexpr size_t NO_RECORD = std::numeric_limits<size_t>::max();
+    // размер несжатого блока: смещение совпадения LZ77 (2 байта) покрывает блок целиком
+    inline static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    // блоки в памяти из resource
+    explicit TextStore(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    // блоки в файле path (создается заново), таблицы - из resource
+    explicit TextStore(const std::string& path, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    TextStore(const TextStore&) = delete;
+    TextStore& operator=(const TextStore&) = delete;
+
+    // возвращает номер записи
+    size_t Append(std::string_view text);
+    // распаковывает блок записи; последний распакованный блок кэшируется
+    std::string Get(size_t record) const;
+    // заменяет текст записи, номер записи сохраняется; записи нет - исключение out_of_range
+    void Replace(size_t record, std::string_view text);
+    void Release(size_t record);
+    // уплотняет или очищает хранилище по правилам выше; в режиме файла ошибка - исключение runtime_error
+    void CompactIfSparse();
+
+    TextStoreStats GetStats() const;
+
+private:
+    struct Record {
+        uint32_t block;  // номер блока; m_blocks.size() - открытый блок
+        uint32_t offset; // смещение в несжатом блоке
+        uint32_t size;
+        bool is_live;
+    };
+
+    struct Block {
+        uint64_t position;        // смещение сжатого блока в m_blob или в файле
+        uint32_t compressed_size;
+        uint32_t size;
+    };
+
+    // дописывает текст в открытый блок, возвращает его место
+    Record WriteText(std::string_view text);
+    void SealOpenBlock();
+    // сжатый блок берется из file в режиме файла, иначе из blob
+    std::string DecompressBlock(const Block& block, std::string_view blob, std::fstream& file) const;
+    std::string ReadFileBlock(const Block& block, std::fstream& file) const;
+    void Compact();
+    void Clear();
+
+    std::pmr::memory_resource* m_resource;
+    std::pmr::vector<Record> m_records;
+    // номера освобожденных записей
+    std::pmr::vector<uint32_t> m_free_records;
+    std::pmr::vector<Block> m_blocks;
+    // текущий несжатый блок
+    std::pmr::string m_open_block;
+    // сжатые блоки подряд (TextStorage::MEMORY)
+    std::pmr::string m_blob;
+    // файл сжатых блоков (TextStorage::FILE); пустой путь - блоки в памяти
+    std::string m_path;
+    mutable std::fstream m_file;
+    uint64_t m_file_size = 0;
+    size_t m_live_records = 0;
+    size_t m_raw_bytes = 0;
+    size_t m_dead_bytes = 0;
+
+    // последний распакованный блок; мьютекс защищает кэш и позицию чтения файла
+    mutable std::mutex m_read_mutex;
+    mutable size_t m_cached_block = NO_RECORD;
+    mutable std::pmr::string m_cached_text;
+};
@@ -0,0 +1,258 @@
+// Оценка качества приближенного поиска (SetApproximateIdfThreshold) по журналу запросов
+//
+// Каждый запрос выполняется точно и с каждым порогом IDF из --thresholds. Для порога выводится
+// среднее и минимальное перекрытие верхних K с точной выдачей (доля документов точной выдачи,
+// попавших в приближенную), доля запросов с совпавшей выдачей, среднее число отброшенных слов,
+// просмотренных постингов и задержки - по ним порог выбирается по данным, а не наугад.
+//
+// Корпус - --corpus-file в формате LoadCorpus или синтетический по закону Ципфа (как в benchmark).
+// Журнал - --query-log: двоичный журнал QueryLogWriter или текст, один запрос на строку (пустые строки
+// и строки с '#' пропускаются), - или синтетические запросы. Запросы с ошибкой разбора пропускаются
+// и считаются в "invalid_queries". --stop-words - стоп-слова сервера, через пробел.
+//
+// Пример: ./approximate_eval --corpus-file corpus.tsv --query-log queries.txt --thresholds 0.5,1,2,3 --output eval.json
+
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "search_server.h"
+#include "corpus_loader.h"
+#include "query_log.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+// качество и стоимость запросов журнала при одном пороге
+struct ThresholdResult {
+    double threshold = 0.0;
+    double mean_overlap = 0.0;
+    double min_overlap = 1.0;
+    double identical_fraction = 0.0;
+    double mean_words_skipped = 0.0;
+    double mean_postings_scanned = 0.0;
+    bench::BenchResult timing;
+};
+
+vector<double> ParseThresholds(const string& text) {
+    vector<double> thresholds;
+    stringstream input(text);
+    string item;
+    while(getline(input, item, ',')) {
+        if(!item.empty()) {
+            thresholds.push_back(stod(item));
+        }
+    }
+    return thresholds;
+}
+
+vector<string> ReadQueryTexts(const string& path) {
+    ifstream input(path, ios::binary);
+    if(!input) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    // двоичный журнал узнается по заголовку
+    char magic[4] = {};
+    if(input.read(magic, sizeof(magic)) && string_view(magic, sizeof(magic)) == "SQLG"sv) {
+        vector<string> queries;
+        for(QueryLogRecord& record : ReadQueryLog(path)) {
+            queries.push_back(move(record.raw_query));
+        }
+        return queries;
+    }
+    input.clear();
+    input.seekg(0);
+
+    vector<string> queries;
+    string line;
+    while(getline(input, line)) {
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if(!line.empty() && line.front() != '#') {
+            queries.push_back(line);
+        }
+    }
+    return queries;
+}
+
+// доля документов exact, которые есть в approximate; пустая точная выдача совпадает только с пустой
+double ComputeOverlap(const vector<Document>& exact, const vector<Document>& approximate) {
+    if(exact.empty()) {
+        return approximate.empty() ? 1.0 : 0.0;
+    }
+    size_t common = 0;
+    for(const Document& document : exact) {
+        for(const Document& candidate : approximate) {
+            if(candidate.id == document.id) {
+                ++common;
+                break;
+            }
+        }
+    }
+    return static_cast<double>(common) / exact.size();
+}
+
+bool HasSameIds(const vector<Document>& lhs, const vector<Document>& rhs) {
+    if(lhs.size() != rhs.size()) {
+        return false;
+    }
+    for(size_t i = 0; i < lhs.size(); ++i) {
+        if(lhs[i].id != rhs[i].id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// все запросы с порогом threshold: выдачи и сводка по стоимости
+ThresholdResult RunQueries(SearchServer& search_server, const vector<string>& queries, double threshold, vector<vector<Document>>& results) {
+    search_server.SetApproximateIdfThreshold(threshold);
+    ThresholdResult result;
+    result.threshold = threshold;
+    results.assign(queries.size(), {});
+
+    bench::LatencyRecorder recorder;
+    recorder.Reserve(queries.size());
+    size_t words_skipped = 0;
+    size_t postings_scanned = 0;
+    const auto start = bench::Clock::now();
+    for(size_t i = 0; i < queries.size(); ++i) {
+        QueryStats stats;
+        const auto query_start = bench::Clock::now();
+        results[i] = search_server.FindTopDocuments(queries[i], DocumentStatus::ACTUAL, stats);
+        recorder.Record(bench::Clock::now() - query_start);
+        words_skipped += stats.words_skipped;
+        postings_scanned += stats.postings_scanned;
+    }
+    const auto total = bench::Clock::now() - start;
+
+    const double query_count = max<size_t>(queries.size(), 1);
+    result.mean_words_skipped = words_skipped / query_count;
+    result.mean_postings_scanned = postings_scanned / query_count;
+    result.timing = {"threshold_"s + to_string(threshold), queries.size(), chrono::duration<double, milli>(total).count(), recorder.Summarize()};
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const bench::Arguments arguments(argc, argv);
+    const string corpus_path = arguments.GetString("corpus-file", "");
+    const string query_log_path = arguments.GetString("query-log", "");
+    const string stop_words = arguments.GetString("stop-words", "");
+    const string thresholds_text = arguments.GetString("thresholds", "0.25,0.5,1,2");
+    const int64_t document_count = arguments.GetInt("documents", 20'000);
+    const int64_t vocabulary = arguments.GetInt("vocabulary", 50'000);
+    const double zipf_exponent = arguments.GetDouble("zipf", 1.0);
+    const int64_t document_words = arguments.GetInt("document-words", 60);
+    const int64_t query_count = arguments.GetInt("queries", 1'000);
+    const int64_t query_words = arguments.GetInt("query-words", 6);
+    const int64_t seed = arguments.GetInt("seed", 42);
+    const string output_path = arguments.GetString("output", "");
+
+    const vector<double> thresholds = ParseThresholds(thresholds_text);
+    mt19937_64 generator(static_cast<uint64_t>(seed));
+    const bench::ZipfDistribution zipf(static_cast<size_t>(vocabulary), zipf_exponent);
+
+    SearchServer search_server(stop_words);
+    if(!corpus_path.empty()) {
+        const CorpusLoadResult loaded = LoadCorpus(search_server, corpus_path);
+        if(!loaded.errors.empty()) {
+            cerr << "Corpus errors: "s << loaded.errors.size() << ", first: "s << loaded.errors.front().message << endl;
+        }
+    } else {
+        for(int64_t i = 0; i < document_count; ++i) {
+            const int words = uniform_int_distribution<int>(1, static_cast<int>(2 * document_words))(generator);
+            search_server.AddDocument(static_cast<int>(i), bench::GenerateZipfText(generator, zipf, words), DocumentStatus::ACTUAL, {1});
+        }
+    }
+
+    vector<string> queries;
+    if(!query_log_path.empty()) {
+        queries = ReadQueryTexts(query_log_path);
+    } else {
+        for(int64_t i = 0; i < query_count; ++i) {
+            const int words = uniform_int_distribution<int>(1, static_cast<int>(query_words))(generator);
+            queries.push_back(bench::GenerateZipfText(generator, zipf, words));
+        }
+    }
+
+    // запросы, которые сервер не разбирает, отсеиваются заранее: в сравнении участвуют одни и те же запросы
+    size_t invalid_queries = 0;
+    vector<string> valid_queries;
+    valid_queries.reserve(queries.size());
+    for(const string& query : queries) {
+        try {
+            search_server.FindTopDocuments(query);
+            valid_queries.push_back(query);
+        } catch(const invalid_argument&) {
+            ++invalid_queries;
+        }
+    }
+
+    vector<vector<Document>> exact_results;
+    const ThresholdResult exact = RunQueries(search_server, valid_queries, 0.0, exact_results);
+
+    vector<ThresholdResult> results;
+    vector<vector<Document>> approximate_results;
+    for(const double threshold : thresholds) {
+        ThresholdResult result = RunQueries(search_server, valid_queries, threshold, approximate_results);
+        double overlap_sum = 0.0;
+        size_t identical = 0;
+        for(size_t i = 0; i < valid_queries.size(); ++i) {
+            const double overlap = ComputeOverlap(exact_results[i], approximate_results[i]);
+            overlap_sum += overlap;
+            result.min_overlap = min(result.min_overlap, overlap);
+            identical += HasSameIds(exact_results[i], approximate_results[i]) ? 1 : 0;
+        }
+        const double valid_count = max<size_t>(valid_queries.size(), 1);
+        result.mean_overlap = overlap_sum / valid_count;
+        result.identical_fraction = identical / valid_count;
+        results.push_back(move(result));
+    }
+
+    ofstream file_output;
+    if(!output_path.empty()) {
+        file_output.open(output_path);
+        if(!file_output) {
+            cerr << "Cannot open "s << output_path << endl;
+            return 1;
+        }
+    }
+    ostream& output = output_path.empty() ? cout : file_output;
+
+    output << "{\"config\": {"
+           << "\"documents\": " << search_server.GetDocumentCount()
+           << ", \"queries\": " << valid_queries.size()
+           << ", \"invalid_queries\": " << invalid_queries
+           << ", \"corpus_file\": \"" << bench::JsonEscape(corpus_path) << "\""
+           << ", \"query_log\": \"" << bench::JsonEscape(query_log_path) << "\""
+           << ", \"top_k\": " << MAX_RESULT_DOCUMENT_COUNT
+           << ", \"seed\": " << seed
+           << "},\n \"exact\": {\"mean_postings_scanned\": " << exact.mean_postings_scanned
+           << ", \"timing\": ";
+    bench::WriteJson(output, exact.timing);
+    output << "},\n \"results\": [\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        const ThresholdResult& result = results[i];
+        output << "  {\"threshold\": " << result.threshold
+               << ", \"mean_overlap\": " << result.mean_overlap
+               << ", \"min_overlap\": " << result.min_overlap
+               << ", \"identical_fraction\": " << result.identical_fraction
+               << ", \"mean_words_skipped\": " << result.mean_words_skipped
+               << ", \"mean_postings_scanned\": " << result.mean_postings_scanned
+               << ", \"timing\": ";
+        bench::WriteJson(output, result.timing);
+        output << (i + 1 < results.size() ? "},\n" : "}\n");
+    }
+    output << "]}" << endl;
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+// общие средства нагрузочных утилит: генерация корпуса по закону Ципфа,
+// сбор задержек с перцентилями и вывод результатов в JSON
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+// генератор рангов слов по закону Ципфа: P(r) ~ 1 / r^exponent, r = 1..size
+class ZipfDistribution {
+public:
+    explicit ZipfDistribution(size_t size, double exponent) : m_cdf(size) {
+        double sum = 0.0;
+        for(size_t rank = 0; rank < size; ++rank) {
+            sum += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+            m_cdf[rank] = sum;
+        }
+        for(double& value : m_cdf) {
+            value /= sum;
+        }
+    }
+
+    // ранг от 0 (самое частое слово) до size-1
+    template <typename Generator>
+    size_t operator()(Generator& generator) const {
+        const double value = std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+        const auto it = std::lower_bound(m_cdf.begin(), m_cdf.end(), value);
+        return std::min(static_cast<size_t>(it - m_cdf.begin()), m_cdf.size() - 1);
+    }
+
+private:
+    std::vector<double> m_cdf; // функция распределения по рангам
+};
+
+// слово словаря по рангу: запись ранга в 26-ричной системе буквами a..z
+inline std::string MakeWord(size_t rank) {
+    std::string word;
+    do {
+        word.push_back(static_cast<char>('a' + rank % 26));
+        rank /= 26;
+    } while(rank > 0);
+    return word;
+}
+
+// текст из word_count слов, выбранных по закону Ципфа
+template <typename Generator>
+std::string GenerateZipfText(Generator& generator, const ZipfDistribution& zipf, int word_count, double minus_prob = 0.0) {
+    std::string text;
+    for(int i = 0; i < word_count; ++i) {
+        if(!text.empty()) {
+            text.push_back(' ');
+        }
+        if(minus_prob > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(generator) < minus_prob) {
+            text.push_back('-');
+        }
+        text += MakeWord(zipf(generator));
+    }
+    return text;
+}
+
+// сводка по задержкам одной операции
+struct LatencySummary {
+    size_t count = 0;
+    double mean_us = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double p999_us = 0.0;
+    double max_us = 0.0;
+};
+
+// накопитель задержек в наносекундах
+class LatencyRecorder {
+public:
+    void Reserve(size_t count) {
+        m_latencies_ns.reserve(count);
+    }
+
+    void Record(Clock::duration duration) {
+        m_latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+    void RecordNanoseconds(int64_t latency_ns) {
+        m_latencies_ns.push_back(latency_ns);
+    }
+
+    void Merge(const LatencyRecorder& other) {
+        m_latencies_ns.insert(m_latencies_ns.end(), other.m_latencies_ns.begin(), other.m_latencies_ns.end());
+    }
+
+    size_t Count() const {
+        return m_latencies_ns.size();
+    }
+
+    // перцентили по методу ближайшего ранга
+    LatencySummary Summarize() const {
+        LatencySummary summary;
+        summary.count = m_latencies_ns.size();
+        if(summary.count == 0) {
+            return summary;
+        }
+
+        std::vector<int64_t> sorted = m_latencies_ns;
+        std::sort(sorted.begin(), sorted.end());
+
+        const auto percentile = [&sorted](double fraction) {
+            const size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+            return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1] / 1000.0;
+        };
+
+        double sum = 0.0;
+        for(const int64_t latency : sorted) {
+            sum += latency;
+        }
+        summary.mean_us = sum / sorted.size() / 1000.0;
+        summary.p50_us = percentile(0.50);
+        summary.p99_us = percentile(0.99);
+        summary.p999_us = percentile(0.999);
+        summary.max_us = sorted.back() / 1000.0;
+        return summary;
+    }
+
+private:
+    std::vector<int64_t> m_latencies_ns;
+};
+
+// результат одного замера
+struct BenchResult {
+    std::string name;
+    size_t operations = 0;
+    double total_ms = 0.0;
+    LatencySummary latency; // пустая, если задержки отдельных операций не замерялись
+};
+
+inline std::string JsonEscape(std::string_view text) {
+    std::string result;
+    for(const char c : text) {
+        if(c == '"' || c == '\\') {
+            result.push_back('\\');
+            result.push_back(c);
+        } else if(static_cast<unsigned char>(c) < ' ') {
+            std::ostringstream code;
+            code << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+            result += code.str();
+        } else {
+            result.push_back(c);
+        }
+    }
+    return result;
+}
+
+inline void WriteJson(std::ostream& output, const BenchResult& result) {
+    const double throughput = result.total_ms > 0.0 ? result.operations * 1000.0 / result.total_ms : 0.0;
+    output << std::fixed << std::setprecision(3)
+           << "{\"name\": \"" << JsonEscape(result.name) << "\""
+           << ", \"operations\": " << result.operations
+           << ", \"total_ms\": " << result.total_ms
+           << ", \"throughput_per_sec\": " << throughput;
+    if(result.latency.count > 0) {
+        output << ", \"latency_us\": {"
+               << "\"mean\": " << result.latency.mean_us
+               << ", \"p50\": " << result.latency.p50_us
+               << ", \"p99\": " << result.latency.p99_us
+               << ", \"p999\": " << result.latency.p999_us
+               << ", \"max\": " << result.latency.max_us << "}";
+    }
+    output << "}";
+}
+
+// простой разбор аргументов вида --name value
+class Arguments {
+public:
+    explicit Arguments(int argc, char** argv) {
+        for(int i = 1; i < argc; ++i) {
+            const std::string_view arg = argv[i];
+            if(arg.substr(0, 2) != "--" || i + 1 >= argc) {
+                throw std::invalid_argument("Expected --name value, got " + std::string(arg));
+            }
+            m_values.emplace_back(std::string(arg.substr(2)), argv[++i]);
+        }
+    }
+
+    std::string GetString(std::string_view name, std::string default_value) const {
+        for(const auto& [key, value] : m_values) {
+            if(key == name) {
+                return value;
+            }
+        }
+        return default_value;
+    }
+
+    int64_t GetInt(std::string_view name, int64_t default_value) const {
+        const std::string value = GetString(name, "");
+        return value.empty() ? default_value : std::stoll(value);
+    }
+
+    double GetDouble(std::string_view name, double default_value) const {
+        const std::string value = GetString(name, "");
+        return value.empty() ? default_value : std::stod(value);
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> m_values;
+};
+
+} // namespace bench
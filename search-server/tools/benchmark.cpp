@@ -0,0 +1,386 @@
+// Воспроизводимый нагрузочный тест поискового сервера
+//
+// Корпус и запросы строятся по закону Ципфа с фиксированным seed, поэтому два запуска
+// с одинаковыми параметрами работают с одинаковыми данными и их результаты можно сравнивать
+// между коммитами. Результат - JSON с пропускной способностью и перцентилями задержек.
+//
+// Пример: ./benchmark --documents 50000 --queries 2000 --memory arena --shards 8 --output before.json
+// С --corpus-file корпус записывается в файл и дополнительно замеряется его загрузка LoadCorpus.
+// --text-storage none|memory|file (--text-file - файл для режима file) выбирает хранилище текстов документов.
+// Пороги планировщика для find_top_documents_auto калибруются перед замером; --planner-thresholds
+// передает сохраненные пороги в текстовой форме FormatPlannerThresholds (они же выводятся в config).
+// С --query-log запросы фазы find_top_documents_seq пишутся в журнал (в замер входит и запись журнала);
+// вместе с --corpus-file его можно воспроизвести: ./query_replay --corpus corpus.tsv --log queries.log --stop-words "a b c"
+
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "search_server.h"
+#include "corpus_loader.h"
+#include "sharded_search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+struct BenchConfig {
+    int64_t documents;
+    int64_t vocabulary;
+    double zipf_exponent;
+    int64_t document_words;
+    int64_t queries;
+    int64_t query_words;
+    double minus_prob;
+    double duplicate_prob;
+    int64_t seed;
+    string memory;
+    int64_t shards;
+    string text_storage;
+};
+
+// замер каждой операции по отдельности
+template <typename Items, typename Operation>
+bench::BenchResult MeasureEach(string name, const Items& items, Operation operation) {
+    bench::LatencyRecorder recorder;
+    recorder.Reserve(items.size());
+
+    const auto start = bench::Clock::now();
+    for(const auto& item : items) {
+        const auto operation_start = bench::Clock::now();
+        operation(item);
+        recorder.Record(bench::Clock::now() - operation_start);
+    }
+    const auto total = bench::Clock::now() - start;
+
+    return {move(name), items.size(), chrono::duration<double, milli>(total).count(), recorder.Summarize()};
+}
+
+// замер пакетной операции целиком
+template <typename Operation>
+bench::BenchResult MeasureBatch(string name, size_t operations, Operation operation) {
+    const auto start = bench::Clock::now();
+    operation();
+    const auto total = bench::Clock::now() - start;
+
+    return {move(name), operations, chrono::duration<double, milli>(total).count(), {}};
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const bench::Arguments arguments(argc, argv);
+    const BenchConfig config{
+        arguments.GetInt("documents", 20'000),
+        arguments.GetInt("vocabulary", 50'000),
+        arguments.GetDouble("zipf", 1.0),
+        arguments.GetInt("document-words", 60),
+        arguments.GetInt("queries", 1'000),
+        arguments.GetInt("query-words", 6),
+        arguments.GetDouble("minus-prob", 0.1),
+        arguments.GetDouble("duplicate-prob", 0.01),
+        arguments.GetInt("seed", 42),
+        arguments.GetString("memory", "heap"),
+        arguments.GetInt("shards", 0),
+        arguments.GetString("text-storage", "memory"),
+    };
+    const string output_path = arguments.GetString("output", "");
+    const string corpus_path = arguments.GetString("corpus-file", "");
+    const string text_path = arguments.GetString("text-file", "benchmark_texts.lz");
+    const string query_log_path = arguments.GetString("query-log", "");
+    const string planner_thresholds_text = arguments.GetString("planner-thresholds", "");
+
+    IndexMemory index_memory = IndexMemory::HEAP;
+    if(config.memory == "pool"s) {
+        index_memory = IndexMemory::POOL;
+    } else if(config.memory == "arena"s) {
+        index_memory = IndexMemory::ARENA;
+    } else if(config.memory != "heap"s) {
+        cerr << "Unknown --memory "s << config.memory << ", expected heap, pool or arena"s << endl;
+        return 1;
+    }
+
+    TextStorage text_storage = TextStorage::MEMORY;
+    if(config.text_storage == "none"s) {
+        text_storage = TextStorage::NONE;
+    } else if(config.text_storage == "file"s) {
+        text_storage = TextStorage::FILE;
+    } else if(config.text_storage != "memory"s) {
+        cerr << "Unknown --text-storage "s << config.text_storage << ", expected none, memory or file"s << endl;
+        return 1;
+    }
+
+    mt19937_64 generator(config.seed);
+    const bench::ZipfDistribution zipf(config.vocabulary, config.zipf_exponent);
+
+    // корпус: часть документов - точные копии предыдущих, чтобы RemoveDuplicates было что удалять
+    vector<string> documents;
+    documents.reserve(config.documents);
+    for(int64_t i = 0; i < config.documents; ++i) {
+        if(!documents.empty() && uniform_real_distribution<double>(0.0, 1.0)(generator) < config.duplicate_prob) {
+            documents.push_back(documents[uniform_int_distribution<size_t>(0, documents.size() - 1)(generator)]);
+        } else {
+            const int words = uniform_int_distribution<int>(1, static_cast<int>(2 * config.document_words))(generator);
+            documents.push_back(bench::GenerateZipfText(generator, zipf, words));
+        }
+    }
+
+    vector<string> queries;
+    queries.reserve(config.queries);
+    for(int64_t i = 0; i < config.queries; ++i) {
+        const int words = uniform_int_distribution<int>(1, static_cast<int>(config.query_words))(generator);
+        queries.push_back(bench::GenerateZipfText(generator, zipf, words, config.minus_prob));
+    }
+
+    vector<pair<string, int>> match_requests;
+    match_requests.reserve(queries.size());
+    for(const string& query : queries) {
+        match_requests.emplace_back(query, uniform_int_distribution<int>(0, static_cast<int>(config.documents) - 1)(generator));
+    }
+
+    vector<int> document_ids(config.documents);
+    for(int64_t i = 0; i < config.documents; ++i) {
+        document_ids[i] = static_cast<int>(i);
+    }
+
+    vector<bench::BenchResult> results;
+
+    // загрузка того же корпуса из файла; файл успевает попасть в page cache, поэтому замеряется
+    // разбор и добавление, а не чтение с диска
+    size_t corpus_bytes = 0;
+    if(!corpus_path.empty()) {
+        {
+            ofstream corpus_file(corpus_path, ios::binary);
+            for(int64_t i = 0; i < config.documents; ++i) {
+                corpus_file << i << "\tACTUAL\t"s << i % 10 << " 5\t"s << documents[i] << '\n';
+            }
+        }
+        SearchServer loaded_server("a b c"s);
+        CorpusLoadResult loaded;
+        results.push_back(MeasureBatch("load_corpus", static_cast<size_t>(config.documents),
+            [&]() { loaded = LoadCorpus(loaded_server, corpus_path); }));
+        corpus_bytes = loaded.bytes;
+        if(!loaded.errors.empty()) {
+            cerr << "Corpus errors: "s << loaded.errors.size() << ", first: "s << loaded.errors.front().message << endl;
+            return 1;
+        }
+
+        ShardedSearchServer loaded_sharded_server("a b c"s, static_cast<size_t>(config.shards));
+        results.push_back(MeasureBatch("load_corpus_sharded", static_cast<size_t>(config.documents),
+            [&]() { LoadCorpus(loaded_sharded_server, corpus_path); }));
+    }
+    // сервер в куче, чтобы замерить его разрушение
+    auto memory_resource = MakeIndexMemoryResource(index_memory);
+    auto search_server_holder = make_unique<SearchServer>("a b c"s, memory_resource.get());
+    SearchServer& search_server = *search_server_holder;
+    search_server.SetTextStorage(text_storage, text_path);
+
+    results.push_back(MeasureEach("add_document", document_ids,
+        [&](int id) { search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10, 5}); }));
+    const MemoryStats memory = search_server.GetMemoryStats();
+    const TextStoreStats text_store = search_server.GetTextStoreStats();
+
+    double checksum = 0.0;
+    unique_ptr<QueryLogWriter> query_log;
+    if(!query_log_path.empty()) {
+        query_log = make_unique<QueryLogWriter>(query_log_path);
+        search_server.SetQueryLog(query_log.get());
+    }
+    results.push_back(MeasureEach("find_top_documents_seq", queries,
+        [&](const string& query) {
+            for(const Document& document : search_server.FindTopDocuments(execution::seq, query)) {
+                checksum += document.relevance;
+            }
+        }));
+    search_server.SetQueryLog(nullptr);
+    results.push_back(MeasureEach("find_top_documents_par", queries,
+        [&](const string& query) {
+            for(const Document& document : search_server.FindTopDocuments(execution::par, query)) {
+                checksum += document.relevance;
+            }
+        }));
+    // калибровка планировщика - до замера, а не на первом запросе
+    const PlannerThresholds planner_thresholds = planner_thresholds_text.empty()
+        ? SearchServer::CalibratePlannerThresholds()
+        : ParsePlannerThresholds(planner_thresholds_text);
+    search_server.SetPlannerThresholds(planner_thresholds);
+    results.push_back(MeasureEach("find_top_documents_auto", queries,
+        [&](const string& query) {
+            for(const Document& document : search_server.FindTopDocuments(auto_execution, query)) {
+                checksum += document.relevance;
+            }
+        }));
+
+    // те же запросы, где первое плюс-слово длиннее двух букв заменено префиксом из двух букв
+    vector<string> prefix_queries;
+    prefix_queries.reserve(queries.size());
+    for(const string& query : queries) {
+        string prefix_query;
+        bool is_replaced = false;
+        for(const string_view word : SplitIntoWords(query)) {
+            if(!prefix_query.empty()) {
+                prefix_query.push_back(' ');
+            }
+            if(!is_replaced && word.size() > 2 && word[0] != '-') {
+                prefix_query.append(word.substr(0, 2)).push_back('*');
+                is_replaced = true;
+            } else {
+                prefix_query.append(word);
+            }
+        }
+        prefix_queries.push_back(move(prefix_query));
+    }
+    results.push_back(MeasureEach("find_top_documents_prefix", prefix_queries,
+        [&](const string& query) {
+            for(const Document& document : search_server.FindTopDocuments(query)) {
+                checksum += document.relevance;
+            }
+        }));
+
+    results.push_back(MeasureEach("match_document_seq", match_requests,
+        [&](const pair<string, int>& request) {
+            checksum += get<0>(search_server.MatchDocument(execution::seq, request.first, request.second)).size();
+        }));
+    results.push_back(MeasureEach("match_document_par", match_requests,
+        [&](const pair<string, int>& request) {
+            checksum += get<0>(search_server.MatchDocument(execution::par, request.first, request.second)).size();
+        }));
+    // выдача текстов найденных документов: документы запросов совпадения разбросаны по блокам хранилища
+    if(text_storage != TextStorage::NONE) {
+        results.push_back(MeasureEach("get_document_text", match_requests,
+            [&](const pair<string, int>& request) { checksum += search_server.GetDocumentText(request.second).size(); }));
+    }
+
+    results.push_back(MeasureBatch("process_queries", queries.size(),
+        [&]() {
+            for(const auto& documents_list : ProcessQueries(search_server, queries)) {
+                checksum += documents_list.size();
+            }
+        }));
+
+    // тот же корпус в шардированном сервере: пакетное добавление и поиск с объединением выдачи шардов
+    {
+        ShardedSearchServer sharded_server("a b c"s, static_cast<size_t>(config.shards));
+        vector<DocumentInput> batch;
+        batch.reserve(document_ids.size());
+        for(int id : document_ids) {
+            batch.push_back({id, documents[id], DocumentStatus::ACTUAL, {id % 10, 5}});
+        }
+        results.push_back(MeasureBatch("sharded_add_documents", batch.size(),
+            [&]() { sharded_server.AddDocuments(batch); }));
+        results.push_back(MeasureEach("sharded_find_top_documents_seq", queries,
+            [&](const string& query) {
+                for(const Document& document : sharded_server.FindTopDocuments(execution::seq, query)) {
+                    checksum += document.relevance;
+                }
+            }));
+        results.push_back(MeasureEach("sharded_find_top_documents_par", queries,
+            [&](const string& query) {
+                for(const Document& document : sharded_server.FindTopDocuments(execution::par, query)) {
+                    checksum += document.relevance;
+                }
+            }));
+    }
+
+    // индекс вкладов строится один раз и сбрасывается первым же удалением документа ниже
+    results.push_back(MeasureBatch("build_impact_index", static_cast<size_t>(search_server.GetDocumentCount()),
+        [&]() { search_server.BuildImpactIndex(); }));
+    results.push_back(MeasureEach("find_top_documents_impact", queries,
+        [&](const string& query) {
+            for(const Document& document : search_server.FindTopDocuments(query)) {
+                checksum += document.relevance;
+            }
+        }));
+
+    results.push_back(MeasureBatch("remove_duplicates", static_cast<size_t>(search_server.GetDocumentCount()),
+        [&]() {
+            // RemoveDuplicates сообщает о каждом дубликате в cout - на время замера глушим вывод
+            ostringstream sink;
+            auto* const old_buffer = cout.rdbuf(sink.rdbuf());
+            RemoveDuplicates(search_server);
+            cout.rdbuf(old_buffer);
+        }));
+
+    // удаляем по десятой части оставшихся документов последовательной и параллельной версией
+    const vector<int> remaining(search_server.begin(), search_server.end());
+    const size_t remove_count = remaining.size() / 10;
+    const vector<int> remove_seq(remaining.begin(), remaining.begin() + remove_count);
+    const vector<int> remove_par(remaining.begin() + remove_count, remaining.begin() + 2 * remove_count);
+    // смена статуса на месте против удаления и повторного добавления документа; затем замена текста
+    const vector<int> update_ids(remaining.begin() + 2 * remove_count, remaining.begin() + 3 * remove_count);
+    results.push_back(MeasureEach("update_document_status", update_ids,
+        [&](int id) { search_server.UpdateDocumentStatus(id, DocumentStatus::BANNED); }));
+    results.push_back(MeasureEach("readd_document_status", update_ids,
+        [&](int id) {
+            search_server.RemoveDocument(id);
+            search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10, 5});
+        }));
+    results.push_back(MeasureEach("update_document_text", update_ids,
+        [&](int id) { search_server.UpdateDocument(id, documents[(id + 1) % documents.size()]); }));
+
+    results.push_back(MeasureEach("remove_document_seq", remove_seq,
+        [&](int id) { search_server.RemoveDocument(execution::seq, id); }));
+    results.push_back(MeasureEach("remove_document_par", remove_par,
+        [&](int id) { search_server.RemoveDocument(execution::par, id); }));
+
+    results.push_back(MeasureBatch("destroy_server", remaining.size() - 2 * remove_count,
+        [&]() {
+            search_server_holder.reset();
+            memory_resource.reset();
+        }));
+
+    ofstream file_output;
+    if(!output_path.empty()) {
+        file_output.open(output_path);
+        if(!file_output) {
+            cerr << "Cannot open "s << output_path << endl;
+            return 1;
+        }
+    }
+    ostream& output = output_path.empty() ? cout : file_output;
+
+    output << "{\"config\": {"
+           << "\"documents\": " << config.documents
+           << ", \"vocabulary\": " << config.vocabulary
+           << ", \"zipf\": " << config.zipf_exponent
+           << ", \"document_words\": " << config.document_words
+           << ", \"queries\": " << config.queries
+           << ", \"query_words\": " << config.query_words
+           << ", \"minus_prob\": " << config.minus_prob
+           << ", \"duplicate_prob\": " << config.duplicate_prob
+           << ", \"seed\": " << config.seed
+           << ", \"memory\": \"" << config.memory << "\""
+           << ", \"shards\": " << config.shards
+           << ", \"text_storage\": \"" << config.text_storage << "\""
+           << ", \"corpus_bytes\": " << corpus_bytes
+           << ", \"planner_thresholds\": \"" << FormatPlannerThresholds(planner_thresholds) << "\""
+           << "},\n \"memory_bytes\": {"
+           << "\"document_text\": " << memory.document_text.bytes
+           << ", \"inverted_index\": " << memory.inverted_index.bytes
+           << ", \"forward_index\": " << memory.forward_index.bytes
+           << ", \"document_metadata\": " << memory.document_metadata.bytes
+           << ", \"dictionary\": " << memory.dictionary.bytes
+           << ", \"stop_words\": " << memory.stop_words.bytes
+           << ", \"auxiliary\": " << memory.auxiliary.bytes
+           << ", \"total\": " << memory.TotalBytes()
+           << ", \"text_raw\": " << text_store.raw_bytes
+           << ", \"text_compressed\": " << text_store.compressed_bytes
+           << "},\n \"checksum\": " << checksum
+           << ",\n \"results\": [\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        output << "  ";
+        bench::WriteJson(output, results[i]);
+        output << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    output << "]}" << endl;
+
+    return 0;
+}
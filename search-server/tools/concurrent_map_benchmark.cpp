@@ -0,0 +1,150 @@
+// Нагрузочный тест конкурентной хеш-таблицы при росте числа потоков
+//
+// Каждый поток выполняет --operations приращений map[key] += 1 по ключам, выбранным по закону Ципфа
+// (--zipf 0 - равномерно), сначала в ConcurrentMap, затем в unordered_map под одним мьютексом.
+// Число потоков удваивается от 1 до --max-threads. Ключи генерируются до замера.
+//
+// Пример: ./concurrent_map_benchmark --max-threads 64 --operations 200000 --keys 100000 --output contention.json
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "concurrent_map.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+// запускает thread_count потоков одновременно и возвращает время от старта до завершения последнего
+template <typename Worker>
+bench::Clock::duration RunThreads(size_t thread_count, Worker worker) {
+    atomic<size_t> ready = 0;
+    atomic<bool> go = false;
+    vector<thread> threads;
+    threads.reserve(thread_count);
+    for(size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&ready, &go, &worker, t]() {
+            ++ready;
+            while(!go.load(memory_order_acquire)) {
+                this_thread::yield();
+            }
+            worker(t);
+        });
+    }
+    while(ready.load() < thread_count) {
+        this_thread::yield();
+    }
+    const auto start = bench::Clock::now();
+    go.store(true, memory_order_release);
+    for(thread& worker_thread : threads) {
+        worker_thread.join();
+    }
+    return bench::Clock::now() - start;
+}
+
+// приращения под одним мьютексом на всю таблицу - для сравнения
+class GlobalMutexMap {
+public:
+    void Increment(int key) {
+        lock_guard<mutex> guard(m_mutex);
+        ++m_map[key];
+    }
+
+    int64_t Sum() const {
+        int64_t sum = 0;
+        for(const auto& [key, value] : m_map) {
+            sum += value;
+        }
+        return sum;
+    }
+
+private:
+    mutex m_mutex;
+    unordered_map<int, int64_t> m_map;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const bench::Arguments arguments(argc, argv);
+    const int64_t max_threads = arguments.GetInt("max-threads", 64);
+    const int64_t operations = arguments.GetInt("operations", 200'000);
+    const int64_t key_count = arguments.GetInt("keys", 100'000);
+    const double zipf_exponent = arguments.GetDouble("zipf", 0.0);
+    const int64_t seed = arguments.GetInt("seed", 42);
+    const string output_path = arguments.GetString("output", "");
+
+    // ключи всех потоков генерируются заранее, чтобы генератор не попадал в замер
+    const bench::ZipfDistribution zipf(static_cast<size_t>(key_count), zipf_exponent);
+    vector<vector<int>> thread_keys(static_cast<size_t>(max_threads));
+    for(int64_t t = 0; t < max_threads; ++t) {
+        mt19937_64 generator(static_cast<uint64_t>(seed + t));
+        thread_keys[t].reserve(static_cast<size_t>(operations));
+        for(int64_t i = 0; i < operations; ++i) {
+            thread_keys[t].push_back(static_cast<int>(zipf(generator)));
+        }
+    }
+
+    vector<bench::BenchResult> results;
+    int64_t checksum = 0;
+    for(size_t thread_count = 1; thread_count <= static_cast<size_t>(max_threads); thread_count *= 2) {
+        const size_t total_operations = thread_count * static_cast<size_t>(operations);
+
+        ConcurrentMap<int, int64_t> concurrent_map;
+        const auto concurrent_time = RunThreads(thread_count, [&](size_t t) {
+            for(const int key : thread_keys[t]) {
+                concurrent_map[key] += 1;
+            }
+        });
+        concurrent_map.ForEach([&checksum](int, int64_t value) { checksum += value; });
+        results.push_back({"concurrent_map_threads_"s + to_string(thread_count), total_operations,
+                           chrono::duration<double, milli>(concurrent_time).count(), {}});
+
+        GlobalMutexMap global_mutex_map;
+        const auto global_time = RunThreads(thread_count, [&](size_t t) {
+            for(const int key : thread_keys[t]) {
+                global_mutex_map.Increment(key);
+            }
+        });
+        checksum += global_mutex_map.Sum();
+        results.push_back({"global_mutex_threads_"s + to_string(thread_count), total_operations,
+                           chrono::duration<double, milli>(global_time).count(), {}});
+    }
+
+    ofstream file_output;
+    if(!output_path.empty()) {
+        file_output.open(output_path);
+        if(!file_output) {
+            cerr << "Cannot open "s << output_path << endl;
+            return 1;
+        }
+    }
+    ostream& output = output_path.empty() ? cout : file_output;
+
+    output << "{\"config\": {"
+           << "\"max_threads\": " << max_threads
+           << ", \"operations\": " << operations
+           << ", \"keys\": " << key_count
+           << ", \"zipf\": " << zipf_exponent
+           << ", \"seed\": " << seed
+           << ", \"hardware_threads\": " << thread::hardware_concurrency()
+           << ", \"buckets\": " << ConcurrentMap<int, int64_t>().GetBucketCount()
+           << "},\n \"checksum\": " << checksum
+           << ",\n \"results\": [\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        output << "  ";
+        bench::WriteJson(output, results[i]);
+        output << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    output << "]}" << endl;
+
+    return 0;
+}
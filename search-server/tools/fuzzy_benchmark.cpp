@@ -0,0 +1,192 @@
+// Нагрузочный тест поиска термов с опечатками автоматом Левенштейна
+//
+// Словарь - --terms случайных слов длины 5..12 (латиница), упорядоченный как инвертированный индекс сервера.
+// Запросы - слова словаря с 1..--distance случайными правками. Для каждого расстояния замеряется обход
+// компактного словаря TermLexicon (им пользуется сервер), обход упорядоченной мапы с поиском следующей живой
+// строки (ForEachFuzzyMatch) и, на первых --brute-force-queries запросах, полный перебор словаря - для
+// сравнения и проверки, что все способы находят те же термы.
+//
+// Пример: ./fuzzy_benchmark --terms 2000000 --queries 2000 --output fuzzy.json
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "levenshtein_automaton.h"
+#include "term_lexicon.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+string GenerateWord(mt19937_64& generator) {
+    const int length = uniform_int_distribution<int>(5, 12)(generator);
+    string word;
+    for(int i = 0; i < length; ++i) {
+        word.push_back(static_cast<char>('a' + uniform_int_distribution<int>(0, 25)(generator)));
+    }
+    return word;
+}
+
+// случайная вставка, удаление или замена
+void ApplyRandomEdit(mt19937_64& generator, string& word) {
+    const char letter = static_cast<char>('a' + uniform_int_distribution<int>(0, 25)(generator));
+    const int kind = uniform_int_distribution<int>(0, 2)(generator);
+    if(kind == 0 || word.size() < 2) {
+        word.insert(word.begin() + uniform_int_distribution<size_t>(0, word.size())(generator), letter);
+        return;
+    }
+    const size_t position = uniform_int_distribution<size_t>(0, word.size() - 1)(generator);
+    if(kind == 1) {
+        word.erase(word.begin() + position);
+    } else {
+        word[position] = letter;
+    }
+}
+
+// расстояние Левенштейна полной таблицей
+int ComputeEditDistance(const string& lhs, const string& rhs) {
+    vector<int> row(rhs.size() + 1);
+    for(size_t j = 0; j < row.size(); ++j) {
+        row[j] = static_cast<int>(j);
+    }
+    for(size_t i = 1; i <= lhs.size(); ++i) {
+        int diagonal = row[0];
+        row[0] = static_cast<int>(i);
+        for(size_t j = 1; j <= rhs.size(); ++j) {
+            const int above = row[j];
+            row[j] = min({row[j] + 1, row[j - 1] + 1, diagonal + (lhs[i - 1] != rhs[j - 1] ? 1 : 0)});
+            diagonal = above;
+        }
+    }
+    return row.back();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const bench::Arguments arguments(argc, argv);
+    const int64_t term_count = arguments.GetInt("terms", 2'000'000);
+    const int64_t query_count = arguments.GetInt("queries", 2'000);
+    const int64_t max_distance = arguments.GetInt("distance", 2);
+    const int64_t brute_force_queries = arguments.GetInt("brute-force-queries", 10);
+    const int64_t seed = arguments.GetInt("seed", 42);
+    const string output_path = arguments.GetString("output", "");
+
+    mt19937_64 generator(static_cast<uint64_t>(seed));
+    map<string, int> dictionary;
+    while(static_cast<int64_t>(dictionary.size()) < term_count) {
+        dictionary.emplace(GenerateWord(generator), static_cast<int>(dictionary.size()));
+    }
+    vector<const string*> terms;
+    terms.reserve(dictionary.size());
+    for(const auto& [term, _] : dictionary) {
+        (void)_;
+        terms.push_back(&term);
+    }
+    TermLexicon lexicon;
+    lexicon.Assign(dictionary.begin(), dictionary.end());
+
+    vector<bench::BenchResult> results;
+    size_t checksum = 0;
+    for(int distance = 1; distance <= max_distance; ++distance) {
+        vector<string> queries;
+        queries.reserve(static_cast<size_t>(query_count));
+        for(int64_t i = 0; i < query_count; ++i) {
+            string query = *terms[uniform_int_distribution<size_t>(0, terms.size() - 1)(generator)];
+            const int edits = uniform_int_distribution<int>(1, distance)(generator);
+            for(int e = 0; e < edits; ++e) {
+                ApplyRandomEdit(generator, query);
+            }
+            queries.push_back(move(query));
+        }
+
+        vector<size_t> match_counts;
+        match_counts.reserve(queries.size());
+        bench::LatencyRecorder lexicon_recorder;
+        lexicon_recorder.Reserve(queries.size());
+        const auto lexicon_start = bench::Clock::now();
+        for(const string& query : queries) {
+            const auto query_start = bench::Clock::now();
+            const size_t matches = lexicon.FindFuzzyMatches(query, distance).size();
+            lexicon_recorder.Record(bench::Clock::now() - query_start);
+            match_counts.push_back(matches);
+        }
+        results.push_back({"lexicon_distance_"s + to_string(distance), queries.size(),
+                           chrono::duration<double, milli>(bench::Clock::now() - lexicon_start).count(),
+                           lexicon_recorder.Summarize()});
+
+        bench::LatencyRecorder recorder;
+        recorder.Reserve(queries.size());
+        const auto start = bench::Clock::now();
+        for(size_t i = 0; i < queries.size(); ++i) {
+            const auto query_start = bench::Clock::now();
+            size_t matches = 0;
+            ForEachFuzzyMatch(dictionary, queries[i], distance, [&matches](const auto&, int) { ++matches; });
+            recorder.Record(bench::Clock::now() - query_start);
+            if(matches != match_counts[i]) {
+                cerr << "Mismatch for "s << queries[i] << ": lexicon "s << match_counts[i] << ", automaton "s << matches << endl;
+                return 1;
+            }
+        }
+        const auto total = bench::Clock::now() - start;
+        for(const size_t matches : match_counts) {
+            checksum += matches;
+        }
+        results.push_back({"automaton_distance_"s + to_string(distance), queries.size(),
+                           chrono::duration<double, milli>(total).count(), recorder.Summarize()});
+
+        bench::LatencyRecorder brute_force_recorder;
+        const size_t brute_force_count = min(queries.size(), static_cast<size_t>(max<int64_t>(brute_force_queries, 0)));
+        const auto brute_force_start = bench::Clock::now();
+        for(size_t i = 0; i < brute_force_count; ++i) {
+            const auto query_start = bench::Clock::now();
+            size_t matches = 0;
+            for(const string* term : terms) {
+                matches += ComputeEditDistance(*term, queries[i]) <= distance;
+            }
+            brute_force_recorder.Record(bench::Clock::now() - query_start);
+            if(matches != match_counts[i]) {
+                cerr << "Mismatch for "s << queries[i] << ": automaton "s << match_counts[i] << ", brute force "s << matches << endl;
+                return 1;
+            }
+        }
+        if(brute_force_count > 0) {
+            results.push_back({"brute_force_distance_"s + to_string(distance), brute_force_count,
+                               chrono::duration<double, milli>(bench::Clock::now() - brute_force_start).count(),
+                               brute_force_recorder.Summarize()});
+        }
+    }
+
+    ofstream file_output;
+    if(!output_path.empty()) {
+        file_output.open(output_path);
+        if(!file_output) {
+            cerr << "Cannot open "s << output_path << endl;
+            return 1;
+        }
+    }
+    ostream& output = output_path.empty() ? cout : file_output;
+
+    output << "{\"config\": {"
+           << "\"terms\": " << term_count
+           << ", \"queries\": " << query_count
+           << ", \"distance\": " << max_distance
+           << ", \"brute_force_queries\": " << brute_force_queries
+           << ", \"seed\": " << seed
+           << "},\n \"checksum\": " << checksum
+           << ",\n \"results\": [\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        output << "  ";
+        bench::WriteJson(output, results[i]);
+        output << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    output << "]}" << endl;
+
+    return 0;
+}
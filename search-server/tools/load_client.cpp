@@ -0,0 +1,313 @@
+// Генератор нагрузки для query_server
+//
+// Сначала заполняет сервер корпусом по закону Ципфа запросами ADD, затем каждое из --connections
+// соединений держит в полете до --pipeline поисковых запросов. Результат - JSON
+// с пропускной способностью и перцентилями задержек (от отправки запроса до получения ответа).
+//
+// Пример: ./load_client --port 7700 --connections 8 --pipeline 64 --requests 500000
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "query_protocol.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+struct ClientConfig {
+    string host;
+    int64_t port;
+    string unix_path;
+    int64_t connections;
+    int64_t pipeline;
+    int64_t requests;
+    int64_t populate;
+    int64_t vocabulary;
+    double zipf_exponent;
+    int64_t document_words;
+    int64_t query_words;
+    double minus_prob;
+    int64_t seed;
+};
+
+// блокирующее соединение с сервером
+class Connection {
+public:
+    explicit Connection(const ClientConfig& config) {
+        if(!config.unix_path.empty()) {
+            sockaddr_un address{};
+            if(config.unix_path.size() >= sizeof(address.sun_path)) {
+                throw invalid_argument("Unix socket path is too long: "s + config.unix_path);
+            }
+            address.sun_family = AF_UNIX;
+            memcpy(address.sun_path, config.unix_path.data(), config.unix_path.size());
+            m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            Connect(reinterpret_cast<sockaddr*>(&address), sizeof(address), config.unix_path);
+        } else {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(config.port));
+            if(inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) != 1) {
+                throw invalid_argument("Invalid IPv4 address "s + config.host);
+            }
+            m_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            Connect(reinterpret_cast<sockaddr*>(&address), sizeof(address), config.host + ":"s + to_string(config.port));
+            const int enable = 1;
+            setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+    }
+
+    ~Connection() {
+        if(m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    void Send(const string& bytes) {
+        size_t offset = 0;
+        while(offset < bytes.size()) {
+            const ssize_t sent = send(m_fd, bytes.data() + offset, bytes.size() - offset, MSG_NOSIGNAL);
+            if(sent < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("send failed: "s + strerror(errno));
+            }
+            offset += sent;
+        }
+    }
+
+    // читает хотя бы один ответ; тип запроса каждого ответа - из types по порядку
+    template <typename Handler>
+    void ReceiveResponses(deque<protocol::RequestType>& types, Handler handler) {
+        size_t handled = 0;
+        while(handled == 0) {
+            char chunk[64 << 10];
+            const ssize_t bytes = recv(m_fd, chunk, sizeof(chunk), 0);
+            if(bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if(bytes <= 0) {
+                throw runtime_error("Connection closed by server"s);
+            }
+            m_input.append(chunk, bytes);
+
+            size_t parsed = 0;
+            protocol::Response response;
+            while(!types.empty()) {
+                response.type = types.front();
+                const size_t frame_size = protocol::ParseResponse(string_view(m_input).substr(parsed), response);
+                if(frame_size == 0) {
+                    break;
+                }
+                parsed += frame_size;
+                types.pop_front();
+                handler(response);
+                ++handled;
+            }
+            m_input.erase(0, parsed);
+        }
+    }
+
+private:
+    void Connect(const sockaddr* address, socklen_t size, const string& name) {
+        if(m_fd < 0 || connect(m_fd, address, size) < 0) {
+            throw runtime_error("Cannot connect to "s + name + ": "s + strerror(errno));
+        }
+    }
+
+    int m_fd = -1;
+    string m_input;
+};
+
+// отправляет запросы, держа в полете не больше pipeline; on_response получает ответ и время отправки
+template <typename MakeRequest, typename OnResponse>
+void RunPipelined(Connection& connection, size_t request_count, size_t pipeline, MakeRequest make_request, OnResponse on_response) {
+    deque<protocol::RequestType> types;
+    deque<bench::Clock::time_point> send_times;
+    string output;
+    size_t sent = 0;
+    size_t received = 0;
+    while(received < request_count) {
+        output.clear();
+        while(sent < request_count && sent - received < pipeline) {
+            const protocol::Request request = make_request(static_cast<uint32_t>(sent));
+            protocol::AppendRequest(output, request);
+            types.push_back(request.type);
+            ++sent;
+        }
+        if(!output.empty()) {
+            const auto now = bench::Clock::now();
+            send_times.resize(types.size(), now);
+            connection.Send(output);
+        }
+        connection.ReceiveResponses(types, [&](const protocol::Response& response) {
+            if(response.request_id != received) {
+                throw runtime_error("Out of order response "s + to_string(response.request_id));
+            }
+            on_response(response, send_times.front());
+            send_times.pop_front();
+            ++received;
+        });
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const bench::Arguments arguments(argc, argv);
+        const ClientConfig config{
+            arguments.GetString("host", "127.0.0.1"),
+            arguments.GetInt("port", 7700),
+            arguments.GetString("unix", ""),
+            max<int64_t>(arguments.GetInt("connections", 4), 1),
+            max<int64_t>(arguments.GetInt("pipeline", 64), 1),
+            arguments.GetInt("requests", 200'000),
+            arguments.GetInt("populate", 20'000),
+            arguments.GetInt("vocabulary", 50'000),
+            arguments.GetDouble("zipf", 1.0),
+            arguments.GetInt("document-words", 60),
+            arguments.GetInt("query-words", 3),
+            arguments.GetDouble("minus-prob", 0.1),
+            arguments.GetInt("seed", 42),
+        };
+        const string output_path = arguments.GetString("output", "");
+        const bench::ZipfDistribution zipf(config.vocabulary, config.zipf_exponent);
+
+        vector<bench::BenchResult> results;
+        atomic<size_t> errors = 0;
+
+        // заполнение одним соединением, id документов - с 0
+        {
+            Connection connection(config);
+            mt19937_64 generator(config.seed);
+            bench::LatencyRecorder recorder;
+            recorder.Reserve(config.populate);
+            const auto start = bench::Clock::now();
+            RunPipelined(connection, config.populate, config.pipeline,
+                [&](uint32_t index) {
+                    protocol::Request request;
+                    request.type = protocol::RequestType::ADD;
+                    request.request_id = index;
+                    request.document_id = static_cast<int>(index);
+                    request.ratings = {static_cast<int>(index % 10), 5};
+                    const int words = uniform_int_distribution<int>(1, static_cast<int>(2 * config.document_words))(generator);
+                    request.text = bench::GenerateZipfText(generator, zipf, words);
+                    return request;
+                },
+                [&](const protocol::Response& response, bench::Clock::time_point sent_at) {
+                    recorder.Record(bench::Clock::now() - sent_at);
+                    if(response.code != protocol::ResponseCode::OK) {
+                        ++errors;
+                    }
+                });
+            const auto total = bench::Clock::now() - start;
+            results.push_back({"add", static_cast<size_t>(config.populate), chrono::duration<double, milli>(total).count(), recorder.Summarize()});
+        }
+
+        // поиск: запросы делятся между соединениями поровну, у каждого соединения свой поток
+        {
+            vector<bench::LatencyRecorder> recorders(config.connections);
+            vector<thread> threads;
+            vector<exception_ptr> failures(config.connections);
+            const auto start = bench::Clock::now();
+            for(int64_t c = 0; c < config.connections; ++c) {
+                const size_t quota = config.requests / config.connections + (c < config.requests % config.connections ? 1 : 0);
+                threads.emplace_back([&, c, quota]() {
+                    try {
+                        Connection connection(config);
+                        mt19937_64 generator(config.seed + 1 + c);
+                        recorders[c].Reserve(quota);
+                        RunPipelined(connection, quota, config.pipeline,
+                            [&](uint32_t index) {
+                                protocol::Request request;
+                                request.type = protocol::RequestType::SEARCH;
+                                request.request_id = index;
+                                const int words = uniform_int_distribution<int>(1, static_cast<int>(config.query_words))(generator);
+                                request.text = bench::GenerateZipfText(generator, zipf, words, config.minus_prob);
+                                return request;
+                            },
+                            [&](const protocol::Response& response, bench::Clock::time_point sent_at) {
+                                recorders[c].Record(bench::Clock::now() - sent_at);
+                                if(response.code != protocol::ResponseCode::OK) {
+                                    ++errors;
+                                }
+                            });
+                    } catch(...) {
+                        failures[c] = current_exception();
+                    }
+                });
+            }
+            for(thread& t : threads) {
+                t.join();
+            }
+            const auto total = bench::Clock::now() - start;
+            for(const exception_ptr& failure : failures) {
+                if(failure) {
+                    rethrow_exception(failure);
+                }
+            }
+            bench::LatencyRecorder merged;
+            for(const bench::LatencyRecorder& recorder : recorders) {
+                merged.Merge(recorder);
+            }
+            results.push_back({"search", static_cast<size_t>(config.requests), chrono::duration<double, milli>(total).count(), merged.Summarize()});
+        }
+
+        ofstream file_output;
+        if(!output_path.empty()) {
+            file_output.open(output_path);
+            if(!file_output) {
+                cerr << "Cannot open "s << output_path << endl;
+                return 1;
+            }
+        }
+        ostream& output = output_path.empty() ? cout : file_output;
+
+        output << "{\"config\": {"
+               << "\"transport\": \"" << (config.unix_path.empty() ? "tcp" : "unix") << "\""
+               << ", \"connections\": " << config.connections
+               << ", \"pipeline\": " << config.pipeline
+               << ", \"requests\": " << config.requests
+               << ", \"populate\": " << config.populate
+               << ", \"vocabulary\": " << config.vocabulary
+               << ", \"zipf\": " << config.zipf_exponent
+               << ", \"query_words\": " << config.query_words
+               << ", \"seed\": " << config.seed
+               << "},\n \"errors\": " << errors.load()
+               << ",\n \"results\": [\n";
+        for(size_t i = 0; i < results.size(); ++i) {
+            output << "  ";
+            bench::WriteJson(output, results[i]);
+            output << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        output << "]}" << endl;
+    } catch(const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Воспроизведение журнала запросов (QueryLogWriter) на сервере из файла корпуса
+//
+// Сервер строится из --corpus (формат LoadCorpus). Запросы журнала выполняются --threads потоками
+// по расписанию открытой нагрузки: у каждого запроса есть назначенное время старта, и оно не сдвигается,
+// если сервер не успевает. Назначенное время - время из журнала, ускоренное в --speed раз,
+// или, с --qps, равномерная сетка с заданной частотой (порядок запросов - из журнала).
+//
+// Выводятся перцентили двух задержек:
+//   service_time  - от фактического старта до ответа: столько длится сам запрос;
+//   response_time - от назначенного старта до ответа, с поправкой на coordinated omission:
+//                   если потоки заняты и запрос стартует поздно, ожидание входит в задержку,
+//                   как его увидел бы клиент, отправивший запрос вовремя.
+// Журнал не хранит предикаты: запрос с предикатом выполняется с предикатом, пропускающим все документы.
+//
+// Пример: ./query_replay --corpus corpus.tsv --log queries.log --speed 2 --threads 8 --output replay.json
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "search_server.h"
+#include "corpus_loader.h"
+#include "query_log.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+// задержки и ошибки одного потока
+struct ReplayStats {
+    bench::LatencyRecorder service_time;
+    bench::LatencyRecorder response_time;
+    size_t late_starts = 0; // запрос стартовал позже назначенного больше чем на LATE_START_NS
+    size_t errors = 0;
+    int64_t max_start_lag_ns = 0;
+};
+
+// опоздание старта, начиная с которого запрос считается отложенным из-за занятых потоков
+const int64_t LATE_START_NS = 1'000'000;
+
+vector<Document> RunRecord(const SearchServer& search_server, const QueryLogRecord& record) {
+    if(record.filter == QueryLogFilter::PREDICATE) {
+        return search_server.FindTopDocuments(record.raw_query, [](int, DocumentStatus, int) { return true; });
+    }
+    return search_server.FindTopDocuments(record.raw_query, record.status);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const bench::Arguments arguments(argc, argv);
+        const string corpus_path = arguments.GetString("corpus", "");
+        const string log_path = arguments.GetString("log", "");
+        const string stop_words = arguments.GetString("stop-words", "");
+        const double speed = arguments.GetDouble("speed", 1.0);
+        const double qps = arguments.GetDouble("qps", 0.0);
+        const int64_t thread_count = max<int64_t>(arguments.GetInt("threads", max(1u, thread::hardware_concurrency())), 1);
+        const string output_path = arguments.GetString("output", "");
+
+        if(log_path.empty()) {
+            cerr << "Set --log: query log written by SearchServer::SetQueryLog"s << endl;
+            return 1;
+        }
+        if(speed <= 0.0 || qps < 0.0) {
+            cerr << "--speed must be positive and --qps non-negative"s << endl;
+            return 1;
+        }
+
+        SearchServer search_server(stop_words);
+        if(!corpus_path.empty()) {
+            const CorpusLoadResult loaded = LoadCorpus(search_server, corpus_path);
+            if(!loaded.errors.empty()) {
+                cerr << "Corpus errors: "s << loaded.errors.size() << ", first: "s << loaded.errors.front().message << endl;
+            }
+        }
+
+        vector<QueryLogRecord> records = ReadQueryLog(log_path);
+        // записи журнала идут в порядке завершения запросов, воспроизводятся - в порядке старта
+        stable_sort(records.begin(), records.end(),
+            [](const QueryLogRecord& lhs, const QueryLogRecord& rhs) { return lhs.start_us < rhs.start_us; });
+
+        // назначенное время старта от начала воспроизведения, нс
+        vector<int64_t> scheduled_ns(records.size());
+        for(size_t i = 0; i < records.size(); ++i) {
+            scheduled_ns[i] = qps > 0.0
+                ? static_cast<int64_t>(i * 1e9 / qps)
+                : static_cast<int64_t>((records[i].start_us - records.front().start_us) * 1000.0 / speed);
+        }
+
+        bench::LatencyRecorder original_latency;
+        for(const QueryLogRecord& record : records) {
+            original_latency.RecordNanoseconds(static_cast<int64_t>(record.latency_ns));
+        }
+
+        // потоки разбирают запросы по порядку: следующий запрос берет первый освободившийся поток
+        atomic<size_t> next_record = 0;
+        vector<ReplayStats> thread_stats(static_cast<size_t>(thread_count));
+        vector<thread> threads;
+        threads.reserve(thread_stats.size());
+        const auto replay_start = bench::Clock::now();
+        for(ReplayStats& stats : thread_stats) {
+            threads.emplace_back([&, &stats = stats]() {
+                for(size_t i = next_record++; i < records.size(); i = next_record++) {
+                    const auto scheduled = replay_start + chrono::nanoseconds(scheduled_ns[i]);
+                    this_thread::sleep_until(scheduled);
+                    const auto start = bench::Clock::now();
+                    try {
+                        RunRecord(search_server, records[i]);
+                    } catch(const invalid_argument&) {
+                        ++stats.errors;
+                    }
+                    const auto finish = bench::Clock::now();
+                    const int64_t lag_ns = chrono::duration_cast<chrono::nanoseconds>(start - scheduled).count();
+                    stats.late_starts += lag_ns > LATE_START_NS ? 1 : 0;
+                    stats.max_start_lag_ns = max(stats.max_start_lag_ns, lag_ns);
+                    stats.service_time.Record(finish - start);
+                    stats.response_time.Record(finish - scheduled);
+                }
+            });
+        }
+        for(thread& worker : threads) {
+            worker.join();
+        }
+        const double replay_ms = chrono::duration<double, milli>(bench::Clock::now() - replay_start).count();
+
+        ReplayStats total;
+        for(const ReplayStats& stats : thread_stats) {
+            total.service_time.Merge(stats.service_time);
+            total.response_time.Merge(stats.response_time);
+            total.late_starts += stats.late_starts;
+            total.errors += stats.errors;
+            total.max_start_lag_ns = max(total.max_start_lag_ns, stats.max_start_lag_ns);
+        }
+        const double original_ms = records.empty() ? 0.0 : (records.back().start_us - records.front().start_us) / 1000.0;
+
+        ofstream file_output;
+        if(!output_path.empty()) {
+            file_output.open(output_path);
+            if(!file_output) {
+                cerr << "Cannot open "s << output_path << endl;
+                return 1;
+            }
+        }
+        ostream& output = output_path.empty() ? cout : file_output;
+
+        output << "{\"config\": {"
+               << "\"corpus\": \"" << bench::JsonEscape(corpus_path) << "\""
+               << ", \"log\": \"" << bench::JsonEscape(log_path) << "\""
+               << ", \"documents\": " << search_server.GetDocumentCount()
+               << ", \"queries\": " << records.size()
+               << ", \"speed\": " << speed
+               << ", \"qps\": " << qps
+               << ", \"threads\": " << thread_count
+               << "},\n \"original_duration_ms\": " << original_ms
+               << ", \"replay_duration_ms\": " << replay_ms
+               << ", \"late_starts\": " << total.late_starts
+               << ", \"max_start_lag_us\": " << total.max_start_lag_ns / 1000.0
+               << ", \"errors\": " << total.errors
+               << ",\n \"results\": [\n  ";
+        bench::WriteJson(output, {"original_latency", records.size(), original_ms, original_latency.Summarize()});
+        output << ",\n  ";
+        bench::WriteJson(output, {"service_time", records.size(), replay_ms, total.service_time.Summarize()});
+        output << ",\n  ";
+        bench::WriteJson(output, {"response_time", records.size(), replay_ms, total.response_time.Summarize()});
+        output << "\n]}" << endl;
+    } catch(const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
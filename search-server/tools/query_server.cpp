@@ -0,0 +1,575 @@
+// Сетевой поисковый сервер: SearchServer за TCP и/или Unix-сокетом
+//
+// Один поток ведет цикл epoll с неблокирующими сокетами, запросы выполняют рабочие потоки.
+// Протокол - кадры query_protocol.h. Клиент может отправлять запросы, не дожидаясь ответов:
+// все прочитанные, но еще не выполненные запросы соединения уходят рабочему потоку одним пакетом,
+// у соединения в работе не больше одного пакета, поэтому запросы соединения выполняются
+// и получают ответы строго по порядку. Параллельность - между соединениями.
+// Поиск и матчинг выполняются под разделяемой блокировкой, добавление и удаление - под исключительной.
+//
+// Пример: ./query_server --port 7700 --unix /tmp/search.sock --workers 8 --corpus corpus.tsv
+// --query-log queries.log - журнал поисковых запросов для воспроизведения утилитой query_replay
+// Поиск выполняется с auto_execution. --planner-thresholds задает пороги планировщика в текстовой форме
+// FormatPlannerThresholds; без них --calibrate-planner 1 калибрует пороги при запуске, иначе весь поиск
+// последовательный. Действующие пороги выводятся при запуске - их можно передать следующему запуску
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "search_server.h"
+#include "corpus_loader.h"
+#include "query_protocol.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+// данные epoll для служебных дескрипторов; id соединений начинаются с FIRST_CONNECTION_ID
+enum : uint64_t {
+    WAKEUP_EVENT = 0,
+    SIGNAL_EVENT = 1,
+    TCP_LISTENER_EVENT = 2,
+    UNIX_LISTENER_EVENT = 3,
+    FIRST_CONNECTION_ID = 16,
+};
+
+// соединение перестает читаться, пока не разберут его очередь запросов и клиент не заберет ответы
+const size_t MAX_PENDING_REQUESTS = 4096;
+const size_t MAX_OUTPUT_BUFFER = 16u << 20;
+const size_t READ_CHUNK_SIZE = 64u << 10;
+const int MAX_EPOLL_EVENTS = 256;
+
+[[noreturn]] void ThrowSystemError(const string& what) {
+    throw runtime_error(what + ": "s + strerror(errno));
+}
+
+// пакет запросов одного соединения
+struct Task {
+    uint64_t connection_id;
+    vector<protocol::Request> requests;
+};
+
+// закодированные ответы на пакет
+struct Completion {
+    uint64_t connection_id;
+    string output;
+};
+
+// пул рабочих потоков: выполняет пакеты и будит цикл событий через eventfd
+class WorkerPool {
+public:
+    WorkerPool(SearchServer& search_server, size_t worker_count, int wakeup_fd)
+        : m_search_server(search_server), m_wakeup_fd(wakeup_fd) {
+        for(size_t i = 0; i < worker_count; ++i) {
+            m_workers.emplace_back([this]() { Run(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            lock_guard guard(m_tasks_mutex);
+            m_stopped = true;
+        }
+        m_tasks_ready.notify_all();
+        for(thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    void Submit(Task task) {
+        {
+            lock_guard guard(m_tasks_mutex);
+            m_tasks.push_back(move(task));
+        }
+        m_tasks_ready.notify_one();
+    }
+
+    vector<Completion> TakeCompletions() {
+        lock_guard guard(m_completions_mutex);
+        vector<Completion> completions;
+        completions.swap(m_completions);
+        return completions;
+    }
+
+private:
+    void Run() {
+        for(;;) {
+            Task task;
+            {
+                unique_lock lock(m_tasks_mutex);
+                m_tasks_ready.wait(lock, [this]() { return m_stopped || !m_tasks.empty(); });
+                if(m_tasks.empty()) {
+                    return;
+                }
+                task = move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            Completion completion{task.connection_id, {}};
+            for(const protocol::Request& request : task.requests) {
+                if(protocol::IsWriteRequest(request.type)) {
+                    unique_lock lock(m_server_mutex);
+                    protocol::AppendResponse(completion.output, protocol::ExecuteRequest(m_search_server, request));
+                } else {
+                    shared_lock lock(m_server_mutex);
+                    protocol::AppendResponse(completion.output, protocol::ExecuteRequest(m_search_server, request));
+                }
+            }
+
+            bool was_empty = false;
+            {
+                lock_guard guard(m_completions_mutex);
+                was_empty = m_completions.empty();
+                m_completions.push_back(move(completion));
+            }
+            // цикл событий забирает все готовые ответы разом, будить его достаточно один раз
+            if(was_empty) {
+                const uint64_t one = 1;
+                [[maybe_unused]] const ssize_t written = write(m_wakeup_fd, &one, sizeof(one));
+            }
+        }
+    }
+
+    SearchServer& m_search_server;
+    shared_mutex m_server_mutex;
+    int m_wakeup_fd;
+
+    mutex m_tasks_mutex;
+    condition_variable m_tasks_ready;
+    deque<Task> m_tasks;
+    bool m_stopped = false;
+
+    mutex m_completions_mutex;
+    vector<Completion> m_completions;
+
+    vector<thread> m_workers;
+};
+
+struct Connection {
+    int fd = -1;
+    string input;                          // прочитанные байты неполного кадра
+    vector<protocol::Request> requests;    // разобранные запросы, ждущие отправки в пул
+    string output;                         // ответы, ждущие отправки клиенту
+    size_t output_offset = 0;              // сколько байт output уже отправлено
+    bool task_in_flight = false;           // пакет соединения выполняется рабочим потоком
+    bool read_closed = false;              // клиент закрыл свою сторону
+    uint32_t events = 0;                   // события, на которые подписан fd
+};
+
+class EventLoop {
+public:
+    EventLoop(SearchServer& search_server, size_t worker_count)
+        : m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+          m_wakeup_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          m_workers(make_unique<WorkerPool>(search_server, worker_count, m_wakeup_fd)) {
+        if(m_epoll_fd < 0 || m_wakeup_fd < 0) {
+            ThrowSystemError("Cannot create epoll instance"s);
+        }
+        Watch(m_wakeup_fd, EPOLLIN, WAKEUP_EVENT);
+
+        // SIGINT и SIGTERM заблокированы в main до создания потоков и приходят только сюда
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        m_signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if(m_signal_fd < 0) {
+            ThrowSystemError("Cannot create signalfd"s);
+        }
+        Watch(m_signal_fd, EPOLLIN, SIGNAL_EVENT);
+    }
+
+    ~EventLoop() {
+        // рабочие потоки пишут в m_wakeup_fd - останавливаем их до закрытия дескрипторов
+        m_workers.reset();
+        for(const auto& [id, connection] : m_connections) {
+            close(connection.fd);
+        }
+        for(const int fd : {m_tcp_listener_fd, m_unix_listener_fd, m_signal_fd, m_wakeup_fd, m_epoll_fd}) {
+            if(fd >= 0) {
+                close(fd);
+            }
+        }
+        if(!m_unix_path.empty()) {
+            unlink(m_unix_path.c_str());
+        }
+    }
+
+    void ListenTcp(const string& host, uint16_t port) {
+        m_tcp_listener_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(m_tcp_listener_fd < 0) {
+            ThrowSystemError("Cannot create TCP socket"s);
+        }
+        const int enable = 1;
+        setsockopt(m_tcp_listener_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if(inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+            throw invalid_argument("Invalid IPv4 address "s + host);
+        }
+        if(bind(m_tcp_listener_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+           || listen(m_tcp_listener_fd, SOMAXCONN) < 0) {
+            ThrowSystemError("Cannot listen on "s + host + ":"s + to_string(port));
+        }
+        Watch(m_tcp_listener_fd, EPOLLIN, TCP_LISTENER_EVENT);
+    }
+
+    void ListenUnix(const string& path) {
+        sockaddr_un address{};
+        if(path.size() >= sizeof(address.sun_path)) {
+            throw invalid_argument("Unix socket path is too long: "s + path);
+        }
+        m_unix_listener_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(m_unix_listener_fd < 0) {
+            ThrowSystemError("Cannot create Unix socket"s);
+        }
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.data(), path.size());
+        unlink(path.c_str());
+        if(bind(m_unix_listener_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+           || listen(m_unix_listener_fd, SOMAXCONN) < 0) {
+            ThrowSystemError("Cannot listen on "s + path);
+        }
+        m_unix_path = path;
+        Watch(m_unix_listener_fd, EPOLLIN, UNIX_LISTENER_EVENT);
+    }
+
+    // работает до SIGINT или SIGTERM
+    void Run() {
+        epoll_event events[MAX_EPOLL_EVENTS];
+        while(!m_stopped) {
+            const int count = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+            if(count < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                ThrowSystemError("epoll_wait failed"s);
+            }
+            for(int i = 0; i < count; ++i) {
+                HandleEvent(events[i].data.u64, events[i].events);
+            }
+        }
+    }
+
+private:
+    void Watch(int fd, uint32_t events, uint64_t data) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = data;
+        if(epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ThrowSystemError("epoll_ctl failed"s);
+        }
+    }
+
+    void HandleEvent(uint64_t data, uint32_t events) {
+        switch(data) {
+            case WAKEUP_EVENT: {
+                uint64_t counter = 0;
+                [[maybe_unused]] const ssize_t bytes = read(m_wakeup_fd, &counter, sizeof(counter));
+                for(Completion& completion : m_workers->TakeCompletions()) {
+                    HandleCompletion(completion);
+                }
+                return;
+            }
+            case SIGNAL_EVENT:
+                m_stopped = true;
+                return;
+            case TCP_LISTENER_EVENT:
+                Accept(m_tcp_listener_fd, true);
+                return;
+            case UNIX_LISTENER_EVENT:
+                Accept(m_unix_listener_fd, false);
+                return;
+            default:
+                break;
+        }
+
+        const auto it = m_connections.find(data);
+        if(it == m_connections.end()) {
+            return;
+        }
+        Connection& connection = it->second;
+        if(events & EPOLLERR) {
+            CloseConnection(data);
+            return;
+        }
+        if(events & EPOLLIN) {
+            if(!Read(connection)) {
+                CloseConnection(data);
+                return;
+            }
+        }
+        // обе стороны закрыты - ответы отправить уже некуда
+        if(events & EPOLLHUP) {
+            CloseConnection(data);
+            return;
+        }
+        if(events & EPOLLOUT) {
+            if(!Write(connection)) {
+                CloseConnection(data);
+                return;
+            }
+        }
+        Update(data, connection);
+    }
+
+    void Accept(int listener_fd, bool is_tcp) {
+        for(;;) {
+            const int fd = accept4(listener_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                    return;
+                }
+                // нехватка дескрипторов не должна останавливать сервер
+                cerr << "accept failed: "s << strerror(errno) << endl;
+                return;
+            }
+            if(is_tcp) {
+                const int enable = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            }
+            const uint64_t id = m_next_connection_id++;
+            Connection& connection = m_connections[id];
+            connection.fd = fd;
+            connection.events = EPOLLIN;
+            Watch(fd, connection.events, id);
+        }
+    }
+
+    // false - соединение нужно закрыть
+    bool Read(Connection& connection) {
+        while(!connection.read_closed && connection.requests.size() < MAX_PENDING_REQUESTS) {
+            const size_t old_size = connection.input.size();
+            connection.input.resize(old_size + READ_CHUNK_SIZE);
+            const ssize_t bytes = recv(connection.fd, connection.input.data() + old_size, READ_CHUNK_SIZE, 0);
+            connection.input.resize(old_size + max<ssize_t>(bytes, 0));
+            if(bytes == 0) {
+                connection.read_closed = true;
+            } else if(bytes < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                if(errno != EINTR) {
+                    return false;
+                }
+                continue;
+            }
+            if(!ParseRequests(connection)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // переносит целые кадры из input в очередь запросов
+    bool ParseRequests(Connection& connection) {
+        size_t parsed = 0;
+        try {
+            for(;;) {
+                protocol::Request request;
+                const size_t frame_size = protocol::ParseRequest(string_view(connection.input).substr(parsed), request);
+                if(frame_size == 0) {
+                    break;
+                }
+                parsed += frame_size;
+                connection.requests.push_back(move(request));
+            }
+        } catch(const invalid_argument& e) {
+            // после испорченного кадра границы следующих неизвестны - соединение закрывается
+            cerr << "Protocol error: "s << e.what() << endl;
+            return false;
+        }
+        connection.input.erase(0, parsed);
+        return true;
+    }
+
+    // false - соединение нужно закрыть
+    bool Write(Connection& connection) {
+        while(connection.output_offset < connection.output.size()) {
+            const ssize_t bytes = send(connection.fd, connection.output.data() + connection.output_offset,
+                                       connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+            if(bytes < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                if(errno != EINTR) {
+                    return false;
+                }
+                continue;
+            }
+            connection.output_offset += bytes;
+        }
+        connection.output.clear();
+        connection.output_offset = 0;
+        return true;
+    }
+
+    void HandleCompletion(Completion& completion) {
+        const auto it = m_connections.find(completion.connection_id);
+        // соединение закрылось, пока пакет выполнялся
+        if(it == m_connections.end()) {
+            return;
+        }
+        Connection& connection = it->second;
+        connection.task_in_flight = false;
+        if(connection.output.empty()) {
+            connection.output.swap(completion.output);
+        } else {
+            connection.output += completion.output;
+        }
+        if(!Write(connection)) {
+            CloseConnection(completion.connection_id);
+            return;
+        }
+        Update(completion.connection_id, connection);
+    }
+
+    // отправляет накопленные запросы в пул, переподписывает события, закрывает отработавшее соединение
+    void Update(uint64_t id, Connection& connection) {
+        const size_t output_pending = connection.output.size() - connection.output_offset;
+        if(!connection.task_in_flight && !connection.requests.empty() && output_pending < MAX_OUTPUT_BUFFER) {
+            connection.task_in_flight = true;
+            m_workers->Submit({id, move(connection.requests)});
+            connection.requests.clear();
+        }
+
+        if(connection.read_closed && !connection.task_in_flight && connection.requests.empty() && output_pending == 0) {
+            CloseConnection(id);
+            return;
+        }
+
+        uint32_t events = 0;
+        if(!connection.read_closed && connection.requests.size() < MAX_PENDING_REQUESTS && output_pending < MAX_OUTPUT_BUFFER) {
+            events |= EPOLLIN;
+        }
+        if(output_pending > 0) {
+            events |= EPOLLOUT;
+        }
+        if(events != connection.events) {
+            epoll_event event{};
+            event.events = events;
+            event.data.u64 = id;
+            epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.events = events;
+        }
+    }
+
+    void CloseConnection(uint64_t id) {
+        const auto it = m_connections.find(id);
+        if(it != m_connections.end()) {
+            // закрытый дескриптор сам удаляется из epoll
+            close(it->second.fd);
+            m_connections.erase(it);
+        }
+    }
+
+    int m_epoll_fd;
+    int m_wakeup_fd;
+    int m_signal_fd = -1;
+    int m_tcp_listener_fd = -1;
+    int m_unix_listener_fd = -1;
+    string m_unix_path;
+    bool m_stopped = false;
+    unique_ptr<WorkerPool> m_workers;
+    uint64_t m_next_connection_id = FIRST_CONNECTION_ID;
+    unordered_map<uint64_t, Connection> m_connections;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const bench::Arguments arguments(argc, argv);
+        const string host = arguments.GetString("host", "0.0.0.0");
+        const int64_t port = arguments.GetInt("port", 7700);
+        const string unix_path = arguments.GetString("unix", "");
+        const int64_t workers = arguments.GetInt("workers", max(1u, thread::hardware_concurrency()));
+        const string stop_words = arguments.GetString("stop-words", "");
+        const string corpus_path = arguments.GetString("corpus", "");
+        const string query_log_path = arguments.GetString("query-log", "");
+        const string planner_thresholds_text = arguments.GetString("planner-thresholds", "");
+        const bool calibrate_planner = arguments.GetInt("calibrate-planner", 0) != 0;
+
+        // маска сигналов до создания потоков - сигналы получает только signalfd цикла событий
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+
+        SearchServer search_server(stop_words);
+        if(!planner_thresholds_text.empty()) {
+            search_server.SetPlannerThresholds(ParsePlannerThresholds(planner_thresholds_text));
+        } else if(calibrate_planner) {
+            search_server.SetPlannerThresholds(SearchServer::CalibratePlannerThresholds());
+        }
+        cerr << "Planner thresholds: "s << FormatPlannerThresholds(search_server.GetPlannerThresholds()) << endl;
+        if(!corpus_path.empty()) {
+            const CorpusLoadResult loaded = LoadCorpus(search_server, corpus_path);
+            for(const CorpusError& error : loaded.errors) {
+                cerr << corpus_path << ":"s << error.line << " (offset "s << error.offset << "): "s << error.message << endl;
+            }
+            cerr << "Loaded "s << loaded.documents_added << " documents from "s << corpus_path << endl;
+        }
+        // журнал объявлен после сервера и разрушается раньше: сервер отвязывается от него перед разрушением
+        unique_ptr<QueryLogWriter> query_log;
+        if(!query_log_path.empty()) {
+            query_log = make_unique<QueryLogWriter>(query_log_path);
+            search_server.SetQueryLog(query_log.get());
+        }
+        {
+            EventLoop loop(search_server, static_cast<size_t>(max<int64_t>(workers, 1)));
+            if(port > 0) {
+                loop.ListenTcp(host, static_cast<uint16_t>(port));
+                cerr << "Listening on "s << host << ":"s << port << endl;
+            }
+            if(!unix_path.empty()) {
+                loop.ListenUnix(unix_path);
+                cerr << "Listening on "s << unix_path << endl;
+            }
+            if(port <= 0 && unix_path.empty()) {
+                cerr << "Nothing to listen on: set --port or --unix"s << endl;
+                return 1;
+            }
+            loop.Run();
+        }
+        search_server.SetQueryLog(nullptr);
+        if(query_log) {
+            cerr << "Logged "s << query_log->GetRecordCount() << " queries to "s << query_log_path << endl;
+        }
+        cerr << "Stopped, documents: "s << search_server.GetDocumentCount() << endl;
+        search_server.WriteMetrics(cerr);
+    } catch(const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
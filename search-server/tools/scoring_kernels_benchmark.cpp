@@ -0,0 +1,186 @@
+// Замер векторных ядер релевантности (scoring_kernels) против скалярных
+//
+// Плотный массив оценок на --documents документов, --terms списков постингов: в каждом список - доля
+// --density документов по возрастанию смещения, частоты случайные. Ядра каждого набора инструкций,
+// который поддерживает процессор, выполняются --repeats раз над одними и теми же данными:
+//   accumulate - AccumulateScores по всем спискам, операция - постинг;
+//   mask       - ApplyScoreMask с долей --excluded исключенных документов, операция - документ;
+//   compact    - CompactScores, операция - документ.
+// Для каждого ядра выводится ускорение относительно скалярного; "mismatches" - число ядер, чей результат
+// отличается от скалярного хотя бы в одном бите (должно быть 0).
+//
+// Пример: ./scoring_kernels_benchmark --documents 100000 --density 0.05 --terms 3 --output kernels.json
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "scoring_kernels.h"
+#include "bench_utils.h"
+
+using namespace std;
+
+namespace {
+
+struct TermList {
+    vector<uint32_t> offsets;
+    vector<double> freqs;
+    double inverse_document_freq = 0.0;
+};
+
+// результат ядер одного набора инструкций - для сравнения со скалярным
+struct KernelOutput {
+    vector<double> scores;
+    vector<uint32_t> offsets;
+    vector<double> compacted_scores;
+};
+
+template <typename Kernel>
+double MeasureMs(int64_t repeats, Kernel kernel) {
+    const auto start = bench::Clock::now();
+    for(int64_t r = 0; r < repeats; ++r) {
+        kernel();
+    }
+    return chrono::duration<double, milli>(bench::Clock::now() - start).count();
+}
+
+bool IsSameBits(const vector<double>& lhs, const vector<double>& rhs) {
+    return lhs.size() == rhs.size() && memcmp(lhs.data(), rhs.data(), lhs.size() * sizeof(double)) == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const bench::Arguments arguments(argc, argv);
+    const int64_t document_count = max<int64_t>(arguments.GetInt("documents", 100'000), 1);
+    const double density = arguments.GetDouble("density", 0.05);
+    const int64_t term_count = arguments.GetInt("terms", 3);
+    const double excluded_fraction = arguments.GetDouble("excluded", 0.01);
+    const int64_t repeats = max<int64_t>(arguments.GetInt("repeats", 100), 1);
+    const int64_t seed = arguments.GetInt("seed", 42);
+    const string output_path = arguments.GetString("output", "");
+
+    const size_t range = static_cast<size_t>(document_count);
+    mt19937_64 generator(static_cast<uint64_t>(seed));
+    vector<TermList> terms(static_cast<size_t>(term_count));
+    size_t postings_count = 0;
+    for(TermList& term : terms) {
+        bernoulli_distribution contains(density);
+        for(size_t i = 0; i < range; ++i) {
+            if(contains(generator)) {
+                term.offsets.push_back(static_cast<uint32_t>(i));
+                term.freqs.push_back(uniform_real_distribution<double>(0.01, 1.0)(generator));
+            }
+        }
+        term.inverse_document_freq = uniform_real_distribution<double>(0.1, 5.0)(generator);
+        postings_count += term.offsets.size();
+    }
+    vector<uint64_t> mask((range + 63) / 64, ~uint64_t(0));
+    bernoulli_distribution excluded(excluded_fraction);
+    for(size_t i = 0; i < range; ++i) {
+        if(excluded(generator)) {
+            mask[i / 64] &= ~(uint64_t(1) << (i % 64));
+        }
+    }
+
+    vector<ScoringKernelIsa> isas = {ScoringKernelIsa::SCALAR};
+    for(const ScoringKernelIsa isa : {ScoringKernelIsa::AVX2, ScoringKernelIsa::AVX512}) {
+        if(static_cast<int>(isa) <= static_cast<int>(GetBestScoringKernelIsa())) {
+            isas.push_back(isa);
+        }
+    }
+
+    vector<bench::BenchResult> results;
+    vector<double> speedups;
+    double scalar_ms[3] = {};
+    KernelOutput expected;
+    size_t mismatches = 0;
+    size_t found_count = 0;
+    vector<double> scores(range);
+    vector<double> masked_scores(range);
+    vector<uint32_t> offsets(range);
+    vector<double> compacted_scores(range);
+    for(const ScoringKernelIsa isa : isas) {
+        SetScoringKernelIsa(isa);
+        const string name = GetScoringKernelIsaName(isa);
+
+        const double accumulate_ms = MeasureMs(repeats, [&]() {
+            fill(scores.begin(), scores.end(), NO_SCORE);
+            for(const TermList& term : terms) {
+                AccumulateScores(term.offsets.data(), term.freqs.data(), term.offsets.size(), term.inverse_document_freq, scores.data());
+            }
+        });
+        // маска и сжатие каждый раз работают с копией оценок: копирование входит в замер у всех ядер одинаково
+        const double mask_ms = MeasureMs(repeats, [&]() {
+            copy(scores.begin(), scores.end(), masked_scores.begin());
+            ApplyScoreMask(mask.data(), range, masked_scores.data());
+        });
+        const double compact_ms = MeasureMs(repeats, [&]() {
+            found_count = CompactScores(masked_scores.data(), range, offsets.data(), compacted_scores.data());
+        });
+
+        const double times[3] = {accumulate_ms, mask_ms, compact_ms};
+        const char* kernels[3] = {"accumulate", "mask", "compact"};
+        const size_t operations[3] = {postings_count, range, range};
+        for(size_t k = 0; k < 3; ++k) {
+            if(isa == ScoringKernelIsa::SCALAR) {
+                scalar_ms[k] = times[k];
+            }
+            results.push_back({kernels[k] + "_"s + name, operations[k] * static_cast<size_t>(repeats), times[k], {}});
+            speedups.push_back(times[k] > 0.0 ? scalar_ms[k] / times[k] : 0.0);
+        }
+
+        KernelOutput output{masked_scores, vector<uint32_t>(offsets.begin(), offsets.begin() + found_count),
+                            vector<double>(compacted_scores.begin(), compacted_scores.begin() + found_count)};
+        if(isa == ScoringKernelIsa::SCALAR) {
+            expected = move(output);
+        } else if(!IsSameBits(expected.scores, output.scores) || expected.offsets != output.offsets
+                  || !IsSameBits(expected.compacted_scores, output.compacted_scores)) {
+            ++mismatches;
+        }
+    }
+    SetScoringKernelIsa(GetBestScoringKernelIsa());
+
+    double checksum = 0.0;
+    for(const double score : expected.compacted_scores) {
+        checksum += score;
+    }
+
+    ofstream file_output;
+    if(!output_path.empty()) {
+        file_output.open(output_path);
+        if(!file_output) {
+            cerr << "Cannot open "s << output_path << endl;
+            return 1;
+        }
+    }
+    ostream& output = output_path.empty() ? cout : file_output;
+
+    output << "{\"config\": {"
+           << "\"documents\": " << document_count
+           << ", \"density\": " << density
+           << ", \"terms\": " << term_count
+           << ", \"excluded\": " << excluded_fraction
+           << ", \"repeats\": " << repeats
+           << ", \"seed\": " << seed
+           << ", \"best_isa\": \"" << GetScoringKernelIsaName(GetBestScoringKernelIsa()) << "\""
+           << "},\n \"postings\": " << postings_count
+           << ", \"found\": " << expected.offsets.size()
+           << ", \"checksum\": " << checksum
+           << ", \"mismatches\": " << mismatches
+           << ",\n \"results\": [\n"
+           << fixed << setprecision(3);
+    for(size_t i = 0; i < results.size(); ++i) {
+        output << "  {\"speedup\": " << speedups[i] << ", \"result\": ";
+        bench::WriteJson(output, results[i]);
+        output << (i + 1 < results.size() ? "},\n" : "}\n");
+    }
+    output << "]}" << endl;
+
+    return mismatches == 0 ? 0 : 1;
+}